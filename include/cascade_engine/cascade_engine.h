@@ -0,0 +1,55 @@
+//
+// Two stage cascade: regions found by a detector (e.g. UltraFace) are cropped from the
+// source frame and classified by a secondary ClassificationEngine.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_CASCADE_ENGINE_H
+#define EGDETPU_VIDEO_INFERENCE_CASCADE_ENGINE_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "classification_engine.h"
+#include "opencv2/opencv.hpp"
+#include "worker_pool.h"
+
+namespace edge {
+	//Data structure to hold the secondary model result of one detected region
+	struct CascadeCandidate {
+		cv::Rect box;
+		float score;
+		std::vector<ClassificationCandidate> classes;
+	};
+
+	class CascadeEngine {
+	public:
+		//Loads one copy of the secondary model per Edge TPU in `edgetpu_contexts`. Without
+		//Edge TPUs `num_cpu_workers` CPU copies are created instead. At most
+		//`max_crops_per_frame` of the highest scoring regions are classified per frame.
+		CascadeEngine(const std::string& model, const std::string& label_path,
+		              const std::vector<std::shared_ptr<edgetpu::EdgeTpuContext>>& edgetpu_contexts,
+		              const bool edgetpu, const int num_cpu_workers, const int max_crops_per_frame,
+		              const float threshold);
+
+		//Crops every region straight from `frame` into the input tensor of a worker's engine
+		//and classifies them.
+		std::vector<CascadeCandidate> Run(const cv::Mat& frame,
+		                                  const std::vector<std::pair<cv::Rect, float>>& detections);
+
+		//Overlay the cascade output on the image.
+		static void img_overlay(cv::Mat& frame, const std::vector<CascadeCandidate>& ret);
+
+	private:
+		std::vector<std::unique_ptr<ClassificationEngine>> m_engines;
+		std::unique_ptr<WorkerPool> m_pool;
+		// Per worker resize target for crops whose channels differ from the model input.
+		std::vector<cv::Mat> m_scratch;
+		std::vector<int> m_input_shape;
+		int m_max_crops;
+		float m_threshold;
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_CASCADE_ENGINE_H
@@ -31,6 +31,8 @@ namespace edge {
 
 		//Overlay the classification output on the image
 		static void img_overlay(cv::Mat& frame, const std::vector<ClassificationCandidate>& ret);
+		//Draws the classification output on the image without displaying it
+		static void draw_overlay(cv::Mat& frame, const std::vector<ClassificationCandidate>& ret);
 
 		//Returns a 3 member vector of classification candidates with highest scores
 		std::vector<ClassificationCandidate> ClassifyWithOutputVector(
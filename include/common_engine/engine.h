@@ -8,13 +8,26 @@
 
 #include <array>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "edgetpu.h"
+#include "input_adapter.h"
+#include "label_utils.h"
+#include "op_profiler.h"
+#include "output_reader.h"
+#include "tensor_record.h"
 #include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/model.h"
 
+namespace coral {
+	struct PosenetDecoderParams;
+}
+
 namespace edge {
+	class WorkerPool;
+
 	class Engine {
 	public:
 		//Constructors to slightly modify the engine types
@@ -33,19 +46,95 @@ namespace edge {
 
         // Does Inference with the model and returns the output tensor concatenated as a vector.
 		std::vector<float> RunInference(const std::vector<uint8_t>& input_data);
+		// Same, for input already written in place through GetInputBuffer().
+		std::vector<float> RunInference();
+		// Same, with one vector per output tensor.
+		void RunInference(std::vector<std::vector<float>>& output_data);
+		// Takes a float input that is already normalized; the tensor must be float.
         void RunInference(const std::vector<float>& input_data, std::vector<std::vector<float>> &output_data);
 
+		// Where preprocessing writes uint8 RGB pixels. That is the input tensor itself for
+		// models taking raw pixels, else a pixel buffer the input adapter converts from.
+		uint8_t* GetInputBuffer();
+		// How pixels map to the real input values of float or requantized models, e.g.
+		// mean 127.5 and scale 1/128 for inputs in [-1, 1].
+		void SetInputNormalization(const InputNormalization& normalization);
+		InputAdapter::Kernel GetInputKernel() const { return m_input_adapter.GetKernel(); }
+
+		// Exposes the underlying interpreter for callers that move tensors themselves.
+		tflite::Interpreter* GetInterpreter() { return m_interpreter.get(); }
+
+		// Lets the PosenetDecoderOp of the model decode poses in parallel on `pool`, which
+		// must outlive the engine; nullptr decodes sequentially. False without the op.
+		bool SetPosenetDecoderPool(WorkerPool* pool);
+		// Reads and overrides the parameters of the PosenetDecoderOp of the model, e.g. to
+		// trade accuracy for decoding time without exporting the model again. Call between
+		// inferences. The stride is read-only, start from the params read. False without
+		// the op or, when setting, for out of range values or a different stride.
+		bool GetPosenetDecoderParams(coral::PosenetDecoderParams* params);
+		bool SetPosenetDecoderParams(const coral::PosenetDecoderParams& params);
+		// Splits decoding off Invoke, e.g. to pipeline it behind the Edge TPU: while deferred
+		// the PosenetDecoderOp leaves its outputs untouched and DecodePosenetInputs decodes
+		// copies of its inputs instead, on one thread at a time. False without the op.
+		bool SetPosenetDecoderDeferred(bool deferred);
+		// Tensor indices of the inputs and outputs of the PosenetDecoderOp, false without it.
+		bool GetPosenetDecoderTensors(std::vector<int>* inputs, std::vector<int>* outputs);
+		// Decodes copies of the decoder inputs, in GetPosenetDecoderTensors order, into
+		// float buffers of its outputs.
+		bool DecodePosenetInputs(const void* const* inputs, float* const* outputs);
 
+		// Records the raw tensors of every following inference to `path`, see decoder_replay.
+		// These are the inputs of the PosenetDecoderOp if the model has one, else the outputs.
+		// The metadata holds the decoder parameters of this moment, so apply overrides first.
+		bool StartTensorRecording(const std::string& path);
+
+		// Times every operator of the following inferences, e.g. to see how long the Edge TPU
+		// runs against the CPU ops and the PosenetDecoderOp. Disabling keeps what was
+		// aggregated so far; enabling again continues it.
+		void SetProfiling(bool enabled);
+		bool IsProfiling() const { return m_profiling; }
+		// What profiling aggregated, nullptr if it was never enabled.
+		const OpProfiler* GetProfiler() const { return m_profiler.get(); }
+		// The OpProfiler report, empty if profiling was never enabled.
+		std::string ProfileReport() const;
 
 	private:
+		// Converts one output tensor to float with the reader for its element type, chosen
+		// once after AllocateTensors.
+		struct OutputReader {
+			const TfLiteTensor* tensor;
+			size_t count;
+			OutputReadFn read;
+
+			void Read(float* out) const {
+				read(tensor->data.raw_const, count, tensor->params.scale, tensor->params.zero_point, out);
+			}
+		};
+
+		// The node and registration of the PosenetDecoderOp, nullptr without one.
+		const std::pair<TfLiteNode, TfLiteRegistration>* FindPosenetDecoder();
+		void Invoke();
+		void CollectOutputs(std::vector<std::vector<float>>& output_data);
+		void RecordTensors();
+
 		std::unique_ptr<tflite::FlatBufferModel> m_model;
 		std::unique_ptr<tflite::Interpreter> m_interpreter;
 		std::vector<int> m_input_shape;
+		InputAdapter m_input_adapter;
+		std::vector<OutputReader> m_output_readers;
+		size_t m_output_size = 0;
+		std::unique_ptr<TensorRecordWriter> m_tensor_recorder;
+		std::vector<int> m_recorded_tensors;
+		std::unique_ptr<OpProfiler> m_profiler;
+		bool m_profiling = false;
 	public:
-		std::map<int, std::string> m_labels;
+		LabelTable m_labels;
 		std::vector<size_t> m_output_shape;
 
 	};
+
+	// Opens every connected Edge TPU, e.g. to place one model segment on each device.
+	std::vector<std::shared_ptr<edgetpu::EdgeTpuContext>> OpenAllEdgeTpus();
 }
 
 #endif //EGDETPU_VIDEO_INFERENCE_ENGINE_H
@@ -0,0 +1,63 @@
+//
+// Fills the model input tensor from 8-bit RGB pixels whatever type the tensor has.
+// Preprocessing always produces uint8 pixels; the adapter decides once, from the input
+// tensor type and quantization, how they reach the tensor.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_INPUT_ADAPTER_H
+#define EGDETPU_VIDEO_INFERENCE_INPUT_ADAPTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "tensorflow/lite/context.h"
+
+namespace edge {
+	//Maps a pixel p to the real value the model expects: (p - mean) * scale.
+	struct InputNormalization {
+		float mean = 0.0f;
+		float scale = 1.0f;
+	};
+
+	class InputAdapter {
+	public:
+		enum class Kernel {
+			// uint8 tensor taking raw pixels, preprocessing writes straight into it.
+			kPassthrough,
+			// int8 tensor quantized like the raw pixels shifted by 128.
+			kFlipSign,
+			// Requantization of a uint8 or int8 tensor through a 256 entry table.
+			kTable,
+			// float tensor, (p - mean) * scale.
+			kAffine,
+			kUnsupported,
+		};
+
+		//Binds to `tensor`, which must stay allocated. Without `normalization` quantized
+		//tensors get the raw pixel codes (uint8, or shifted by 128 for int8) and float
+		//tensors the pixel values.
+		void Init(TfLiteTensor* tensor);
+		void Init(TfLiteTensor* tensor, const InputNormalization& normalization);
+
+		Kernel GetKernel() const { return m_kernel; }
+		//Where preprocessing writes the uint8 pixels, the tensor itself for kPassthrough.
+		uint8_t* Buffer();
+		//Converts the pixels in Buffer() into the tensor; nothing to do for kPassthrough.
+		void Apply();
+
+	private:
+		void Select(const InputNormalization* normalization);
+
+		TfLiteTensor* m_tensor = nullptr;
+		Kernel m_kernel = Kernel::kUnsupported;
+		size_t m_count = 0;
+		//Pixels for every kernel but kPassthrough, a quarter of a float staging buffer.
+		std::vector<uint8_t> m_pixels;
+		uint8_t m_table[256];
+		float m_scale = 1.0f;
+		float m_offset = 0.0f;
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_INPUT_ADAPTER_H
@@ -0,0 +1,92 @@
+//
+// Per-operator latency of an interpreter across inferences. TFLite's BufferedProfiler
+// timestamps every node Invoke runs; after each inference the events are folded into a
+// histogram per node and one per op name, the latter holding the time all nodes of that
+// op took in the inference. This tells the Edge TPU custom op apart from the CPU ops
+// around it and the PosenetDecoderOp.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_OP_PROFILER_H
+#define EGDETPU_VIDEO_INFERENCE_OP_PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "latency_histogram.h"
+#include "tensorflow/lite/profiling/buffered_profiler.h"
+
+namespace edge {
+	//Where an operator runs.
+	enum class OpKind { kEdgeTpu, kCpu, kPosenetDecoder };
+
+	//"edgetpu", "cpu" or "decoder".
+	const char* OpKindName(OpKind kind);
+	//The kind of an operator from the name the interpreter reports for it: the custom op
+	//name for custom ops, else the builtin op name.
+	OpKind ClassifyOp(const std::string& op_name);
+
+	//Latencies of one node of the execution plan, in microseconds.
+	struct NodeProfile {
+		int node_index = -1;
+		std::string op_name;
+		OpKind kind = OpKind::kCpu;
+		LatencyHistogram latency_us;
+	};
+
+	//Latencies of all nodes of one op name, summed per inference, in microseconds.
+	struct OpProfile {
+		std::string op_name;
+		OpKind kind = OpKind::kCpu;
+		int num_nodes = 0;
+		LatencyHistogram latency_us;
+	};
+
+	class OpProfiler {
+	public:
+		//`max_events` bounds the operator events of one inference, at least the number of
+		//nodes in the execution plan.
+		explicit OpProfiler(uint32_t max_events);
+
+		//What to hand to Interpreter::SetProfiler.
+		tflite::Profiler* TfLiteProfiler() { return &m_profiler; }
+
+		//Bracket one Invoke; EndInvoke folds its events into the histograms.
+		void BeginInvoke();
+		void EndInvoke();
+		//Drops everything aggregated so far.
+		void Reset();
+
+		uint64_t NumInvokes() const { return m_invoke_us.Count(); }
+		//Wall time of whole inferences, including the interpreter around the ops.
+		const LatencyHistogram& InvokeLatency() const { return m_invoke_us; }
+		//Nodes in the order they first ran.
+		const std::vector<NodeProfile>& Nodes() const { return m_nodes; }
+		//Op names in the order they first ran.
+		const std::vector<OpProfile>& Ops() const { return m_ops; }
+		//Total microseconds of every op of `kind` over all inferences.
+		uint64_t TotalUs(OpKind kind) const;
+
+		//A table of the ops and nodes by total time, with the share of each kind.
+		std::string Report() const;
+
+	private:
+		NodeProfile& NodeSlot(int node_index, const char* op_name);
+
+		tflite::profiling::BufferedProfiler m_profiler;
+		std::chrono::steady_clock::time_point m_invoke_start;
+		LatencyHistogram m_invoke_us;
+		std::vector<NodeProfile> m_nodes;
+		std::vector<OpProfile> m_ops;
+		// Node index to its slot in m_nodes, -1 before it first ran.
+		std::vector<int> m_node_slots;
+		// Op slot of every entry of m_nodes.
+		std::vector<int> m_node_ops;
+		// Per-op time of the current inference.
+		std::vector<uint64_t> m_op_frame_us;
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_OP_PROFILER_H
@@ -0,0 +1,61 @@
+//
+// Converts output tensors to float. The conversion is specialized on the element type
+// at compile time; callers select it once per tensor instead of switching on the type
+// for every inference.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_OUTPUT_READER_H
+#define EGDETPU_VIDEO_INFERENCE_OUTPUT_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "dequantize.h"
+#include "tensorflow/lite/context.h"
+
+namespace edge {
+	//Writes `count` elements at `data` to `out` as real values.
+	typedef void (*OutputReadFn)(const void* data, size_t count, float scale, int32_t zero_point, float* out);
+
+	//Dequantizes integer elements, (q - zero_point) * scale. The supported types are
+	//specialized below onto the SIMD kernels of dequantize.h.
+	template <typename T>
+	void ReadOutput(const void* data, size_t count, float scale, int32_t zero_point, float* out) {
+		const T* values = static_cast<const T*>(data);
+		for (size_t i = 0; i < count; ++i) out[i] = (values[i] - zero_point) * scale;
+	}
+
+	template <>
+	inline void ReadOutput<uint8_t>(const void* data, size_t count, float scale, int32_t zero_point, float* out) {
+		DequantizeUint8(static_cast<const uint8_t*>(data), count, zero_point, scale, out);
+	}
+
+	template <>
+	inline void ReadOutput<int8_t>(const void* data, size_t count, float scale, int32_t zero_point, float* out) {
+		DequantizeInt8(static_cast<const int8_t*>(data), count, zero_point, scale, out);
+	}
+
+	template <>
+	inline void ReadOutput<int16_t>(const void* data, size_t count, float scale, int32_t zero_point, float* out) {
+		DequantizeInt16(static_cast<const int16_t*>(data), count, zero_point, scale, out);
+	}
+
+	template <>
+	inline void ReadOutput<float>(const void* data, size_t count, float, int32_t, float* out) {
+		std::memcpy(out, data, count * sizeof(float));
+	}
+
+	//The reader for `type` and its element size, nullptr for unsupported types.
+	inline OutputReadFn SelectOutputReader(TfLiteType type, size_t* element_size) {
+		switch (type) {
+			case kTfLiteFloat32: *element_size = sizeof(float); return &ReadOutput<float>;
+			case kTfLiteUInt8: *element_size = sizeof(uint8_t); return &ReadOutput<uint8_t>;
+			case kTfLiteInt8: *element_size = sizeof(int8_t); return &ReadOutput<int8_t>;
+			case kTfLiteInt16: *element_size = sizeof(int16_t); return &ReadOutput<int16_t>;
+			default: *element_size = 1; return nullptr;
+		}
+	}
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_OUTPUT_READER_H
@@ -10,6 +10,7 @@
 #include <string>
 
 #include "engine.h"
+#include "input_transform.h"
 #include "opencv2/opencv.hpp"
 
 namespace edge {
@@ -35,10 +36,20 @@ namespace edge {
 		}
 		//Overlay the detection output on the image.
 		static void img_overlay(cv::Mat& frame, const std::vector<DetectionCandidate>& ret, const int& width, const int& height);
+		//Draws the detection output on the image without displaying it.
+		static void draw_overlay(cv::Mat& frame, const std::vector<DetectionCandidate>& ret, const int& width, const int& height);
 
-		//Returns a vector of Detection candidates.
+		//Returns a vector of Detection candidates, with boxes mapped to normalized frame
+		//coordinates by the `transform` the input was prepared with.
 		std::vector<DetectionCandidate> DetectWithOutputVector(
-						const std::vector<float>& inf_vec,const float& threshold);
+						const std::vector<float>& inf_vec,const float& threshold,
+						const AffineTransform& transform = AffineTransform());
+		//Same from outputs of a model with the given output tensor sizes, no interpreter
+		//needed. Without labels the class id is returned as candidate name.
+		static std::vector<DetectionCandidate> DetectWithOutputVector(
+						const std::vector<float>& inf_vec, const std::vector<size_t>& output_shape,
+						const LabelTable& labels, const float& threshold,
+						const AffineTransform& transform = AffineTransform());
 
 	};
 }
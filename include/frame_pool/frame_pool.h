@@ -0,0 +1,88 @@
+//
+// A fixed-capacity pool of pre-allocated frames. Threads exchange small
+// FrameHandle values through the lock-free queues instead of copying cv::Mat
+// pixel data around.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_FRAME_POOL_H
+#define EGDETPU_VIDEO_INFERENCE_FRAME_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "lockfree_queue.h"
+#include "opencv2/opencv.hpp"
+
+namespace edge {
+	//Enough buffers for one frame being captured, one queued and one in inference, plus slack.
+	static constexpr size_t kDefaultFramePoolSize = 4;
+
+	//Handle to a frame buffer owned by a FramePool, cheap to pass between threads.
+	struct FrameHandle {
+		int index = -1;
+		uint64_t frame_id = 0;
+		int64_t capture_time_us = 0;
+	};
+
+	class FramePool {
+	public:
+		//Allocates `capacity` cache-line aligned buffers of height x width pixels of the given cv type.
+		FramePool(size_t capacity, int height, int width, int type);
+		~FramePool();
+
+		FramePool(const FramePool&) = delete;
+		FramePool& operator=(const FramePool&) = delete;
+
+		//Takes a free buffer from the pool. Returns false if every buffer is in use.
+		bool Acquire(FrameHandle* handle);
+		//Returns a buffer to the pool. Safe to call from any thread.
+		void Release(const FrameHandle& handle);
+
+		//cv::Mat header over the pooled pixels, no copy is involved.
+		cv::Mat& Frame(const FrameHandle& handle) { return m_frames[handle.index]; }
+
+		size_t Capacity() const { return m_frames.size(); }
+		size_t Available() const { return m_free.Size(); }
+
+	private:
+		uint8_t* m_storage;
+		std::vector<cv::Mat> m_frames;
+		MpmcQueue<int> m_free;
+	};
+
+	//Runs the camera capture loop on its own thread. Every frame is read straight into a
+	//pooled buffer and its handle pushed to `output`. When inference falls behind and the
+	//pool is exhausted the frame is read into a scratch buffer and counted as dropped.
+	class FrameGrabber {
+	public:
+		FrameGrabber(cv::VideoCapture& capture, FramePool& pool, SpscQueue<FrameHandle>& output);
+		~FrameGrabber();
+
+		void Start();
+		void Stop();
+		bool Running() const { return m_running.load(std::memory_order_acquire); }
+		uint64_t Captured() const { return m_captured.load(std::memory_order_relaxed); }
+		uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+	private:
+		void CaptureLoop();
+
+		cv::VideoCapture& m_capture;
+		FramePool& m_pool;
+		SpscQueue<FrameHandle>& m_output;
+		std::thread m_thread;
+		std::atomic<bool> m_running;
+		std::atomic<uint64_t> m_captured;
+		std::atomic<uint64_t> m_dropped;
+	};
+
+	//Pops the most recent frame from `queue`, returning stale ones to `pool`. Waits while the
+	//queue is empty and `grabber` is still running. Returns false once the grabber stopped.
+	//Sets `skipped`, if given, to the number of stale frames returned.
+	bool PopLatestFrame(SpscQueue<FrameHandle>& queue, FramePool& pool, const FrameGrabber& grabber,
+	                    FrameHandle* handle, uint64_t* skipped = nullptr);
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_FRAME_POOL_H
@@ -0,0 +1,158 @@
+//
+// Bounded lock-free queues used to hand frame handles between the capture,
+// preprocessing and inference threads without locking or allocating.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_LOCKFREE_QUEUE_H
+#define EGDETPU_VIDEO_INFERENCE_LOCKFREE_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace edge {
+	static constexpr size_t kCacheLineSize = 64;
+
+	// Rounds the requested capacity up to the next power of two so that
+	// positions can be wrapped with a mask instead of a modulo.
+	inline size_t RoundUpToPowerOfTwo(size_t n) {
+		size_t ret = 1;
+		while (ret < n) ret <<= 1;
+		return ret;
+	}
+
+	// Single-producer single-consumer ring buffer. Exactly one thread may call
+	// TryPush and exactly one (other) thread may call TryPop.
+	template <typename T>
+	class SpscQueue {
+	public:
+		explicit SpscQueue(size_t capacity)
+						: m_mask(RoundUpToPowerOfTwo(capacity) - 1), m_slots(m_mask + 1),
+						  m_head(0), m_tail(0) {}
+
+		SpscQueue(const SpscQueue&) = delete;
+		SpscQueue& operator=(const SpscQueue&) = delete;
+
+		// Returns false if the queue is full.
+		bool TryPush(const T& item) {
+			const size_t tail = m_tail.load(std::memory_order_relaxed);
+			if (tail - m_head.load(std::memory_order_acquire) > m_mask) return false;
+			m_slots[tail & m_mask] = item;
+			m_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Returns false if the queue is empty.
+		bool TryPop(T* item) {
+			const size_t head = m_head.load(std::memory_order_relaxed);
+			if (head == m_tail.load(std::memory_order_acquire)) return false;
+			*item = m_slots[head & m_mask];
+			m_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Approximate number of queued items, exact only when both sides are idle.
+		size_t Size() const {
+			return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+		}
+
+		size_t Capacity() const { return m_mask + 1; }
+
+	private:
+		const size_t m_mask;
+		std::vector<T> m_slots;
+		// Producer and consumer positions live on separate cache lines so that the
+		// two threads do not invalidate each other on every operation.
+		char m_pad0[kCacheLineSize];
+		std::atomic<size_t> m_head;
+		char m_pad1[kCacheLineSize - sizeof(std::atomic<size_t>)];
+		std::atomic<size_t> m_tail;
+		char m_pad2[kCacheLineSize - sizeof(std::atomic<size_t>)];
+	};
+
+	// Multi-producer multi-consumer bounded queue (Vyukov). Every cell carries a
+	// sequence number telling producers and consumers whose turn it is, so any
+	// number of threads may push and pop concurrently.
+	template <typename T>
+	class MpmcQueue {
+	public:
+		explicit MpmcQueue(size_t capacity)
+						: m_mask(RoundUpToPowerOfTwo(capacity) - 1), m_cells(m_mask + 1),
+						  m_enqueue_pos(0), m_dequeue_pos(0) {
+			for (size_t i = 0; i <= m_mask; ++i) {
+				m_cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		MpmcQueue(const MpmcQueue&) = delete;
+		MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+		// Returns false if the queue is full.
+		bool TryPush(const T& item) {
+			size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+			Cell* cell;
+			while (true) {
+				cell = &m_cells[pos & m_mask];
+				const size_t seq = cell->sequence.load(std::memory_order_acquire);
+				const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+				if (diff == 0) {
+					if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+				} else if (diff < 0) {
+					return false;
+				} else {
+					pos = m_enqueue_pos.load(std::memory_order_relaxed);
+				}
+			}
+			cell->data = item;
+			cell->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Returns false if the queue is empty.
+		bool TryPop(T* item) {
+			size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+			Cell* cell;
+			while (true) {
+				cell = &m_cells[pos & m_mask];
+				const size_t seq = cell->sequence.load(std::memory_order_acquire);
+				const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+				if (diff == 0) {
+					if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+				} else if (diff < 0) {
+					return false;
+				} else {
+					pos = m_dequeue_pos.load(std::memory_order_relaxed);
+				}
+			}
+			*item = cell->data;
+			cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Approximate number of queued items.
+		size_t Size() const {
+			const size_t enq = m_enqueue_pos.load(std::memory_order_acquire);
+			const size_t deq = m_dequeue_pos.load(std::memory_order_acquire);
+			return enq > deq ? enq - deq : 0;
+		}
+
+		size_t Capacity() const { return m_mask + 1; }
+
+	private:
+		struct Cell {
+			Cell() : sequence(0), data() {}
+			std::atomic<size_t> sequence;
+			T data;
+		};
+		const size_t m_mask;
+		std::vector<Cell> m_cells;
+		char m_pad0[kCacheLineSize];
+		std::atomic<size_t> m_enqueue_pos;
+		char m_pad1[kCacheLineSize - sizeof(std::atomic<size_t>)];
+		std::atomic<size_t> m_dequeue_pos;
+		char m_pad2[kCacheLineSize - sizeof(std::atomic<size_t>)];
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_LOCKFREE_QUEUE_H
@@ -0,0 +1,120 @@
+//
+// Decides, frame by frame, what the inference loop does with a captured frame so that a
+// percentile of the glass-to-result latency stays within a budget. Frames too old to
+// finish in time are dropped, frames a newer capture has superseded are skipped so
+// processing keeps pace with the engine instead of working through a backlog, and when
+// even fresh frames would miss the budget processing steps down to a cheaper level, e.g.
+// a smaller input resolution.
+//
+// The scheduler keeps no clock of its own: callers pass timestamps in microseconds on
+// one monotonic clock, e.g. FrameHandle::capture_time_us, which also lets simulations
+// drive it in virtual time.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_FRAME_SCHEDULER_H
+#define EGDETPU_VIDEO_INFERENCE_FRAME_SCHEDULER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "latency_histogram.h"
+
+namespace edge {
+	struct FrameSchedulerOptions {
+		//Capture to result latency the scheduler aims for.
+		float latency_budget_ms = 100.0f;
+		//The percentile of the latency that must stay within the budget.
+		float percentile = 95.0f;
+		//Relative processing cost of each level, level 0 the most expensive. Used to predict
+		//levels not measured yet; one entry disables downscaling.
+		std::vector<float> level_costs = {1.0f};
+	};
+
+	enum class FrameAction {
+		//Run inference on the frame at the decided level.
+		kProcess,
+		//Discard the frame, it cannot make the budget any more.
+		kDrop,
+		//Discard the frame, a newer one has been captured while it was queued.
+		kSkip
+	};
+
+	struct FrameDecision {
+		FrameAction action = FrameAction::kProcess;
+		int level = 0;
+	};
+
+	class FrameScheduler {
+	public:
+		explicit FrameScheduler(const FrameSchedulerOptions& options);
+
+		//The fate of a frame captured at `capture_us` that could start processing at `now_us`.
+		FrameDecision Admit(int64_t capture_us, int64_t now_us);
+		//Reports a processed frame whose inference ran from `start_us` to `end_us`.
+		void Complete(int64_t capture_us, int64_t start_us, int64_t end_us, int level);
+
+		//The level frames are processed at, 0 the most expensive.
+		int Level() const { return m_level; }
+		int NumLevels() const { return static_cast<int>(m_levels.size()); }
+		//Predicted processing time of `level` at the percentile, in milliseconds.
+		double ServiceEstimateMs(int level) const;
+		//Smoothed interval between captured frames in milliseconds, 0 before two frames.
+		double FrameIntervalMs() const { return m_interval_us / 1000.0; }
+
+		//Capture to result latency of every processed frame, in microseconds.
+		const LatencyHistogram& Latency() const { return m_latency_us; }
+		uint64_t Processed() const { return m_latency_us.Count(); }
+		uint64_t Dropped() const { return m_dropped; }
+		uint64_t Skipped() const { return m_skipped; }
+		//Processed frames whose latency exceeded the budget.
+		uint64_t OverBudget() const { return m_over_budget; }
+
+	private:
+		// The most recent samples of one series, for percentiles of the current conditions.
+		class Window {
+		public:
+			void Add(double value);
+			void Clear() { m_values.clear(); m_next = 0; }
+			bool Empty() const { return m_values.empty(); }
+			double Percentile(double p) const;
+
+		private:
+			std::vector<double> m_values;
+			// Reordered by Percentile, kept so that frames after the first allocate nothing.
+			mutable std::vector<double> m_sorted;
+			size_t m_next = 0;
+		};
+
+		struct LevelState {
+			float cost;
+			Window service_us;
+		};
+
+		double ServiceEstimateUs(int level) const;
+		void Adapt();
+
+		FrameSchedulerOptions m_options;
+		int64_t m_budget_us;
+		std::vector<LevelState> m_levels;
+		int m_level;
+		// Frames completed since the level last changed, and how many in a row had room for
+		// the next more expensive level.
+		int m_frames_on_level;
+		int m_headroom_frames;
+		// Time processed frames waited between capture and the start of processing, and the
+		// age of every admitted frame.
+		Window m_wait_us;
+		Window m_age_us;
+		int64_t m_last_capture_us;
+		double m_interval_us;
+		// When the last processed frame started, -1 before the first.
+		int64_t m_last_start_us;
+		LatencyHistogram m_latency_us;
+		uint64_t m_dropped;
+		uint64_t m_skipped;
+		uint64_t m_over_budget;
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_FRAME_SCHEDULER_H
@@ -0,0 +1,73 @@
+//
+// Wraps several input resolutions of the same PoseNet family and picks one per frame
+// so that the measured inference time stays within a latency budget.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_ADAPTIVE_POSE_ENGINE_H
+#define EGDETPU_VIDEO_INFERENCE_ADAPTIVE_POSE_ENGINE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "humanpose_engine.h"
+#include "opencv2/opencv.hpp"
+
+namespace edge {
+	class AdaptivePoseEngine {
+	public:
+		//Loads every model in `model_paths`; they are ordered by input resolution internally.
+		//Inference starts on the smallest variant and steps up while there is headroom.
+		AdaptivePoseEngine(const std::vector<std::string>& model_paths,
+		                   const std::shared_ptr<edgetpu::EdgeTpuContext>& edgetpu_context,
+		                   const bool edgetpu, const float latency_budget_ms);
+
+		//Preprocesses and runs `frame` on the currently selected variant, then adapts the
+		//selection using the measured inference time. `input_shape` receives the shape of the
+		//variant that produced the returned poses and `transform` the transform of its input,
+		//both needed to map keypoints back to the frame.
+		std::vector<PoseCandidate> PoseEstimate(const cv::Mat& frame, const float& threshold,
+		                                        std::vector<int>* input_shape, AffineTransform* transform = nullptr);
+		//Decodes poses of every variant in parallel on `pool`, see Engine::SetPosenetDecoderPool.
+		void SetPosenetDecoderPool(WorkerPool* pool) {
+			for (auto& variant : m_variants) variant->SetPosenetDecoderPool(pool);
+		}
+		//Overrides the decoder parameters of every variant, see Engine::SetPosenetDecoderParams.
+		bool SetPosenetDecoderParams(const coral::PosenetDecoderParams& params) {
+			bool set = !m_variants.empty();
+			for (auto& variant : m_variants) set = variant->SetPosenetDecoderParams(params) && set;
+			return set;
+		}
+		bool GetPosenetDecoderParams(coral::PosenetDecoderParams* params) {
+			return m_variants[m_current]->GetPosenetDecoderParams(params);
+		}
+		//How frames are fitted into the inputs, kStretch by default.
+		void SetResizeMode(const ResizeMode mode) { m_resize_mode = mode; }
+
+		// Exposes the input tensor shape of the currently selected variant.
+		std::vector<int> GetInputShape() const { return m_input_shapes[m_current]; }
+		size_t CurrentVariant() const { return m_current; }
+		size_t NumVariants() const { return m_variants.size(); }
+		// Smoothed inference time of a variant in milliseconds, 0 if never measured.
+		double AverageLatencyMs(size_t variant) const { return m_average_ms[variant]; }
+		// Inference time of the last PoseEstimate in microseconds, without pre- and postprocessing.
+		uint64_t LastInferenceUs() const { return m_last_inference_us; }
+
+	private:
+		void Adapt(const double latency_ms);
+		double EstimatedLatencyMs(size_t variant) const;
+
+		std::vector<std::unique_ptr<HumanPoseEngine>> m_variants;
+		std::vector<std::vector<int>> m_input_shapes;
+		std::vector<double> m_average_ms;
+		size_t m_current;
+		ResizeMode m_resize_mode;
+		float m_budget_ms;
+		int m_headroom_frames;
+		int m_frames_on_variant;
+		uint64_t m_last_inference_us;
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_ADAPTIVE_POSE_ENGINE_H
@@ -9,7 +9,9 @@
 #include <string>
 
 #include "engine.h"
+#include "input_transform.h"
 #include "opencv2/opencv.hpp"
+#include "posenet_decoder_op.h"
 
 namespace edge{
 	//Data structure to hold Detection result
@@ -32,10 +34,21 @@ namespace edge{
 		//Overlay the pose estimate on the image
 		static void img_overlay(cv::Mat& frame, const std::vector<PoseCandidate>& ret,const float& keypoint_threshold,
 		                        const float& inp_width, const float& inp_height, const float& camera_width, const float& camera_height);
+		//Draws the pose estimate on the image without displaying it
+		static void draw_overlay(cv::Mat& frame, const std::vector<PoseCandidate>& ret,const float& keypoint_threshold,
+		                         const float& inp_width, const float& inp_height, const float& camera_width, const float& camera_height);
+		//Rescales keypoints from model input to camera pixel coordinates, undoing the
+		//`transform` the input was prepared with
+		static void ToFrameCoordinates(std::vector<PoseCandidate>& ret, const float& inp_width, const float& inp_height,
+		                               const float& camera_width, const float& camera_height,
+		                               const AffineTransform& transform = AffineTransform());
 
 		//Returns a vector of Pose candidates.
 		std::vector<PoseCandidate> PoseEstimateWithOutputVector(
 						const std::vector<float>& inf_vec, const float& threshold);
+		//Same as above for outputs produced elsewhere, e.g. by a SegmentedPipeline.
+		static std::vector<PoseCandidate> PoseEstimateWithOutputVector(
+						const std::vector<float>& inf_vec, const std::vector<size_t>& output_shape, const float& threshold);
 
 	};
 }
@@ -0,0 +1,148 @@
+#ifndef EDGETPU_CPP_POSENET_POSE_SKELETON_H_
+#define EDGETPU_CPP_POSENET_POSE_SKELETON_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace coral {
+
+// Keypoints of the COCO skeleton the PoseNet models are trained on.
+enum KeypointType {
+  kNose,
+  kLeftEye,
+  kRightEye,
+  kLeftEar,
+  kRightEar,
+  kLeftShoulder,
+  kRightShoulder,
+  kLeftElbow,
+  kRightElbow,
+  kLeftWrist,
+  kRightWrist,
+  kLeftHip,
+  kRightHip,
+  kLeftKnee,
+  kRightKnee,
+  kLeftAnkle,
+  kRightAnkle
+};
+
+// Directed edges of the COCO skeleton, the 16 forward edges followed by the
+// same edges reversed. This is the order of the mid offsets of the model.
+constexpr std::pair<KeypointType, KeypointType> kCocoEdgeList[] = {
+    // Forward edges
+    {kNose, kLeftEye},
+    {kLeftEye, kLeftEar},
+    {kNose, kRightEye},
+    {kRightEye, kRightEar},
+    {kNose, kLeftShoulder},
+    {kLeftShoulder, kLeftElbow},
+    {kLeftElbow, kLeftWrist},
+    {kLeftShoulder, kLeftHip},
+    {kLeftHip, kLeftKnee},
+    {kLeftKnee, kLeftAnkle},
+    {kNose, kRightShoulder},
+    {kRightShoulder, kRightElbow},
+    {kRightElbow, kRightWrist},
+    {kRightShoulder, kRightHip},
+    {kRightHip, kRightKnee},
+    {kRightKnee, kRightAnkle},
+
+    // Backward edges
+    {kLeftEye, kNose},
+    {kLeftEar, kLeftEye},
+    {kRightEye, kNose},
+    {kRightEar, kRightEye},
+    {kLeftShoulder, kNose},
+    {kLeftElbow, kLeftShoulder},
+    {kLeftWrist, kLeftElbow},
+    {kLeftHip, kLeftShoulder},
+    {kLeftKnee, kLeftHip},
+    {kLeftAnkle, kLeftKnee},
+    {kRightShoulder, kNose},
+    {kRightElbow, kRightShoulder},
+    {kRightWrist, kRightElbow},
+    {kRightHip, kRightShoulder},
+    {kRightKnee, kRightHip},
+    {kRightAnkle, kRightKnee}};
+
+// Bounds of the skeletons the decoder supports, they size its stack buffers.
+static constexpr int kMaxSkeletonKeypoints = 256;
+static constexpr int kMaxSkeletonEdges = 256;
+
+// The keypoint graph a PoseNet style model predicts. The model has
+// num_keypoints heatmaps, 2 * num_keypoints short offsets and 4 * num_edges
+// mid offsets: forward y, forward x, backward y, backward x, each in the
+// order of `edges`.
+struct PoseSkeleton {
+  std::string name;
+  int num_keypoints = 0;
+  // Forward edges as (parent, child) keypoint ids.
+  std::vector<std::pair<int, int>> edges;
+};
+
+// The 17 keypoint COCO body skeleton.
+const PoseSkeleton& CocoSkeleton();
+
+// A 21 keypoint hand: the wrist, then four keypoints per finger from the thumb
+// to the little finger, each chain starting at the wrist.
+const PoseSkeleton& HandSkeleton();
+
+// The built-in skeleton called `name`, nullptr if there is none.
+const PoseSkeleton* FindSkeleton(const std::string& name);
+
+// The built-in skeleton with these sizes, nullptr if there is none.
+const PoseSkeleton* FindSkeleton(int num_keypoints, int num_edges);
+
+// Picks the skeleton of a model with num_keypoints heatmaps and num_edges
+// forward edges: `edges` if given, else the built-in skeleton `name` if given,
+// else the built-in skeleton of that size. Returns false if none matches.
+bool ResolveSkeleton(const std::string& name,
+                     const std::vector<std::pair<int, int>>& edges,
+                     int num_keypoints, int num_edges, PoseSkeleton* skeleton);
+
+// Edges as "parent child parent child ...", how tensor recordings store them.
+std::string SkeletonEdgesToString(const PoseSkeleton& skeleton);
+
+// Parses the output of SkeletonEdgesToString, false if it is malformed.
+bool SkeletonEdgesFromString(const std::string& text,
+                             std::vector<std::pair<int, int>>* edges);
+
+namespace posenet_decoder_op {
+
+// Adjacency of a PoseSkeleton for the decoder, built once when the model is
+// prepared. Directed edge ids are [0, num_edges) for the forward edges and
+// [num_edges, 2 * num_edges) for the same edges reversed.
+class SkeletonGraph {
+ public:
+  // False if the skeleton has out of range keypoint ids or exceeds
+  // kMaxSkeletonKeypoints or kMaxSkeletonEdges.
+  bool Init(const PoseSkeleton& skeleton);
+
+  const PoseSkeleton& Skeleton() const { return skeleton_; }
+  int NumKeypoints() const { return skeleton_.num_keypoints; }
+  int NumEdges() const { return static_cast<int>(skeleton_.edges.size()); }
+  // True for the COCO skeleton, which the decoder has a compile-time
+  // specialization for.
+  bool IsCoco() const { return is_coco_; }
+
+  // Directed edges starting at `keypoint` in id order, -1 terminated.
+  const int* ChildEdges(int keypoint) const {
+    return &child_edges_[child_offsets_[keypoint]];
+  }
+  // The keypoint a directed edge ends at.
+  int EdgeChild(int edge) const { return edge_children_[edge]; }
+
+ private:
+  PoseSkeleton skeleton_;
+  bool is_coco_ = false;
+  std::vector<int> child_offsets_;
+  std::vector<int> child_edges_;
+  std::vector<int> edge_children_;
+};
+
+}  // namespace posenet_decoder_op
+}  // namespace coral
+
+#endif  // EDGETPU_CPP_POSENET_POSE_SKELETON_H_
@@ -1,43 +1,66 @@
 #ifndef EDGETPU_CPP_POSENET_POSENET_DECODER_H_
 #define EDGETPU_CPP_POSENET_POSENET_DECODER_H_
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <ostream>
-#include <queue>
 #include <vector>
 
-namespace coral {
+#include "pose_skeleton.h"
 
-// An adjacency list representing the directed edges connecting keypoints.
-struct AdjacencyList {
-  AdjacencyList() = default;
-  AdjacencyList(const AdjacencyList&) = default;
-  AdjacencyList& operator=(const AdjacencyList&) = default;
-
-  explicit AdjacencyList(const int n_nodes)
-      : child_ids(n_nodes), edge_ids(n_nodes) {}
-
-  // child_ids[i] is a vector holding the node ids of all children of the i-th
-  // node and edge_ids[i] is a vector holding the edge ids of all edges stemming
-  // from the i-th node. If the k-th edge in the graph starts at the i-th node
-  // and ends at the j-th node, then child_ids[i] and edge_ids will contain j
-  // and k, respectively, at corresponding positions.
-  std::vector<std::vector<int>> child_ids;
-  std::vector<std::vector<int>> edge_ids;
-};
+namespace edge {
+class WorkerPool;
+}  // namespace edge
+
+namespace coral {
 
 namespace posenet_decoder_op {
 
+class DecoderWorkspace;
+
+// Sizes of the COCO skeleton of the PoseNet models, see pose_skeleton.h for
+// other skeletons.
 static constexpr int kNumKeypoints = 17;
 
 // These 16 edges allow traversing of the pose graph along the mid_offsets (see
 // paper for details).
 static constexpr int kNumEdges = 16;
 
+// Refinement steps the PosenetDecoderOp runs along the mid and short offsets.
+static constexpr int kMidShortOffsetRefinementSteps = 5;
+
+// Radius of the window a root candidate must be the maximum score of, in
+// block space.
+static constexpr int kLocalMaximumRadius = 1;
+
+// Dequantizes the uint8 inputs of the decoder as (value - zero_point) * scale *
+// extra_scale, the op uses extra_scale to bring offsets into block space.
+void DequantizeUint8(const uint8_t* src, size_t num_elements, int zero_point,
+                     float scale, float extra_scale, float* dst);
+
+// Float counterpart of DequantizeUint8.
+void ScaleFloat(const float* src, size_t num_elements, float scale,
+                float* dst);
+
 struct Point {
   float y;  // all coordinate pairs always use y first.
   float x;
 };
 
+// How the decoder samples the offsets and scores of the children of a
+// keypoint. kBatched samples all children together with SampleTensorBatch,
+// using AVX2 gathers where the CPU has them; kBatchedScalar does the same
+// without SIMD and kPerEdge samples each edge on its own. All modes give
+// identical poses, the setting exists to benchmark them.
+enum class SamplingMode { kPerEdge, kBatchedScalar, kBatched };
+
+void SetSamplingMode(SamplingMode mode);
+
+// The instruction set of kBatched: "avx2" or "scalar".
+const char* SamplingIsa();
+
 struct PoseKeypoints {
   Point keypoint[posenet_decoder_op::kNumKeypoints];
 };
@@ -58,6 +81,11 @@ struct PoseKeypointScores {
 // nms_radius must also be given in these units.
 // The output coordinates will be in pixel coordinates.
 //
+// A `workspace` kept across calls makes steady state decoding allocation free.
+// With a `pool`, root candidates are backtracked speculatively in batches of
+// one per worker and then accepted in score order against keypoint NMS, which
+// gives the same poses as the sequential decode.
+//
 // For details see https://arxiv.org/abs/1803.08225
 // PersonLab: Person Pose Estimation and Instance Segmentation with a
 // Bottom-Up, Part-Based, Geometric Embedding Model
@@ -73,6 +101,7 @@ int DecodeAllPoses(
     int max_detections,                     // maximum number of poses to detect
     float score_threshold,                  // between 0 and 1
     int mid_short_offset_refinement_steps,  // roughly 1-10
+    int local_maximum_radius,  // window of root candidates, typically 1
     float nms_radius,  // exclusion radius for keypoint of the same kind
                        // between different poses
     int stride,        // Stride of network - used to rescale keypoints
@@ -83,14 +112,31 @@ int DecodeAllPoses(
         pose_keypoint_scores,  // pointer to preallocated buffer
                                // of size
                                // [max_detections*sizeof(PoseKeypointScores)]
-    float* pose_scores         // pointer to preallocated buffer of size
+    float* pose_scores,        // pointer to preallocated buffer of size
                                // [max_detections*sizeof(float)]
+    edge::WorkerPool* pool = nullptr,  // decodes roots in parallel if given
+    DecoderWorkspace* workspace = nullptr  // reused scratch buffers if given
 );
 
+// Same for any skeleton, with num_keypoints heatmaps, 2*num_keypoints short
+// offsets and 4*num_edges mid offsets. pose_keypoints holds
+// max_detections*num_keypoints points and pose_keypoint_scores as many
+// floats. The COCO skeleton runs the same compile-time specialized decoder as
+// the overload above.
+int DecodeAllPoses(const SkeletonGraph& skeleton, const float* scores,
+                   const float* short_offsets, const float* mid_offsets,
+                   int height, int width, int max_detections,
+                   float score_threshold, int mid_short_offset_refinement_steps,
+                   int local_maximum_radius, float nms_radius, int stride,
+                   Point* pose_keypoints, float* pose_keypoint_scores,
+                   float* pose_scores, edge::WorkerPool* pool = nullptr,
+                   DecoderWorkspace* workspace = nullptr);
+
 }  // namespace posenet_decoder_op
 
 // Defines a 2-D keypoint with (x, y) float coordinates and its type id.
 struct KeypointWithScore {
+  KeypointWithScore() = default;
   KeypointWithScore(const posenet_decoder_op::Point& _point, const int _id,
                     const float _score)
       : point(_point), id(_id), score(_score) {}
@@ -113,13 +159,66 @@ struct KeypointWithScoreComparator {
   }
 };
 
-using DecreasingScoreKeypointPriorityQueue =
-    std::priority_queue<KeypointWithScore, std::vector<KeypointWithScore>,
-                        KeypointWithScoreComparator>;
+// Max-heap of keypoints in decreasing score order, popping in the same order
+// as a std::priority_queue with KeypointWithScoreComparator. It keeps its
+// elements in a caller owned vector, which keeps its capacity across uses.
+class KeypointHeap {
+ public:
+  explicit KeypointHeap(std::vector<KeypointWithScore>* storage)
+      : storage_(storage) {
+    storage_->clear();
+  }
+
+  bool empty() const { return storage_->empty(); }
+  size_t size() const { return storage_->size(); }
+  const KeypointWithScore& top() const { return storage_->front(); }
+  void push(const KeypointWithScore& keypoint) {
+    storage_->push_back(keypoint);
+    std::push_heap(storage_->begin(), storage_->end(),
+                   KeypointWithScoreComparator());
+  }
+  void pop() {
+    std::pop_heap(storage_->begin(), storage_->end(),
+                  KeypointWithScoreComparator());
+    storage_->pop_back();
+  }
+
+ private:
+  std::vector<KeypointWithScore>* storage_;
+};
+
+namespace posenet_decoder_op {
+
+// Scratch buffers of DecodeAllPoses. They grow to the largest max_detections
+// and candidate count seen and are reused afterwards, so decoding a stream of
+// frames stops allocating once the buffers have warmed up.
+class DecoderWorkspace {
+ public:
+  // Sizes the buffers for max_detections poses of num_keypoints and batches of
+  // batch_size speculative decodes, never shrinks them.
+  void Reserve(int max_detections, int batch_size, int num_keypoints);
+
+  // Poses are stored as num_keypoints consecutive points and scores.
+  std::vector<KeypointWithScore> candidates;
+  std::vector<Point> poses;
+  std::vector<float> keypoint_scores;
+  std::vector<float> instance_scores;
+  std::vector<int> decreasing_indices;
+  // One speculatively decoded root per worker, see DecodeAllPoses.
+  std::vector<KeypointWithScore> batch;
+  std::vector<Point> batch_poses;
+  std::vector<float> batch_keypoint_scores;
+  std::vector<float> batch_instance_scores;
+};
+
+}  // namespace posenet_decoder_op
 
 void DecreasingArgSort(const float* scores, const size_t len,
                        std::vector<int>* indices);
 
+// Same, into a caller provided array of `len` indices.
+void DecreasingArgSort(const float* scores, const size_t len, int* indices);
+
 void DecreasingArgSort(const std::vector<float>& scores,
                        std::vector<int>* indices);
 
@@ -146,6 +245,13 @@ void SampleTensorAtMultipleChannels(const float* tensor, const int height,
                                     const size_t n_result_channels,
                                     float* result);
 
+// Bilinearly samples n queries tensor(ys[i], xs[i], channels[i]) of a tensor
+// of shape [height, width, num_channels], with the arithmetic of
+// SampleTensorAtMultipleChannels. Queries at integer positions read the cell
+// directly.
+void SampleTensorBatch(const float* tensor, int height, int width,
+                       int num_channels, const float* ys, const float* xs,
+                       const int* channels, size_t n, float* result);
 float SampleTensorAtSingleChannel(const float* tensor, const int height,
                                   const int width, const int num_channels,
                                   const posenet_decoder_op::Point& point,
@@ -157,40 +263,6 @@ posenet_decoder_op::Point FindDisplacedPosition(
     const posenet_decoder_op::Point& source, const int edge_id,
     const int target_id, const int mid_short_offset_refinement_steps);
 
-AdjacencyList BuildAdjacencyList();
-
-void BacktrackDecodePose(
-    const float* scores, const float* short_offsets, const float* mid_offsets,
-    const int height, const int width, const int num_keypoints,
-    const int num_edges, const KeypointWithScore& root,
-    const AdjacencyList& adjacency_list,
-    const int mid_short_offset_refinement_steps,
-    posenet_decoder_op::PoseKeypoints* pose_keypoints,
-    posenet_decoder_op::PoseKeypointScores* keypoint_scores);
-
-void BuildKeypointWithScoreQueue(const float* scores,
-                                 const float* short_offsets, const int height,
-                                 const int width, const int num_keypoints,
-                                 const float score_threshold,
-                                 const int local_maximum_radius,
-                                 DecreasingScoreKeypointPriorityQueue* queue);
-
-bool PassKeypointNMS(const posenet_decoder_op::PoseKeypoints* poses,
-                     const size_t n_poses, const KeypointWithScore& keypoint,
-                     const float squared_nms_radius);
-
-void FindOverlappingKeypoints(const posenet_decoder_op::PoseKeypoints& pose1,
-                              const posenet_decoder_op::PoseKeypoints& pose2,
-                              const float squared_radius,
-                              std::vector<bool>* mask);
-
-void PerformSoftKeypointNMS(
-    const std::vector<int>& decreasing_indices,
-    const posenet_decoder_op::PoseKeypoints* all_keypoint_coords,
-    const posenet_decoder_op::PoseKeypointScores* all_keypoint_scores,
-    const int num_keypoints, const float squared_nms_radius, const int topk,
-    std::vector<float>* all_instance_scores);
-
 }  // namespace coral
 
 #endif  // EDGETPU_CPP_POSENET_POSENET_DECODER_H_
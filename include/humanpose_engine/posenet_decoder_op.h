@@ -1,14 +1,73 @@
 #ifndef EDGETPU_CPP_POSENET_POSENET_DECODER_OP_H_
 #define EDGETPU_CPP_POSENET_POSENET_DECODER_OP_H_
 
+#include "pose_skeleton.h"
 #include "tensorflow/lite/context.h"
 
+namespace edge {
+class WorkerPool;
+}  // namespace edge
+
 namespace coral {
 
 static const char kPosenetDecoderOp[] = "PosenetDecoderOp";
 
 TfLiteRegistration* RegisterPosenetDecoderOp();
 
+// Decoder parameters of a PosenetDecoderOp. The first four are baked into
+// the custom options of the op, the others start at the defaults of
+// DecodeAllPoses.
+struct PosenetDecoderParams {
+  int max_detections;
+  float score_threshold;
+  int stride;
+  float nms_radius;
+  int mid_short_offset_refinement_steps;
+  int local_maximum_radius;
+};
+
+// Returns the parameters of `node` if it is a PosenetDecoderOp, else nullptr.
+const PosenetDecoderParams* GetPosenetDecoderParams(
+    const TfLiteRegistration& registration, const TfLiteNode& node);
+
+// Returns the keypoint graph `node` decodes if it is a prepared
+// PosenetDecoderOp, else nullptr.
+const PoseSkeleton* GetPosenetDecoderSkeleton(
+    const TfLiteRegistration& registration, const TfLiteNode& node);
+
+// Makes `node`, if it is a PosenetDecoderOp, decode poses in parallel on
+// `pool`, which must outlive the interpreter; nullptr decodes sequentially.
+// Returns false for other ops.
+bool SetPosenetDecoderPool(const TfLiteRegistration& registration,
+                           const TfLiteNode& node, edge::WorkerPool* pool);
+
+// Overrides the decode settings of `node` for the following invocations,
+// without rebuilding the model. max_detections is clamped to the value in the
+// model, which the output tensors are allocated for. The stride is a property
+// of the network and read-only: `params.stride` must equal the stride from the
+// custom options, as returned by GetPosenetDecoderParams. Returns false for
+// other ops, for a different stride and for out of range values, which leave
+// the parameters unchanged.
+bool SetPosenetDecoderParams(const TfLiteRegistration& registration,
+                             const TfLiteNode& node,
+                             const PosenetDecoderParams& params);
+
+// Makes Eval of `node`, if it is a PosenetDecoderOp, skip decoding and leave
+// its outputs untouched, so that DecodePosenetInputs can decode on another
+// thread than Invoke. Returns false for other ops.
+bool SetPosenetDecoderDeferred(const TfLiteRegistration& registration,
+                               const TfLiteNode& node, bool deferred);
+
+// Decodes like Eval of `node`, from copies of the data of its three input
+// tensors in `inputs`, into float buffers shaped like its four outputs.
+// `input_tensors` are the input tensors of the node, for their shapes and
+// quantization. At most one thread may decode a node at a time. Returns false
+// for other ops.
+bool DecodePosenetInputs(const TfLiteRegistration& registration,
+                         const TfLiteNode& node,
+                         const TfLiteTensor* const* input_tensors,
+                         const void* const* inputs, float* const* outputs);
+
 }  // namespace coral
 
 #endif  // EDGETPU_CPP_POSENET_POSENET_DECODER_OP_H_
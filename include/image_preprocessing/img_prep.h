@@ -5,12 +5,51 @@
 #ifndef EDGETPU_VIDEO_INFERENCE_IMG_PREP_H
 #define EDGETPU_VIDEO_INFERENCE_IMG_PREP_H
 
+#include <string>
+
+#include "input_transform.h"
 #include "opencv2/opencv.hpp"
+#include "yuv_prep.h"
 
 namespace edge {
 
 	// Converts a image to a input vector for the model.
 	std::vector<uint8_t > GetInputFromImage(cv::Mat input_frame, const int& width,
 					const int& height, const int& channels);
+	// Same for frames decoded to YUV, converting colour only at model resolution.
+	std::vector<uint8_t> GetInputFromImage(const YuvImage& input_frame, const int& width, const int& height);
+
+	// Writes the BGR `input_frame` as width x height RGB straight into `input`, e.g. the
+	// model input tensor, fitted according to `mode`. Returns the transform that maps
+	// results back to the frame. Gray and BGRA frames are converted to BGR first, other
+	// types are reported and leave the input zeroed.
+	AffineTransform GetInputFromImage(const cv::Mat& input_frame, const ResizeMode mode, const int& width,
+					const int& height, uint8_t* input);
+	// Same for frames decoded to YUV.
+	AffineTransform GetInputFromImage(const YuvImage& input_frame, const ResizeMode mode, const int& width,
+					const int& height, uint8_t* input);
+	// Resizes `input_frame` into the preallocated `dst` according to `mode`, keeping its
+	// channel order, for callers with their own input conversion. `input_frame` must have
+	// the type of `dst`.
+	AffineTransform ResizeInto(const cv::Mat& input_frame, const ResizeMode mode, cv::Mat& dst);
+
+	// Where a frame lands in the input: `src` is the part of the frame that is used, `dst`
+	// the part of the input it is resized into. The rest of the input is padding.
+	struct InputPlacement {
+		cv::Rect src;
+		cv::Rect dst;
+	};
+	// `align` keeps the source crop on multiples of it, e.g. 2 for subsampled chroma.
+	InputPlacement PlaceInput(const ResizeMode mode, const int frame_width, const int frame_height,
+	                          const int width, const int height, const int align);
+	AffineTransform PlacementTransform(const InputPlacement& placement, const int frame_width, const int frame_height,
+	                                   const int width, const int height);
+	// Zeroes a width x height RGB `input` if the placement leaves padding.
+	void ClearPadding(const InputPlacement& placement, const int width, const int height, uint8_t* input);
+	// View of the `roi` of `image`; x and y must be even for subsampled formats.
+	YuvImage CropYuv(const YuvImage& image, const cv::Rect& roi);
+
+	// Parses "stretch", "letterbox" or "crop". Returns false for unknown names.
+	bool ParseResizeMode(const std::string& name, ResizeMode* mode);
 }
 #endif //EDGETPU_VIDEO_INFERENCE_IMG_PREP_H
@@ -0,0 +1,31 @@
+//
+// How a camera frame is fitted into the model input and how to map results back.
+//
+
+#ifndef EDGETPU_VIDEO_INFERENCE_INPUT_TRANSFORM_H
+#define EDGETPU_VIDEO_INFERENCE_INPUT_TRANSFORM_H
+
+namespace edge {
+	enum class ResizeMode {
+		// Scales each axis independently, distorting the aspect ratio.
+		kStretch,
+		// Scales the whole frame to fit and pads the rest of the input.
+		kLetterbox,
+		// Scales the frame to cover the input and cuts off what sticks out.
+		kCenterCrop,
+	};
+
+	//Maps normalized model input coordinates ([0, 1] across the input tensor) to
+	//normalized frame coordinates. Decoders apply it to boxes and keypoints so results
+	//are independent of the ResizeMode used; the identity corresponds to kStretch.
+	struct AffineTransform {
+		float scale_x = 1.0f;
+		float scale_y = 1.0f;
+		float offset_x = 0.0f;
+		float offset_y = 0.0f;
+
+		float X(float x) const { return x * scale_x + offset_x; }
+		float Y(float y) const { return y * scale_y + offset_y; }
+	};
+}
+#endif //EDGETPU_VIDEO_INFERENCE_INPUT_TRANSFORM_H
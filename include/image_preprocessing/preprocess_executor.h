@@ -0,0 +1,45 @@
+//
+// Runs input preprocessing of one frame on several cores. The output rows are split
+// into bands that a persistent WorkerPool resizes and converts concurrently, so large
+// inputs such as the 721x1281 PoseNet do not bottleneck on one core.
+//
+
+#ifndef EDGETPU_VIDEO_INFERENCE_PREPROCESS_EXECUTOR_H
+#define EDGETPU_VIDEO_INFERENCE_PREPROCESS_EXECUTOR_H
+
+#include <memory>
+
+#include "img_prep.h"
+#include "resampler.h"
+#include "worker_pool.h"
+
+namespace edge {
+	class PreprocessExecutor {
+	public:
+		//With one thread everything runs on the calling thread and no pool is created.
+		explicit PreprocessExecutor(int num_threads);
+
+		PreprocessExecutor(const PreprocessExecutor&) = delete;
+		PreprocessExecutor& operator=(const PreprocessExecutor&) = delete;
+
+		int NumThreads() const { return m_num_threads; }
+
+		//Same as GetInputFromImage with a ResizeMode, for 8-bit BGR and YUV frames.
+		AffineTransform Run(const cv::Mat& frame, const ResizeMode mode, const int width, const int height,
+		                    uint8_t* input);
+		AffineTransform Run(const YuvImage& frame, const ResizeMode mode, const int width, const int height,
+		                    uint8_t* input);
+
+	private:
+		//Calls fn(row_begin, row_end, worker) for bands covering [0, rows).
+		void ForEachBand(const int rows, const std::function<void(int, int, int)>& fn);
+
+		int m_num_threads;
+		std::unique_ptr<WorkerPool> m_pool;
+		//Taps of the current geometry, shared read-only by all bands.
+		std::unique_ptr<Resampler> m_resampler;
+		//Resize buffers of each worker, reused across frames.
+		std::vector<Resampler::Scratch> m_scratch;
+	};
+}
+#endif //EDGETPU_VIDEO_INFERENCE_PREPROCESS_EXECUTOR_H
@@ -0,0 +1,87 @@
+//
+// Resizing for a geometry that stays fixed for the life of the process, e.g. camera
+// frames to the model input. Tap indices and fixed point weights are computed once per
+// geometry instead of on every frame like cv::resize does.
+//
+
+#ifndef EDGETPU_VIDEO_INFERENCE_RESAMPLER_H
+#define EDGETPU_VIDEO_INFERENCE_RESAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace edge {
+	enum class Interpolation {
+		kBilinear,
+		// Averages every source pixel an output pixel covers, like cv::INTER_AREA. Falls
+		// back to bilinear along axes that are enlarged.
+		kArea,
+	};
+
+	class Resampler {
+	public:
+		//Resizes interleaved 8-bit images with `channels` channels. With `swap_rb` the
+		//first and third channel are exchanged on the way, e.g. BGR to RGB.
+		Resampler(int src_width, int src_height, int dst_width, int dst_height, int channels = 3,
+		          Interpolation interpolation = Interpolation::kBilinear, bool swap_rb = false);
+
+		bool Matches(int src_width, int src_height, int dst_width, int dst_height, int channels,
+		             Interpolation interpolation, bool swap_rb) const;
+
+		//Row buffers of one Resize call, kept so that frames after the first allocate nothing.
+		struct Scratch {
+			std::vector<int16_t> ring;
+			std::vector<int> ring_rows;
+			std::vector<const int16_t*> rows;
+		};
+
+		//Resizes `src` with rows `src_stride` bytes apart into `dst` with rows `dst_stride`
+		//bytes apart. Only output rows [row_begin, row_end) are produced, row_end < 0 means
+		//all of them. Uses the buffers of the resampler, see the overload below for bands
+		//resized concurrently.
+		void Resize(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride, int row_begin = 0,
+		            int row_end = -1) {
+			Resize(src, src_stride, dst, dst_stride, row_begin, row_end, &m_scratch);
+		}
+		//Same with caller owned buffers, so bands of one image can be resized concurrently
+		//with one `scratch` per thread.
+		void Resize(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride, int row_begin, int row_end,
+		            Scratch* scratch) const;
+
+		int SrcWidth() const { return m_src_width; }
+		int SrcHeight() const { return m_src_height; }
+		int DstWidth() const { return m_dst_width; }
+		int DstHeight() const { return m_dst_height; }
+
+	private:
+		//`count` taps per output position: source index and 7 bit weight of each.
+		struct Taps {
+			int count;
+			std::vector<int> index;
+			std::vector<int16_t> weight;
+		};
+
+		static Taps BuildTaps(int src_size, int dst_size, Interpolation interpolation);
+		void BlendHorizontal(const uint8_t* row, int16_t* out) const;
+		void BlendVertical(const int16_t* const* rows, const int16_t* weights, uint8_t* out) const;
+
+		int m_src_width;
+		int m_src_height;
+		int m_dst_width;
+		int m_dst_height;
+		int m_channels;
+		Interpolation m_interpolation;
+		bool m_swap_rb;
+		Taps m_taps_x;
+		Taps m_taps_y;
+		//m_taps_x.index in bytes.
+		std::vector<int> m_offsets_x;
+		//Source channel written to each output channel.
+		std::vector<int> m_channel_map;
+		//Output pixels of a row the vectorized three channel bilinear pass produces.
+		int m_vector_pixels_x;
+		Scratch m_scratch;
+	};
+}
+#endif //EDGETPU_VIDEO_INFERENCE_RESAMPLER_H
@@ -0,0 +1,50 @@
+//
+// Preprocessing straight from the YUV buffers cameras deliver. Colour conversion and
+// bilinear resizing happen in one pass at output resolution, so no full size BGR frame
+// is ever materialized on the way to the model input tensor.
+//
+
+#ifndef EDGETPU_VIDEO_INFERENCE_YUV_PREP_H
+#define EDGETPU_VIDEO_INFERENCE_YUV_PREP_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace edge {
+	enum class PixelFormat {
+		// Packed 4:2:2, Y0 U Y1 V.
+		kYUYV,
+		// Y plane followed by an interleaved UV plane at half resolution.
+		kNV12,
+		// Same with the chroma interleaved VU, as Android cameras deliver it.
+		kNV21,
+		// Y plane followed by separate U and V planes at half resolution.
+		kI420,
+	};
+
+	//Non-owning description of a YUV image, e.g. a mapped capture buffer.
+	struct YuvImage {
+		PixelFormat format;
+		int width;
+		int height;
+		// kYUYV uses planes[0] only, kNV12 and kNV21 planes[0] (Y) and planes[1] (UV or
+		// VU), kI420 all three (Y, U, V).
+		const uint8_t* planes[3];
+		int strides[3];
+	};
+
+	//Bytes of one tightly packed frame of `format`.
+	size_t YuvFrameSize(PixelFormat format, int width, int height);
+	//Describes a tightly packed frame of `format` starting at `data`.
+	YuvImage MakeYuvImage(PixelFormat format, int width, int height, const uint8_t* data);
+
+	//Converts `src` to 8-bit RGB (BT.601, limited range, as cv::COLOR_YUV2RGB_*) and
+	//resizes it bilinearly to dst_width x dst_height, writing interleaved rows that are
+	//`dst_stride` bytes apart into `dst`, e.g. the model input tensor. With `bgr` the
+	//channels are written in BGR order instead. Only output rows [row_begin, row_end)
+	//are produced, row_end < 0 means all of them. Runs eight pixels at a time with SSE2
+	//or NEON where available, with bit identical results on every path.
+	void ConvertYuvToRgb(const YuvImage& src, int dst_width, int dst_height, uint8_t* dst, int dst_stride,
+	                     bool bgr = false, int row_begin = 0, int row_end = -1);
+}
+#endif //EDGETPU_VIDEO_INFERENCE_YUV_PREP_H
@@ -0,0 +1,79 @@
+//
+// The metrics every camera app exports: frames captured, dropped and inferred, the
+// latency of each stage of a frame and of the whole frame from capture to result,
+// queue depths and how busy the inference device is.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_CAMERA_METRICS_H
+#define EGDETPU_VIDEO_INFERENCE_CAMERA_METRICS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "frame_pool.h"
+#include "metrics.h"
+
+namespace edge {
+	//Microseconds on the clock of FrameHandle::capture_time_us.
+	int64_t SteadyNowMicros();
+
+	//Splits the time spent on a frame into consecutive stages.
+	class StageTimer {
+	public:
+		StageTimer() : m_last(SteadyNowMicros()) {}
+		//Microseconds since construction or the previous Lap.
+		uint64_t Lap() {
+			const int64_t now = SteadyNowMicros();
+			const int64_t elapsed = now - m_last;
+			m_last = now;
+			return static_cast<uint64_t>(elapsed);
+		}
+
+	private:
+		int64_t m_last;
+	};
+
+	class CameraMetrics {
+	public:
+		//Registers the series in `registry`; `device` labels the device series, e.g.
+		//"edgetpu" or "cpu".
+		CameraMetrics(MetricsRegistry& registry, const std::string& device);
+
+		//Reads what `grabber` captured and dropped, the frames waiting in `queue` and the
+		//buffers of `pool` in use whenever the registry renders. All three must outlive
+		//the exporter of the registry.
+		void WatchCapture(const FrameGrabber& grabber, const FramePool& pool, const SpscQueue<FrameHandle>& queue);
+
+		//Time the device spent on one inference.
+		void RecordInference(uint64_t us) {
+			inference_us->Record(us);
+			device_busy_us->Increment(us);
+		}
+		//A result was published for a frame captured at `capture_time_us`.
+		void RecordResult(int64_t capture_time_us) {
+			frames_inferred->Increment();
+			frame_latency_us->Record(static_cast<uint64_t>(std::max<int64_t>(0, SteadyNowMicros() - capture_time_us)));
+		}
+
+		//Captured frames dropped unprocessed because a newer one was already waiting.
+		Counter* frames_skipped;
+		//Frames dropped unprocessed because they could no longer make the latency budget.
+		Counter* frames_late;
+		Counter* frames_inferred;
+		Histogram* preprocess_us;
+		Histogram* inference_us;
+		Histogram* postprocess_us;
+		Histogram* publish_us;
+		//From capture to the published result.
+		Histogram* frame_latency_us;
+		Counter* device_busy_us;
+		//Frames pushed into a pipeline whose results are still outstanding.
+		Gauge* frames_in_flight;
+
+	private:
+		MetricsRegistry& m_registry;
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_CAMERA_METRICS_H
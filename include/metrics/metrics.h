@@ -0,0 +1,107 @@
+//
+// Counters, gauges and latency histograms for long running processes, rendered in the
+// Prometheus text exposition format. Metrics are registered once up front and updated
+// through the returned pointers with relaxed atomics only, so hot paths never lock;
+// the registry lock is only taken to register and to render.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_METRICS_H
+#define EGDETPU_VIDEO_INFERENCE_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "latency_histogram.h"
+
+namespace edge {
+	//Label names and values of one series, e.g. {{"stage", "inference"}}.
+	typedef std::vector<std::pair<std::string, std::string>> MetricLabels;
+
+	//A monotonic count of integer units, rendered multiplied by the scale it was
+	//registered with, e.g. microseconds rendered as seconds.
+	class Counter {
+	public:
+		void Increment(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+		uint64_t Value() const { return m_value.load(std::memory_order_relaxed); }
+
+	private:
+		std::atomic<uint64_t> m_value{0};
+	};
+
+	class Gauge {
+	public:
+		void Set(double value);
+		void Add(double delta);
+		double Value() const;
+
+	private:
+		// The bits of a double, std::atomic<double> has no fetch_add before C++20.
+		std::atomic<uint64_t> m_bits{0};
+	};
+
+	//Integer durations bucketed like LatencyHistogram, exported with one Prometheus
+	//bucket per power of two.
+	class Histogram {
+	public:
+		void Record(uint64_t value) {
+			m_buckets[LatencyHistogram::BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+			m_sum.fetch_add(value, std::memory_order_relaxed);
+		}
+		uint64_t BucketCount(int index) const { return m_buckets[index].load(std::memory_order_relaxed); }
+		uint64_t Sum() const { return m_sum.load(std::memory_order_relaxed); }
+
+	private:
+		std::array<std::atomic<uint64_t>, LatencyHistogram::kNumBuckets> m_buckets{};
+		std::atomic<uint64_t> m_sum{0};
+	};
+
+	class MetricsRegistry {
+	public:
+		MetricsRegistry();
+		~MetricsRegistry();
+
+		MetricsRegistry(const MetricsRegistry&) = delete;
+		MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+		//Registers a series of the family `name`; series of one family share its help text
+		//and type. The pointers stay valid for the lifetime of the registry. Registering a
+		//name again with another type aborts.
+		Counter* AddCounter(const std::string& name, const std::string& help, const MetricLabels& labels = {},
+		                    double scale = 1.0);
+		Gauge* AddGauge(const std::string& name, const std::string& help, const MetricLabels& labels = {});
+		Histogram* AddHistogram(const std::string& name, const std::string& help, const MetricLabels& labels = {},
+		                        double scale = 1.0);
+		//Series whose value is read from `read` at render time, for totals another class
+		//already keeps. Whatever `read` uses must outlive every Render call.
+		void AddCounterFunction(const std::string& name, const std::string& help, const MetricLabels& labels,
+		                        std::function<double()> read);
+		void AddGaugeFunction(const std::string& name, const std::string& help, const MetricLabels& labels,
+		                      std::function<double()> read);
+		//A gauge of the rate of `counter` per second since the previous render, times
+		//`scale`, e.g. the utilization of a device from its busy microseconds.
+		void AddRateGauge(const std::string& name, const std::string& help, const MetricLabels& labels,
+		                  const Counter* counter, double scale);
+
+		//All series in the Prometheus text format, version 0.0.4.
+		std::string Render() const;
+
+	private:
+		enum Type { kCounter, kGauge, kHistogram };
+		struct Family;
+		struct Series;
+
+		Series& AddSeries(const std::string& name, const std::string& help, Type type, const MetricLabels& labels);
+
+		mutable std::mutex m_mutex;
+		std::vector<std::unique_ptr<Family>> m_families;
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_METRICS_H
@@ -0,0 +1,47 @@
+//
+// Publishes a MetricsRegistry for a Prometheus scraper: rewritten to a file every
+// interval, e.g. for the node exporter textfile collector, and/or served over HTTP on
+// localhost. Rendering happens on the exporter's thread, never on the caller's.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_METRICS_EXPORTER_H
+#define EGDETPU_VIDEO_INFERENCE_METRICS_EXPORTER_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "metrics.h"
+
+namespace edge {
+	class MetricsExporter {
+	public:
+		//`file_path` empty and `port` 0 disable the file and the endpoint respectively.
+		MetricsExporter(const MetricsRegistry& registry, const std::string& file_path, int port,
+		                int file_interval_ms = 1000);
+		~MetricsExporter();
+
+		MetricsExporter(const MetricsExporter&) = delete;
+		MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+		//Binds the endpoint and starts the thread. False if the port cannot be bound.
+		bool Start();
+		//Writes the file a last time and stops serving.
+		void Stop();
+
+	private:
+		void ExportLoop();
+		bool WriteFile() const;
+		void ServeConnection(int client) const;
+
+		const MetricsRegistry& m_registry;
+		std::string m_file_path;
+		int m_port;
+		int m_file_interval_ms;
+		int m_listen_fd;
+		std::thread m_thread;
+		std::atomic<bool> m_running;
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_METRICS_EXPORTER_H
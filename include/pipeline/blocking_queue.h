@@ -0,0 +1,76 @@
+//
+// Bounded blocking queue used between pipeline stages that spend most of their
+// time waiting on an accelerator.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_BLOCKING_QUEUE_H
+#define EGDETPU_VIDEO_INFERENCE_BLOCKING_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace edge {
+	template <typename T>
+	class BlockingQueue {
+	public:
+		explicit BlockingQueue(size_t capacity) : m_capacity(capacity), m_closed(false) {}
+
+		BlockingQueue(const BlockingQueue&) = delete;
+		BlockingQueue& operator=(const BlockingQueue&) = delete;
+
+		//Blocks while the queue is full. Returns false if the queue was closed.
+		bool Push(const T& item) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_not_full.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+			if (m_closed) return false;
+			m_items.push_back(item);
+			m_not_empty.notify_one();
+			return true;
+		}
+
+		//Like Push but never blocks. Returns false if the queue is full or closed.
+		bool TryPush(const T& item) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_closed || m_items.size() >= m_capacity) return false;
+			m_items.push_back(item);
+			m_not_empty.notify_one();
+			return true;
+		}
+
+		//Blocks while the queue is empty. Returns false once the queue is closed and drained.
+		bool Pop(T* item) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_not_empty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+			if (m_items.empty()) return false;
+			*item = m_items.front();
+			m_items.pop_front();
+			m_not_full.notify_one();
+			return true;
+		}
+
+		//Wakes every waiting thread; subsequent pushes fail.
+		void Close() {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_closed = true;
+			m_not_empty.notify_all();
+			m_not_full.notify_all();
+		}
+
+		size_t Size() {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_items.size();
+		}
+
+	private:
+		const size_t m_capacity;
+		std::deque<T> m_items;
+		std::mutex m_mutex;
+		std::condition_variable m_not_empty;
+		std::condition_variable m_not_full;
+		bool m_closed;
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_BLOCKING_QUEUE_H
@@ -0,0 +1,111 @@
+//
+// Runs a model compiled into N segments (edgetpu_compiler --num_segments) as a
+// pipeline with one segment per Edge TPU. Each segment has its own thread and the
+// intermediate tensors travel between them through bounded queues, so throughput
+// approaches that of the slowest segment. Optionally the PoseNet decoder gets a CPU
+// stage of its own behind the last segment, which also pipelines a single model.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_SEGMENTED_PIPELINE_H
+#define EGDETPU_VIDEO_INFERENCE_SEGMENTED_PIPELINE_H
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blocking_queue.h"
+#include "engine.h"
+#include "input_adapter.h"
+
+namespace edge {
+	//Raw tensor bytes flowing between two segments.
+	struct SegmentTensors {
+		std::vector<std::vector<uint8_t>> tensors;
+	};
+
+	class SegmentedPipeline {
+	public:
+		//Segment i runs on edgetpu_contexts[i]. With `edgetpu` false (or fewer devices than
+		//segments) the remaining segments use CPU interpreters, which is handy for testing.
+		//With `decode_stage` the PosenetDecoderOp of the last segment decodes on a thread of
+		//its own, so the Edge TPU runs the next frame meanwhile instead of waiting for the
+		//CPU; the outputs are the same.
+		SegmentedPipeline(const std::vector<std::string>& segment_paths,
+		                  const std::vector<std::shared_ptr<edgetpu::EdgeTpuContext>>& edgetpu_contexts,
+		                  const bool edgetpu, const size_t queue_depth = 2, const bool decode_stage = false);
+		~SegmentedPipeline();
+
+		SegmentedPipeline(const SegmentedPipeline&) = delete;
+		SegmentedPipeline& operator=(const SegmentedPipeline&) = delete;
+
+		// Exposes the input tensor shape of the first segment.
+		std::vector<int> GetInputShape();
+		// Number of floats per output tensor of the last segment.
+		const std::vector<size_t>& GetOutputShape() const;
+		size_t NumSegments() const { return m_segments.size(); }
+		//Threads a frame passes through, the segments and the decode stage if there is one.
+		size_t NumStages() const { return m_segments.size() + (m_decode_stage ? 1 : 0); }
+		//Decodes poses in parallel if the last segment has the PosenetDecoderOp, see
+		//Engine::SetPosenetDecoderPool. Call before the first Push.
+		bool SetPosenetDecoderPool(WorkerPool* pool) { return m_segments.back()->SetPosenetDecoderPool(pool); }
+		//Reads and overrides the decoder parameters of the last segment, see
+		//Engine::SetPosenetDecoderParams. Call while no frame is in flight.
+		bool GetPosenetDecoderParams(coral::PosenetDecoderParams* params) {
+			return m_segments.back()->GetPosenetDecoderParams(params);
+		}
+		bool SetPosenetDecoderParams(const coral::PosenetDecoderParams& params) {
+			return m_segments.back()->SetPosenetDecoderParams(params);
+		}
+
+		//Queues uint8 pixels for the first segment, one per element of its input tensor,
+		//and blocks while the pipeline is full. False if the size does not match, the
+		//input tensor type is not supported or the pipeline stopped.
+		bool Push(const std::vector<uint8_t>& input_data);
+		//Blocks until the oldest input has passed through every segment and returns its
+		//outputs concatenated and dequantized as Engine::RunInference does.
+		bool Pop(std::vector<float>* output_data);
+		//Stops all segment threads, pending inputs are discarded.
+		void Stop();
+
+	private:
+		typedef BlockingQueue<SegmentTensors*> TensorQueue;
+
+		// Dequantizes one result tensor, see Engine::OutputReader.
+		struct ResultReader {
+			OutputReadFn read;
+			size_t count;
+			float scale;
+			int32_t zero_point;
+		};
+
+		// Defers the decoder of the last segment to DecodeLoop, false if it has none or the
+		// model has outputs besides the decoder's.
+		bool SplitDecoder();
+		void SegmentLoop(size_t segment);
+		void DecodeLoop();
+
+		std::vector<std::unique_ptr<Engine>> m_segments;
+		// Converts the pixels of a frame into the first segment's input tensor, which need
+		// not be uint8. Only the thread of segment 0 applies it.
+		InputAdapter m_input_adapter;
+		size_t m_input_pixels = 0;
+		// m_input_map[i][j] is the output of segment i-1 feeding input j of segment i.
+		std::vector<std::vector<int>> m_input_map;
+		// m_queues[i] feeds segment i, the last one holds the pipeline results. Buffers
+		// are recycled through m_free_buffers[i] so steady state does not allocate.
+		std::vector<std::unique_ptr<TensorQueue>> m_queues;
+		std::vector<std::unique_ptr<TensorQueue>> m_free_buffers;
+		std::vector<std::unique_ptr<SegmentTensors>> m_storage;
+		std::vector<std::thread> m_threads;
+		std::vector<ResultReader> m_result_readers;
+		size_t m_result_size = 0;
+		// With a decode stage the last segment forwards the decoder inputs, and decoder
+		// output k is result tensor m_decoder_output_positions[k].
+		bool m_decode_stage = false;
+		std::vector<int> m_decoder_inputs;
+		std::vector<int> m_decoder_output_positions;
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_SEGMENTED_PIPELINE_H
@@ -0,0 +1,210 @@
+//
+// Versioned binary format for per-frame results, a writer that streams records to a file
+// without assembling them in memory and a memory-mapped reader that hands out views into
+// the file, so recordings of many hours can be scanned without parsing or copying.
+//
+// Layout, all integers little endian:
+//   RecordFileHeader
+//   record*   each record is a RecordHeader followed by, in this order, the detections,
+//             faces, poses, keypoints, classes, face classes and string bytes of the frame,
+//             zero padded so the next record starts at a multiple of kRecordAlignment.
+//
+// Readers accept every version up to kRecordVersion. New fields are only ever appended
+// to RecordHeader, its size is stored in the file header.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_RESULT_RECORD_H
+#define EGDETPU_VIDEO_INFERENCE_RESULT_RECORD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace edge {
+	constexpr uint32_t kRecordMagic = 0x52474445;  // "EDGR"
+	constexpr uint16_t kRecordVersion = 1;
+	constexpr uint32_t kRecordAlignment = 8;
+
+	struct RecordFileHeader {
+		uint32_t magic;
+		uint16_t version;
+		uint16_t file_header_size;
+		uint16_t record_header_size;
+		uint16_t reserved0;
+		uint32_t reserved1;
+	};
+
+	struct RecordHeader {
+		// Size of the whole record including this header and the padding.
+		uint32_t size;
+		uint32_t num_detections;
+		uint64_t frame_id;
+		int64_t timestamp_us;
+		int32_t width;
+		int32_t height;
+		uint32_t num_faces;
+		uint32_t num_poses;
+		uint32_t num_keypoints;
+		uint32_t num_classes;
+		uint32_t num_face_classes;
+		uint32_t string_bytes;
+	};
+
+	//Box normalized to [0, 1], label in the record's string bytes.
+	struct DetectionRecord {
+		float score;
+		float x1;
+		float y1;
+		float x2;
+		float y2;
+		uint32_t label_offset;
+		uint32_t label_size;
+	};
+
+	//Box in frame pixels. Its classes are face_classes[first_class, first_class + num_classes).
+	struct FaceRecord {
+		float score;
+		int32_t x;
+		int32_t y;
+		int32_t width;
+		int32_t height;
+		uint32_t first_class;
+		uint32_t num_classes;
+	};
+
+	//Keypoints are keypoints[first_keypoint, first_keypoint + num_keypoints).
+	struct PoseRecord {
+		uint32_t first_keypoint;
+		uint32_t num_keypoints;
+	};
+
+	//Position in frame pixels.
+	struct KeypointRecord {
+		float x;
+		float y;
+		float score;
+	};
+
+	struct ClassRecord {
+		float score;
+		uint32_t label_offset;
+		uint32_t label_size;
+	};
+
+	static_assert(sizeof(RecordFileHeader) == 16, "RecordFileHeader must be packed");
+	static_assert(sizeof(RecordHeader) == 56, "RecordHeader must be packed");
+	static_assert(sizeof(DetectionRecord) == 28, "DetectionRecord must be packed");
+	static_assert(sizeof(FaceRecord) == 28, "FaceRecord must be packed");
+	static_assert(sizeof(PoseRecord) == 8, "PoseRecord must be packed");
+	static_assert(sizeof(KeypointRecord) == 12, "KeypointRecord must be packed");
+	static_assert(sizeof(ClassRecord) == 12, "ClassRecord must be packed");
+
+	//Appends records to a file. The sections of a frame are collected in buffers that are
+	//reused from frame to frame and handed to the kernel with a single writev, so steady
+	//state writing neither allocates nor copies the record into one block.
+	class RecordWriter {
+	public:
+		RecordWriter() = default;
+		~RecordWriter();
+
+		RecordWriter(const RecordWriter&) = delete;
+		RecordWriter& operator=(const RecordWriter&) = delete;
+
+		//Truncates `path` and writes the file header. Returns false on failure.
+		bool Open(const std::string& path);
+		void Close();
+		bool IsOpen() const { return m_fd >= 0; }
+
+		void BeginFrame(uint64_t frame_id, int64_t timestamp_us, int width, int height);
+		void AddDetection(const std::string& label, float score, float x1, float y1, float x2, float y2);
+		void AddFace(float score, int x, int y, int width, int height);
+		//Adds a class to the face added last.
+		void AddFaceClass(const std::string& label, float score);
+		void AddPose();
+		//Adds a keypoint to the pose added last.
+		void AddKeypoint(float x, float y, float score);
+		void AddClass(const std::string& label, float score);
+		//Writes the frame started by BeginFrame. Returns false if the write failed.
+		bool EndFrame();
+
+	private:
+		uint32_t AddString(const std::string& text);
+
+		int m_fd = -1;
+		RecordHeader m_header;
+		std::vector<DetectionRecord> m_detections;
+		std::vector<FaceRecord> m_faces;
+		std::vector<PoseRecord> m_poses;
+		std::vector<KeypointRecord> m_keypoints;
+		std::vector<ClassRecord> m_classes;
+		std::vector<ClassRecord> m_face_classes;
+		std::vector<char> m_strings;
+	};
+
+	//Non-owning view of one record, valid as long as the RecordReader it came from is open.
+	class RecordView {
+	public:
+		const RecordHeader& header() const { return *m_header; }
+		uint64_t frame_id() const { return m_header->frame_id; }
+		int64_t timestamp_us() const { return m_header->timestamp_us; }
+
+		const DetectionRecord* detections() const { return m_detections; }
+		const FaceRecord* faces() const { return m_faces; }
+		const PoseRecord* poses() const { return m_poses; }
+		const KeypointRecord* keypoints() const { return m_keypoints; }
+		const ClassRecord* classes() const { return m_classes; }
+		const ClassRecord* face_classes() const { return m_face_classes; }
+
+		std::string Label(uint32_t offset, uint32_t size) const { return std::string(m_strings + offset, size); }
+		const char* Strings() const { return m_strings; }
+
+	private:
+		friend class RecordReader;
+
+		const RecordHeader* m_header = nullptr;
+		const DetectionRecord* m_detections = nullptr;
+		const FaceRecord* m_faces = nullptr;
+		const PoseRecord* m_poses = nullptr;
+		const KeypointRecord* m_keypoints = nullptr;
+		const ClassRecord* m_classes = nullptr;
+		const ClassRecord* m_face_classes = nullptr;
+		const char* m_strings = nullptr;
+	};
+
+	//Maps a record file and iterates over its records in file order.
+	class RecordReader {
+	public:
+		RecordReader() = default;
+		~RecordReader();
+
+		RecordReader(const RecordReader&) = delete;
+		RecordReader& operator=(const RecordReader&) = delete;
+
+		//Returns false if the file can not be mapped or is not a supported record file.
+		bool Open(const std::string& path);
+		void Close();
+
+		//Points `view` at the next record. Returns false at the end of the file or at a
+		//record that is cut short or inconsistent, see Truncated().
+		bool Next(RecordView* view);
+		void Rewind() { m_offset = m_first_record; }
+
+		//True if iteration stopped before the end of the file, e.g. because the writer
+		//was killed in the middle of a record.
+		bool Truncated() const { return m_truncated; }
+		uint16_t Version() const { return m_version; }
+		size_t FileSize() const { return m_size; }
+
+	private:
+		const uint8_t* m_data = nullptr;
+		size_t m_size = 0;
+		size_t m_first_record = 0;
+		size_t m_offset = 0;
+		size_t m_record_header_size = 0;
+		uint16_t m_version = 0;
+		bool m_truncated = false;
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_RESULT_RECORD_H
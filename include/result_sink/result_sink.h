@@ -0,0 +1,150 @@
+//
+// Pluggable consumers of per-frame results. They replace the cv::imshow/cv::waitKey
+// calls on the inference loop: every sink runs on its own thread, so writing JSON,
+// records or video and rendering never delay the next inference.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_RESULT_SINK_H
+#define EGDETPU_VIDEO_INFERENCE_RESULT_SINK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blocking_queue.h"
+#include "cascade_engine.h"
+#include "classification_engine.h"
+#include "detection_engine.h"
+#include "humanpose_engine.h"
+#include "opencv2/opencv.hpp"
+#include "result_record.h"
+
+namespace edge {
+	//Everything one frame produced. Detection boxes are normalized to [0, 1] as returned
+	//by DetectionEngine, faces and pose keypoints are in frame pixels.
+	struct FrameResult {
+		uint64_t frame_id = 0;
+		int64_t timestamp_us = 0;
+		int width = 0;
+		int height = 0;
+		std::vector<DetectionCandidate> detections;
+		std::vector<CascadeCandidate> faces;
+		std::vector<PoseCandidate> poses;
+		// Keypoints scoring below this are not drawn.
+		float keypoint_threshold = 0.0f;
+		std::vector<ClassificationCandidate> classes;
+		// Only filled for sinks that render, see ResultSink::WantsFrame.
+		cv::Mat frame;
+	};
+
+	class ResultSink {
+	public:
+		virtual ~ResultSink() = default;
+		virtual void Consume(const FrameResult& result) = 0;
+		//Sinks returning true receive a copy of the camera frame with every result. The copy
+		//is shared by all sinks and must not be drawn on.
+		virtual bool WantsFrame() const { return false; }
+		//Set by interactive sinks when the user asked to quit.
+		virtual bool QuitRequested() const { return false; }
+	};
+
+	//Writes one JSON object per frame to a file, or to stdout for path "-".
+	class JsonLinesSink : public ResultSink {
+	public:
+		explicit JsonLinesSink(const std::string& path);
+		~JsonLinesSink() override;
+		void Consume(const FrameResult& result) override;
+
+	private:
+		FILE* m_file;
+		bool m_owns_file;
+		std::string m_line;
+	};
+
+	//Writes every result in the binary record format of result_record.h.
+	class BinaryRecordSink : public ResultSink {
+	public:
+		explicit BinaryRecordSink(const std::string& path);
+		void Consume(const FrameResult& result) override;
+
+	private:
+		RecordWriter m_writer;
+	};
+
+	//Draws the results on the frame and writes them to a video file.
+	class VideoWriterSink : public ResultSink {
+	public:
+		VideoWriterSink(const std::string& path, double fps);
+		void Consume(const FrameResult& result) override;
+		bool WantsFrame() const override { return true; }
+
+	private:
+		std::string m_path;
+		double m_fps;
+		cv::VideoWriter m_writer;
+		// Frame with the overlays drawn, reused across frames.
+		cv::Mat m_canvas;
+	};
+
+	//Draws the results and shows them in a window. ESC requests quitting.
+	class DisplaySink : public ResultSink {
+	public:
+		explicit DisplaySink(const std::string& window_name);
+		void Consume(const FrameResult& result) override;
+		bool WantsFrame() const override { return true; }
+		bool QuitRequested() const override { return m_quit.load(); }
+
+	private:
+		std::string m_window_name;
+		std::atomic<bool> m_quit;
+		// Frame with the overlays drawn, reused across frames.
+		cv::Mat m_canvas;
+	};
+
+	//Draws every kind of result contained in `result` onto `frame`.
+	void DrawFrameResult(cv::Mat& frame, const FrameResult& result);
+
+	//Fans results out to sinks, each on its own thread with its own bounded queue.
+	class ResultDispatcher {
+	public:
+		ResultDispatcher() = default;
+		~ResultDispatcher();
+
+		ResultDispatcher(const ResultDispatcher&) = delete;
+		ResultDispatcher& operator=(const ResultDispatcher&) = delete;
+
+		//With `drop_when_full` a slow sink loses results instead of back-pressuring the
+		//inference loop; use it for rendering, not for data sinks.
+		void Add(std::unique_ptr<ResultSink> sink, bool drop_when_full, size_t queue_depth = 8);
+		//Hands `result` to every sink. The frame is only copied if a sink renders it and
+		//result.frame was not filled by the caller already.
+		void Publish(FrameResult& result, const cv::Mat& frame);
+		//True if any sink renders frames, so callers can skip producing them.
+		bool WantsFrame() const;
+		bool QuitRequested() const;
+		bool Empty() const { return m_workers.empty(); }
+		//Flushes the queues and joins the sink threads.
+		void Stop();
+
+	private:
+		struct Worker {
+			std::unique_ptr<ResultSink> sink;
+			std::unique_ptr<BlockingQueue<std::shared_ptr<const FrameResult>>> queue;
+			bool drop_when_full;
+			std::thread thread;
+		};
+		std::vector<std::unique_ptr<Worker>> m_workers;
+	};
+
+	//Builds the dispatcher the camera apps use from their command line options. Empty
+	//paths disable the corresponding sink; without `headless` results are also displayed.
+	std::unique_ptr<ResultDispatcher> MakeResultDispatcher(const bool headless, const std::string& window_name,
+	                                                       const std::string& json_path, const std::string& record_path,
+	                                                       const std::string& video_path, const double fps);
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_RESULT_SINK_H
@@ -0,0 +1,151 @@
+//
+// Compact recording of raw, still quantized tensors per inference, used to replay the
+// postprocessing of a model without a camera, a model file or an interpreter.
+//
+// Layout, all integers little endian:
+//   TensorFileHeader
+//   metadata  "key=value\n" lines, e.g. the decoder parameters baked into the model,
+//             zero padded to a multiple of kTensorRecordAlignment
+//   frame*    a TensorFrameHeader followed by num_tensors times a TensorHeader, the
+//             tensor name and the tensor bytes, name and bytes each zero padded to a
+//             multiple of kTensorRecordAlignment so the tensor data is aligned
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_TENSOR_RECORD_H
+#define EGDETPU_VIDEO_INFERENCE_TENSOR_RECORD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace edge {
+	constexpr uint32_t kTensorRecordMagic = 0x54474445;  // "EDGT"
+	constexpr uint16_t kTensorRecordVersion = 1;
+	constexpr uint32_t kTensorRecordAlignment = 8;
+	constexpr int kTensorRecordMaxDims = 6;
+
+	//What the recorded tensors are, tells the replay which decoder to run.
+	enum class TensorStream : uint16_t {
+		// The output tensors of the model, as RunInference sees them.
+		kModelOutputs = 1,
+		// The heatmaps, short and mid offsets entering the PosenetDecoderOp.
+		kPosenetDecoderInputs = 2,
+	};
+
+	struct TensorFileHeader {
+		uint32_t magic;
+		uint16_t version;
+		uint16_t stream;
+		uint32_t metadata_size;
+		uint32_t reserved;
+	};
+
+	struct TensorFrameHeader {
+		// Size of the whole frame including this header and the padding.
+		uint32_t size;
+		uint32_t num_tensors;
+		uint64_t frame_index;
+	};
+
+	struct TensorHeader {
+		// A TfLiteType value.
+		int32_t type;
+		int32_t zero_point;
+		float scale;
+		uint32_t num_dims;
+		int32_t dims[kTensorRecordMaxDims];
+		uint32_t name_size;
+		uint32_t byte_size;
+	};
+
+	static_assert(sizeof(TensorFileHeader) == 16, "TensorFileHeader must be packed");
+	static_assert(sizeof(TensorFrameHeader) == 16, "TensorFrameHeader must be packed");
+	static_assert(sizeof(TensorHeader) == 48, "TensorHeader must be packed");
+
+	//Non-owning view of one recorded tensor, valid as long as its reader is open.
+	struct TensorView {
+		const TensorHeader* header;
+		const char* name;
+		const uint8_t* data;
+
+		size_t NumElements() const;
+		std::string Name() const { return std::string(name, header->name_size); }
+	};
+
+	//Dequantizes a uint8 or float32 tensor the way Engine::RunInference does.
+	void DequantizeTensorView(const TensorView& tensor, std::vector<float>* out);
+
+	//Appends frames of tensors to a file, one writev per frame. The tensor bytes are
+	//written straight from the interpreter's buffers.
+	class TensorRecordWriter {
+	public:
+		TensorRecordWriter() = default;
+		~TensorRecordWriter();
+
+		TensorRecordWriter(const TensorRecordWriter&) = delete;
+		TensorRecordWriter& operator=(const TensorRecordWriter&) = delete;
+
+		//Truncates `path` and writes the header and metadata. Returns false on failure.
+		bool Open(const std::string& path, TensorStream stream, const std::map<std::string, std::string>& metadata);
+		void Close();
+		bool IsOpen() const { return m_fd >= 0; }
+
+		void BeginFrame();
+		//`data` must stay valid until EndFrame.
+		void AddTensor(const std::string& name, int type, const int* dims, int num_dims, float scale, int zero_point,
+		               const void* data, size_t byte_size);
+		bool EndFrame();
+
+	private:
+		struct PendingTensor {
+			TensorHeader header;
+			const void* data;
+		};
+
+		int m_fd = -1;
+		uint64_t m_frame_index = 0;
+		TensorFrameHeader m_frame_header;
+		std::vector<PendingTensor> m_tensors;
+		// Names of m_tensors, the strings are reused from frame to frame.
+		std::vector<std::string> m_names;
+		size_t m_num_tensors = 0;
+	};
+
+	//Maps a tensor recording and iterates over its frames in file order.
+	class TensorRecordReader {
+	public:
+		TensorRecordReader() = default;
+		~TensorRecordReader();
+
+		TensorRecordReader(const TensorRecordReader&) = delete;
+		TensorRecordReader& operator=(const TensorRecordReader&) = delete;
+
+		//Returns false if the file can not be mapped or is not a supported recording.
+		bool Open(const std::string& path);
+		void Close();
+
+		TensorStream Stream() const { return m_stream; }
+		const std::map<std::string, std::string>& Metadata() const { return m_metadata; }
+		//Returns the metadata value of `key`, `fallback` if it was not recorded.
+		std::string GetMetadata(const std::string& key, const std::string& fallback) const;
+
+		//Fills `tensors` with the tensors of the next frame. Returns false at the end of the
+		//file or at a frame that is cut short, see Truncated().
+		bool Next(uint64_t* frame_index, std::vector<TensorView>* tensors);
+		void Rewind() { m_offset = m_first_frame; }
+		bool Truncated() const { return m_truncated; }
+
+	private:
+		const uint8_t* m_data = nullptr;
+		size_t m_size = 0;
+		size_t m_first_frame = 0;
+		size_t m_offset = 0;
+		TensorStream m_stream = TensorStream::kModelOutputs;
+		std::map<std::string, std::string> m_metadata;
+		bool m_truncated = false;
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_TENSOR_RECORD_H
@@ -10,10 +10,28 @@
 #include <string>
 
 #include "engine.h"
+#include "input_transform.h"
 #include "opencv2/opencv.hpp"
 
 namespace edge {
 
+// Turns the raw UltraFace outputs into face boxes. Needs no interpreter, so
+// recorded outputs can be decoded offline.
+class UltraFaceDecoder {
+ public:
+  void Init(const float det_score = 0.6, const float nms_iou = 0.5);
+  // `transform` is the one the input was prepared with, see GetInputFromImage.
+  std::vector<std::pair<cv::Rect, float>> Decode(const std::vector<std::vector<float> > &outputs, const cv::Size &img_size,
+                                                 const AffineTransform &transform = AffineTransform()) const;
+
+ private:
+  void NMS(std::vector<std::pair<cv::Rect, float>> &input, std::vector<std::pair<cv::Rect, float>> &output) const;
+  int iw_, ih_;
+  float th_;
+  float nms_th_;
+  std::vector<std::vector<float>> priors = {};
+};
+
 class UltraFaceEngine : public Engine {
  public:
   // Constructor that loads the model and label into the program.
@@ -23,18 +41,20 @@ class UltraFaceEngine : public Engine {
       const bool edgetpu, float score_threshold_ = 0.7,
       float iou_threshold_ = 0.3, int topk_ = -1)
       : Engine(model, edgetpu_context, edgetpu) {
+    // The model expects RGB scaled to [-1, 1).
+    InputNormalization normalization;
+    normalization.mean = 127.5f;
+    normalization.scale = 1.0f / 128.0f;
+    SetInputNormalization(normalization);
     std::cout << "Detection Engine loaded successfully" << std::endl;
   }
 
   void InitAll(const float det_score=0.6, const float nms_iou=0.5);
-  std::vector<std::pair<cv::Rect, float>> Decode(const std::vector<std::vector<float> > &outputs, const cv::Size &img_size);
+  std::vector<std::pair<cv::Rect, float>> Decode(const std::vector<std::vector<float> > &outputs, const cv::Size &img_size,
+                                                 const AffineTransform &transform = AffineTransform());
 
  private:
- void NMS(std::vector<std::pair<cv::Rect, float>> &input, std::vector<std::pair<cv::Rect, float>> &output);
-  int iw_, ih_;
-  float th_;
-  float nms_th_;
-  std::vector<std::vector<float>> priors = {};
+  UltraFaceDecoder decoder_;
 };
 }  // namespace edge
 #endif  // EGDETPU_VIDEO_INFERENCE_ULTRAFACE_ENGINE_H
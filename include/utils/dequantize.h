@@ -0,0 +1,27 @@
+//
+// Vectorized conversion of quantized tensors to float: AVX2 or SSE4.1 picked at runtime
+// on x86, NEON on ARM, and a scalar fallback. Every path computes
+// float(q - zero_point) * scale, so results do not depend on the CPU.
+//
+
+#ifndef EDGETPU_VIDEO_INFERENCE_DEQUANTIZE_H
+#define EDGETPU_VIDEO_INFERENCE_DEQUANTIZE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace edge {
+	//dst[i] = (src[i] - zero_point) * scale.
+	void DequantizeUint8(const uint8_t* src, size_t count, int32_t zero_point, float scale, float* dst);
+	void DequantizeInt8(const int8_t* src, size_t count, int32_t zero_point, float scale, float* dst);
+	void DequantizeInt16(const int16_t* src, size_t count, int32_t zero_point, float scale, float* dst);
+	//dst[i] = src[i] * scale.
+	void ScaleFloat(const float* src, size_t count, float scale, float* dst);
+
+	//The instruction set the kernels dispatch to: "avx2", "sse4.1", "neon" or "scalar".
+	const char* DequantizeIsa();
+	//Makes the kernels use the scalar path, e.g. to benchmark against it.
+	void SetDequantizeScalar(bool scalar);
+}
+
+#endif //EDGETPU_VIDEO_INFERENCE_DEQUANTIZE_H
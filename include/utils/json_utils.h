@@ -0,0 +1,17 @@
+//
+// JSON string escaping shared by the JSON lines sink and result_convert, so both write
+// byte-identical output.
+//
+
+#ifndef EDGETPU_VIDEO_INFERENCE_JSON_UTILS_H
+#define EDGETPU_VIDEO_INFERENCE_JSON_UTILS_H
+
+#include <string>
+
+namespace edge {
+	//Appends `text` to `out` as a quoted JSON string, escaping quotes, backslashes and
+	//control characters.
+	void AppendJsonString(std::string* out, const std::string& text);
+}
+
+#endif //EDGETPU_VIDEO_INFERENCE_JSON_UTILS_H
@@ -1,13 +1,55 @@
 #ifndef EDGE_LABEL_UTIL_H
 #define EDGE_LABEL_UTIL_H
 
-#include <fstream>
+#include <cstddef>
+#include <cstdint>
 #include <map>
-#include <regex>
 #include <string>
+#include <vector>
 
 namespace edge {
 
+// Non-owning view of a label, valid as long as the LabelTable it came from.
+struct LabelView {
+  const char* data;
+  size_t size;
+
+  bool empty() const { return size == 0; }
+  std::string str() const { return std::string(data, size); }
+};
+
+// Dense id-indexed label table. All label text lives in one buffer and
+// lookups are a bounds check plus an array access.
+class LabelTable {
+ public:
+  // Parses "<id> <label>" lines from a memory-mapped file. Lines without an
+  // id get their line number as id. Lines with an id above 65535 are reported
+  // and skipped. Returns false if the file is unreadable.
+  bool Load(const std::string& label_path);
+
+  // Returns an empty view for ids without a label.
+  LabelView Get(int id) const;
+  // Like std::map::at, throws std::out_of_range for ids without a label.
+  LabelView at(int id) const;
+
+  bool contains(int id) const;
+  size_t size() const { return m_count; }
+  bool empty() const { return m_count == 0; }
+  // One past the largest id in the table.
+  size_t capacity() const { return m_offsets.size(); }
+
+ private:
+  void Parse(const char* begin, const char* end);
+
+  static constexpr uint32_t kMissing = 0xffffffffu;
+  std::string m_text;
+  std::vector<uint32_t> m_offsets;
+  std::vector<uint32_t> m_lengths;
+  size_t m_count = 0;
+};
+
+LabelTable ParseLabelTable(const std::string& label_path);
+
 std::map<int, std::string> ParseLabel(const std::string& label_path);
 
 }  // namespace edge
@@ -0,0 +1,52 @@
+//
+// A persistent pool of worker threads for splitting per-frame work without
+// creating threads on every frame.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_WORKER_POOL_H
+#define EGDETPU_VIDEO_INFERENCE_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace edge {
+	class WorkerPool {
+	public:
+		explicit WorkerPool(int num_threads);
+		~WorkerPool();
+
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+
+		int NumThreads() const { return static_cast<int>(m_threads.size()); }
+
+		//Runs fn(task, worker) for every task in [0, num_tasks) and blocks until all are done.
+		//`worker` is the stable index of the thread running the task, so callers can keep
+		//per-worker state such as an interpreter or a scratch buffer. Concurrent callers are
+		//served one batch after another.
+		void ParallelFor(int num_tasks, const std::function<void(int task, int worker)>& fn);
+
+	private:
+		void WorkerLoop(int worker);
+
+		std::vector<std::thread> m_threads;
+		// Held for a whole ParallelFor: waiting for the workers releases m_mutex, which must
+		// not let a second caller replace the batch they are running.
+		std::mutex m_call_mutex;
+		std::mutex m_mutex;
+		std::condition_variable m_work_cv;
+		std::condition_variable m_done_cv;
+		const std::function<void(int, int)>* m_fn;
+		int m_num_tasks;
+		std::atomic<int> m_next_task;
+		int m_active_workers;
+		unsigned m_generation;
+		bool m_stop;
+	};
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_WORKER_POOL_H
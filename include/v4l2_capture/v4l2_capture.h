@@ -0,0 +1,128 @@
+//
+// Camera capture that hands out the driver's own buffers. V4l2Capture streams YUYV,
+// NV12, NV21 or I420 frames into mmap'ed V4L2 buffers, optionally exported as DMABUF file descriptors
+// for other devices, and the caller reads them in place before queueing them back.
+// FileCaptureSource plays a raw YUV file through the same interface, for tests and
+// for machines without a camera.
+//
+
+#ifndef EGDETPU_VIDEO_INFERENCE_V4L2_CAPTURE_H
+#define EGDETPU_VIDEO_INFERENCE_V4L2_CAPTURE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "yuv_prep.h"
+
+namespace edge {
+	//A captured frame still owned by its CaptureSource, valid until Requeue.
+	struct CapturedBuffer {
+		int index = -1;
+		YuvImage image;
+		// DMABUF file descriptor of the buffer, -1 if it was not exported.
+		int dmabuf_fd = -1;
+		uint64_t sequence = 0;
+		int64_t timestamp_us = 0;
+	};
+
+	class CaptureSource {
+	public:
+		virtual ~CaptureSource() = default;
+		virtual bool Start() = 0;
+		virtual void Stop() = 0;
+		//Waits for the next frame. Returns false on error, timeout or end of stream.
+		virtual bool Dequeue(CapturedBuffer* buffer) = 0;
+		//Gives the buffer back to the source for the next capture.
+		virtual void Requeue(const CapturedBuffer& buffer) = 0;
+
+		virtual int Width() const = 0;
+		virtual int Height() const = 0;
+		virtual PixelFormat Format() const = 0;
+	};
+
+	class V4l2Capture : public CaptureSource {
+	public:
+		//The driver may adjust width and height, see Width() and Height() after Start().
+		V4l2Capture(const std::string& device, int width, int height, PixelFormat format, int num_buffers = 4,
+		            bool export_dmabuf = false);
+		~V4l2Capture() override;
+
+		V4l2Capture(const V4l2Capture&) = delete;
+		V4l2Capture& operator=(const V4l2Capture&) = delete;
+
+		bool Start() override;
+		void Stop() override;
+		bool Dequeue(CapturedBuffer* buffer) override;
+		void Requeue(const CapturedBuffer& buffer) override;
+
+		int Width() const override { return m_width; }
+		int Height() const override { return m_height; }
+		PixelFormat Format() const override { return m_format; }
+
+	private:
+		struct MappedBuffer {
+			void* data;
+			size_t length;
+			int dmabuf_fd;
+		};
+
+		bool Configure();
+		bool MapBuffers();
+
+		std::string m_device;
+		int m_width;
+		int m_height;
+		PixelFormat m_format;
+		int m_num_buffers;
+		bool m_export_dmabuf;
+		int m_fd;
+		int m_bytes_per_line;
+		bool m_streaming;
+		std::vector<MappedBuffer> m_buffers;
+	};
+
+	//Plays a file of raw, tightly packed frames, e.g. written by
+	//`ffmpeg -i in.mp4 -pix_fmt nv12 -f rawvideo out.nv12`. Frames are read in place
+	//from a memory mapping of the file.
+	class FileCaptureSource : public CaptureSource {
+	public:
+		//`fps` 0 delivers frames as fast as they are requested. With `loop` the file
+		//restarts at its end instead of ending the stream.
+		FileCaptureSource(const std::string& path, int width, int height, PixelFormat format, double fps = 0,
+		                  bool loop = false);
+		~FileCaptureSource() override;
+
+		FileCaptureSource(const FileCaptureSource&) = delete;
+		FileCaptureSource& operator=(const FileCaptureSource&) = delete;
+
+		bool Start() override;
+		void Stop() override;
+		bool Dequeue(CapturedBuffer* buffer) override;
+		void Requeue(const CapturedBuffer&) override {}
+
+		int Width() const override { return m_width; }
+		int Height() const override { return m_height; }
+		PixelFormat Format() const override { return m_format; }
+		size_t NumFrames() const { return m_num_frames; }
+
+	private:
+		std::string m_path;
+		int m_width;
+		int m_height;
+		PixelFormat m_format;
+		double m_fps;
+		bool m_loop;
+		const uint8_t* m_data;
+		size_t m_size;
+		size_t m_frame_size;
+		size_t m_num_frames;
+		uint64_t m_sequence;
+		int64_t m_start_us;
+	};
+
+	//Parses "yuyv", "nv12", "nv21" or "i420". Returns false for unknown names.
+	bool ParsePixelFormat(const std::string& name, PixelFormat* format);
+}
+
+#endif //EGDETPU_VIDEO_INFERENCE_V4L2_CAPTURE_H
@@ -0,0 +1 @@
+bin/k8/humanpose_camera --adaptive_model_paths test_data/pose_estimation/posenet_mobilenet_v1_075_353_481_quant_decoder_edgetpu.tflite,test_data/pose_estimation/posenet_mobilenet_v1_075_481_641_quant_decoder_edgetpu.tflite,test_data/pose_estimation/posenet_mobilenet_v1_075_721_1281_quant_decoder_edgetpu.tflite --latency_budget_ms 33 --edgetpu --height 720 --width 1280
\ No newline at end of file
@@ -0,0 +1,113 @@
+//
+// Detector driven cascade of per-region classification.
+//
+
+#include "cascade_engine.h"
+
+#include <algorithm>
+
+namespace edge {
+	namespace {
+		// Converts a resized BGR, BGRA or gray crop into the `channels` of the model input.
+		bool ConvertChannels(const cv::Mat& crop, const int channels, cv::Mat& input) {
+			const int source = crop.channels();
+			int code = -1;
+			if (channels == 1 && source == 3) code = cv::COLOR_BGR2GRAY;
+			else if (channels == 1 && source == 4) code = cv::COLOR_BGRA2GRAY;
+			else if (channels == 3 && source == 1) code = cv::COLOR_GRAY2RGB;
+			else if (channels == 3 && source == 4) code = cv::COLOR_BGRA2RGB;
+			else if (channels == 4 && source == 1) code = cv::COLOR_GRAY2RGBA;
+			else if (channels == 4 && source == 3) code = cv::COLOR_BGR2RGBA;
+			else if (channels == 4 && source == 4) code = cv::COLOR_BGRA2RGBA;
+			else if (channels == source) {
+				crop.copyTo(input);
+				return true;
+			}
+			if (code < 0) {
+				std::cout << "Cannot feed " << source << " channel crops to a " << channels << " channel model"
+				          << std::endl;
+				return false;
+			}
+			cv::cvtColor(crop, input, code);
+			return true;
+		}
+	}
+
+	CascadeEngine::CascadeEngine(const std::string& model, const std::string& label_path,
+	                             const std::vector<std::shared_ptr<edgetpu::EdgeTpuContext>>& edgetpu_contexts,
+	                             const bool edgetpu, const int num_cpu_workers, const int max_crops_per_frame,
+	                             const float threshold)
+					: m_max_crops(std::max(max_crops_per_frame, 1)), m_threshold(threshold) {
+		if (edgetpu && !edgetpu_contexts.empty()) {
+			for (const auto& context : edgetpu_contexts) {
+				m_engines.emplace_back(new ClassificationEngine(model, label_path, context, true));
+			}
+		} else {
+			for (int i = 0; i < std::max(num_cpu_workers, 1); ++i) {
+				m_engines.emplace_back(new ClassificationEngine(model, label_path, nullptr, false));
+			}
+		}
+		m_pool.reset(new WorkerPool(static_cast<int>(m_engines.size())));
+		m_input_shape = m_engines.front()->GetInputShape();
+		m_scratch.resize(m_engines.size());
+		std::cout << "Cascade Engine loaded successfully with " << m_engines.size() << " worker(s)" << std::endl;
+	}
+
+	std::vector<CascadeCandidate> CascadeEngine::Run(const cv::Mat& frame,
+	                                                 const std::vector<std::pair<cv::Rect, float>>& detections) {
+		std::vector<std::pair<cv::Rect, float>> regions;
+		regions.reserve(detections.size());
+		const cv::Rect frame_rect(0, 0, frame.cols, frame.rows);
+		for (const auto& detection : detections) {
+			const cv::Rect roi = detection.first & frame_rect;
+			if (roi.area() > 0) regions.emplace_back(roi, detection.second);
+		}
+		// Bound the per-frame latency by only keeping the most confident regions.
+		if (static_cast<int>(regions.size()) > m_max_crops) {
+			std::partial_sort(regions.begin(), regions.begin() + m_max_crops, regions.end(),
+			                  [](const std::pair<cv::Rect, float>& a, const std::pair<cv::Rect, float>& b) {
+				                  return a.second > b.second;
+			                  });
+			regions.resize(m_max_crops);
+		}
+
+		std::vector<CascadeCandidate> ret(regions.size());
+		const int width = m_input_shape[2];
+		const int height = m_input_shape[1];
+		const int channels = m_input_shape[3];
+		m_pool->ParallelFor(static_cast<int>(regions.size()), [&](int task, int worker) {
+			// Every worker owns its engine, so the crop is written straight into that engine's
+			// input tensor; OpenCV keeps the destination storage because its size and type match.
+			ret[task].box = regions[task].first;
+			ret[task].score = regions[task].second;
+			ClassificationEngine& engine = *m_engines[worker];
+			cv::Mat input(height, width, CV_8UC(channels), engine.GetInputBuffer());
+			const cv::Mat region = frame(regions[task].first);
+			if (channels == 3 && frame.channels() == 3) {
+				cv::resize(region, input, cv::Size(width, height));
+				cv::cvtColor(input, input, cv::COLOR_BGR2RGB);
+			} else {
+				cv::Mat& scratch = m_scratch[worker];
+				cv::resize(region, scratch, cv::Size(width, height));
+				if (!ConvertChannels(scratch, channels, input)) return;
+			}
+			const auto& results = engine.RunInference();
+			ret[task].classes = engine.ClassifyWithOutputVector(results, m_threshold, false);
+		});
+		return ret;
+	}
+
+	void CascadeEngine::img_overlay(cv::Mat& frame, const std::vector<CascadeCandidate>& ret) {
+		const auto& magenta = cv::Scalar(255, 1, 127);
+		const auto& green = cv::Scalar(0, 255, 0);
+		for (const auto& candidate : ret) {
+			cv::rectangle(frame, candidate.box, magenta, 4);
+			if (!candidate.classes.empty()) {
+				const auto& top = candidate.classes.front();
+				cv::putText(frame, top.classname + " " + std::to_string(top.score),
+				            cv::Point(candidate.box.x, std::max(candidate.box.y - 5, 15)),
+				            cv::FONT_HERSHEY_TRIPLEX, 0.5, green, 1.5);
+			}
+		}
+	}
+}
@@ -9,7 +9,9 @@
 #include <string>
 
 #include "edgetpu.h"
+#include "frame_pool.h"
 #include "img_prep.h"
+#include "result_sink.h"
 #include "classification_engine.h"
 #include "cxxopts.hpp"
 #include "opencv2/opencv.hpp"
@@ -26,6 +28,10 @@ cxxopts::ParseResult parse_args(int argc, char** argv) {
 					("edgetpu", "To run with EdgeTPU.", cxxopts::value<bool>()->default_value("false"))
 					("height", "Camera image height.", cxxopts::value<int>()->default_value("480"))
 					("width", "Camera image width.", cxxopts::value<int>()->default_value("640"))
+					("headless", "Run without display, e.g. on a server or in a container.", cxxopts::value<bool>()->default_value("false"))
+					("json_out", "Write per-frame results as JSON lines to this file, - for stdout.", cxxopts::value<std::string>()->default_value(""))
+					("record_out", "Write per-frame results as binary records to this file.", cxxopts::value<std::string>()->default_value(""))
+					("video_out", "Write the annotated frames to this video file.", cxxopts::value<std::string>()->default_value(""))
 					("help", "Print Usage");
 
 	const auto& args = options.parse(argc, argv);
@@ -99,16 +105,33 @@ int main(int argc, char** argv) {
 		return 0;
 	}
 
-	while(true)
+	const auto dispatcher = edge::MakeResultDispatcher(args["headless"].as<bool>(), "CLASSIFICATION",
+	                                                   args["json_out"].as<std::string>(),
+	                                                   args["record_out"].as<std::string>(),
+	                                                   args["video_out"].as<std::string>(), 30.0);
+	edge::FramePool frame_pool(edge::kDefaultFramePoolSize, camera_height, camera_width, frame.type());
+	edge::SpscQueue<edge::FrameHandle> captured_frames(edge::kDefaultFramePoolSize);
+	edge::FrameGrabber grabber(cam_frame, frame_pool, captured_frames);
+	grabber.Start();
+	edge::FrameHandle handle;
+	while(edge::PopLatestFrame(captured_frames, frame_pool, grabber, &handle))
 	{
-		cam_frame >> frame;
+		cv::Mat& frame = frame_pool.Frame(handle);
 		const auto& input = edge::GetInputFromImage(frame,required_input_tensor_shape[2],required_input_tensor_shape[1],required_input_tensor_shape[3]);
 		const auto& results = engine.RunInference(input);
 		const auto& class_result = engine.ClassifyWithOutputVector(results,threshold,verbose);
-		edge::ClassificationEngine::img_overlay(frame,class_result);
+		edge::FrameResult frame_result;
+		frame_result.frame_id = handle.frame_id;
+		frame_result.timestamp_us = handle.capture_time_us;
+		frame_result.width = camera_width;
+		frame_result.height = camera_height;
+		frame_result.classes = class_result;
+		dispatcher->Publish(frame_result, frame);
+		frame_pool.Release(handle);
 
-		char c=(char)cv::waitKey(25);
-		if(c==27)
+		if(dispatcher->QuitRequested())
 			break;
 	}
+	grabber.Stop();
+	dispatcher->Stop();
 }
\ No newline at end of file
@@ -14,6 +14,12 @@ namespace edge {
 
 
 	void ClassificationEngine::img_overlay(cv::Mat& frame, const std::vector<ClassificationCandidate>& ret)
+{
+	draw_overlay(frame, ret);
+	cv::imshow("Classified output", frame);
+}
+
+	void ClassificationEngine::draw_overlay(cv::Mat& frame, const std::vector<ClassificationCandidate>& ret)
 {
 		int y_coordinate = 20;
 		for (const auto& i : ret)
@@ -22,9 +28,6 @@ namespace edge {
 			cv::putText(frame, "Score :"+std::to_string(i.score), cv::Point(15,y_coordinate+20), cv::FONT_HERSHEY_TRIPLEX, 0.5, cv::Scalar(0,255,0),1.5);
 			y_coordinate = y_coordinate+40;
 		}
-
-	cv::imshow("Classified output", frame);
-
 }
 
 	std::vector<ClassificationCandidate> ClassificationEngine::ClassifyWithOutputVector(const std::vector<float>& inf_vec,
@@ -41,7 +44,7 @@ namespace edge {
 			if (score >threshold && score > Max_score) {
 				Max_score = score;
 				max_idx = idx;
-				max_candidate.classname = m_labels.at(max_idx);
+				max_candidate.classname = m_labels.at(max_idx).str();
 				max_candidate.score = Max_score;
 				change = true;
 			}
@@ -3,11 +3,14 @@
 //
 
 #include "engine.h"
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <vector>
 
 #include "label_utils.h"
+#include "output_reader.h"
 #include "posenet_decoder_op.h"
 #include "tensorflow/lite/builtin_op_data.h"
 #include "tensorflow/lite/kernels/register.h"
@@ -17,7 +20,9 @@ namespace edge {
 					const std::string& model_path, const std::string& label_path, const std::shared_ptr<edgetpu::EdgeTpuContext>& edgetpu_context,
 					const bool edgetpu){
 		PrepEngine(model_path,edgetpu_context,edgetpu);
-		m_labels = ParseLabel(label_path);
+		if (!m_labels.Load(label_path)) {
+			std::cout << "Failed to read label file " << label_path << std::endl;
+		}
 	}
 	Engine::Engine(const std::string& model_path,	const std::shared_ptr<edgetpu::EdgeTpuContext>& edgetpu_context,
 					const bool edgetpu){
@@ -39,15 +44,25 @@ namespace edge {
 		// Set input tensor shape.
 		const auto* dims = m_interpreter->tensor(m_interpreter->inputs()[0])->dims;
 		m_input_shape = {dims->data[0],dims->data[1], dims->data[2], dims->data[3]};
-		// set output tensor shape.
+		m_input_adapter.Init(m_interpreter->input_tensor(0));
+		// Set output tensor shape, in elements, and how each output is read.
 		const auto& out_tensor_indices = m_interpreter->outputs();
 		m_output_shape.resize(out_tensor_indices.size());
-		//for debugging
-		//std::cout<<"out_tensor_indices.size() : "<<out_tensor_indices.size()<<std::endl;
+		m_output_readers.resize(out_tensor_indices.size());
+		m_output_size = 0;
 		for (size_t i = 0; i < out_tensor_indices.size(); i++) {
 			const auto* tensor = m_interpreter->tensor(out_tensor_indices[i]);
-			// We are assuming that outputs tensor are only of type float.
-			m_output_shape[i] = tensor->bytes / sizeof(float);
+			OutputReader& reader = m_output_readers[i];
+			size_t element_size;
+			reader.tensor = tensor;
+			reader.read = SelectOutputReader(tensor->type, &element_size);
+			reader.count = reader.read ? tensor->bytes / element_size : 0;
+			if (!reader.read) {
+				std::cerr << "Tensor " << tensor->name
+				          << " has unsupported output type: " << tensor->type << std::endl;
+			}
+			m_output_shape[i] = reader.count;
+			m_output_size += reader.count;
 		}
 
 	}
@@ -73,81 +88,188 @@ namespace edge {
 		}
 	}
 
+	std::vector<std::shared_ptr<edgetpu::EdgeTpuContext>> OpenAllEdgeTpus() {
+		std::vector<std::shared_ptr<edgetpu::EdgeTpuContext>> contexts;
+		auto* manager = edgetpu::EdgeTpuManager::GetSingleton();
+		if (manager == nullptr) return contexts;
+		for (const auto& record : manager->EnumerateEdgeTpu()) {
+			auto context = manager->OpenDevice(record.type, record.path);
+			if (context) contexts.push_back(context);
+		}
+		return contexts;
+	}
+
+	const std::pair<TfLiteNode, TfLiteRegistration>* Engine::FindPosenetDecoder() {
+		for (int node_index : m_interpreter->execution_plan()) {
+			const auto* node_and_registration = m_interpreter->node_and_registration(node_index);
+			if (coral::GetPosenetDecoderParams(node_and_registration->second, node_and_registration->first)) {
+				return node_and_registration;
+			}
+		}
+		return nullptr;
+	}
+
+	bool Engine::SetPosenetDecoderPool(WorkerPool* pool) {
+		const auto* decoder = FindPosenetDecoder();
+		return decoder && coral::SetPosenetDecoderPool(decoder->second, decoder->first, pool);
+	}
+
+	bool Engine::GetPosenetDecoderParams(coral::PosenetDecoderParams* params) {
+		const auto* decoder = FindPosenetDecoder();
+		if (decoder == nullptr) return false;
+		*params = *coral::GetPosenetDecoderParams(decoder->second, decoder->first);
+		return true;
+	}
+
+	bool Engine::SetPosenetDecoderParams(const coral::PosenetDecoderParams& params) {
+		const auto* decoder = FindPosenetDecoder();
+		return decoder && coral::SetPosenetDecoderParams(decoder->second, decoder->first, params);
+	}
+
+	bool Engine::SetPosenetDecoderDeferred(bool deferred) {
+		const auto* decoder = FindPosenetDecoder();
+		return decoder && coral::SetPosenetDecoderDeferred(decoder->second, decoder->first, deferred);
+	}
+
+	bool Engine::GetPosenetDecoderTensors(std::vector<int>* inputs, std::vector<int>* outputs) {
+		const auto* decoder = FindPosenetDecoder();
+		if (decoder == nullptr) return false;
+		const TfLiteIntArray* node_inputs = decoder->first.inputs;
+		const TfLiteIntArray* node_outputs = decoder->first.outputs;
+		inputs->assign(node_inputs->data, node_inputs->data + node_inputs->size);
+		outputs->assign(node_outputs->data, node_outputs->data + node_outputs->size);
+		return true;
+	}
+
+	bool Engine::DecodePosenetInputs(const void* const* inputs, float* const* outputs) {
+		const auto* decoder = FindPosenetDecoder();
+		if (decoder == nullptr) return false;
+		const TfLiteIntArray* node_inputs = decoder->first.inputs;
+		std::array<const TfLiteTensor*, 3> input_tensors;
+		if (node_inputs->size != static_cast<int>(input_tensors.size())) return false;
+		for (size_t i = 0; i < input_tensors.size(); ++i) input_tensors[i] = m_interpreter->tensor(node_inputs->data[i]);
+		return coral::DecodePosenetInputs(decoder->second, decoder->first, input_tensors.data(), inputs, outputs);
+	}
+
+	bool Engine::StartTensorRecording(const std::string& path) {
+		TensorStream stream = TensorStream::kModelOutputs;
+		std::map<std::string, std::string> metadata;
+		m_recorded_tensors = m_interpreter->outputs();
+		if (const auto* decoder = FindPosenetDecoder()) {
+			const auto* params = coral::GetPosenetDecoderParams(decoder->second, decoder->first);
+			// Record what the decoder sees, so replay exercises DecodeAllPoses itself.
+			stream = TensorStream::kPosenetDecoderInputs;
+			const TfLiteIntArray* inputs = decoder->first.inputs;
+			m_recorded_tensors.assign(inputs->data, inputs->data + inputs->size);
+			char buffer[32];
+			metadata["max_detections"] = std::to_string(params->max_detections);
+			snprintf(buffer, sizeof(buffer), "%.9g", params->score_threshold);
+			metadata["score_threshold"] = buffer;
+			metadata["stride"] = std::to_string(params->stride);
+			snprintf(buffer, sizeof(buffer), "%.9g", params->nms_radius);
+			metadata["nms_radius"] = buffer;
+			metadata["refinement_steps"] = std::to_string(params->mid_short_offset_refinement_steps);
+			metadata["local_maximum_radius"] = std::to_string(params->local_maximum_radius);
+			if (const auto* skeleton = coral::GetPosenetDecoderSkeleton(decoder->second, decoder->first)) {
+				metadata["skeleton"] = skeleton->name;
+				metadata["skeleton_edges"] = coral::SkeletonEdgesToString(*skeleton);
+			}
+		}
+		m_tensor_recorder.reset(new TensorRecordWriter);
+		if (!m_tensor_recorder->Open(path, stream, metadata)) {
+			m_tensor_recorder.reset();
+			return false;
+		}
+		return true;
+	}
+
+	void Engine::SetProfiling(const bool enabled) {
+		if (enabled && !m_profiler) {
+			// Room for every node twice over, in case an op reports nested events.
+			m_profiler.reset(new OpProfiler(2 * m_interpreter->nodes_size() + 16));
+		}
+		m_interpreter->SetProfiler(enabled ? m_profiler->TfLiteProfiler() : nullptr);
+		m_profiling = enabled;
+	}
+
+	std::string Engine::ProfileReport() const {
+		return m_profiler ? m_profiler->Report() : std::string();
+	}
+
+	void Engine::RecordTensors() {
+		m_tensor_recorder->BeginFrame();
+		for (int index : m_recorded_tensors) {
+			const TfLiteTensor* tensor = m_interpreter->tensor(index);
+			m_tensor_recorder->AddTensor(tensor->name ? tensor->name : "", tensor->type, tensor->dims->data,
+			                             tensor->dims->size, tensor->params.scale, tensor->params.zero_point,
+			                             tensor->data.raw_const, tensor->bytes);
+		}
+		if (!m_tensor_recorder->EndFrame()) {
+			std::cout << "Failed to record tensors, recording stopped" << std::endl;
+			m_tensor_recorder.reset();
+		}
+	}
+
 	std::vector<int> Engine::GetInputShape() {
 		return m_input_shape;
 	}
 
-	std::vector<float> Engine::RunInference (const std::vector<uint8_t>& input_data) {
-		std::vector<float> output_data;
-		auto* input = m_interpreter->typed_input_tensor<uint8_t>(0);
-		std::memcpy(input, input_data.data(), input_data.size());
-		m_interpreter->Invoke();
-
-		const auto& output_indices = m_interpreter->outputs();
-		const int num_outputs = output_indices.size();
-		int out_idx = 0;
-		for (int i = 0; i < num_outputs; ++i) {
-			const auto* out_tensor = m_interpreter->tensor(output_indices[i]);
-			assert(out_tensor != nullptr);
-			if (out_tensor->type == kTfLiteUInt8) {
-				const int num_values = out_tensor->bytes;
-				output_data.resize(out_idx + num_values);
-				const uint8_t* output = m_interpreter->typed_output_tensor<uint8_t>(i);
-				for (int j = 0; j < num_values; ++j) {
-					output_data[out_idx++] =
-									(output[j] - out_tensor->params.zero_point) * out_tensor->params.scale;
-				}
-			} else if (out_tensor->type == kTfLiteFloat32) {
-				const int num_values = out_tensor->bytes / sizeof(float);
-				output_data.resize(out_idx + num_values);
-				const float* output = m_interpreter->typed_output_tensor<float>(i);
-				for (int j = 0; j < num_values; ++j) {
-					output_data[out_idx++] = output[j];
-				}
-			} else {
-				std::cerr << "Tensor " << out_tensor->name
-				          << " has unsupported output type: " << out_tensor->type << std::endl;
-			}
+	uint8_t* Engine::GetInputBuffer() {
+		return m_input_adapter.Buffer();
+	}
+
+	void Engine::SetInputNormalization(const InputNormalization& normalization) {
+		m_input_adapter.Init(m_interpreter->input_tensor(0), normalization);
+	}
+
+	void Engine::Invoke() {
+		if (m_profiling) {
+			m_profiler->BeginInvoke();
+			m_interpreter->Invoke();
+			m_profiler->EndInvoke();
+		} else {
+			m_interpreter->Invoke();
 		}
-		return output_data;
+		if (m_tensor_recorder) RecordTensors();
 	}
 
-    void Engine::RunInference(const std::vector<float>& input_data, std::vector<std::vector<float>> &output_data) {
+	std::vector<float> Engine::RunInference (const std::vector<uint8_t>& input_data) {
+		std::memcpy(GetInputBuffer(), input_data.data(), input_data.size());
+		return RunInference();
+	}
 
+	std::vector<float> Engine::RunInference() {
+		m_input_adapter.Apply();
+		Invoke();
 
+		std::vector<float> output_data(m_output_size);
+		float* out = output_data.data();
+		for (const auto& reader : m_output_readers) {
+			if (reader.read) reader.Read(out);
+			out += reader.count;
+		}
+		return output_data;
+	}
 
-        std::cout << m_interpreter->input_tensor(0)->type << " <---> "<< kTfLiteUInt8 << std::endl; std::cout.flush();
+	void Engine::RunInference(std::vector<std::vector<float>>& output_data) {
+		m_input_adapter.Apply();
+		Invoke();
+		CollectOutputs(output_data);
+	}
 
+    void Engine::RunInference(const std::vector<float>& input_data, std::vector<std::vector<float>> &output_data) {
         auto* input = m_interpreter->typed_input_tensor<float>(0);
         std::memcpy(input, input_data.data(), input_data.size()*sizeof (float));
-        m_interpreter->Invoke();
-
-        output_data.clear();
-        const auto& output_indices = m_interpreter->outputs();
-        const int num_outputs = output_indices.size();
-        for (int i = 0; i < num_outputs; ++i) {
-            const auto* out_tensor = m_interpreter->tensor(output_indices[i]);
-            assert(out_tensor != nullptr);
-            if (out_tensor->type == kTfLiteUInt8) {
-                const int num_values = out_tensor->bytes;
-                std::vector<float> outdata(num_values);
-                const uint8_t* output = m_interpreter->typed_output_tensor<uint8_t>(i);
-                for (int j = 0; j < num_values; ++j) {
-                    outdata[j] = (output[j] - out_tensor->params.zero_point) * out_tensor->params.scale;
-                }
-                output_data.push_back(outdata);
-            } else if (out_tensor->type == kTfLiteFloat32) {
-                const int num_values = out_tensor->bytes / sizeof(float);
-                std::vector<float> outdata(num_values);
-                const float* output = m_interpreter->typed_output_tensor<float>(i);
-                for (int j = 0; j < num_values; ++j) {
-                    outdata[j] = output[j];
-                }
-                output_data.push_back(outdata);
-            } else {
-                std::cerr << "Tensor " << out_tensor->name
-                          << " has unsupported output type: " << out_tensor->type << std::endl;
-            }
+        Invoke();
+        CollectOutputs(output_data);
+    }
+
+    void Engine::CollectOutputs(std::vector<std::vector<float>>& output_data) {
+        output_data.resize(m_output_readers.size());
+        for (size_t i = 0; i < m_output_readers.size(); ++i) {
+            const auto& reader = m_output_readers[i];
+            output_data[i].resize(reader.count);
+            if (reader.read) reader.Read(output_data[i].data());
         }
     }
 
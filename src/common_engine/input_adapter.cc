@@ -0,0 +1,108 @@
+//
+// Input tensor conversion kernels, chosen once per model.
+//
+
+#include "input_adapter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace edge {
+	namespace {
+		// Plain loops over restrict pointers, which the compiler vectorizes.
+		void FlipSign(const uint8_t* __restrict in, size_t count, uint8_t* __restrict out) {
+			for (size_t i = 0; i < count; ++i) out[i] = static_cast<uint8_t>(in[i] ^ 0x80);
+		}
+
+		void Lookup(const uint8_t* __restrict in, size_t count, const uint8_t* __restrict table,
+		            uint8_t* __restrict out) {
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				out[i] = table[in[i]];
+				out[i + 1] = table[in[i + 1]];
+				out[i + 2] = table[in[i + 2]];
+				out[i + 3] = table[in[i + 3]];
+			}
+			for (; i < count; ++i) out[i] = table[in[i]];
+		}
+
+		void Affine(const uint8_t* __restrict in, size_t count, float scale, float offset, float* __restrict out) {
+			for (size_t i = 0; i < count; ++i) out[i] = in[i] * scale + offset;
+		}
+	}
+
+	void InputAdapter::Init(TfLiteTensor* tensor) {
+		m_tensor = tensor;
+		Select(nullptr);
+	}
+
+	void InputAdapter::Init(TfLiteTensor* tensor, const InputNormalization& normalization) {
+		m_tensor = tensor;
+		Select(&normalization);
+	}
+
+	void InputAdapter::Select(const InputNormalization* normalization) {
+		m_kernel = Kernel::kUnsupported;
+		m_count = 0;
+		if (m_tensor == nullptr) return;
+		const float mean = normalization ? normalization->mean : 0.0f;
+		const float scale = normalization ? normalization->scale : 1.0f;
+		const TfLiteQuantizationParams& quantization = m_tensor->params;
+
+		switch (m_tensor->type) {
+			case kTfLiteUInt8:
+			case kTfLiteInt8: {
+				const bool is_signed = m_tensor->type == kTfLiteInt8;
+				m_count = m_tensor->bytes;
+				const int shift = is_signed ? 0x80 : 0;
+				bool identity = true;
+				for (int p = 0; p < 256; ++p) {
+					int q = p - shift;
+					// Without normalization or quantization the pixel codes go in as they are.
+					if (normalization && quantization.scale > 0.0f) {
+						q = static_cast<int>(std::lround((p - mean) * scale / quantization.scale)) + quantization.zero_point;
+						q = std::max(-shift, std::min(255 - shift, q));
+					}
+					m_table[p] = static_cast<uint8_t>(q);
+					identity = identity && m_table[p] == static_cast<uint8_t>(p ^ shift);
+				}
+				m_kernel = !identity ? Kernel::kTable : is_signed ? Kernel::kFlipSign : Kernel::kPassthrough;
+				break;
+			}
+			case kTfLiteFloat32:
+				m_count = m_tensor->bytes / sizeof(float);
+				m_scale = scale;
+				m_offset = -mean * scale;
+				m_kernel = Kernel::kAffine;
+				break;
+			default:
+				std::cout << "Input tensor " << (m_tensor->name ? m_tensor->name : "") << " has unsupported type "
+				          << m_tensor->type << std::endl;
+				return;
+		}
+		m_pixels.assign(m_kernel == Kernel::kPassthrough ? 0 : m_count, 0);
+	}
+
+	uint8_t* InputAdapter::Buffer() {
+		if (m_kernel == Kernel::kPassthrough) return m_tensor->data.uint8;
+		return m_pixels.empty() ? nullptr : m_pixels.data();
+	}
+
+	void InputAdapter::Apply() {
+		switch (m_kernel) {
+			case Kernel::kFlipSign:
+				FlipSign(m_pixels.data(), m_count, reinterpret_cast<uint8_t*>(m_tensor->data.int8));
+				break;
+			case Kernel::kTable:
+				Lookup(m_pixels.data(), m_count, m_table, reinterpret_cast<uint8_t*>(m_tensor->data.raw));
+				break;
+			case Kernel::kAffine:
+				Affine(m_pixels.data(), m_count, m_scale, m_offset, m_tensor->data.f);
+				break;
+			case Kernel::kPassthrough:
+			case Kernel::kUnsupported:
+				break;
+		}
+	}
+}
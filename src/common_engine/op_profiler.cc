@@ -0,0 +1,170 @@
+//
+// Folds the BufferedProfiler events of every inference into per-node and per-op
+// histograms, then empties the buffer for the next one.
+//
+
+#include "op_profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace edge {
+	namespace {
+		typedef tflite::Profiler::EventType EventType;
+
+		void AppendRow(std::string* report, const char* name, const char* kind, int count,
+		               const LatencyHistogram& latency, uint64_t total_invoke_us) {
+			char line[192];
+			const double share = total_invoke_us ? 100.0 * latency.Sum() / total_invoke_us : 0.0;
+			snprintf(line, sizeof(line), "%-28.28s %-8s %5d %9.1f %8llu %8llu %8llu %8llu %6.1f%%\n", name, kind,
+			         count, latency.Mean(), static_cast<unsigned long long>(latency.Percentile(50)),
+			         static_cast<unsigned long long>(latency.Percentile(90)),
+			         static_cast<unsigned long long>(latency.Percentile(99)),
+			         static_cast<unsigned long long>(latency.Max()), share);
+			*report += line;
+		}
+
+		void AppendHeader(std::string* report, const char* name, const char* count) {
+			char line[192];
+			snprintf(line, sizeof(line), "%-28s %-8s %5s %9s %8s %8s %8s %8s %7s\n", name, "kind", count, "mean us",
+			         "p50 us", "p90 us", "p99 us", "max us", "share");
+			*report += line;
+		}
+	}
+
+	const char* OpKindName(OpKind kind) {
+		switch (kind) {
+			case OpKind::kEdgeTpu: return "edgetpu";
+			case OpKind::kPosenetDecoder: return "decoder";
+			default: return "cpu";
+		}
+	}
+
+	OpKind ClassifyOp(const std::string& op_name) {
+		if (op_name == "edgetpu-custom-op") return OpKind::kEdgeTpu;
+		if (op_name == "PosenetDecoderOp") return OpKind::kPosenetDecoder;
+		return OpKind::kCpu;
+	}
+
+	OpProfiler::OpProfiler(uint32_t max_events) : m_profiler(max_events) {}
+
+	void OpProfiler::BeginInvoke() {
+		m_profiler.Reset();
+		m_profiler.StartProfiling();
+		m_invoke_start = std::chrono::steady_clock::now();
+	}
+
+	void OpProfiler::EndInvoke() {
+		const auto invoke_end = std::chrono::steady_clock::now();
+		m_profiler.StopProfiling();
+		m_invoke_us.Record(
+						std::chrono::duration_cast<std::chrono::microseconds>(invoke_end - m_invoke_start).count());
+
+		std::fill(m_op_frame_us.begin(), m_op_frame_us.end(), UINT64_MAX);
+		for (const auto* event : m_profiler.GetProfileEvents()) {
+			// Delegate events nest inside the node of their delegate kernel, which is
+			// already timed as a whole.
+			if (event->event_type != EventType::OPERATOR_INVOKE_EVENT || event->tag == nullptr) continue;
+			const uint64_t elapsed_us = event->end_timestamp_us >= event->begin_timestamp_us
+			                            ? event->end_timestamp_us - event->begin_timestamp_us : 0;
+			NodeProfile& node = NodeSlot(static_cast<int>(event->event_metadata), event->tag);
+			node.latency_us.Record(elapsed_us);
+			uint64_t& op_us = m_op_frame_us[m_node_ops[&node - m_nodes.data()]];
+			op_us = (op_us == UINT64_MAX ? 0 : op_us) + elapsed_us;
+		}
+		for (size_t op = 0; op < m_ops.size(); ++op) {
+			if (m_op_frame_us[op] != UINT64_MAX) m_ops[op].latency_us.Record(m_op_frame_us[op]);
+		}
+		m_profiler.Reset();
+	}
+
+	NodeProfile& OpProfiler::NodeSlot(const int node_index, const char* op_name) {
+		if (node_index >= static_cast<int>(m_node_slots.size())) m_node_slots.resize(node_index + 1, -1);
+		int& slot = m_node_slots[node_index];
+		if (slot >= 0) return m_nodes[slot];
+
+		slot = static_cast<int>(m_nodes.size());
+		m_nodes.emplace_back();
+		NodeProfile& node = m_nodes.back();
+		node.node_index = node_index;
+		node.op_name = op_name;
+		node.kind = ClassifyOp(node.op_name);
+
+		int op = 0;
+		while (op < static_cast<int>(m_ops.size()) && m_ops[op].op_name != node.op_name) ++op;
+		if (op == static_cast<int>(m_ops.size())) {
+			m_ops.emplace_back();
+			m_ops.back().op_name = node.op_name;
+			m_ops.back().kind = node.kind;
+			// The op did not run earlier in this inference.
+			m_op_frame_us.push_back(UINT64_MAX);
+		}
+		++m_ops[op].num_nodes;
+		m_node_ops.push_back(op);
+		return node;
+	}
+
+	void OpProfiler::Reset() {
+		m_profiler.Reset();
+		m_invoke_us.Reset();
+		m_nodes.clear();
+		m_ops.clear();
+		m_node_slots.clear();
+		m_node_ops.clear();
+		m_op_frame_us.clear();
+	}
+
+	uint64_t OpProfiler::TotalUs(OpKind kind) const {
+		uint64_t total = 0;
+		for (const auto& op : m_ops) {
+			if (op.kind == kind) total += op.latency_us.Sum();
+		}
+		return total;
+	}
+
+	std::string OpProfiler::Report() const {
+		const uint64_t invoke_us = m_invoke_us.Sum();
+		std::string report;
+		char line[192];
+		snprintf(line, sizeof(line), "Operator profile of %llu inferences\n",
+		         static_cast<unsigned long long>(NumInvokes()));
+		report += line;
+		if (NumInvokes() == 0) return report;
+
+		uint64_t ops_us = 0;
+		report += "Time in";
+		for (OpKind kind : {OpKind::kEdgeTpu, OpKind::kCpu, OpKind::kPosenetDecoder}) {
+			const uint64_t kind_us = TotalUs(kind);
+			ops_us += kind_us;
+			snprintf(line, sizeof(line), " %s %.1f%%,", OpKindName(kind), 100.0 * kind_us / invoke_us);
+			report += line;
+		}
+		snprintf(line, sizeof(line), " interpreter %.1f%%\n\n",
+		         invoke_us > ops_us ? 100.0 * (invoke_us - ops_us) / invoke_us : 0.0);
+		report += line;
+
+		AppendHeader(&report, "op", "nodes");
+		AppendRow(&report, "Invoke", "", static_cast<int>(m_nodes.size()), m_invoke_us, invoke_us);
+		std::vector<const OpProfile*> ops;
+		for (const auto& op : m_ops) ops.push_back(&op);
+		std::stable_sort(ops.begin(), ops.end(), [](const OpProfile* a, const OpProfile* b) {
+			return a->latency_us.Sum() > b->latency_us.Sum();
+		});
+		for (const auto* op : ops) {
+			AppendRow(&report, op->op_name.c_str(), OpKindName(op->kind), op->num_nodes, op->latency_us, invoke_us);
+		}
+
+		report += "\n";
+		AppendHeader(&report, "node", "index");
+		std::vector<const NodeProfile*> nodes;
+		for (const auto& node : m_nodes) nodes.push_back(&node);
+		std::stable_sort(nodes.begin(), nodes.end(), [](const NodeProfile* a, const NodeProfile* b) {
+			return a->latency_us.Sum() > b->latency_us.Sum();
+		});
+		for (const auto* node : nodes) {
+			AppendRow(&report, node->op_name.c_str(), OpKindName(node->kind), node->node_index, node->latency_us,
+			          invoke_us);
+		}
+		return report;
+	}
+}
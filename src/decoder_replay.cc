@@ -0,0 +1,336 @@
+//
+// Replays tensors recorded with --record_tensors through the postprocessing of the
+// engines, without camera, model or interpreter. Measures decoding throughput and can
+// dump the decoded results or compare them exactly against an earlier dump, to check
+// that an optimized decoder still produces identical output.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cxxopts.hpp"
+#include "detection_engine.h"
+#include "label_utils.h"
+#include "posenet_decoder.h"
+#include "tensor_record.h"
+#include "ultraface_engine.h"
+#include "worker_pool.h"
+
+cxxopts::ParseResult parse_args(int argc, char** argv) {
+	cxxopts::Options options("decoder_replay", "Replays recorded tensors through the decoders");
+
+	options.add_options()
+					("input", "Tensor recording written with --record_tensors.", cxxopts::value<std::string>())
+					("decoder", "auto, posenet, detection or ultraface.", cxxopts::value<std::string>()->default_value("auto"))
+					("iterations", "Number of passes over the recording.", cxxopts::value<int>()->default_value("1"))
+					("threshold", "Minimum detection or face score.", cxxopts::value<float>()->default_value("0.3"))
+					("nms_iou", "UltraFace NMS overlap threshold.", cxxopts::value<float>()->default_value("0.5"))
+					("label_path", "Labels for detection, class ids are printed without.", cxxopts::value<std::string>())
+					("height", "Camera image height the faces are scaled to.", cxxopts::value<int>()->default_value("480"))
+					("width", "Camera image width the faces are scaled to.", cxxopts::value<int>()->default_value("640"))
+					("decode_threads", "Threads decoding the poses of a frame in parallel.", cxxopts::value<int>()->default_value("1"))
+					("dump", "Write the decoded results of the first pass to this file.", cxxopts::value<std::string>())
+					("compare", "Compare the decoded results against this dump.", cxxopts::value<std::string>())
+					("help", "Print Usage");
+
+	const auto& args = options.parse(argc, argv);
+	if (args.count("help") || !args.count("input")) {
+		std::cerr << options.help() << "\n";
+		exit(0);
+	}
+	return args;
+}
+
+// Floats are printed with enough digits to round trip, so dumps compare exactly.
+void AppendFloat(std::string* out, float value) {
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), " %.9g", value);
+	out->append(buffer);
+}
+
+class PosenetReplay {
+public:
+	PosenetReplay(const edge::TensorRecordReader& reader, edge::WorkerPool* pool)
+					: m_pool(pool), m_max_detections(std::stoi(reader.GetMetadata("max_detections", "10"))),
+					  m_score_threshold(std::stof(reader.GetMetadata("score_threshold", "0.5"))),
+					  m_stride(std::stoi(reader.GetMetadata("stride", "16"))),
+					  m_nms_radius(std::stof(reader.GetMetadata("nms_radius", "20"))),
+					  m_refinement_steps(std::stoi(reader.GetMetadata(
+									  "refinement_steps", std::to_string(coral::posenet_decoder_op::kMidShortOffsetRefinementSteps)))),
+					  m_local_maximum_radius(std::stoi(reader.GetMetadata(
+									  "local_maximum_radius", std::to_string(coral::posenet_decoder_op::kLocalMaximumRadius)))),
+					  m_skeleton_name(reader.GetMetadata("skeleton", "")), m_pose_scores(m_max_detections) {
+		if (!coral::SkeletonEdgesFromString(reader.GetMetadata("skeleton_edges", ""), &m_skeleton_edges)) {
+			std::cerr << "Ignoring the malformed skeleton_edges of the recording" << std::endl;
+			m_skeleton_edges.clear();
+		}
+	}
+
+	bool Decode(const std::vector<edge::TensorView>& tensors) {
+		if (tensors.size() != 3) return false;
+		if (m_graph.NumKeypoints() == 0 && !InitGraph(tensors)) return false;
+		// Same dequantization and parameters as the PosenetDecoderOp's Eval.
+		Dequantize(tensors[0], 1.0, &m_heatmaps);
+		Dequantize(tensors[1], 1.0 / m_stride, &m_shorts);
+		Dequantize(tensors[2], 1.0 / m_stride, &m_mids);
+		const float nms_radius = m_nms_radius / m_stride;
+		m_count = coral::posenet_decoder_op::DecodeAllPoses(
+						m_graph, m_heatmaps.data(), m_shorts.data(), m_mids.data(), tensors[0].header->dims[1],
+						tensors[0].header->dims[2], m_max_detections, m_score_threshold,
+						m_refinement_steps, m_local_maximum_radius, nms_radius, m_stride,
+						m_keypoints.data(), m_keypoint_scores.data(), m_pose_scores.data(), m_pool, &m_workspace);
+		return true;
+	}
+
+	void Format(std::string* out) const {
+		out->append(" poses " + std::to_string(m_count) + "\n");
+		for (int i = 0; i < m_count; ++i) {
+			out->append("pose");
+			AppendFloat(out, m_pose_scores[i]);
+			const int num_keypoints = m_graph.NumKeypoints();
+			for (int k = i * num_keypoints; k < (i + 1) * num_keypoints; ++k) {
+				AppendFloat(out, m_keypoints[k].y);
+				AppendFloat(out, m_keypoints[k].x);
+				AppendFloat(out, m_keypoint_scores[k]);
+			}
+			out->append("\n");
+		}
+	}
+
+private:
+	// The skeleton of the recording, else the built-in one matching the channels of the first frame.
+	bool InitGraph(const std::vector<edge::TensorView>& tensors) {
+		const int num_keypoints = tensors[0].header->dims[3];
+		const int num_edges = tensors[2].header->dims[3] / 4;
+		coral::PoseSkeleton skeleton;
+		if (!coral::ResolveSkeleton(m_skeleton_name, m_skeleton_edges, num_keypoints, num_edges, &skeleton) ||
+		    !m_graph.Init(skeleton)) {
+			std::cerr << "No pose skeleton with " << num_keypoints << " keypoints and " << num_edges << " edges"
+			          << std::endl;
+			return false;
+		}
+		m_keypoints.resize(m_max_detections * num_keypoints);
+		m_keypoint_scores.resize(m_max_detections * num_keypoints);
+		return true;
+	}
+
+	static void Dequantize(const edge::TensorView& tensor, float extra_scale, std::vector<float>* out) {
+		const size_t num_elements = tensor.NumElements();
+		out->resize(num_elements);
+		if (tensor.header->type == kTfLiteUInt8) {
+			coral::posenet_decoder_op::DequantizeUint8(tensor.data, num_elements, tensor.header->zero_point,
+			                                           tensor.header->scale, extra_scale, out->data());
+		} else {
+			coral::posenet_decoder_op::ScaleFloat(reinterpret_cast<const float*>(tensor.data), num_elements,
+			                                      extra_scale, out->data());
+		}
+	}
+
+	edge::WorkerPool* m_pool;
+	const int m_max_detections;
+	const float m_score_threshold;
+	const int m_stride;
+	const float m_nms_radius;
+	const int m_refinement_steps;
+	const int m_local_maximum_radius;
+	const std::string m_skeleton_name;
+	std::vector<std::pair<int, int>> m_skeleton_edges;
+	coral::posenet_decoder_op::SkeletonGraph m_graph;
+	std::vector<float> m_heatmaps;
+	std::vector<float> m_shorts;
+	std::vector<float> m_mids;
+	std::vector<coral::posenet_decoder_op::Point> m_keypoints;
+	std::vector<float> m_keypoint_scores;
+	std::vector<float> m_pose_scores;
+	coral::posenet_decoder_op::DecoderWorkspace m_workspace;
+	int m_count = 0;
+};
+
+class DetectionReplay {
+public:
+	DetectionReplay(const edge::LabelTable& labels, float threshold) : m_labels(labels), m_threshold(threshold) {}
+
+	bool Decode(const std::vector<edge::TensorView>& tensors) {
+		// Concatenated like Engine::RunInference returns it.
+		m_output_shape.clear();
+		m_outputs.clear();
+		for (const auto& tensor : tensors) {
+			edge::DequantizeTensorView(tensor, &m_tensor);
+			m_output_shape.push_back(m_tensor.size());
+			m_outputs.insert(m_outputs.end(), m_tensor.begin(), m_tensor.end());
+		}
+		m_result = edge::DetectionEngine::DetectWithOutputVector(m_outputs, m_output_shape, m_labels, m_threshold);
+		return true;
+	}
+
+	void Format(std::string* out) const {
+		out->append(" detections " + std::to_string(m_result.size()) + "\n");
+		for (const auto& candidate : m_result) {
+			out->append(candidate.candidate);
+			AppendFloat(out, candidate.score);
+			AppendFloat(out, candidate.x1);
+			AppendFloat(out, candidate.y1);
+			AppendFloat(out, candidate.x2);
+			AppendFloat(out, candidate.y2);
+			out->append("\n");
+		}
+	}
+
+private:
+	const edge::LabelTable& m_labels;
+	const float m_threshold;
+	std::vector<size_t> m_output_shape;
+	std::vector<float> m_outputs;
+	std::vector<float> m_tensor;
+	std::vector<edge::DetectionCandidate> m_result;
+};
+
+class UltraFaceReplay {
+public:
+	UltraFaceReplay(float threshold, float nms_iou, const cv::Size& frame_size) : m_frame_size(frame_size) {
+		m_decoder.Init(threshold, nms_iou);
+	}
+
+	bool Decode(const std::vector<edge::TensorView>& tensors) {
+		if (tensors.size() < 2) return false;
+		m_outputs.resize(tensors.size());
+		for (size_t i = 0; i < tensors.size(); ++i) edge::DequantizeTensorView(tensors[i], &m_outputs[i]);
+		m_result = m_decoder.Decode(m_outputs, m_frame_size);
+		return true;
+	}
+
+	void Format(std::string* out) const {
+		out->append(" faces " + std::to_string(m_result.size()) + "\n");
+		for (const auto& face : m_result) {
+			out->append(std::to_string(face.first.x) + " " + std::to_string(face.first.y) + " " +
+			            std::to_string(face.first.width) + " " + std::to_string(face.first.height));
+			AppendFloat(out, face.second);
+			out->append("\n");
+		}
+	}
+
+private:
+	edge::UltraFaceDecoder m_decoder;
+	const cv::Size m_frame_size;
+	std::vector<std::vector<float>> m_outputs;
+	std::vector<std::pair<cv::Rect, float>> m_result;
+};
+
+std::vector<std::string> ReadLines(const std::string& path) {
+	std::vector<std::string> lines;
+	std::ifstream file(path);
+	std::string line;
+	while (std::getline(file, line)) lines.push_back(line);
+	return lines;
+}
+
+template <typename Replay>
+int Run(Replay& replay, edge::TensorRecordReader& reader, const cxxopts::ParseResult& args) {
+	const int iterations = std::max(1, args["iterations"].as<int>());
+	std::string results;
+	std::vector<edge::TensorView> tensors;
+	uint64_t frame_index = 0;
+	size_t frames = 0;
+	std::chrono::steady_clock::duration decoding(0);
+	for (int iteration = 0; iteration < iterations; ++iteration) {
+		reader.Rewind();
+		while (reader.Next(&frame_index, &tensors)) {
+			const auto start = std::chrono::steady_clock::now();
+			const bool decoded = replay.Decode(tensors);
+			decoding += std::chrono::steady_clock::now() - start;
+			if (!decoded) {
+				std::cerr << "Frame " << frame_index << " does not have the tensors of this decoder" << std::endl;
+				return 1;
+			}
+			++frames;
+			if (iteration == 0) {
+				results.append("frame " + std::to_string(frame_index));
+				replay.Format(&results);
+			}
+		}
+	}
+	if (reader.Truncated()) std::cerr << "Stopped at a truncated frame" << std::endl;
+
+	const double total_ms = std::chrono::duration<double, std::milli>(decoding).count();
+	std::cout << "Decoded " << frames << " frames in " << total_ms << " ms, " << 1000.0 * total_ms / std::max<size_t>(frames, 1)
+	          << " us per frame, " << (total_ms > 0 ? 1000.0 * frames / total_ms : 0.0) << " frames/s" << std::endl;
+
+	if (args.count("dump")) {
+		std::ofstream dump(args["dump"].as<std::string>());
+		dump << results;
+	}
+	if (args.count("compare")) {
+		const auto expected = ReadLines(args["compare"].as<std::string>());
+		std::vector<std::string> actual;
+		std::istringstream stream(results);
+		std::string line;
+		while (std::getline(stream, line)) actual.push_back(line);
+		for (size_t i = 0; i < std::max(expected.size(), actual.size()); ++i) {
+			const std::string& want = i < expected.size() ? expected[i] : std::string("<end of dump>");
+			const std::string& got = i < actual.size() ? actual[i] : std::string("<end of results>");
+			if (want != got) {
+				std::cout << "Mismatch at line " << i + 1 << "\n  expected: " << want << "\n  actual:   " << got
+				          << std::endl;
+				return 1;
+			}
+		}
+		std::cout << "Results identical to " << args["compare"].as<std::string>() << std::endl;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	const auto& args = parse_args(argc, argv);
+	edge::TensorRecordReader reader;
+	if (!reader.Open(args["input"].as<std::string>())) return 1;
+
+	std::string decoder = args["decoder"].as<std::string>();
+	if (decoder == "auto") {
+		if (reader.Stream() == edge::TensorStream::kPosenetDecoderInputs) {
+			decoder = "posenet";
+		} else {
+			// SSD postprocessing has four outputs, UltraFace boxes and scores.
+			uint64_t frame_index;
+			std::vector<edge::TensorView> tensors;
+			reader.Next(&frame_index, &tensors);
+			decoder = tensors.size() == 4 ? "detection" : "ultraface";
+		}
+		std::cout << "Decoder : " << decoder << std::endl;
+	}
+
+	const float threshold = args["threshold"].as<float>();
+	if (decoder == "posenet") {
+		if (reader.Stream() != edge::TensorStream::kPosenetDecoderInputs) {
+			std::cerr << "The recording does not contain PosenetDecoderOp inputs" << std::endl;
+			return 1;
+		}
+		std::unique_ptr<edge::WorkerPool> pool;
+		if (args["decode_threads"].as<int>() > 1) pool.reset(new edge::WorkerPool(args["decode_threads"].as<int>()));
+		PosenetReplay replay(reader, pool.get());
+		return Run(replay, reader, args);
+	}
+	if (decoder == "detection") {
+		edge::LabelTable labels;
+		if (args.count("label_path") && !labels.Load(args["label_path"].as<std::string>())) {
+			std::cerr << "Failed to read label file " << args["label_path"].as<std::string>() << std::endl;
+			return 1;
+		}
+		DetectionReplay replay(labels, threshold);
+		return Run(replay, reader, args);
+	}
+	if (decoder == "ultraface") {
+		UltraFaceReplay replay(threshold, args["nms_iou"].as<float>(),
+		                       cv::Size(args["width"].as<int>(), args["height"].as<int>()));
+		return Run(replay, reader, args);
+	}
+	std::cerr << "Unknown decoder " << decoder << std::endl;
+	return 1;
+}
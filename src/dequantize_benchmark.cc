@@ -0,0 +1,90 @@
+//
+// Measures the dequantization kernels against the scalar loop on the output sizes of the
+// bundled models: the heatmap, short and mid offset tensors the PoseNet decoder
+// dequantizes at every input resolution, and the UltraFace score and box outputs.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cxxopts.hpp"
+#include "dequantize.h"
+
+cxxopts::ParseResult parse_args(int argc, char** argv) {
+	cxxopts::Options options("dequantize_benchmark", "Benchmarks output tensor dequantization");
+
+	options.add_options()
+					("iterations", "Number of timed conversions per tensor.", cxxopts::value<int>()->default_value("2000"))
+					("help", "Print Usage");
+
+	const auto& args = options.parse(argc, argv);
+	if (args.count("help")) {
+		std::cerr << options.help() << "\n";
+		exit(0);
+	}
+	return args;
+}
+
+struct OutputTensor {
+	const char* name;
+	size_t elements;
+};
+
+// PoseNet MobileNet v1 0.75 at output stride 16 has a (h - 1) / 16 + 1 by
+// (w - 1) / 16 + 1 grid with 17 heatmaps, 34 short and 64 mid offsets per cell.
+// UltraFace slim-320 scores 4420 priors with 2 classes and 4 box coordinates.
+const OutputTensor kOutputs[] = {
+				{"posenet 353x481 heatmaps", 23 * 31 * 17},
+				{"posenet 353x481 short offsets", 23 * 31 * 34},
+				{"posenet 353x481 mid offsets", 23 * 31 * 64},
+				{"posenet 481x641 heatmaps", 31 * 41 * 17},
+				{"posenet 481x641 short offsets", 31 * 41 * 34},
+				{"posenet 481x641 mid offsets", 31 * 41 * 64},
+				{"posenet 721x1281 heatmaps", 46 * 81 * 17},
+				{"posenet 721x1281 short offsets", 46 * 81 * 34},
+				{"posenet 721x1281 mid offsets", 46 * 81 * 64},
+				{"ultraface 320 scores", 4420 * 2},
+				{"ultraface 320 boxes", 4420 * 4},
+};
+
+template <typename Fn>
+double TimeUsPerCall(const int iterations, Fn fn) {
+	fn();
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i) fn();
+	const auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+}
+
+int main(int argc, char** argv) {
+	const auto& args = parse_args(argc, argv);
+	const int iterations = args["iterations"].as<int>();
+	const char* isa = edge::DequantizeIsa();
+
+	std::printf("%-32s %9s %10s %10s %8s %10s %10s %8s\n", "tensor", "elements", "u8 scalar", (std::string("u8 ") + isa).c_str(),
+	            "speedup", "i8 scalar", (std::string("i8 ") + isa).c_str(), "speedup");
+	for (const auto& tensor : kOutputs) {
+		std::vector<uint8_t> quantized(tensor.elements);
+		for (auto& value : quantized) value = static_cast<uint8_t>(std::rand());
+		const int8_t* signed_data = reinterpret_cast<const int8_t*>(quantized.data());
+		std::vector<float> out(tensor.elements);
+
+		double times[4];
+		for (int scalar = 1; scalar >= 0; --scalar) {
+			edge::SetDequantizeScalar(scalar != 0);
+			times[1 - scalar] = TimeUsPerCall(iterations, [&] {
+				edge::DequantizeUint8(quantized.data(), tensor.elements, 128, 0.0470588f, out.data());
+			});
+			times[3 - scalar] = TimeUsPerCall(iterations, [&] {
+				edge::DequantizeInt8(signed_data, tensor.elements, 0, 0.0470588f, out.data());
+			});
+		}
+		edge::SetDequantizeScalar(false);
+		std::printf("%-32s %9zu %8.2fus %8.2fus %7.2fx %8.2fus %8.2fus %7.2fx\n", tensor.name, tensor.elements, times[0],
+		            times[1], times[0] / times[1], times[2], times[3], times[2] / times[3]);
+	}
+}
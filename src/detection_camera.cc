@@ -8,9 +8,14 @@
 #include <ostream>
 #include <string>
 
+#include "camera_metrics.h"
 #include "edgetpu.h"
+#include "frame_pool.h"
 #include "img_prep.h"
+#include "metrics_exporter.h"
+#include "result_sink.h"
 #include "detection_engine.h"
+#include "v4l2_capture.h"
 #include "cxxopts.hpp"
 #include "opencv2/opencv.hpp"
 
@@ -25,6 +30,19 @@ cxxopts::ParseResult parse_args(int argc, char** argv) {
 					("edgetpu", "To run with EdgeTPU.", cxxopts::value<bool>()->default_value("false"))
 					("height", "Camera image height.", cxxopts::value<int>()->default_value("480"))
 					("width", "Camera image width.", cxxopts::value<int>()->default_value("640"))
+					("headless", "Run without display, e.g. on a server or in a container.", cxxopts::value<bool>()->default_value("false"))
+					("json_out", "Write per-frame results as JSON lines to this file, - for stdout.", cxxopts::value<std::string>()->default_value(""))
+					("record_out", "Write per-frame results as binary records to this file.", cxxopts::value<std::string>()->default_value(""))
+					("video_out", "Write the annotated frames to this video file.", cxxopts::value<std::string>()->default_value(""))
+					("record_tensors", "Record the raw output tensors of every frame to this file for decoder_replay.", cxxopts::value<std::string>())
+					("v4l2_device", "Capture YUV frames from this V4L2 device, e.g. /dev/video0, instead of OpenCV.", cxxopts::value<std::string>()->default_value(""))
+					("yuv_file", "Play raw YUV frames of --width x --height from this file instead of a camera.", cxxopts::value<std::string>()->default_value(""))
+					("pixel_format", "Pixel format of --v4l2_device or --yuv_file, yuyv, nv12, nv21 or i420.", cxxopts::value<std::string>()->default_value("yuyv"))
+					("export_dmabuf", "Export the V4L2 capture buffers as DMABUF.", cxxopts::value<bool>()->default_value("false"))
+					("resize_mode", "Fit frames to the model input by stretch, letterbox or crop.", cxxopts::value<std::string>()->default_value("stretch"))
+					("profile", "Time every operator of the model and print the report on exit.", cxxopts::value<bool>()->default_value("false"))
+					("metrics_file", "Rewrite Prometheus metrics to this file every second.", cxxopts::value<std::string>()->default_value(""))
+					("metrics_port", "Serve Prometheus metrics on this localhost port, 0 to disable.", cxxopts::value<int>()->default_value("0"))
 					("help", "Print Usage");
 
 	const auto& args = options.parse(argc, argv);
@@ -35,6 +53,60 @@ cxxopts::ParseResult parse_args(int argc, char** argv) {
 	return args;
 }
 
+// Feeds the engine from driver buffers: every frame is converted and resized straight
+// into the input tensor, a full size BGR frame is only made when a sink renders it.
+int RunYuvCapture(edge::CaptureSource& source, edge::DetectionEngine& engine, const float threshold,
+                  const edge::ResizeMode resize_mode, edge::ResultDispatcher& dispatcher, edge::CameraMetrics& metrics)
+{
+	const auto& required_input_tensor_shape = engine.GetInputShape();
+	if(required_input_tensor_shape[3] != 3)
+	{
+		std::cout << "YUV capture needs a model with 3 input channels" << std::endl;
+		return 1;
+	}
+	if(!source.Start())
+	{
+		return 1;
+	}
+	const int camera_width = source.Width();
+	const int camera_height = source.Height();
+	std::cout << "Capturing YUV frames with resolution (W x H) : " << camera_width << " x " << camera_height << std::endl;
+
+	edge::CapturedBuffer buffer;
+	while(source.Dequeue(&buffer))
+	{
+		edge::StageTimer stage_timer;
+		const auto& transform = edge::GetInputFromImage(buffer.image, resize_mode, required_input_tensor_shape[2],
+		                                                required_input_tensor_shape[1], engine.GetInputBuffer());
+		metrics.preprocess_us->Record(stage_timer.Lap());
+		const auto& results = engine.RunInference();
+		metrics.RecordInference(stage_timer.Lap());
+		edge::FrameResult frame_result;
+		frame_result.frame_id = buffer.sequence;
+		frame_result.timestamp_us = buffer.timestamp_us;
+		frame_result.width = camera_width;
+		frame_result.height = camera_height;
+		frame_result.detections = engine.DetectWithOutputVector(results,threshold,transform);
+		if(dispatcher.WantsFrame())
+		{
+			frame_result.frame.create(camera_height, camera_width, CV_8UC3);
+			edge::ConvertYuvToRgb(buffer.image, camera_width, camera_height, frame_result.frame.data,
+			                      static_cast<int>(frame_result.frame.step), true);
+		}
+		source.Requeue(buffer);
+		metrics.postprocess_us->Record(stage_timer.Lap());
+		dispatcher.Publish(frame_result, cv::Mat());
+		metrics.publish_us->Record(stage_timer.Lap());
+		metrics.RecordResult(frame_result.timestamp_us);
+
+		if(dispatcher.QuitRequested())
+			break;
+	}
+	source.Stop();
+	dispatcher.Stop();
+	return 0;
+}
+
 int main(int argc, char** argv) {
 	const auto &args = parse_args(argc, argv);
 	// Building Interpreter.
@@ -58,7 +130,59 @@ int main(int argc, char** argv) {
 					edgetpu::EdgeTpuManager::GetSingleton()->OpenDevice();
 
 	edge::DetectionEngine engine(model_path,label_path,edgetpu_context,with_edgetpu);
+	if (args.count("record_tensors") && !engine.StartTensorRecording(args["record_tensors"].as<std::string>()))
+	{
+		return 1;
+	}
+	if (args["profile"].as<bool>()) engine.SetProfiling(true);
 	const auto& required_input_tensor_shape = engine.GetInputShape();
+	edge::ResizeMode resize_mode;
+	if(!edge::ParseResizeMode(args["resize_mode"].as<std::string>(), &resize_mode))
+	{
+		std::cout << "Unknown resize mode " << args["resize_mode"].as<std::string>() << std::endl;
+		return 1;
+	}
+
+	// Declared before the capture objects whose counters it reads, the exporter after them.
+	edge::MetricsRegistry metrics_registry;
+	edge::CameraMetrics metrics(metrics_registry, with_edgetpu ? "edgetpu" : "cpu");
+	const auto& metrics_file = args["metrics_file"].as<std::string>();
+	const int metrics_port = args["metrics_port"].as<int>();
+
+	const auto& v4l2_device = args["v4l2_device"].as<std::string>();
+	const auto& yuv_file = args["yuv_file"].as<std::string>();
+	if(!v4l2_device.empty() || !yuv_file.empty())
+	{
+		edge::PixelFormat pixel_format;
+		if(!edge::ParsePixelFormat(args["pixel_format"].as<std::string>(), &pixel_format))
+		{
+			std::cout << "Unknown pixel format " << args["pixel_format"].as<std::string>() << std::endl;
+			return 1;
+		}
+		std::unique_ptr<edge::CaptureSource> yuv_source;
+		if(!v4l2_device.empty())
+		{
+			yuv_source.reset(new edge::V4l2Capture(v4l2_device, image_width, image_height, pixel_format, 4,
+			                                       args["export_dmabuf"].as<bool>()));
+		}
+		else
+		{
+			yuv_source.reset(new edge::FileCaptureSource(yuv_file, image_width, image_height, pixel_format, 30.0));
+		}
+		const auto dispatcher = edge::MakeResultDispatcher(args["headless"].as<bool>(), "DETECTIONS",
+		                                                   args["json_out"].as<std::string>(),
+		                                                   args["record_out"].as<std::string>(),
+		                                                   args["video_out"].as<std::string>(), 30.0);
+		edge::MetricsExporter metrics_exporter(metrics_registry, metrics_file, metrics_port);
+		if ((!metrics_file.empty() || metrics_port > 0) && !metrics_exporter.Start())
+		{
+			return 1;
+		}
+		const int status = RunYuvCapture(*yuv_source, engine, threshold, resize_mode, *dispatcher, metrics);
+		metrics_exporter.Stop();
+		if (engine.IsProfiling()) std::cout << engine.ProfileReport();
+		return status;
+	}
 
 	cv::VideoCapture cam_frame;
 	cam_frame.open(source);
@@ -95,16 +219,50 @@ int main(int argc, char** argv) {
 		return 0;
 	}
 
-	while(true)
+	const auto dispatcher = edge::MakeResultDispatcher(args["headless"].as<bool>(), "DETECTIONS",
+	                                                   args["json_out"].as<std::string>(),
+	                                                   args["record_out"].as<std::string>(),
+	                                                   args["video_out"].as<std::string>(), 30.0);
+	edge::FramePool frame_pool(edge::kDefaultFramePoolSize, camera_height, camera_width, frame.type());
+	edge::SpscQueue<edge::FrameHandle> captured_frames(edge::kDefaultFramePoolSize);
+	edge::FrameGrabber grabber(cam_frame, frame_pool, captured_frames);
+	metrics.WatchCapture(grabber, frame_pool, captured_frames);
+	edge::MetricsExporter metrics_exporter(metrics_registry, metrics_file, metrics_port);
+	if ((!metrics_file.empty() || metrics_port > 0) && !metrics_exporter.Start())
 	{
-		cam_frame >> frame;
-		const auto& input = edge::GetInputFromImage(frame,required_input_tensor_shape[2],required_input_tensor_shape[1],required_input_tensor_shape[3]);
-		const auto& results = engine.RunInference(input);
-		const auto& detection_result = engine.DetectWithOutputVector(results,threshold);
-		edge::DetectionEngine::img_overlay(frame,detection_result,image_width,image_height);
-
-		char c=(char)cv::waitKey(25);
-		if(c==27)
+		return 1;
+	}
+	grabber.Start();
+	edge::FrameHandle handle;
+	uint64_t skipped_frames;
+	while(edge::PopLatestFrame(captured_frames, frame_pool, grabber, &handle, &skipped_frames))
+	{
+		metrics.frames_skipped->Increment(skipped_frames);
+		edge::StageTimer stage_timer;
+		cv::Mat& frame = frame_pool.Frame(handle);
+		const auto& transform = edge::GetInputFromImage(frame, resize_mode, required_input_tensor_shape[2],
+		                                                required_input_tensor_shape[1], engine.GetInputBuffer());
+		metrics.preprocess_us->Record(stage_timer.Lap());
+		const auto& results = engine.RunInference();
+		metrics.RecordInference(stage_timer.Lap());
+		const auto& detection_result = engine.DetectWithOutputVector(results,threshold,transform);
+		metrics.postprocess_us->Record(stage_timer.Lap());
+		edge::FrameResult frame_result;
+		frame_result.frame_id = handle.frame_id;
+		frame_result.timestamp_us = handle.capture_time_us;
+		frame_result.width = camera_width;
+		frame_result.height = camera_height;
+		frame_result.detections = detection_result;
+		dispatcher->Publish(frame_result, frame);
+		frame_pool.Release(handle);
+		metrics.publish_us->Record(stage_timer.Lap());
+		metrics.RecordResult(frame_result.timestamp_us);
+
+		if(dispatcher->QuitRequested())
 			break;
 	}
+	grabber.Stop();
+	dispatcher->Stop();
+	metrics_exporter.Stop();
+	if (engine.IsProfiling()) std::cout << engine.ProfileReport();
 }
\ No newline at end of file
@@ -10,6 +10,12 @@
 
 namespace edge {
 	void DetectionEngine::img_overlay(cv::Mat& frame, const std::vector<DetectionCandidate>& ret, const int& width, const int& height)
+	{
+		draw_overlay(frame, ret, width, height);
+		cv::imshow("Detections", frame);
+	}
+
+	void DetectionEngine::draw_overlay(cv::Mat& frame, const std::vector<DetectionCandidate>& ret, const int& width, const int& height)
 	{
 		for (const auto& candidate : ret) {
 			int top = static_cast<int>(candidate.y1 * height + 0.5f);
@@ -28,17 +34,23 @@ namespace edge {
 			cv::putText(
 							frame, s, cv::Point(lft, top - 5), cv::FONT_HERSHEY_COMPLEX, .8, cvred, 1.5, 8, false);
 		}
-		cv::imshow("Detections", frame);
 	}
 
 	std::vector<DetectionCandidate> DetectionEngine::DetectWithOutputVector(
-					const std::vector<float>& inf_vec,const float& threshold)
+					const std::vector<float>& inf_vec,const float& threshold, const AffineTransform& transform)
+	{
+		return DetectWithOutputVector(inf_vec, m_output_shape, m_labels, threshold, transform);
+	}
+
+	std::vector<DetectionCandidate> DetectionEngine::DetectWithOutputVector(
+					const std::vector<float>& inf_vec, const std::vector<size_t>& output_shape,
+					const LabelTable& labels, const float& threshold, const AffineTransform& transform)
 	{
 		const auto* result_raw = inf_vec.data();
-		std::vector<std::vector<float>> results(m_output_shape.size());
+		std::vector<std::vector<float>> results(output_shape.size());
 		int offset = 0;
-		for(size_t i=0; i < m_output_shape.size();++i) {
-			const size_t size_of_output_tensor_i = m_output_shape[i];
+		for(size_t i=0; i < output_shape.size();++i) {
+			const size_t size_of_output_tensor_i = output_shape[i];
 			results[i].resize(size_of_output_tensor_i);
 			std::memcpy(results[i].data(), result_raw + offset, sizeof(float) * size_of_output_tensor_i);
 			offset += size_of_output_tensor_i;
@@ -50,12 +62,12 @@ namespace edge {
 				float score = results[2][i];
 				if (score > threshold) {
 					DetectionCandidate result;
-					result.candidate = m_labels.at(id);
+					result.candidate = labels.empty() ? std::to_string(id) : labels.at(id).str();
 					result.score = score;
-					result.y1 = std::max(static_cast<float>(0.0), results[0][4 * i]);
-					result.x1 = std::max(static_cast<float>(0.0), results[0][4 * i + 1]);
-					result.y2 = std::min(static_cast<float>(1.0), results[0][4 * i + 2]);
-					result.x2 = std::min(static_cast<float>(1.0), results[0][4 * i + 3]);
+					result.y1 = std::max(static_cast<float>(0.0), transform.Y(results[0][4 * i]));
+					result.x1 = std::max(static_cast<float>(0.0), transform.X(results[0][4 * i + 1]));
+					result.y2 = std::min(static_cast<float>(1.0), transform.Y(results[0][4 * i + 2]));
+					result.x2 = std::min(static_cast<float>(1.0), transform.X(results[0][4 * i + 3]));
 					inf_results.push_back(result);
 				}
 			}
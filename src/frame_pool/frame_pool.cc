@@ -0,0 +1,124 @@
+//
+// Pooled frame storage and the capture thread feeding it.
+//
+
+#include "frame_pool.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+namespace edge {
+	namespace {
+		int64_t NowMicros() {
+			return std::chrono::duration_cast<std::chrono::microseconds>(
+							std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+	}
+
+	FramePool::FramePool(size_t capacity, int height, int width, int type)
+					: m_storage(nullptr), m_free(capacity) {
+		const cv::Mat probe(1, 1, type);
+		const size_t row_bytes = static_cast<size_t>(width) * probe.elemSize();
+		// Pad every frame to a whole number of cache lines so neighbouring buffers
+		// never share a line while different threads write them.
+		const size_t frame_bytes = (row_bytes * height + kCacheLineSize - 1) / kCacheLineSize * kCacheLineSize;
+		void* storage = nullptr;
+		if (posix_memalign(&storage, kCacheLineSize, frame_bytes * capacity) != 0) {
+			std::cout << "Failed to allocate frame pool\n";
+			std::abort();
+		}
+		m_storage = static_cast<uint8_t*>(storage);
+		m_frames.reserve(capacity);
+		for (size_t i = 0; i < capacity; ++i) {
+			m_frames.emplace_back(height, width, type, m_storage + i * frame_bytes, row_bytes);
+			m_free.TryPush(static_cast<int>(i));
+		}
+	}
+
+	FramePool::~FramePool() {
+		m_frames.clear();
+		free(m_storage);
+	}
+
+	bool FramePool::Acquire(FrameHandle* handle) {
+		int index;
+		if (!m_free.TryPop(&index)) return false;
+		handle->index = index;
+		return true;
+	}
+
+	void FramePool::Release(const FrameHandle& handle) {
+		if (handle.index >= 0) m_free.TryPush(handle.index);
+	}
+
+	FrameGrabber::FrameGrabber(cv::VideoCapture& capture, FramePool& pool, SpscQueue<FrameHandle>& output)
+					: m_capture(capture), m_pool(pool), m_output(output), m_running(false), m_captured(0),
+					  m_dropped(0) {}
+
+	FrameGrabber::~FrameGrabber() {
+		Stop();
+	}
+
+	void FrameGrabber::Start() {
+		if (m_running.exchange(true)) return;
+		m_thread = std::thread(&FrameGrabber::CaptureLoop, this);
+	}
+
+	void FrameGrabber::Stop() {
+		m_running.store(false, std::memory_order_release);
+		if (m_thread.joinable()) m_thread.join();
+	}
+
+	void FrameGrabber::CaptureLoop() {
+		cv::Mat scratch;
+		uint64_t frame_id = 0;
+		while (m_running.load(std::memory_order_acquire)) {
+			FrameHandle handle;
+			if (!m_pool.Acquire(&handle)) {
+				// Keep the camera drained so the next frame we hand out is fresh.
+				m_capture.read(scratch);
+				m_captured.fetch_add(1, std::memory_order_relaxed);
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				frame_id++;
+				continue;
+			}
+			// VideoCapture reuses the destination buffer when size and type match,
+			// so the pixels land directly in the pooled storage.
+			cv::Mat& frame = m_pool.Frame(handle);
+			uint8_t* const pooled_data = frame.data;
+			if (!m_capture.read(frame) || frame.empty()) {
+				std::cout << "Camera stopped delivering frames" << std::endl;
+				m_pool.Release(handle);
+				m_running.store(false, std::memory_order_release);
+				break;
+			}
+			if (frame.data != pooled_data) {
+				std::cout << "Camera frame geometry changed, frame pool buffer was reallocated" << std::endl;
+			}
+			m_captured.fetch_add(1, std::memory_order_relaxed);
+			handle.frame_id = frame_id++;
+			handle.capture_time_us = NowMicros();
+			if (!m_output.TryPush(handle)) {
+				m_pool.Release(handle);
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool PopLatestFrame(SpscQueue<FrameHandle>& queue, FramePool& pool, const FrameGrabber& grabber,
+	                    FrameHandle* handle, uint64_t* skipped) {
+		while (!queue.TryPop(handle)) {
+			if (!grabber.Running()) return false;
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+		FrameHandle newer;
+		if (skipped) *skipped = 0;
+		while (queue.TryPop(&newer)) {
+			pool.Release(*handle);
+			*handle = newer;
+			if (skipped) ++*skipped;
+		}
+		return true;
+	}
+}
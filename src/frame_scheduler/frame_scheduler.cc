@@ -0,0 +1,140 @@
+//
+// Admission, cadence and level control of the FrameScheduler.
+//
+
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace edge {
+	namespace {
+		// Samples kept per window, about two seconds of frames at 30 fps.
+		constexpr size_t kWindowSize = 64;
+		// Weight of the newest capture interval in the smoothed one.
+		constexpr double kIntervalSmoothing = 0.1;
+		// A frame queued for longer than this many capture intervals has been superseded by a
+		// newer one.
+		constexpr double kSupersededIntervals = 1.5;
+		// Only step up to a more expensive level predicted to use at most this share of the budget.
+		constexpr double kStepUpMargin = 0.8;
+		// Consecutive frames with headroom required before stepping up, avoids oscillating.
+		constexpr int kStepUpFrames = 30;
+		// Frames measured on a level before it may be left for a cheaper one, so a single slow
+		// frame does not trigger a switch.
+		constexpr int kMinFramesOnLevel = 4;
+	}
+
+	void FrameScheduler::Window::Add(const double value) {
+		if (m_values.size() < kWindowSize) {
+			m_values.push_back(value);
+			return;
+		}
+		m_values[m_next] = value;
+		m_next = (m_next + 1) % kWindowSize;
+	}
+
+	double FrameScheduler::Window::Percentile(const double p) const {
+		if (m_values.empty()) return 0.0;
+		m_sorted.assign(m_values.begin(), m_values.end());
+		const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * m_sorted.size()));
+		const size_t index = std::min(m_sorted.size() - 1, rank > 0 ? rank - 1 : 0);
+		std::nth_element(m_sorted.begin(), m_sorted.begin() + index, m_sorted.end());
+		return m_sorted[index];
+	}
+
+	FrameScheduler::FrameScheduler(const FrameSchedulerOptions& options)
+					: m_options(options), m_budget_us(static_cast<int64_t>(options.latency_budget_ms * 1000.0f)),
+					  m_level(0), m_frames_on_level(0), m_headroom_frames(0), m_last_capture_us(-1), m_interval_us(0.0),
+					  m_last_start_us(-1), m_dropped(0), m_skipped(0), m_over_budget(0) {
+		if (m_options.level_costs.empty()) m_options.level_costs.push_back(1.0f);
+		for (float cost : m_options.level_costs) {
+			m_levels.emplace_back();
+			m_levels.back().cost = cost > 0.0f ? cost : 1.0f;
+		}
+	}
+
+	double FrameScheduler::ServiceEstimateUs(const int level) const {
+		const LevelState& state = m_levels[level];
+		if (!state.service_us.Empty()) return state.service_us.Percentile(m_options.percentile);
+		// Never measured: scale the nearest measured level by the relative costs.
+		for (int distance = 1; distance < NumLevels(); ++distance) {
+			for (int other : {level - distance, level + distance}) {
+				if (other < 0 || other >= NumLevels() || m_levels[other].service_us.Empty()) continue;
+				return m_levels[other].service_us.Percentile(m_options.percentile) * state.cost / m_levels[other].cost;
+			}
+		}
+		return 0.0;
+	}
+
+	double FrameScheduler::ServiceEstimateMs(const int level) const {
+		return ServiceEstimateUs(level) / 1000.0;
+	}
+
+	FrameDecision FrameScheduler::Admit(const int64_t capture_us, const int64_t now_us) {
+		if (m_last_capture_us >= 0 && capture_us > m_last_capture_us) {
+			const double interval = static_cast<double>(capture_us - m_last_capture_us);
+			m_interval_us = m_interval_us > 0.0 ? (1.0 - kIntervalSmoothing) * m_interval_us + kIntervalSmoothing * interval
+			                                    : interval;
+		}
+		m_last_capture_us = std::max(m_last_capture_us, capture_us);
+
+		FrameDecision decision;
+		decision.level = m_level;
+		const int64_t age_us = now_us - capture_us;
+		// Without results for a whole budget the frame is processed regardless, so a system
+		// that cannot meet the budget at all still delivers results.
+		const bool starving = m_last_start_us < 0 || now_us - m_last_start_us >= m_budget_us;
+		// Ages include however long capture itself takes; the youngest recent frame shows that.
+		m_age_us.Add(static_cast<double>(age_us));
+		const double queued_us = age_us - m_age_us.Percentile(0.0);
+		if (m_interval_us > 0.0 && queued_us > kSupersededIntervals * m_interval_us) {
+			// A newer frame is already waiting behind this one: keep pace with the engine by
+			// moving on to it instead of working through the backlog.
+			decision.action = FrameAction::kSkip;
+			++m_skipped;
+			return decision;
+		}
+		const double service_us = ServiceEstimateUs(m_level);
+		if (!starving && service_us <= m_budget_us && age_us + service_us > m_budget_us) {
+			// A fresher frame could still make the budget, this one cannot.
+			decision.action = FrameAction::kDrop;
+			++m_dropped;
+			return decision;
+		}
+		m_last_start_us = now_us;
+		return decision;
+	}
+
+	void FrameScheduler::Complete(const int64_t capture_us, const int64_t start_us, const int64_t end_us,
+	                              const int level) {
+		const int64_t latency_us = std::max<int64_t>(0, end_us - capture_us);
+		m_latency_us.Record(static_cast<uint64_t>(latency_us));
+		if (latency_us > m_budget_us) ++m_over_budget;
+		if (level < 0 || level >= NumLevels()) return;
+		m_levels[level].service_us.Add(static_cast<double>(end_us - start_us));
+		m_wait_us.Add(static_cast<double>(std::max<int64_t>(0, start_us - capture_us)));
+		if (level == m_level) Adapt();
+	}
+
+	void FrameScheduler::Adapt() {
+		++m_frames_on_level;
+		const double wait_us = m_wait_us.Percentile(m_options.percentile);
+		if (m_level + 1 < NumLevels() && m_frames_on_level >= kMinFramesOnLevel &&
+		    wait_us + ServiceEstimateUs(m_level) > m_budget_us) {
+			m_level++;
+			m_frames_on_level = 0;
+			m_headroom_frames = 0;
+			return;
+		}
+		if (m_level > 0 && wait_us + ServiceEstimateUs(m_level - 1) <= kStepUpMargin * m_budget_us) {
+			if (++m_headroom_frames >= kStepUpFrames) {
+				m_level--;
+				m_frames_on_level = 0;
+				m_headroom_frames = 0;
+			}
+		} else {
+			m_headroom_frames = 0;
+		}
+	}
+}
@@ -0,0 +1,187 @@
+//
+// Synthetic load test of the FrameScheduler. A simulated camera feeds a driver-style FIFO
+// of a few buffers and a simulated engine, slower than the camera and with periodic load
+// spikes, works through it. The run is repeated in virtual time for three policies:
+// processing every queued frame, always taking the newest frame as PopLatestFrame does,
+// and letting the scheduler drop, skip and downscale. Each row reports the capture to
+// result latency against the budget.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cxxopts.hpp"
+#include "frame_scheduler.h"
+#include "latency_histogram.h"
+
+cxxopts::ParseResult parse_args(int argc, char** argv) {
+	cxxopts::Options options("frame_scheduler_benchmark", "Simulates a slow engine behind the frame scheduler");
+
+	options.add_options()
+					("fps", "Camera frame rate.", cxxopts::value<float>()->default_value("30"))
+					("seconds", "Simulated run time.", cxxopts::value<float>()->default_value("300"))
+					("queue", "Capture buffers queued ahead of the engine; frames arriving while all are full are lost.", cxxopts::value<int>()->default_value("4"))
+					("capture_delay_ms", "Time from capture until the frame can be dequeued.", cxxopts::value<float>()->default_value("5"))
+					("service_ms", "Median inference time of the most expensive level.", cxxopts::value<float>()->default_value("40"))
+					("jitter", "Log-normal sigma of the inference time.", cxxopts::value<float>()->default_value("0.15"))
+					("level_costs", "Comma separated relative inference cost of each level.", cxxopts::value<std::vector<float>>()->default_value("1,0.56,0.32"))
+					("spike_period_s", "Seconds between load spikes, 0 for none.", cxxopts::value<float>()->default_value("20"))
+					("spike_s", "Duration of a load spike.", cxxopts::value<float>()->default_value("5"))
+					("spike_factor", "Inference slowdown during a spike.", cxxopts::value<float>()->default_value("2.5"))
+					("budget_ms", "Capture to result latency budget.", cxxopts::value<float>()->default_value("100"))
+					("percentile", "Latency percentile held to the budget.", cxxopts::value<float>()->default_value("95"))
+					("seed", "Random seed of the inference times.", cxxopts::value<int>()->default_value("1"))
+					("help", "Print Usage");
+
+	const auto& args = options.parse(argc, argv);
+	if (args.count("help")) {
+		std::cerr << options.help() << "\n";
+		exit(0);
+	}
+	return args;
+}
+
+// An engine whose inference time is log-normal around a median that scales with the
+// level cost and rises by `spike_factor` for `spike_us` of every `spike_period_us`.
+class SimulatedEngine {
+public:
+	SimulatedEngine(const double service_us, const double jitter, const std::vector<float>& level_costs,
+	                const int64_t spike_period_us, const int64_t spike_us, const double spike_factor, const int seed)
+					: m_service_us(service_us), m_level_costs(level_costs), m_spike_period_us(spike_period_us),
+					  m_spike_us(spike_us), m_spike_factor(spike_factor), m_random(seed), m_jitter(0.0, jitter) {}
+
+	int64_t InferenceUs(const int level, const int64_t now_us) {
+		double service_us = m_service_us * m_level_costs[level] * std::exp(m_jitter(m_random));
+		if (m_spike_period_us > 0 && now_us % m_spike_period_us >= m_spike_period_us - m_spike_us) {
+			service_us *= m_spike_factor;
+		}
+		return static_cast<int64_t>(service_us);
+	}
+
+private:
+	double m_service_us;
+	std::vector<float> m_level_costs;
+	int64_t m_spike_period_us;
+	int64_t m_spike_us;
+	double m_spike_factor;
+	std::mt19937 m_random;
+	std::normal_distribution<double> m_jitter;
+};
+
+enum class Policy { kEveryFrame, kLatestFrame, kScheduler };
+
+struct RunResult {
+	edge::LatencyHistogram latency_us;
+	uint64_t lost = 0;
+	uint64_t skipped = 0;
+	uint64_t dropped = 0;
+	uint64_t over_budget = 0;
+	std::vector<uint64_t> frames_per_level;
+};
+
+struct Simulation {
+	int64_t interval_us;
+	int64_t capture_delay_us;
+	int64_t duration_us;
+	size_t queue_capacity;
+	int64_t budget_us;
+	edge::FrameSchedulerOptions options;
+};
+
+// The cost of looking at a frame and discarding it.
+constexpr int64_t kDiscardUs = 50;
+
+RunResult Run(const Simulation& sim, const Policy policy, SimulatedEngine engine) {
+	RunResult result;
+	result.frames_per_level.assign(sim.options.level_costs.size(), 0);
+	edge::FrameScheduler scheduler(sim.options);
+	std::deque<int64_t> queue;
+	int64_t next_frame = 0;
+	int64_t now_us = 0;
+	while (now_us < sim.duration_us) {
+		// Frames whose capture completed by now enter the queue, or are lost if it is full.
+		for (; next_frame * sim.interval_us + sim.capture_delay_us <= now_us; ++next_frame) {
+			if (queue.size() < sim.queue_capacity) queue.push_back(next_frame * sim.interval_us);
+			else result.lost++;
+		}
+		if (queue.empty()) {
+			now_us = next_frame * sim.interval_us + sim.capture_delay_us;
+			continue;
+		}
+		int64_t capture_us;
+		if (policy == Policy::kLatestFrame) {
+			capture_us = queue.back();
+			result.skipped += queue.size() - 1;
+			queue.clear();
+		} else {
+			capture_us = queue.front();
+			queue.pop_front();
+		}
+		int level = 0;
+		if (policy == Policy::kScheduler) {
+			const edge::FrameDecision decision = scheduler.Admit(capture_us, now_us);
+			if (decision.action != edge::FrameAction::kProcess) {
+				if (decision.action == edge::FrameAction::kSkip) result.skipped++;
+				else result.dropped++;
+				now_us += kDiscardUs;
+				continue;
+			}
+			level = decision.level;
+		}
+		const int64_t start_us = now_us;
+		now_us += engine.InferenceUs(level, now_us);
+		if (policy == Policy::kScheduler) scheduler.Complete(capture_us, start_us, now_us, level);
+		result.latency_us.Record(static_cast<uint64_t>(now_us - capture_us));
+		if (now_us - capture_us > sim.budget_us) result.over_budget++;
+		result.frames_per_level[level]++;
+	}
+	return result;
+}
+
+int main(int argc, char** argv) {
+	const auto& args = parse_args(argc, argv);
+	Simulation sim;
+	sim.interval_us = static_cast<int64_t>(1e6 / args["fps"].as<float>());
+	sim.capture_delay_us = static_cast<int64_t>(args["capture_delay_ms"].as<float>() * 1000);
+	sim.duration_us = static_cast<int64_t>(args["seconds"].as<float>() * 1e6);
+	sim.queue_capacity = static_cast<size_t>(std::max(1, args["queue"].as<int>()));
+	sim.options.latency_budget_ms = args["budget_ms"].as<float>();
+	sim.options.percentile = args["percentile"].as<float>();
+	sim.options.level_costs = args["level_costs"].as<std::vector<float>>();
+	sim.budget_us = static_cast<int64_t>(sim.options.latency_budget_ms * 1000);
+	const float percentile = sim.options.percentile;
+	const SimulatedEngine engine(args["service_ms"].as<float>() * 1000, args["jitter"].as<float>(),
+	                             sim.options.level_costs,
+	                             static_cast<int64_t>(args["spike_period_s"].as<float>() * 1e6),
+	                             static_cast<int64_t>(args["spike_s"].as<float>() * 1e6), args["spike_factor"].as<float>(),
+	                             args["seed"].as<int>());
+
+	std::printf("%.0f fps camera, %.0f ms median inference, budget %.0f ms at p%.0f\n\n", args["fps"].as<float>(),
+	            args["service_ms"].as<float>(), sim.options.latency_budget_ms, percentile);
+	std::printf("%-12s %9s %7s %7s %7s %9s %9s %9s %9s %7s %s\n", "policy", "results/s", "lost", "skipped", "dropped",
+	            "p50 ms", "p95 ms", "p99 ms", "max ms", "over", "frames per level");
+	const struct {
+		const char* name;
+		Policy policy;
+	} kPolicies[] = {{"every frame", Policy::kEveryFrame}, {"latest", Policy::kLatestFrame},
+	                 {"scheduler", Policy::kScheduler}};
+	for (const auto& entry : kPolicies) {
+		const RunResult result = Run(sim, entry.policy, engine);
+		const edge::LatencyHistogram& latency = result.latency_us;
+		std::string levels;
+		for (uint64_t frames : result.frames_per_level) levels += " " + std::to_string(frames);
+		std::printf("%-12s %9.2f %7llu %7llu %7llu %9.1f %9.1f %9.1f %9.1f %6.1f%%%s\n", entry.name,
+		            latency.Count() / (sim.duration_us / 1e6), static_cast<unsigned long long>(result.lost),
+		            static_cast<unsigned long long>(result.skipped), static_cast<unsigned long long>(result.dropped),
+		            latency.Percentile(50) / 1000.0, latency.Percentile(95) / 1000.0, latency.Percentile(99) / 1000.0,
+		            latency.Max() / 1000.0, latency.Count() ? 100.0 * result.over_budget / latency.Count() : 0.0,
+		            levels.c_str());
+	}
+}
@@ -3,14 +3,24 @@
 //
 
 #include <algorithm>
+#include <deque>
 #include <iostream>
 #include <memory>
 #include <ostream>
 #include <string>
 
+#include "adaptive_pose_engine.h"
+#include "camera_metrics.h"
 #include "edgetpu.h"
+#include "frame_pool.h"
+#include "frame_scheduler.h"
 #include "img_prep.h"
+#include "metrics_exporter.h"
+#include "preprocess_executor.h"
+#include "result_sink.h"
 #include "humanpose_engine.h"
+#include "segmented_pipeline.h"
+#include "worker_pool.h"
 #include "cxxopts.hpp"
 #include "opencv2/opencv.hpp"
 
@@ -19,16 +29,38 @@ cxxopts::ParseResult parse_args(int argc, char** argv) {
 
 	options.add_options()
 					("model_path", "Path to .tflite/.edgetpu model_file", cxxopts::value<std::string>())
+					("segment_paths", "Comma separated model segments to pipeline, one per EdgeTPU.", cxxopts::value<std::vector<std::string>>())
+					("adaptive_model_paths", "Comma separated resolutions of one model, switched at runtime to meet the latency budget.", cxxopts::value<std::vector<std::string>>())
+					("latency_budget_ms", "Inference latency budget for --adaptive_model_paths.", cxxopts::value<float>()->default_value("33"))
 					("video_source", "Video source.", cxxopts::value<int>()->default_value("0"))
 					("Pose_threshold", "Minimum pose confidence threshold.", cxxopts::value<float>()->default_value("0.3"))
 					("Keypoint_threshold", "Minimum key-point confidence threshold", cxxopts::value<float>()->default_value(("0.3")))
 					("edgetpu", "To run with EdgeTPU.", cxxopts::value<bool>()->default_value("false"))
 					("height", "Camera image height.", cxxopts::value<int>()->default_value("480"))
 					("width", "Camera image width.", cxxopts::value<int>()->default_value("640"))
+					("headless", "Run without display, e.g. on a server or in a container.", cxxopts::value<bool>()->default_value("false"))
+					("json_out", "Write per-frame results as JSON lines to this file, - for stdout.", cxxopts::value<std::string>()->default_value(""))
+					("record_out", "Write per-frame results as binary records to this file.", cxxopts::value<std::string>()->default_value(""))
+					("video_out", "Write the annotated frames to this video file.", cxxopts::value<std::string>()->default_value(""))
+					("resize_mode", "Fit frames to the model input by stretch, letterbox or crop.", cxxopts::value<std::string>()->default_value("stretch"))
+					("preprocess_threads", "Threads resizing each frame into the model input.", cxxopts::value<int>()->default_value("1"))
+					("decode_threads", "Threads decoding the poses of crowded frames in parallel.", cxxopts::value<int>()->default_value("1"))
+					("decode_stage", "Decode poses on a thread of their own while the EdgeTPU runs the next frame.", cxxopts::value<bool>()->default_value("false"))
+					("max_detections", "Override the maximum poses per frame, at most the model's value.", cxxopts::value<int>())
+					("decoder_score_threshold", "Override the root and pose score threshold of the decoder.", cxxopts::value<float>())
+					("nms_radius", "Override the keypoint NMS radius of the decoder in pixels.", cxxopts::value<float>())
+					("refinement_steps", "Override the short offset refinement steps per keypoint.", cxxopts::value<int>())
+					("local_maximum_radius", "Override the window root candidates must be a maximum of.", cxxopts::value<int>())
+					("record_tensors", "Record the PosenetDecoderOp inputs of every frame to this file for decoder_replay, needs --model_path without --decode_stage.", cxxopts::value<std::string>())
+					("profile", "Time every operator of the model and print the report on exit, needs --model_path without --decode_stage.", cxxopts::value<bool>()->default_value("false"))
+					("latency_slo_ms", "Drop and skip frames so the capture to result latency percentile stays within this budget, 0 to disable. Not applied to --segment_paths or --decode_stage.", cxxopts::value<float>()->default_value("0"))
+					("latency_slo_percentile", "Latency percentile held to --latency_slo_ms.", cxxopts::value<float>()->default_value("95"))
+					("metrics_file", "Rewrite Prometheus metrics to this file every second.", cxxopts::value<std::string>()->default_value(""))
+					("metrics_port", "Serve Prometheus metrics on this localhost port, 0 to disable.", cxxopts::value<int>()->default_value("0"))
 					("help", "Print Usage");
 
 	const auto& args = options.parse(argc, argv);
-	if (args.count("help") || !args.count("model_path")) {
+	if (args.count("help") || (!args.count("model_path") && !args.count("segment_paths") && !args.count("adaptive_model_paths"))) {
 		std::cerr << options.help() << "\n";
 		exit(0);
 	}
@@ -38,13 +70,18 @@ cxxopts::ParseResult parse_args(int argc, char** argv) {
 int main(int argc, char** argv)
 {
 	const auto &args = parse_args(argc, argv);
-	const auto &model_path = args["model_path"].as<std::string>();
+	const auto &model_path = args.count("model_path") ? args["model_path"].as<std::string>() : std::string();
 	const auto &pose_threshold = args["Pose_threshold"].as<float>();
 	const auto &keypoint_threshold = args["Keypoint_threshold"].as<float>();
 	const auto &with_edgetpu = args["edgetpu"].as<bool>();
 	const auto &image_height = args["height"].as<int>();
 	const auto &image_width = args["width"].as<int>();
 	const auto &source = args["video_source"].as<int>();
+	edge::ResizeMode resize_mode;
+	if (!edge::ParseResizeMode(args["resize_mode"].as<std::string>(), &resize_mode)) {
+		std::cout << "Unknown resize mode " << args["resize_mode"].as<std::string>() << std::endl;
+		return 1;
+	}
 
 	std::cout << std::endl << "Model Path : " << model_path << std::endl;
 	std::cout << "Pose Threshold : " << pose_threshold << std::endl;
@@ -53,13 +90,85 @@ int main(int argc, char** argv)
 	std::cout << "Camera Height : " << image_height << std::endl;
 	std::cout << "Camera Width : " << image_width << std::endl;
 	std::cout << "Camera Source : " << source << std::endl;
+	std::cout << "Preprocessing Threads : " << args["preprocess_threads"].as<int>() << std::endl;
+	std::cout << "Decoding Threads : " << args["decode_threads"].as<int>() << std::endl;
+	std::cout << "Decode Stage : " << args["decode_stage"].as<bool>() << std::endl;
 
 
-	std::shared_ptr<edgetpu::EdgeTpuContext> edgetpu_context =
-					edgetpu::EdgeTpuManager::GetSingleton()->OpenDevice();
-
-	edge::HumanPoseEngine engine(model_path, edgetpu_context, with_edgetpu);
-	const auto& required_input_tensor_shape = engine.GetInputShape();
+	// Declared before the engines so it outlives their decoder ops.
+	std::unique_ptr<edge::WorkerPool> decode_pool;
+	// A segmented model runs as a pipeline with one segment per Edge TPU, otherwise the
+	// whole model runs on the default device. Splitting off the decoder pipelines a single
+	// model as well.
+	std::unique_ptr<edge::HumanPoseEngine> engine;
+	std::unique_ptr<edge::SegmentedPipeline> pipeline;
+	std::unique_ptr<edge::AdaptivePoseEngine> adaptive;
+	const bool decode_stage = args["decode_stage"].as<bool>();
+	if (args.count("segment_paths") || (decode_stage && !args.count("adaptive_model_paths"))) {
+		const auto segment_paths = args.count("segment_paths") ? args["segment_paths"].as<std::vector<std::string>>()
+		                                                       : std::vector<std::string>{model_path};
+		pipeline.reset(new edge::SegmentedPipeline(segment_paths,
+		                                           with_edgetpu ? edge::OpenAllEdgeTpus()
+		                                                        : std::vector<std::shared_ptr<edgetpu::EdgeTpuContext>>(),
+		                                           with_edgetpu, 2, decode_stage));
+	} else {
+		std::shared_ptr<edgetpu::EdgeTpuContext> edgetpu_context =
+						edgetpu::EdgeTpuManager::GetSingleton()->OpenDevice();
+		if (args.count("adaptive_model_paths")) {
+			adaptive.reset(new edge::AdaptivePoseEngine(args["adaptive_model_paths"].as<std::vector<std::string>>(),
+			                                            edgetpu_context, with_edgetpu,
+			                                            args["latency_budget_ms"].as<float>()));
+			adaptive->SetResizeMode(resize_mode);
+			if (decode_stage) std::cout << "--decode_stage is ignored with --adaptive_model_paths" << std::endl;
+		} else {
+			engine.reset(new edge::HumanPoseEngine(model_path, edgetpu_context, with_edgetpu));
+			if (args["profile"].as<bool>()) engine->SetProfiling(true);
+		}
+	}
+	if (args["profile"].as<bool>() && !engine) std::cout << "--profile is ignored without a single --model_path" << std::endl;
+	if (args["decode_threads"].as<int>() > 1) {
+		decode_pool.reset(new edge::WorkerPool(args["decode_threads"].as<int>()));
+		if (pipeline) {
+			pipeline->SetPosenetDecoderPool(decode_pool.get());
+		} else if (adaptive) {
+			adaptive->SetPosenetDecoderPool(decode_pool.get());
+		} else if (!engine->SetPosenetDecoderPool(decode_pool.get())) {
+			std::cout << "The model has no PosenetDecoderOp, poses are decoded sequentially" << std::endl;
+		}
+	}
+	// Decoder overrides start from the parameters baked into the model.
+	coral::PosenetDecoderParams decoder_params;
+	const bool has_decoder = pipeline ? pipeline->GetPosenetDecoderParams(&decoder_params)
+	                         : adaptive ? adaptive->GetPosenetDecoderParams(&decoder_params)
+	                                    : engine->GetPosenetDecoderParams(&decoder_params);
+	if (has_decoder) {
+		if (args.count("max_detections")) decoder_params.max_detections = args["max_detections"].as<int>();
+		if (args.count("decoder_score_threshold")) decoder_params.score_threshold = args["decoder_score_threshold"].as<float>();
+		if (args.count("nms_radius")) decoder_params.nms_radius = args["nms_radius"].as<float>();
+		if (args.count("refinement_steps")) decoder_params.mid_short_offset_refinement_steps = args["refinement_steps"].as<int>();
+		if (args.count("local_maximum_radius")) decoder_params.local_maximum_radius = args["local_maximum_radius"].as<int>();
+		const bool set = pipeline ? pipeline->SetPosenetDecoderParams(decoder_params)
+		                 : adaptive ? adaptive->SetPosenetDecoderParams(decoder_params)
+		                            : engine->SetPosenetDecoderParams(decoder_params);
+		if (!set) {
+			std::cout << "Invalid PoseNet decoder parameters" << std::endl;
+			return 1;
+		}
+		// Read back, max_detections may have been clamped.
+		if (pipeline) pipeline->GetPosenetDecoderParams(&decoder_params);
+		else if (adaptive) adaptive->GetPosenetDecoderParams(&decoder_params);
+		else engine->GetPosenetDecoderParams(&decoder_params);
+		std::cout << "Decoder : max_detections " << decoder_params.max_detections << ", score_threshold "
+		          << decoder_params.score_threshold << ", nms_radius " << decoder_params.nms_radius
+		          << ", refinement_steps " << decoder_params.mid_short_offset_refinement_steps
+		          << ", local_maximum_radius " << decoder_params.local_maximum_radius << std::endl;
+	}
+	// After the overrides, so the recording's metadata holds the parameters actually decoded with.
+	if (engine && args.count("record_tensors") && !engine->StartTensorRecording(args["record_tensors"].as<std::string>())) {
+		return 1;
+	}
+	const auto& required_input_tensor_shape = pipeline ? pipeline->GetInputShape()
+	                                          : adaptive ? adaptive->GetInputShape() : engine->GetInputShape();
 
 	cv::VideoCapture cam_frame;
 	cam_frame.open(source);
@@ -95,17 +204,121 @@ int main(int argc, char** argv)
 		std::cout << "The channels of the video-stream doesnt match the input channel dimension of the model" << std::endl;
 		return 0;
 	}
-	while(true)
+	// Frames stay checked out of the pool while they are in flight through the pipeline.
+	const size_t frames_in_flight = pipeline ? pipeline->NumStages() : 1;
+	const auto dispatcher = edge::MakeResultDispatcher(args["headless"].as<bool>(), "POSES",
+	                                                   args["json_out"].as<std::string>(),
+	                                                   args["record_out"].as<std::string>(),
+	                                                   args["video_out"].as<std::string>(), 30.0);
+	edge::FramePool frame_pool(edge::kDefaultFramePoolSize + frames_in_flight, camera_height, camera_width, frame.type());
+	edge::SpscQueue<edge::FrameHandle> captured_frames(edge::kDefaultFramePoolSize);
+	edge::FrameGrabber grabber(cam_frame, frame_pool, captured_frames);
+	edge::MetricsRegistry metrics_registry;
+	edge::CameraMetrics metrics(metrics_registry, with_edgetpu ? "edgetpu" : "cpu");
+	metrics.WatchCapture(grabber, frame_pool, captured_frames);
+	edge::MetricsExporter metrics_exporter(metrics_registry, args["metrics_file"].as<std::string>(),
+	                                       args["metrics_port"].as<int>());
+	if ((!args["metrics_file"].as<std::string>().empty() || args["metrics_port"].as<int>() > 0) &&
+	    !metrics_exporter.Start()) {
+		return 1;
+	}
+	grabber.Start();
+	edge::FrameHandle handle;
+	std::deque<edge::FrameHandle> pipelined_frames;
+	std::vector<float> raw_results;
+	std::vector<uint8_t> pipeline_input;
+	edge::PreprocessExecutor preprocess(args["preprocess_threads"].as<int>());
+	// Pipelined frames complete a whole pipeline depth later, so only the engines that
+	// return each result before the next frame is taken are scheduled.
+	std::unique_ptr<edge::FrameScheduler> scheduler;
+	if (args["latency_slo_ms"].as<float>() > 0.0f) {
+		if (pipeline) {
+			std::cout << "--latency_slo_ms is ignored with --segment_paths or --decode_stage" << std::endl;
+		} else {
+			edge::FrameSchedulerOptions scheduler_options;
+			scheduler_options.latency_budget_ms = args["latency_slo_ms"].as<float>();
+			scheduler_options.percentile = args["latency_slo_percentile"].as<float>();
+			scheduler.reset(new edge::FrameScheduler(scheduler_options));
+		}
+	}
+	uint64_t skipped_frames;
+	while(edge::PopLatestFrame(captured_frames, frame_pool, grabber, &handle, &skipped_frames))
 	{
-		cam_frame >> frame;
-		const auto& input = edge::GetInputFromImage(frame,required_input_tensor_shape[2],required_input_tensor_shape[1],required_input_tensor_shape[3]);
-		const auto& raw_results = engine.RunInference(input);
-		const auto& detection_result = engine.PoseEstimateWithOutputVector(raw_results,pose_threshold);
-		edge::HumanPoseEngine::img_overlay(frame,detection_result,keypoint_threshold,required_input_tensor_shape[2]
-						,required_input_tensor_shape[1], camera_width, camera_height);
+		metrics.frames_skipped->Increment(skipped_frames);
+		int64_t start_us = 0;
+		if (scheduler) {
+			start_us = edge::SteadyNowMicros();
+			const edge::FrameDecision decision = scheduler->Admit(handle.capture_time_us, start_us);
+			if (decision.action != edge::FrameAction::kProcess) {
+				if (decision.action == edge::FrameAction::kSkip) metrics.frames_skipped->Increment();
+				else metrics.frames_late->Increment();
+				frame_pool.Release(handle);
+				continue;
+			}
+		}
+		edge::StageTimer stage_timer;
+		std::vector<edge::PoseCandidate> detection_result;
+		std::vector<int> input_shape = required_input_tensor_shape;
+		// Frames all have the same size, so pipelined results share the transform too.
+		edge::AffineTransform transform;
+		if (adaptive) {
+			// Preprocessing, inference and decoding happen in one call, so only the inference
+			// time it measured itself is split out.
+			detection_result = adaptive->PoseEstimate(frame_pool.Frame(handle), pose_threshold, &input_shape, &transform);
+			stage_timer.Lap();
+			metrics.RecordInference(adaptive->LastInferenceUs());
+		} else if (pipeline) {
+			pipeline_input.resize(input_shape[1] * input_shape[2] * input_shape[3]);
+			transform = preprocess.Run(frame_pool.Frame(handle), resize_mode, input_shape[2], input_shape[1],
+			                           pipeline_input.data());
+			metrics.preprocess_us->Record(stage_timer.Lap());
+			if (!pipeline->Push(pipeline_input)) {
+				std::cout << "Failed to queue the frame into the pipeline" << std::endl;
+				break;
+			}
+			pipelined_frames.push_back(handle);
+			metrics.frames_in_flight->Set(pipelined_frames.size());
+			if (pipelined_frames.size() < frames_in_flight) continue;
+			handle = pipelined_frames.front();
+			pipelined_frames.pop_front();
+			if (!pipeline->Pop(&raw_results)) break;
+			metrics.frames_in_flight->Set(pipelined_frames.size());
+			// The segments run concurrently, so this is the time the frame's Push and the Pop of
+			// the oldest result took rather than the time of one device.
+			metrics.RecordInference(stage_timer.Lap());
+			detection_result = edge::HumanPoseEngine::PoseEstimateWithOutputVector(raw_results, pipeline->GetOutputShape(),
+			                                                                       pose_threshold);
+		} else {
+			transform = preprocess.Run(frame_pool.Frame(handle), resize_mode, input_shape[2], input_shape[1],
+			                           engine->GetInputBuffer());
+			metrics.preprocess_us->Record(stage_timer.Lap());
+			raw_results = engine->RunInference();
+			metrics.RecordInference(stage_timer.Lap());
+			detection_result = engine->PoseEstimateWithOutputVector(raw_results,pose_threshold);
+		}
+		edge::HumanPoseEngine::ToFrameCoordinates(detection_result, input_shape[2], input_shape[1], camera_width,
+		                                          camera_height, transform);
+		metrics.postprocess_us->Record(stage_timer.Lap());
+		// Resolution steps are left to AdaptivePoseEngine, the scheduler runs a single level.
+		if (scheduler) scheduler->Complete(handle.capture_time_us, start_us, edge::SteadyNowMicros(), 0);
+		edge::FrameResult frame_result;
+		frame_result.frame_id = handle.frame_id;
+		frame_result.timestamp_us = handle.capture_time_us;
+		frame_result.width = camera_width;
+		frame_result.height = camera_height;
+		frame_result.poses = std::move(detection_result);
+		frame_result.keypoint_threshold = keypoint_threshold;
+		dispatcher->Publish(frame_result, frame_pool.Frame(handle));
+		frame_pool.Release(handle);
+		metrics.publish_us->Record(stage_timer.Lap());
+		metrics.RecordResult(frame_result.timestamp_us);
 
-		char c=(char)cv::waitKey(25);
-		if(c==27)
+		if(dispatcher->QuitRequested())
 			break;
 	}
+	grabber.Stop();
+	dispatcher->Stop();
+	if (pipeline) pipeline->Stop();
+	metrics_exporter.Stop();
+	if (engine && engine->IsProfiling()) std::cout << engine->ProfileReport();
 }
@@ -0,0 +1,102 @@
+//
+// Latency driven selection between PoseNet input resolutions.
+//
+
+#include "adaptive_pose_engine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
+#include "img_prep.h"
+
+namespace edge {
+	namespace {
+		// Weight of the newest sample in the smoothed latency.
+		constexpr double kSmoothing = 0.2;
+		// Only step up when the larger variant is predicted to use at most this share of the budget.
+		constexpr double kStepUpMargin = 0.8;
+		// Consecutive frames with headroom required before stepping up, avoids oscillating.
+		constexpr int kStepUpFrames = 30;
+		// The first invocations after a switch reload parameters on the Edge TPU and are not representative.
+		constexpr int kWarmupFrames = 2;
+		// A larger variant measured under a transient load spike is re-probed after this many frames.
+		constexpr int kReprobeFrames = 600;
+
+		int InputArea(const std::vector<int>& shape) {
+			return shape[1] * shape[2];
+		}
+	}
+
+	AdaptivePoseEngine::AdaptivePoseEngine(const std::vector<std::string>& model_paths,
+	                                       const std::shared_ptr<edgetpu::EdgeTpuContext>& edgetpu_context,
+	                                       const bool edgetpu, const float latency_budget_ms)
+					: m_current(0), m_resize_mode(ResizeMode::kStretch), m_budget_ms(latency_budget_ms), m_headroom_frames(0), m_frames_on_variant(0), m_last_inference_us(0) {
+		std::vector<std::unique_ptr<HumanPoseEngine>> loaded;
+		for (const auto& path : model_paths) {
+			loaded.emplace_back(new HumanPoseEngine(path, edgetpu_context, edgetpu));
+		}
+		std::vector<size_t> order(loaded.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&loaded](size_t a, size_t b) {
+			return InputArea(loaded[a]->GetInputShape()) < InputArea(loaded[b]->GetInputShape());
+		});
+		for (size_t index : order) {
+			m_input_shapes.push_back(loaded[index]->GetInputShape());
+			m_variants.push_back(std::move(loaded[index]));
+		}
+		m_average_ms.assign(m_variants.size(), 0.0);
+	}
+
+	std::vector<PoseCandidate> AdaptivePoseEngine::PoseEstimate(const cv::Mat& frame, const float& threshold,
+	                                                            std::vector<int>* input_shape,
+	                                                            AffineTransform* transform) {
+		HumanPoseEngine& engine = *m_variants[m_current];
+		const std::vector<int>& shape = m_input_shapes[m_current];
+		*input_shape = shape;
+		const AffineTransform input_transform =
+						GetInputFromImage(frame, m_resize_mode, shape[2], shape[1], engine.GetInputBuffer());
+		if (transform) *transform = input_transform;
+		const auto start = std::chrono::steady_clock::now();
+		const auto& raw_results = engine.RunInference();
+		const auto end = std::chrono::steady_clock::now();
+		const auto& result = engine.PoseEstimateWithOutputVector(raw_results, threshold);
+		m_last_inference_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+		Adapt(std::chrono::duration<double, std::milli>(end - start).count());
+		return result;
+	}
+
+	double AdaptivePoseEngine::EstimatedLatencyMs(size_t variant) const {
+		if (m_average_ms[variant] > 0.0) return m_average_ms[variant];
+		// Never measured: assume latency scales with the number of input pixels.
+		return m_average_ms[m_current] * InputArea(m_input_shapes[variant]) / InputArea(m_input_shapes[m_current]);
+	}
+
+	void AdaptivePoseEngine::Adapt(const double latency_ms) {
+		if (++m_frames_on_variant <= kWarmupFrames) return;
+		double& average = m_average_ms[m_current];
+		average = average > 0.0 ? (1.0 - kSmoothing) * average + kSmoothing * latency_ms : latency_ms;
+
+		if (average > m_budget_ms && m_current > 0) {
+			m_current--;
+			m_headroom_frames = 0;
+			m_frames_on_variant = 0;
+			return;
+		}
+		if (m_current + 1 >= m_variants.size() || average > kStepUpMargin * m_budget_ms) {
+			m_headroom_frames = 0;
+			return;
+		}
+		const bool fits = EstimatedLatencyMs(m_current + 1) < kStepUpMargin * m_budget_ms;
+		if (fits || m_frames_on_variant >= kReprobeFrames) {
+			if (++m_headroom_frames >= kStepUpFrames) {
+				m_current++;
+				m_average_ms[m_current] = 0.0;
+				m_headroom_frames = 0;
+				m_frames_on_variant = 0;
+			}
+		} else {
+			m_headroom_frames = 0;
+		}
+	}
+}
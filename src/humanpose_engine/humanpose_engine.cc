@@ -9,45 +9,71 @@ namespace edge {
 	void HumanPoseEngine::img_overlay(cv::Mat& frame, const std::vector<PoseCandidate>& ret, const float& keypoint_threshold,
 					const float& inp_width, const float& inp_height, const float& camera_width, const float& camera_height)
 	{
-		std::vector<int> k_x(17), k_y(17);
+		draw_overlay(frame, ret, keypoint_threshold, inp_width, inp_height, camera_width, camera_height);
+		cv::imshow("Pose Estimation", frame);
+	}
+
+	void HumanPoseEngine::ToFrameCoordinates(std::vector<PoseCandidate>& ret, const float& inp_width,
+					const float& inp_height, const float& camera_width, const float& camera_height,
+					const AffineTransform& transform)
+	{
+		for (auto& candidate : ret)
+		{
+			for (size_t i = 0; i + 1 < candidate.keypoint_coordinates.size(); i += 2)
+			{
+				candidate.keypoint_coordinates[i] = transform.Y(candidate.keypoint_coordinates[i]/inp_height)*camera_height;
+				candidate.keypoint_coordinates[i+1] = transform.X(candidate.keypoint_coordinates[i+1]/inp_width)*camera_width;
+			}
+		}
+	}
+
+	void HumanPoseEngine::draw_overlay(cv::Mat& frame, const std::vector<PoseCandidate>& ret, const float& keypoint_threshold,
+					const float& inp_width, const float& inp_height, const float& camera_width, const float& camera_height)
+	{
 		const auto& green = cv::Scalar(0,255,0);
 		for (auto& candidate : ret)
 		{
-			for (int i=0; i< 17; i++)
+			for (size_t i=0; i< candidate.keypoint_scores.size(); i++)
 			{
 				if(candidate.keypoint_scores[i] > keypoint_threshold)
 				{
 					float x_coordinate = candidate.keypoint_coordinates[(2*i)+1]*(camera_width/inp_width);
 					float y_coordinate = candidate.keypoint_coordinates[2*i]*(camera_height/inp_height);
-					k_x[i]= static_cast<int>(x_coordinate);
-					k_y[i]= static_cast<int>(y_coordinate);
-					cv::circle(frame, cv::Point(k_x[i],k_y[i]), 0, green, 6, 1, 0);
+					cv::circle(frame, cv::Point(static_cast<int>(x_coordinate),static_cast<int>(y_coordinate)), 0, green, 6, 1, 0);
 				}
 			}
 		}
-		cv::imshow("Pose Estimation", frame);
 	}
 
 	std::vector<PoseCandidate> HumanPoseEngine::PoseEstimateWithOutputVector(const std::vector<float>& inf_vec,
 	                                                                        const float& threshold)
+	{
+		return PoseEstimateWithOutputVector(inf_vec, m_output_shape, threshold);
+	}
+
+	std::vector<PoseCandidate> HumanPoseEngine::PoseEstimateWithOutputVector(const std::vector<float>& inf_vec,
+	                                                                        const std::vector<size_t>& output_shape,
+	                                                                        const float& threshold)
 	{
 		const auto* result_raw = inf_vec.data();
-		std::vector<std::vector<float>> results(m_output_shape.size());
+		std::vector<std::vector<float>> results(output_shape.size());
 		int offset = 0;
-		for(size_t i=0; i < m_output_shape.size();++i) {
-			const size_t size_of_output_tensor_i = m_output_shape[i];
+		for(size_t i=0; i < output_shape.size();++i) {
+			const size_t size_of_output_tensor_i = output_shape[i];
 			results[i].resize(size_of_output_tensor_i);
 			std::memcpy(results[i].data(), result_raw + offset, sizeof(float) * size_of_output_tensor_i);
 			offset += size_of_output_tensor_i;
 		}
 		std::vector<PoseCandidate> inf_results;
+		// Keypoint scores are max_detections x num_keypoints, pose scores max_detections.
+		const size_t num_keypoints = output_shape[1] / output_shape[2];
 		int n = lround(results[3][0]);
 		for (int i = 0; i < n; i++) {
 			float overall_score = results[2][i];
 			if(overall_score>threshold) {
 				PoseCandidate result;
-				std::copy(results[1].begin()+(17*i), results[1].begin()+(17*i)+16, std::back_inserter(result.keypoint_scores));
-				std::copy(results[0].begin()+(17*2*i), results[0].begin()+(17*2*i)+33, std::back_inserter((result.keypoint_coordinates)));
+				std::copy(results[1].begin()+(num_keypoints*i), results[1].begin()+(num_keypoints*(i+1)), std::back_inserter(result.keypoint_scores));
+				std::copy(results[0].begin()+(num_keypoints*2*i), results[0].begin()+(num_keypoints*2*(i+1)), std::back_inserter((result.keypoint_coordinates)));
 				inf_results.push_back(result);
 			}
 		}
@@ -0,0 +1,149 @@
+#include "pose_skeleton.h"
+
+#include <sstream>
+
+namespace coral {
+
+namespace {
+
+PoseSkeleton BuildCocoSkeleton() {
+  PoseSkeleton skeleton;
+  skeleton.name = "coco";
+  skeleton.num_keypoints = 17;
+  const int num_edges = sizeof(kCocoEdgeList) / sizeof(kCocoEdgeList[0]) / 2;
+  for (int k = 0; k < num_edges; ++k) {
+    skeleton.edges.emplace_back(kCocoEdgeList[k].first,
+                                kCocoEdgeList[k].second);
+  }
+  return skeleton;
+}
+
+PoseSkeleton BuildHandSkeleton() {
+  PoseSkeleton skeleton;
+  skeleton.name = "hand";
+  skeleton.num_keypoints = 21;
+  for (int finger = 0; finger < 5; ++finger) {
+    const int base = 1 + 4 * finger;
+    skeleton.edges.emplace_back(0, base);
+    for (int joint = 0; joint < 3; ++joint) {
+      skeleton.edges.emplace_back(base + joint, base + joint + 1);
+    }
+  }
+  return skeleton;
+}
+
+}  // namespace
+
+const PoseSkeleton& CocoSkeleton() {
+  static const PoseSkeleton skeleton = BuildCocoSkeleton();
+  return skeleton;
+}
+
+const PoseSkeleton& HandSkeleton() {
+  static const PoseSkeleton skeleton = BuildHandSkeleton();
+  return skeleton;
+}
+
+const PoseSkeleton* FindSkeleton(const std::string& name) {
+  for (const PoseSkeleton* skeleton : {&CocoSkeleton(), &HandSkeleton()}) {
+    if (skeleton->name == name) return skeleton;
+  }
+  return nullptr;
+}
+
+const PoseSkeleton* FindSkeleton(const int num_keypoints,
+                                 const int num_edges) {
+  for (const PoseSkeleton* skeleton : {&CocoSkeleton(), &HandSkeleton()}) {
+    if (skeleton->num_keypoints == num_keypoints &&
+        static_cast<int>(skeleton->edges.size()) == num_edges) {
+      return skeleton;
+    }
+  }
+  return nullptr;
+}
+
+bool ResolveSkeleton(const std::string& name,
+                     const std::vector<std::pair<int, int>>& edges,
+                     const int num_keypoints, const int num_edges,
+                     PoseSkeleton* skeleton) {
+  if (!edges.empty()) {
+    skeleton->name = name.empty() ? "custom" : name;
+    skeleton->num_keypoints = num_keypoints;
+    skeleton->edges = edges;
+    return static_cast<int>(edges.size()) == num_edges;
+  }
+  const PoseSkeleton* builtin = name.empty()
+                                    ? FindSkeleton(num_keypoints, num_edges)
+                                    : FindSkeleton(name);
+  if (builtin == nullptr || builtin->num_keypoints != num_keypoints ||
+      static_cast<int>(builtin->edges.size()) != num_edges) {
+    return false;
+  }
+  *skeleton = *builtin;
+  return true;
+}
+
+std::string SkeletonEdgesToString(const PoseSkeleton& skeleton) {
+  std::string text;
+  for (const auto& edge : skeleton.edges) {
+    if (!text.empty()) text += ' ';
+    text += std::to_string(edge.first) + ' ' + std::to_string(edge.second);
+  }
+  return text;
+}
+
+bool SkeletonEdgesFromString(const std::string& text,
+                             std::vector<std::pair<int, int>>* edges) {
+  edges->clear();
+  std::istringstream stream(text);
+  int parent;
+  int child;
+  while (stream >> parent) {
+    if (!(stream >> child)) return false;
+    edges->emplace_back(parent, child);
+  }
+  return stream.eof();
+}
+
+namespace posenet_decoder_op {
+
+bool SkeletonGraph::Init(const PoseSkeleton& skeleton) {
+  const int num_keypoints = skeleton.num_keypoints;
+  const int num_edges = static_cast<int>(skeleton.edges.size());
+  if (num_keypoints < 1 || num_keypoints > kMaxSkeletonKeypoints ||
+      num_edges > kMaxSkeletonEdges) {
+    return false;
+  }
+  for (const auto& edge : skeleton.edges) {
+    if (edge.first < 0 || edge.first >= num_keypoints || edge.second < 0 ||
+        edge.second >= num_keypoints) {
+      return false;
+    }
+  }
+  skeleton_ = skeleton;
+  is_coco_ = skeleton.num_keypoints == CocoSkeleton().num_keypoints &&
+             skeleton.edges == CocoSkeleton().edges;
+
+  // Forward edges keep their id, the reversed ones follow.
+  edge_children_.resize(2 * num_edges);
+  std::vector<int> edge_parents(2 * num_edges);
+  for (int k = 0; k < num_edges; ++k) {
+    edge_parents[k] = skeleton.edges[k].first;
+    edge_children_[k] = skeleton.edges[k].second;
+    edge_parents[num_edges + k] = skeleton.edges[k].second;
+    edge_children_[num_edges + k] = skeleton.edges[k].first;
+  }
+  child_offsets_.clear();
+  child_edges_.clear();
+  for (int keypoint = 0; keypoint < num_keypoints; ++keypoint) {
+    child_offsets_.push_back(static_cast<int>(child_edges_.size()));
+    for (int edge = 0; edge < 2 * num_edges; ++edge) {
+      if (edge_parents[edge] == keypoint) child_edges_.push_back(edge);
+    }
+    child_edges_.push_back(-1);
+  }
+  return true;
+}
+
+}  // namespace posenet_decoder_op
+}  // namespace coral
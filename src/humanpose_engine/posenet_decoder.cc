@@ -2,75 +2,116 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cmath>
 #include <cstring>
+#include <functional>
 #include <numeric>
 #include <vector>
 
+#include "dequantize.h"
+#include "pose_skeleton.h"
+#include "worker_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POSENET_SAMPLE_X86 1
+#endif
+
 namespace coral {
 
 using posenet_decoder_op::kNumKeypoints;
 using posenet_decoder_op::Point;
 using posenet_decoder_op::PoseKeypoints;
 using posenet_decoder_op::PoseKeypointScores;
+using posenet_decoder_op::SkeletonGraph;
+
+constexpr int kNumEdgeListEdges =
+    sizeof(kCocoEdgeList) / sizeof(kCocoEdgeList[0]);
+static_assert(kNumEdgeListEdges == 2 * posenet_decoder_op::kNumEdges,
+              "kCocoEdgeList holds every edge once forward and once backward");
+
+// The adjacency of the COCO pose graph, resolved at compile time: row i holds
+// the ids of the edges starting at keypoint i in kCocoEdgeList order, -1
+// terminated. An edge ends at kCocoEdgeList[edge].second.
+constexpr int kMaxChildren = 4;
+
+// Id of the n-th edge starting at `parent`, searching from edge k, or -1.
+constexpr int ChildEdge(int parent, int n, int k = 0) {
+  return k == kNumEdgeListEdges ? -1
+         : kCocoEdgeList[k].first != parent
+             ? ChildEdge(parent, n, k + 1)
+             : n == 0 ? k : ChildEdge(parent, n - 1, k + 1);
+}
 
-enum KeypointType {
-  kNose,
-  kLeftEye,
-  kRightEye,
-  kLeftEar,
-  kRightEar,
-  kLeftShoulder,
-  kRightShoulder,
-  kLeftElbow,
-  kRightElbow,
-  kLeftWrist,
-  kRightWrist,
-  kLeftHip,
-  kRightHip,
-  kLeftKnee,
-  kRightKnee,
-  kLeftAnkle,
-  kRightAnkle
+#define POSENET_CHILD_EDGES(parent)                             \
+  {                                                             \
+    ChildEdge(parent, 0), ChildEdge(parent, 1),                 \
+        ChildEdge(parent, 2), ChildEdge(parent, 3), -1          \
+  }
+constexpr int kChildEdges[posenet_decoder_op::kNumKeypoints][kMaxChildren + 1] =
+    {POSENET_CHILD_EDGES(0),  POSENET_CHILD_EDGES(1),  POSENET_CHILD_EDGES(2),
+     POSENET_CHILD_EDGES(3),  POSENET_CHILD_EDGES(4),  POSENET_CHILD_EDGES(5),
+     POSENET_CHILD_EDGES(6),  POSENET_CHILD_EDGES(7),  POSENET_CHILD_EDGES(8),
+     POSENET_CHILD_EDGES(9),  POSENET_CHILD_EDGES(10), POSENET_CHILD_EDGES(11),
+     POSENET_CHILD_EDGES(12), POSENET_CHILD_EDGES(13), POSENET_CHILD_EDGES(14),
+     POSENET_CHILD_EDGES(15), POSENET_CHILD_EDGES(16)};
+#undef POSENET_CHILD_EDGES
+
+constexpr bool HasAtMostMaxChildren(int parent = 0) {
+  return parent == posenet_decoder_op::kNumKeypoints ||
+         (ChildEdge(parent, kMaxChildren) == -1 &&
+          HasAtMostMaxChildren(parent + 1));
+}
+static_assert(HasAtMostMaxChildren(), "a keypoint has too many children");
+
+// The pose graphs the decoder below is instantiated for. CocoGraph has its
+// sizes and adjacency at compile time, so the keypoint loops of the PoseNet
+// models compile to fixed trip counts; RuntimeGraph walks a SkeletonGraph
+// resolved when the model is prepared. kMaxKeypoints and kMaxQueue size the
+// stack buffers of a single pose.
+//
+// The mid-offsets block is organized as 4 blocks of num_edges:
+// [fwd Y offsets][fwd X offsets][bwd Y offsets][bwd X offsets]
+// OTOH edge ids are [0,num_edges) for forward edges and
+// [num_edges, 2*num_edges) for backward edges, so MidOffsetChannel starts
+// backward edges num_edges indices later.
+struct CocoGraph {
+  static constexpr int kMaxKeypoints = posenet_decoder_op::kNumKeypoints;
+  static constexpr int kMaxChildren = coral::kMaxChildren;
+  // The root and at most one entry per directed edge.
+  static constexpr int kMaxQueue = 1 + kNumEdgeListEdges;
+
+  static constexpr int NumKeypoints() {
+    return posenet_decoder_op::kNumKeypoints;
+  }
+  static constexpr int NumEdges() { return posenet_decoder_op::kNumEdges; }
+  const int* ChildEdges(const int keypoint) const {
+    return kChildEdges[keypoint];
+  }
+  int EdgeChild(const int edge) const { return kCocoEdgeList[edge].second; }
+  int MidOffsetChannel(const int edge) const {
+    return edge >= NumEdges() ? edge + NumEdges() : edge;
+  }
 };
 
-const std::array<std::pair<KeypointType, KeypointType>, 32> kEdgeList = {{
-
-    // Forward edges
-    {kNose, kLeftEye},
-    {kLeftEye, kLeftEar},
-    {kNose, kRightEye},
-    {kRightEye, kRightEar},
-    {kNose, kLeftShoulder},
-    {kLeftShoulder, kLeftElbow},
-    {kLeftElbow, kLeftWrist},
-    {kLeftShoulder, kLeftHip},
-    {kLeftHip, kLeftKnee},
-    {kLeftKnee, kLeftAnkle},
-    {kNose, kRightShoulder},
-    {kRightShoulder, kRightElbow},
-    {kRightElbow, kRightWrist},
-    {kRightShoulder, kRightHip},
-    {kRightHip, kRightKnee},
-    {kRightKnee, kRightAnkle},
-
-    // Backward edges
-    {kLeftEye, kNose},
-    {kLeftEar, kLeftEye},
-    {kRightEye, kNose},
-    {kRightEar, kRightEye},
-    {kLeftShoulder, kNose},
-    {kLeftElbow, kLeftShoulder},
-    {kLeftWrist, kLeftElbow},
-    {kLeftHip, kLeftShoulder},
-    {kLeftKnee, kLeftHip},
-    {kLeftAnkle, kLeftKnee},
-    {kRightShoulder, kNose},
-    {kRightElbow, kRightShoulder},
-    {kRightWrist, kRightElbow},
-    {kRightHip, kRightShoulder},
-    {kRightKnee, kRightHip},
-    {kRightAnkle, kRightKnee}}};
+struct RuntimeGraph {
+  static constexpr int kMaxKeypoints = kMaxSkeletonKeypoints;
+  static constexpr int kMaxChildren = 2 * kMaxSkeletonEdges;
+  static constexpr int kMaxQueue = 1 + 2 * kMaxSkeletonEdges;
+
+  int NumKeypoints() const { return graph->NumKeypoints(); }
+  int NumEdges() const { return graph->NumEdges(); }
+  const int* ChildEdges(const int keypoint) const {
+    return graph->ChildEdges(keypoint);
+  }
+  int EdgeChild(const int edge) const { return graph->EdgeChild(edge); }
+  int MidOffsetChannel(const int edge) const {
+    return edge >= NumEdges() ? edge + NumEdges() : edge;
+  }
+
+  const SkeletonGraph* graph;
+};
 
 template <typename T>
 constexpr const T& clamp(const T& v, const T& lo, const T& hi) {
@@ -87,6 +128,13 @@ void DecreasingArgSort(const float* scores, const size_t len,
       [&scores](const int i, const int j) { return scores[i] > scores[j]; });
 }
 
+void DecreasingArgSort(const float* scores, const size_t len, int* indices) {
+  std::iota(indices, indices + len, 0);
+  std::sort(indices, indices + len, [&scores](const int i, const int j) {
+    return scores[i] > scores[j];
+  });
+}
+
 void DecreasingArgSort(const std::vector<float>& scores,
                        std::vector<int>* indices) {
   DecreasingArgSort(scores.data(), scores.size(), indices);
@@ -111,8 +159,10 @@ float Logodds(const float x) { return -std::log(1.0f / (x + 1E-6) - 1.0f); }
 void BuildLinearInterpolation(const float x, const int n, int* x_floor,
                               int* x_ceil, float* x_lerp) {
   const float x_proj = clamp(x, 0.0f, n - 1.0f);
-  *x_floor = static_cast<int>(floorf(x_proj));
-  *x_ceil = static_cast<int>(ceilf(x_proj));
+  // x_proj is not negative, so truncation is the floor, and cheaper than
+  // floorf and ceilf on targets without a rounding instruction.
+  *x_floor = static_cast<int>(x_proj);
+  *x_ceil = *x_floor + (*x_floor < x_proj);
   *x_lerp = x - (*x_floor);
 }
 
@@ -212,88 +262,331 @@ Point FindDisplacedPosition(const float* short_offsets,
   return Point{y, x};
 }
 
-// Build an adjacency list of the pose graph.
-AdjacencyList BuildAdjacencyList() {
-  AdjacencyList adjacency_list(posenet_decoder_op::kNumKeypoints);
-  for (int k = 0; k < kEdgeList.size(); ++k) {
-    const int parent_id = kEdgeList[k].first;
-    const int child_id = kEdgeList[k].second;
-    adjacency_list.child_ids[parent_id].push_back(child_id);
-    adjacency_list.edge_ids[parent_id].push_back(k);
+namespace {
+
+typedef void (*SampleBatchFn)(const float* tensor, int height, int width,
+                              int num_channels, const float* ys,
+                              const float* xs, const int* channels, size_t n,
+                              float* result);
+
+// Computes the same products and sums in the same order as
+// SampleTensorAtMultipleChannels, so every path gives identical results.
+// Consecutive queries at the same position, like the y and x offsets of an
+// edge, share the corners. At integer positions all four corners are the
+// same cell with weights 1 and 0, so the cell is read directly.
+void SampleTensorBatchScalar(const float* tensor, const int height,
+                             const int width, const int num_channels,
+                             const float* ys, const float* xs,
+                             const int* channels, const size_t n,
+                             float* result) {
+  int top_left = 0;
+  int top_right = 0;
+  int bottom_left = 0;
+  int bottom_right = 0;
+  float y_lerp = 0.0f;
+  float x_lerp = 0.0f;
+  for (size_t i = 0; i < n; ++i) {
+    if (i == 0 || ys[i] != ys[i - 1] || xs[i] != xs[i - 1]) {
+      BuildBilinearInterpolation(ys[i], xs[i], height, width, num_channels,
+                                 &top_left, &top_right, &bottom_left,
+                                 &bottom_right, &y_lerp, &x_lerp);
+    }
+    const int c = channels[i];
+    if (y_lerp == 0.0f && x_lerp == 0.0f) {
+      result[i] = tensor[top_left + c];
+      continue;
+    }
+    result[i] = (1 - y_lerp) * ((1 - x_lerp) * tensor[top_left + c] +
+                                x_lerp * tensor[top_right + c]) +
+                y_lerp * ((1 - x_lerp) * tensor[bottom_left + c] +
+                          x_lerp * tensor[bottom_right + c]);
+  }
+}
+
+#if defined(POSENET_SAMPLE_X86)
+// Samples the queries in blocks of eight with the corners gathered and
+// returns how many it sampled. Compiled for AVX2 only, without FMA, which
+// keeps the rounding of the scalar path.
+__attribute__((target("avx2"))) size_t SampleTensorBlocksAvx2(
+    const float* tensor, const int height, const int width,
+    const int num_channels, const float* ys, const float* xs,
+    const int* channels, const size_t n, float* result) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 y_max = _mm256_set1_ps(height - 1.0f);
+  const __m256 x_max = _mm256_set1_ps(width - 1.0f);
+  const __m256i widths = _mm256_set1_epi32(width);
+  const __m256i depths = _mm256_set1_epi32(num_channels);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 y = _mm256_loadu_ps(ys + i);
+    const __m256 x = _mm256_loadu_ps(xs + i);
+    const __m256i c =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(channels + i));
+    // BuildBilinearInterpolation: corners of the clamped position, weights
+    // relative to the unclamped one.
+    const __m256 y_proj = _mm256_min_ps(_mm256_max_ps(y, zero), y_max);
+    const __m256 x_proj = _mm256_min_ps(_mm256_max_ps(x, zero), x_max);
+    const __m256 y_floor = _mm256_floor_ps(y_proj);
+    const __m256 x_floor = _mm256_floor_ps(x_proj);
+    const __m256 y_lerp = _mm256_sub_ps(y, y_floor);
+    const __m256 x_lerp = _mm256_sub_ps(x, x_floor);
+    const __m256i row_floor =
+        _mm256_mullo_epi32(_mm256_cvttps_epi32(y_floor), widths);
+    const __m256i col_floor = _mm256_cvttps_epi32(x_floor);
+    const __m256i top_left = _mm256_add_epi32(
+        _mm256_mullo_epi32(_mm256_add_epi32(row_floor, col_floor), depths), c);
+    const __m256 v_top_left = _mm256_i32gather_ps(tensor, top_left, 4);
+    const __m256 aligned =
+        _mm256_and_ps(_mm256_cmp_ps(y_lerp, zero, _CMP_EQ_OQ),
+                      _mm256_cmp_ps(x_lerp, zero, _CMP_EQ_OQ));
+    if (_mm256_movemask_ps(aligned) == 0xff) {
+      _mm256_storeu_ps(result + i, v_top_left);
+      continue;
+    }
+    const __m256i row_ceil = _mm256_mullo_epi32(
+        _mm256_cvttps_epi32(_mm256_ceil_ps(y_proj)), widths);
+    const __m256i col_ceil = _mm256_cvttps_epi32(_mm256_ceil_ps(x_proj));
+    const __m256i top_right = _mm256_add_epi32(
+        _mm256_mullo_epi32(_mm256_add_epi32(row_floor, col_ceil), depths), c);
+    const __m256i bottom_left = _mm256_add_epi32(
+        _mm256_mullo_epi32(_mm256_add_epi32(row_ceil, col_floor), depths), c);
+    const __m256i bottom_right = _mm256_add_epi32(
+        _mm256_mullo_epi32(_mm256_add_epi32(row_ceil, col_ceil), depths), c);
+    const __m256 v_top_right = _mm256_i32gather_ps(tensor, top_right, 4);
+    const __m256 v_bottom_left = _mm256_i32gather_ps(tensor, bottom_left, 4);
+    const __m256 v_bottom_right = _mm256_i32gather_ps(tensor, bottom_right, 4);
+    const __m256 x_rest = _mm256_sub_ps(one, x_lerp);
+    const __m256 top = _mm256_add_ps(_mm256_mul_ps(x_rest, v_top_left),
+                                     _mm256_mul_ps(x_lerp, v_top_right));
+    const __m256 bottom = _mm256_add_ps(_mm256_mul_ps(x_rest, v_bottom_left),
+                                        _mm256_mul_ps(x_lerp, v_bottom_right));
+    const __m256 value =
+        _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(one, y_lerp), top),
+                      _mm256_mul_ps(y_lerp, bottom));
+    _mm256_storeu_ps(result + i, value);
+  }
+  return i;
+}
+
+// Gathers only pay off for full vectors, the few children of most keypoints
+// take the scalar path without touching the AVX state.
+void SampleTensorBatchAvx2(const float* tensor, const int height,
+                           const int width, const int num_channels,
+                           const float* ys, const float* xs,
+                           const int* channels, const size_t n,
+                           float* result) {
+  const size_t i = n >= 8 ? SampleTensorBlocksAvx2(tensor, height, width,
+                                                   num_channels, ys, xs,
+                                                   channels, n, result)
+                          : 0;
+  SampleTensorBatchScalar(tensor, height, width, num_channels, ys + i, xs + i,
+                          channels + i, n - i, result + i);
+}
+#endif
+
+SampleBatchFn DetectSampleBatch() {
+#if defined(POSENET_SAMPLE_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return &SampleTensorBatchAvx2;
+#endif
+  return &SampleTensorBatchScalar;
+}
+
+std::atomic<posenet_decoder_op::SamplingMode>& ActiveSamplingMode() {
+  static std::atomic<posenet_decoder_op::SamplingMode> mode(
+      posenet_decoder_op::SamplingMode::kBatched);
+  return mode;
+}
+
+SampleBatchFn DetectSampleBatchOnce() {
+  static const SampleBatchFn detected = DetectSampleBatch();
+  return detected;
+}
+
+// The batch kernel of the active mode, nullptr when sampling per edge.
+SampleBatchFn ActiveSampleBatch() {
+  switch (ActiveSamplingMode().load(std::memory_order_relaxed)) {
+    case posenet_decoder_op::SamplingMode::kPerEdge:
+      return nullptr;
+    case posenet_decoder_op::SamplingMode::kBatchedScalar:
+      return &SampleTensorBatchScalar;
+    default:
+      return DetectSampleBatchOnce();
+  }
+}
+
+}  // namespace
+
+namespace posenet_decoder_op {
+
+void SetSamplingMode(const SamplingMode mode) {
+  ActiveSamplingMode().store(mode, std::memory_order_relaxed);
+}
+
+const char* SamplingIsa() {
+  return DetectSampleBatchOnce() == &SampleTensorBatchScalar ? "scalar" : "avx2";
+}
+
+}  // namespace posenet_decoder_op
+
+void SampleTensorBatch(const float* tensor, const int height, const int width,
+                       const int num_channels, const float* ys,
+                       const float* xs, const int* channels, const size_t n,
+                       float* result) {
+  DetectSampleBatchOnce()(tensor, height, width, num_channels, ys, xs,
+                          channels, n, result);
+}
+
+namespace {
+
+// FindDisplacedPosition for several edges leaving `source`, with every
+// sampling round of the edges done as one batch.
+void FindDisplacedPositions(const SampleBatchFn sample,
+                            const float* short_offsets,
+                            const float* mid_offsets, const int height,
+                            const int width, const int num_keypoints,
+                            const int num_edges, const Point& source,
+                            const int* edge_ids, const int* target_ids,
+                            const int n, const int refinement_steps,
+                            Point* targets) {
+  // Queries 2 * i and 2 * i + 1 are the y and x offsets of edge i.
+  constexpr int kChunk = 8;
+  float ys[2 * kChunk];
+  float xs[2 * kChunk];
+  int channels[2 * kChunk];
+  float offsets[2 * kChunk];
+  for (int begin = 0; begin < n; begin += kChunk) {
+    const int count = std::min(kChunk, n - begin);
+    // Follow the mid-range offsets.
+    for (int i = 0; i < count; ++i) {
+      ys[2 * i] = ys[2 * i + 1] = source.y;
+      xs[2 * i] = xs[2 * i + 1] = source.x;
+      channels[2 * i] = edge_ids[begin + i];
+      channels[2 * i + 1] = num_edges + edge_ids[begin + i];
+    }
+    sample(mid_offsets, height, width, 2 * 2 * num_edges, ys, xs, channels,
+           2 * count, offsets);
+    // Refine by the short-range offsets.
+    for (int i = 0; i < count; ++i) {
+      channels[2 * i] = target_ids[begin + i];
+      channels[2 * i + 1] = num_keypoints + target_ids[begin + i];
+    }
+    for (int step = 0;; ++step) {
+      for (int i = 0; i < count; ++i) {
+        ys[2 * i] = ys[2 * i + 1] =
+            clamp(ys[2 * i] + offsets[2 * i], 0.0f, height - 1.0f);
+        xs[2 * i] = xs[2 * i + 1] =
+            clamp(xs[2 * i] + offsets[2 * i + 1], 0.0f, width - 1.0f);
+      }
+      if (step == refinement_steps) break;
+      sample(short_offsets, height, width, 2 * num_keypoints, ys, xs,
+             channels, 2 * count, offsets);
+    }
+    for (int i = 0; i < count; ++i) {
+      targets[begin + i] = Point{ys[2 * i], xs[2 * i]};
+    }
   }
-  return adjacency_list;
 }
 
-void BacktrackDecodePose(const float* scores, const float* short_offsets,
-                         const float* mid_offsets, const int height,
-                         const int width, const int num_keypoints,
-                         const int num_edges, const KeypointWithScore& root,
-                         const AdjacencyList& adjacency_list,
+template <typename Graph>
+void BacktrackDecodePose(const Graph& graph, const float* scores,
+                         const float* short_offsets, const float* mid_offsets,
+                         const int height, const int width,
+                         const KeypointWithScore& root,
                          const int mid_short_offset_refinement_steps,
-                         PoseKeypoints* pose_keypoints,
-                         PoseKeypointScores* keypoint_scores) {
+                         Point* pose_keypoints, float* keypoint_scores) {
+  const int num_keypoints = graph.NumKeypoints();
+  const int num_edges = graph.NumEdges();
   const float root_score = SampleTensorAtSingleChannel(
       scores, height, width, num_keypoints, root.point, root.id);
 
   // Used in order to put candidate keypoints in a priority queue w.r.t. their
   // score. Keypoints with higher score have higher priority and will be
-  // decoded/processed first.
-  DecreasingScoreKeypointPriorityQueue decode_queue;
-  decode_queue.push(KeypointWithScore(root.point, root.id, root_score));
+  // decoded/processed first. Every edge is followed at most once, so the root
+  // and one entry per edge bound its size.
+  std::array<KeypointWithScore, Graph::kMaxQueue> decode_queue;
+  auto queue_end = decode_queue.begin();
+  *queue_end++ = KeypointWithScore(root.point, root.id, root_score);
 
   // Keeps track of the keypoints whose position has already been decoded.
-  std::vector<bool> keypoint_decoded(num_keypoints, false);
-
-  while (!decode_queue.empty()) {
+  bool keypoint_decoded[Graph::kMaxKeypoints];
+  std::fill(keypoint_decoded, keypoint_decoded + num_keypoints, false);
+
+  // Children of the current keypoint, displaced and scored as one batch.
+  const SampleBatchFn sample = ActiveSampleBatch();
+  int child_edges[Graph::kMaxChildren];
+  int child_ids[Graph::kMaxChildren];
+  Point child_points[Graph::kMaxChildren];
+  float child_scores[Graph::kMaxChildren];
+  float child_ys[Graph::kMaxChildren];
+  float child_xs[Graph::kMaxChildren];
+
+  while (queue_end != decode_queue.begin()) {
     // The top element in the queue is the next keypoint to be processed.
-    const KeypointWithScore current_keypoint = decode_queue.top();
-    decode_queue.pop();
+    std::pop_heap(decode_queue.begin(), queue_end,
+                  KeypointWithScoreComparator());
+    const KeypointWithScore current_keypoint = *--queue_end;
 
     if (keypoint_decoded[current_keypoint.id]) continue;
 
-    pose_keypoints->keypoint[current_keypoint.id] = current_keypoint.point;
-    keypoint_scores->keypoint[current_keypoint.id] = current_keypoint.score;
+    pose_keypoints[current_keypoint.id] = current_keypoint.point;
+    keypoint_scores[current_keypoint.id] = current_keypoint.score;
 
     keypoint_decoded[current_keypoint.id] = true;
 
     // Add the children of the current keypoint that have not been decoded yet
     // to the priority queue.
-    const int num_children =
-        adjacency_list.child_ids[current_keypoint.id].size();
-    for (int j = 0; j < num_children; ++j) {
-      const int child_id = adjacency_list.child_ids[current_keypoint.id][j];
-      int edge_id = adjacency_list.edge_ids[current_keypoint.id][j];
+    int n_children = 0;
+    for (const int* child_edge = graph.ChildEdges(current_keypoint.id);
+         *child_edge != -1; ++child_edge) {
+      const int child_id = graph.EdgeChild(*child_edge);
       if (keypoint_decoded[child_id]) continue;
-
-      // The mid-offsets block is organized as 4 blocks of kNumEdges:
-      // [fwd Y offsets][fwd X offsets][bwd Y offsets][bwd X offsets]
-      // OTOH edge_id is [0,kNumEdges) for forward edges and
-      // [kNumEdges, 2*kNumEdges) for backward edges.
-      // Thus if the edge is a backward edge (>kNumEdges) then we need
-      // to start 16 indices later to be correctly aligned with the mid-offsets.
-      if (edge_id > posenet_decoder_op::kNumEdges) {
-        edge_id += posenet_decoder_op::kNumEdges;
+      child_edges[n_children] = graph.MidOffsetChannel(*child_edge);
+      child_ids[n_children] = child_id;
+      ++n_children;
+    }
+    if (n_children == 0) continue;
+
+    if (sample != nullptr) {
+      FindDisplacedPositions(sample, short_offsets, mid_offsets, height, width,
+                             num_keypoints, num_edges, current_keypoint.point,
+                             child_edges, child_ids, n_children,
+                             mid_short_offset_refinement_steps, child_points);
+      for (int i = 0; i < n_children; ++i) {
+        child_ys[i] = child_points[i].y;
+        child_xs[i] = child_points[i].x;
       }
+      sample(scores, height, width, num_keypoints, child_ys, child_xs,
+             child_ids, n_children, child_scores);
+    } else {
+      for (int i = 0; i < n_children; ++i) {
+        child_points[i] = FindDisplacedPosition(
+            short_offsets, mid_offsets, height, width, num_keypoints,
+            num_edges, current_keypoint.point, child_edges[i], child_ids[i],
+            mid_short_offset_refinement_steps);
+        child_scores[i] = SampleTensorAtSingleChannel(
+            scores, height, width, num_keypoints, child_points[i],
+            child_ids[i]);
+      }
+    }
 
-      const Point child_point = FindDisplacedPosition(
-          short_offsets, mid_offsets, height, width, num_keypoints, num_edges,
-          current_keypoint.point, edge_id, child_id,
-          mid_short_offset_refinement_steps);
-
-      const float child_score = SampleTensorAtSingleChannel(
-          scores, height, width, num_keypoints, child_point, child_id);
-
-      decode_queue.emplace(child_point, child_id, child_score);
+    for (int i = 0; i < n_children; ++i) {
+      *queue_end++ =
+          KeypointWithScore(child_points[i], child_ids[i], child_scores[i]);
+      std::push_heap(decode_queue.begin(), queue_end,
+                     KeypointWithScoreComparator());
     }
   }
 }
 
-void BuildKeypointWithScoreQueue(const float* scores,
+template <typename Graph>
+void BuildKeypointWithScoreQueue(const Graph& graph, const float* scores,
                                  const float* short_offsets, const int height,
-                                 const int width, const int num_keypoints,
-                                 const float score_threshold,
+                                 const int width, const float score_threshold,
                                  const int local_maximum_radius,
-                                 DecreasingScoreKeypointPriorityQueue* queue) {
+                                 KeypointHeap* queue) {
+  const int num_keypoints = graph.NumKeypoints();
   int score_index = 0;
   for (int y = 0; y < height; ++y) {
     for (int x = 0; x < width; ++x) {
@@ -322,7 +615,8 @@ void BuildKeypointWithScoreQueue(const float* scores,
             const float dx = short_offsets[offset_index + num_keypoints];
             const float y_refined = clamp(y + dy, 0.0f, height - 1.0f);
             const float x_refined = clamp(x + dx, 0.0f, width - 1.0f);
-            queue->emplace(Point{y_refined, x_refined}, j, score);
+            queue->push(
+                KeypointWithScore(Point{y_refined, x_refined}, j, score));
           }
         }
 
@@ -333,12 +627,15 @@ void BuildKeypointWithScoreQueue(const float* scores,
   }
 }
 
-bool PassKeypointNMS(const PoseKeypoints* poses, const size_t n_poses,
-                     const KeypointWithScore& keypoint,
+// `poses` holds n_poses poses of graph.NumKeypoints() points each.
+template <typename Graph>
+bool PassKeypointNMS(const Graph& graph, const Point* poses,
+                     const size_t n_poses, const KeypointWithScore& keypoint,
                      const float squared_nms_radius) {
+  const int num_keypoints = graph.NumKeypoints();
   for (size_t index = 0; index < n_poses; ++index) {
     if (ComputeSquaredDistance(keypoint.point,
-                               poses[index].keypoint[keypoint.id]) <=
+                               poses[index * num_keypoints + keypoint.id]) <=
         squared_nms_radius) {
       return false;
     }
@@ -346,143 +643,217 @@ bool PassKeypointNMS(const PoseKeypoints* poses, const size_t n_poses,
   return true;
 }
 
-void FindOverlappingKeypoints(const PoseKeypoints& pose1,
-                              const PoseKeypoints& pose2,
-                              const float squared_radius,
-                              std::vector<bool>* mask) {
-  const int num_keypoints = mask->size();
+template <typename Graph>
+void FindOverlappingKeypoints(const Graph& graph, const Point* pose1,
+                              const Point* pose2, const float squared_radius,
+                              bool* mask) {
+  const int num_keypoints = graph.NumKeypoints();
   for (int k = 0; k < num_keypoints; ++k) {
-    if (ComputeSquaredDistance(pose1.keypoint[k], pose2.keypoint[k]) <=
-        squared_radius) {
-      (*mask)[k] = true;
+    if (ComputeSquaredDistance(pose1[k], pose2[k]) <= squared_radius) {
+      mask[k] = true;
     }
   }
 }
 
-void PerformSoftKeypointNMS(const std::vector<int>& decreasing_indices,
-                            const PoseKeypoints* all_keypoint_coords,
-                            const PoseKeypointScores* all_keypoint_scores,
-                            const int num_keypoints,
+template <typename Graph>
+void PerformSoftKeypointNMS(const Graph& graph,
+                            const std::vector<int>& decreasing_indices,
+                            const Point* all_keypoint_coords,
+                            const float* all_keypoint_scores,
                             const float squared_nms_radius, const int topk,
                             std::vector<float>* all_instance_scores) {
+  const int num_keypoints = graph.NumKeypoints();
   const int num_instances = decreasing_indices.size();
   all_instance_scores->resize(num_instances);
   // Indicates the occlusion status of the keypoints of the active instance.
-  std::vector<bool> keypoint_occluded(num_keypoints);
+  bool keypoint_occluded[Graph::kMaxKeypoints];
   // Indices of the keypoints of the active instance in decreasing score value.
-  std::vector<int> indices(num_keypoints);
+  int indices[Graph::kMaxKeypoints];
   for (int i = 0; i < num_instances; ++i) {
     const int current_index = decreasing_indices[i];
+    const Point* current_pose =
+        &all_keypoint_coords[current_index * num_keypoints];
+    const float* current_scores =
+        &all_keypoint_scores[current_index * num_keypoints];
     // Find the keypoints of the current instance which are overlapping with
     // the corresponding keypoints of the higher-scoring instances and
     // zero-out their contribution to the score of the current instance.
-    std::fill(keypoint_occluded.begin(), keypoint_occluded.end(), false);
+    std::fill(keypoint_occluded, keypoint_occluded + num_keypoints, false);
     for (int j = 0; j < i; ++j) {
       const int previous_index = decreasing_indices[j];
-      FindOverlappingKeypoints(all_keypoint_coords[current_index],
-                               all_keypoint_coords[previous_index],
-                               squared_nms_radius, &keypoint_occluded);
+      FindOverlappingKeypoints(
+          graph, current_pose,
+          &all_keypoint_coords[previous_index * num_keypoints],
+          squared_nms_radius, keypoint_occluded);
     }
     // We compute the argsort keypoint indices based on the original keypoint
     // scores, but we do not let them contribute to the instance score if they
     // have been non-maximum suppressed.
-    DecreasingArgSort(&all_keypoint_scores[current_index].keypoint[0],
-                      num_keypoints, &indices);
+    DecreasingArgSort(current_scores, num_keypoints, indices);
     float total_score = 0.0f;
     for (int k = 0; k < topk; ++k) {
       if (!keypoint_occluded[indices[k]]) {
-        total_score += all_keypoint_scores[current_index].keypoint[indices[k]];
+        total_score += current_scores[indices[k]];
       }
     }
     (*all_instance_scores)[current_index] = total_score / topk;
   }
 }
 
-namespace posenet_decoder_op {
+// Backtracks the pose rooted at `root` and returns its instance-level score,
+// the average of the top-k keypoint probabilities. Depends on nothing but the
+// root, so candidates can be decoded in any order and on any thread.
+template <typename Graph>
+float DecodePose(const Graph& graph, const float* scores,
+                 const float* short_offsets, const float* mid_offsets,
+                 const int height, const int width,
+                 const KeypointWithScore& root,
+                 const int mid_short_offset_refinement_steps, Point* pose,
+                 float* keypoint_scores) {
+  const int num_keypoints = graph.NumKeypoints();
+  for (int k = 0; k < num_keypoints; ++k) {
+    pose[k].x = -1.0f;
+    pose[k].y = -1.0f;
+    keypoint_scores[k] = -1E5;
+  }
+  BacktrackDecodePose(graph, scores, short_offsets, mid_offsets, height, width,
+                      root, mid_short_offset_refinement_steps, pose,
+                      keypoint_scores);
+
+  // Convert keypoint-level scores from log-odds to probabilities and compute
+  // an initial instance-level score as the average of the scores of the top-k
+  // scoring keypoints.
+  const int topk = num_keypoints;
+  for (int k = 0; k < num_keypoints; ++k) {
+    keypoint_scores[k] = Sigmoid(keypoint_scores[k]);
+  }
+  int indices[Graph::kMaxKeypoints];
+  DecreasingArgSort(keypoint_scores, num_keypoints, indices);
+  float instance_score = 0.0f;
+  for (int j = 0; j < topk; ++j) {
+    instance_score += keypoint_scores[indices[j]];
+  }
+  return instance_score / topk;
+}
 
-int DecodeAllPoses(const float* scores, const float* short_offsets,
-                   const float* mid_offsets, const int height, const int width,
-                   const int max_detections, const float score_threshold,
-                   const int mid_short_offset_refinement_steps,
-                   const float nms_radius, const int stride,
-                   PoseKeypoints* pose_keypoints,
-                   PoseKeypointScores* pose_keypoint_scores,
-                   float* pose_scores) {
-  static const int kLocalMaximumRadius = 1;
+template <typename Graph>
+int DecodePoses(const Graph& graph, const float* scores,
+                const float* short_offsets, const float* mid_offsets,
+                const int height, const int width, const int max_detections,
+                const float score_threshold,
+                const int mid_short_offset_refinement_steps,
+                const int local_maximum_radius, const float nms_radius,
+                const int stride, Point* pose_keypoints,
+                float* pose_keypoint_scores, float* pose_scores,
+                edge::WorkerPool* pool,
+                posenet_decoder_op::DecoderWorkspace* workspace) {
+  const int num_keypoints = graph.NumKeypoints();
+  posenet_decoder_op::DecoderWorkspace local_workspace;
+  if (workspace == nullptr) workspace = &local_workspace;
+  workspace->Reserve(max_detections, pool ? pool->NumThreads() : 0,
+                     num_keypoints);
 
   // score_threshold threshold as a logit, before sigmoid
   const float min_score_logit = Logodds(score_threshold);
 
-  DecreasingScoreKeypointPriorityQueue queue;
-  BuildKeypointWithScoreQueue(scores, short_offsets, height, width,
-                              kNumKeypoints, min_score_logit,
-                              kLocalMaximumRadius, &queue);
-  AdjacencyList adjacency_list = BuildAdjacencyList();
+  KeypointHeap queue(&workspace->candidates);
+  BuildKeypointWithScoreQueue(graph, scores, short_offsets, height, width,
+                              min_score_logit, local_maximum_radius, &queue);
 
-  const int topk = kNumKeypoints;
-  std::vector<int> indices(kNumKeypoints);
+  const int topk = num_keypoints;
+  const float squared_nms_radius = nms_radius * nms_radius;
 
   int pose_counter = 0;
 
   // Generate at most max_detections object instances per image in decreasing
   // root part score order.
-  std::vector<float> all_instance_scores;
-
-  std::vector<PoseKeypoints> scratch_poses(max_detections);
-  std::vector<PoseKeypointScores> scratch_keypoint_scores(max_detections);
-
-  while (pose_counter < max_detections && !queue.empty()) {
-    // The top element in the queue is the next root candidate.
-    const KeypointWithScore root = queue.top();
-    queue.pop();
-
-    // Reject a root candidate if it is within a disk of `nms_radius` pixels
-    // from the corresponding part of a previously detected instance.
-    if (!PassKeypointNMS(scratch_poses.data(), pose_counter, root,
-                         nms_radius * nms_radius)) {
-      continue;
-    }
+  std::vector<float>& all_instance_scores = workspace->instance_scores;
+  all_instance_scores.clear();
+
+  Point* scratch_poses = workspace->poses.data();
+  float* scratch_keypoint_scores = workspace->keypoint_scores.data();
+
+  if (pool == nullptr) {
+    while (pose_counter < max_detections && !queue.empty()) {
+      // The top element in the queue is the next root candidate.
+      const KeypointWithScore root = queue.top();
+      queue.pop();
+
+      // Reject a root candidate if it is within a disk of `nms_radius` pixels
+      // from the corresponding part of a previously detected instance.
+      if (!PassKeypointNMS(graph, scratch_poses, pose_counter, root,
+                           squared_nms_radius)) {
+        continue;
+      }
 
-    auto next_pose = &scratch_poses[pose_counter];
-    auto next_scores = &scratch_keypoint_scores[pose_counter];
-    for (int k = 0; k < kNumKeypoints; ++k) {
-      next_pose->keypoint[k].x = -1.0f;
-      next_pose->keypoint[k].y = -1.0f;
-      next_scores->keypoint[k] = -1E5;
-    }
-    BacktrackDecodePose(scores, short_offsets, mid_offsets, height, width,
-                        kNumKeypoints, kNumEdges, root, adjacency_list,
-                        mid_short_offset_refinement_steps, next_pose,
-                        next_scores);
-
-    // Convert keypoint-level scores from log-odds to probabilities and compute
-    // an initial instance-level score as the average of the scores of the top-k
-    // scoring keypoints.
-    for (int k = 0; k < kNumKeypoints; ++k) {
-      next_scores->keypoint[k] = Sigmoid(next_scores->keypoint[k]);
-    }
-    DecreasingArgSort(&next_scores->keypoint[0], kNumKeypoints, &indices);
-    float instance_score = 0.0f;
-    for (int j = 0; j < topk; ++j) {
-      instance_score += next_scores->keypoint[indices[j]];
+      const float instance_score = DecodePose(
+          graph, scores, short_offsets, mid_offsets, height, width, root,
+          mid_short_offset_refinement_steps,
+          &scratch_poses[pose_counter * num_keypoints],
+          &scratch_keypoint_scores[pose_counter * num_keypoints]);
+      if (instance_score >= score_threshold) {
+        pose_counter++;
+        all_instance_scores.push_back(instance_score);
+      }
     }
-    instance_score /= topk;
-
-    if (instance_score >= score_threshold) {
-      pose_counter++;
-      all_instance_scores.push_back(instance_score);
+  } else {
+    // Speculative decode: every worker backtracks one of the next candidates
+    // that survive NMS against the poses accepted so far, then the batch is
+    // accepted in queue order exactly like the sequential loop would. A
+    // candidate rejected while gathering stays rejected since the accepted
+    // poses only grow; the others are checked again against poses accepted
+    // earlier in the same batch, which wastes their decode but not results.
+    const int batch_size = pool->NumThreads();
+    std::vector<KeypointWithScore>& batch = workspace->batch;
+    Point* batch_poses = workspace->batch_poses.data();
+    float* batch_keypoint_scores = workspace->batch_keypoint_scores.data();
+    float* batch_instance_scores = workspace->batch_instance_scores.data();
+    const auto decode = [&](int i, int) {
+      batch_instance_scores[i] = DecodePose(
+          graph, scores, short_offsets, mid_offsets, height, width, batch[i],
+          mid_short_offset_refinement_steps, &batch_poses[i * num_keypoints],
+          &batch_keypoint_scores[i * num_keypoints]);
+    };
+    while (pose_counter < max_detections && !queue.empty()) {
+      batch.clear();
+      while (static_cast<int>(batch.size()) < batch_size && !queue.empty()) {
+        const KeypointWithScore root = queue.top();
+        queue.pop();
+        if (PassKeypointNMS(graph, scratch_poses, pose_counter, root,
+                            squared_nms_radius)) {
+          batch.push_back(root);
+        }
+      }
+      // By reference, std::function does not copy the captures to the heap.
+      pool->ParallelFor(static_cast<int>(batch.size()), std::cref(decode));
+      for (size_t i = 0; i < batch.size() && pose_counter < max_detections;
+           ++i) {
+        if (!PassKeypointNMS(graph, scratch_poses, pose_counter, batch[i],
+                             squared_nms_radius) ||
+            batch_instance_scores[i] < score_threshold) {
+          continue;
+        }
+        std::copy(&batch_poses[i * num_keypoints],
+                  &batch_poses[(i + 1) * num_keypoints],
+                  &scratch_poses[pose_counter * num_keypoints]);
+        std::copy(&batch_keypoint_scores[i * num_keypoints],
+                  &batch_keypoint_scores[(i + 1) * num_keypoints],
+                  &scratch_keypoint_scores[pose_counter * num_keypoints]);
+        pose_counter++;
+        all_instance_scores.push_back(batch_instance_scores[i]);
+      }
     }
   }
 
   // Sort the detections in decreasing order of their instance-level scores.
-  std::vector<int> decreasing_indices;
+  std::vector<int>& decreasing_indices = workspace->decreasing_indices;
   DecreasingArgSort(all_instance_scores, &decreasing_indices);
 
   // Keypoint-level soft non-maximum suppression and instance-level rescoring as
   // the average of the top-k keypoints in terms of their keypoint-level scores.
-  PerformSoftKeypointNMS(decreasing_indices, scratch_poses.data(),
-                         scratch_keypoint_scores.data(), kNumKeypoints,
-                         nms_radius * nms_radius, topk, &all_instance_scores);
+  PerformSoftKeypointNMS(graph, decreasing_indices, scratch_poses,
+                         scratch_keypoint_scores, squared_nms_radius, topk,
+                         &all_instance_scores);
 
   // Sort the detections in decreasing order of their final instance-level
   // scores. Usually the order does not change but this is not guaranteed.
@@ -495,15 +866,16 @@ int DecodeAllPoses(const float* scores, const float* short_offsets,
     }
     // Rescale keypoint coordinates into pixel space (much more useful for
     // user).
-    for (int k = 0; k < kNumKeypoints; ++k) {
-      pose_keypoints[pose_counter].keypoint[k].y =
-          scratch_poses[index].keypoint[k].y * stride;
-      pose_keypoints[pose_counter].keypoint[k].x =
-          scratch_poses[index].keypoint[k].x * stride;
+    for (int k = 0; k < num_keypoints; ++k) {
+      pose_keypoints[pose_counter * num_keypoints + k].y =
+          scratch_poses[index * num_keypoints + k].y * stride;
+      pose_keypoints[pose_counter * num_keypoints + k].x =
+          scratch_poses[index * num_keypoints + k].x * stride;
     }
 
-    memcpy(&pose_keypoint_scores[pose_counter], &scratch_keypoint_scores[index],
-           sizeof(PoseKeypointScores));
+    memcpy(&pose_keypoint_scores[pose_counter * num_keypoints],
+           &scratch_keypoint_scores[index * num_keypoints],
+           num_keypoints * sizeof(float));
     pose_scores[pose_counter] = all_instance_scores[index];
     pose_counter++;
   }
@@ -511,5 +883,82 @@ int DecodeAllPoses(const float* scores, const float* short_offsets,
   return pose_counter;
 }
 
+}  // namespace
+
+namespace posenet_decoder_op {
+
+void DequantizeUint8(const uint8_t* src, const size_t num_elements,
+                     const int zero_point, const float scale,
+                     const float extra_scale, float* dst) {
+  edge::DequantizeUint8(src, num_elements, zero_point, scale * extra_scale,
+                        dst);
+}
+
+void ScaleFloat(const float* src, const size_t num_elements, const float scale,
+                float* dst) {
+  edge::ScaleFloat(src, num_elements, scale, dst);
+}
+
+void DecoderWorkspace::Reserve(const int max_detections, const int batch_size,
+                               const int num_keypoints) {
+  const size_t pose_size = static_cast<size_t>(max_detections) * num_keypoints;
+  if (poses.size() < pose_size) {
+    poses.resize(pose_size);
+    keypoint_scores.resize(pose_size);
+  }
+  instance_scores.reserve(max_detections);
+  decreasing_indices.reserve(max_detections);
+  const size_t batch_pose_size =
+      static_cast<size_t>(batch_size) * num_keypoints;
+  batch.reserve(batch_size);
+  if (batch_poses.size() < batch_pose_size) {
+    batch_poses.resize(batch_pose_size);
+    batch_keypoint_scores.resize(batch_pose_size);
+  }
+  if (static_cast<int>(batch_instance_scores.size()) < batch_size) {
+    batch_instance_scores.resize(batch_size);
+  }
+}
+
+int DecodeAllPoses(const float* scores, const float* short_offsets,
+                   const float* mid_offsets, const int height, const int width,
+                   const int max_detections, const float score_threshold,
+                   const int mid_short_offset_refinement_steps,
+                   const int local_maximum_radius, const float nms_radius,
+                   const int stride, PoseKeypoints* pose_keypoints,
+                   PoseKeypointScores* pose_keypoint_scores,
+                   float* pose_scores, edge::WorkerPool* pool,
+                   DecoderWorkspace* workspace) {
+  return DecodePoses(CocoGraph(), scores, short_offsets, mid_offsets, height,
+                     width, max_detections, score_threshold,
+                     mid_short_offset_refinement_steps, local_maximum_radius,
+                     nms_radius, stride, pose_keypoints[0].keypoint,
+                     pose_keypoint_scores[0].keypoint, pose_scores, pool,
+                     workspace);
+}
+
+int DecodeAllPoses(const SkeletonGraph& skeleton, const float* scores,
+                   const float* short_offsets, const float* mid_offsets,
+                   const int height, const int width, const int max_detections,
+                   const float score_threshold,
+                   const int mid_short_offset_refinement_steps,
+                   const int local_maximum_radius, const float nms_radius,
+                   const int stride, Point* pose_keypoints,
+                   float* pose_keypoint_scores, float* pose_scores,
+                   edge::WorkerPool* pool, DecoderWorkspace* workspace) {
+  if (skeleton.IsCoco()) {
+    return DecodePoses(CocoGraph(), scores, short_offsets, mid_offsets, height,
+                       width, max_detections, score_threshold,
+                       mid_short_offset_refinement_steps, local_maximum_radius,
+                       nms_radius, stride, pose_keypoints, pose_keypoint_scores,
+                       pose_scores, pool, workspace);
+  }
+  return DecodePoses(RuntimeGraph{&skeleton}, scores, short_offsets,
+                     mid_offsets, height, width, max_detections,
+                     score_threshold, mid_short_offset_refinement_steps,
+                     local_maximum_radius, nms_radius, stride, pose_keypoints,
+                     pose_keypoint_scores, pose_scores, pool, workspace);
+}
+
 }  // namespace posenet_decoder_op
 }  // namespace coral
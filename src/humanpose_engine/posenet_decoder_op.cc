@@ -1,10 +1,15 @@
 #include "posenet_decoder_op.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <numeric>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "flatbuffers/flexbuffers.h"
+#include "pose_skeleton.h"
 #include "posenet_decoder.h"
 #include "tensorflow/lite/kernels/internal/tensor.h"
 #include "tensorflow/lite/kernels/kernel_util.h"
@@ -28,19 +33,47 @@ constexpr int kOutputTensorPoseKeypointScores = 1;
 constexpr int kOutputTensorPoseScores = 2;
 constexpr int kOutputTensorPoseCount = 3;
 
-struct OpData {
-  // Decoder parameters
-  int max_detections;
-  float score_threshold;
-  int stride;
-  float nms_radius;
-
+struct OpData : PosenetDecoderParams {
   // Temporary tensors (e.g for dequantized values)
   int heatmaps_float_index;
   int shorts_float_index;
   int mids_float_index;
+  // max_detections of the model, the output tensors hold this many poses.
+  int output_max_detections;
+  // Optional "skeleton" name and flattened (parent, child) "edges" of the
+  // custom options, resolved against the input shapes in Prepare.
+  std::string skeleton_name;
+  std::vector<std::pair<int, int>> skeleton_edges;
+  SkeletonGraph skeleton;
+  // Decodes root candidates in parallel if set, see SetPosenetDecoderPool.
+  edge::WorkerPool* pool = nullptr;
+  // Decoder scratch buffers, reused by every Eval of this node.
+  DecoderWorkspace workspace;
+  // Eval leaves decoding to DecodePosenetInputs, see SetPosenetDecoderDeferred.
+  bool deferred = false;
+  // Dequantized inputs of DecodePosenetInputs, the temporary tensors belong
+  // to Invoke.
+  std::vector<float> heatmaps_float;
+  std::vector<float> shorts_float;
+  std::vector<float> mids_float;
 };
 
+// Reads a flat list of parent and child ids, untyped or typed.
+void ReadEdges(const flexbuffers::Reference& reference,
+               std::vector<std::pair<int, int>>* edges) {
+  if (reference.IsTypedVector()) {
+    const flexbuffers::TypedVector ids = reference.AsTypedVector();
+    for (size_t i = 0; i + 1 < ids.size(); i += 2) {
+      edges->emplace_back(ids[i].AsInt32(), ids[i + 1].AsInt32());
+    }
+  } else if (reference.IsVector()) {
+    const flexbuffers::Vector ids = reference.AsVector();
+    for (size_t i = 0; i + 1 < ids.size(); i += 2) {
+      edges->emplace_back(ids[i].AsInt32(), ids[i + 1].AsInt32());
+    }
+  }
+}
+
 void* Init(TfLiteContext* context, const char* buffer, size_t length) {
   auto* op_data = new OpData;
   const uint8_t* buffer_t = reinterpret_cast<const uint8_t*>(buffer);
@@ -50,6 +83,13 @@ void* Init(TfLiteContext* context, const char* buffer, size_t length) {
   op_data->score_threshold = m["score_threshold"].AsFloat();
   op_data->stride = m["stride"].AsInt32();
   op_data->nms_radius = m["nms_radius"].AsFloat();
+  op_data->mid_short_offset_refinement_steps = kMidShortOffsetRefinementSteps;
+  op_data->local_maximum_radius = kLocalMaximumRadius;
+  op_data->output_max_detections = op_data->max_detections;
+  if (m["skeleton"].IsString()) {
+    op_data->skeleton_name = m["skeleton"].AsString().str();
+  }
+  ReadEdges(m["edges"], &op_data->skeleton_edges);
 
   context->AddTensors(context, 1, &op_data->heatmaps_float_index);
   context->AddTensors(context, 1, &op_data->shorts_float_index);
@@ -85,10 +125,7 @@ void ScaleFloatTensor(const TfLiteTensor* src, TfLiteTensor* dst, float scale) {
   float* dst_data = GetTensorData<float>(dst);
   assert(src_data != nullptr);
   assert(dst_data != nullptr);
-  const size_t tensor_elements = src->bytes / sizeof(float);
-  for (int idx = 0; idx < tensor_elements; ++idx) {
-    dst_data[idx] = src_data[idx] * scale;
-  }
+  ScaleFloat(src_data, src->bytes / sizeof(float), scale, dst_data);
 }
 
 void DequantizeTensor(const TfLiteTensor* src, TfLiteTensor* dst,
@@ -96,15 +133,12 @@ void DequantizeTensor(const TfLiteTensor* src, TfLiteTensor* dst,
   if (src->type == kTfLiteUInt8) {
     const int num_elements = src->bytes;
     assert(num_elements * sizeof(float) == dst->bytes);
-    const float quant_zero_point = static_cast<float>(src->params.zero_point);
-    const float quant_scale = src->params.scale * extra_scale;
     const uint8_t* src_data = GetTensorData<uint8_t>(src);
     assert(src_data != nullptr);
     float* dst_data = GetTensorData<float>(dst);
     assert(dst_data != nullptr);
-    for (int idx = 0; idx < num_elements; ++idx) {
-      dst_data[idx] = (src_data[idx] - quant_zero_point) * quant_scale;
-    }
+    DequantizeUint8(src_data, num_elements, src->params.zero_point,
+                    src->params.scale, extra_scale, dst_data);
   } else if (src->type == kTfLiteFloat32) {
     ScaleFloatTensor(src, dst, extra_scale);
   } else {
@@ -112,6 +146,37 @@ void DequantizeTensor(const TfLiteTensor* src, TfLiteTensor* dst,
   }
 }
 
+// Dequantizes the data of `tensor` at `data`, which may be a copy of it.
+void DequantizeInput(const TfLiteTensor* tensor, const void* data,
+                     float extra_scale, std::vector<float>* dst) {
+  if (tensor->type == kTfLiteUInt8) {
+    dst->resize(tensor->bytes);
+    DequantizeUint8(static_cast<const uint8_t*>(data), tensor->bytes,
+                    tensor->params.zero_point, tensor->params.scale,
+                    extra_scale, dst->data());
+  } else {
+    dst->resize(tensor->bytes / sizeof(float));
+    ScaleFloat(static_cast<const float*>(data), dst->size(), extra_scale,
+               dst->data());
+  }
+}
+
+// Decodes dequantized inputs into the four outputs of the op.
+void Decode(OpData* op_data, const float* heatmaps_data,
+            const float* shorts_data, const float* mids_data, int height,
+            int width, float* pose_keypoints_data,
+            float* pose_keypoint_scores_data, float* pose_scores_data,
+            float* pose_count_data) {
+  const float nms_radius = op_data->nms_radius / op_data->stride;
+  pose_count_data[0] = DecodeAllPoses(
+      op_data->skeleton, heatmaps_data, shorts_data, mids_data, height, width,
+      op_data->max_detections, op_data->score_threshold,
+      op_data->mid_short_offset_refinement_steps,
+      op_data->local_maximum_radius, nms_radius, op_data->stride,
+      reinterpret_cast<Point*>(pose_keypoints_data), pose_keypoint_scores_data,
+      pose_scores_data, op_data->pool, &op_data->workspace);
+}
+
 TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   auto* op_data = reinterpret_cast<OpData*>(node->user_data);
   TF_LITE_ENSURE_EQ(context, NumInputs(node), 3);
@@ -134,9 +199,21 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   TF_LITE_ENSURE_EQ(context, heatmaps->dims->data[0], 1);
   TF_LITE_ENSURE_EQ(context, shorts->dims->data[0], 1);
   TF_LITE_ENSURE_EQ(context, mids->dims->data[0], 1);
-  TF_LITE_ENSURE_EQ(context, heatmaps->dims->data[3], kNumKeypoints);
-  TF_LITE_ENSURE_EQ(context, shorts->dims->data[3], 2 * kNumKeypoints);
-  TF_LITE_ENSURE_EQ(context, mids->dims->data[3], 2 * 2 * kNumEdges);
+
+  // The skeleton follows from the channels unless the options name one.
+  const int num_keypoints = heatmaps->dims->data[3];
+  TF_LITE_ENSURE_EQ(context, shorts->dims->data[3], 2 * num_keypoints);
+  TF_LITE_ENSURE_EQ(context, mids->dims->data[3] % 4, 0);
+  const int num_edges = mids->dims->data[3] / 4;
+  PoseSkeleton skeleton;
+  if (!ResolveSkeleton(op_data->skeleton_name, op_data->skeleton_edges,
+                       num_keypoints, num_edges, &skeleton) ||
+      !op_data->skeleton.Init(skeleton)) {
+    context->ReportError(context,
+                         "No pose skeleton with %d keypoints and %d edges",
+                         num_keypoints, num_edges);
+    return kTfLiteError;
+  }
 
   // Temporary tensors
   TfLiteIntArrayFree(node->temporaries);
@@ -154,21 +231,21 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   TF_LITE_ENSURE_OK(
       context, PrepTempTensor(context, op_data->mids_float_index, mids->dims));
 
-  // Output tensor 0 will be max_detections*kNumKeypoints*2
+  // Output tensor 0 will be max_detections*num_keypoints*2
   // The last dimension has the x and y coordinates of each keypoint.
   TF_LITE_ENSURE_OK(
       context,
       PrepOutputTensor(context,
                        GetOutput(context, node, kOutputTensorPoseKeypoints),
-                       {1, op_data->max_detections, kNumKeypoints, 2}));
+                       {1, op_data->output_max_detections, num_keypoints, 2}));
 
-  // Output tensor 1 to be size max_detections*kNumKeypoints and contain
+  // Output tensor 1 to be size max_detections*num_keypoints and contain
   // keypoints scores in the range [0,1].
   TF_LITE_ENSURE_OK(
       context,
       PrepOutputTensor(
           context, GetOutput(context, node, kOutputTensorPoseKeypointScores),
-          {1, op_data->max_detections, kNumKeypoints}));
+          {1, op_data->output_max_detections, num_keypoints}));
 
   // Output tensor 2 to be size max_detections and contain
   // pose scores in the range [0,1].
@@ -176,7 +253,7 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   TF_LITE_ENSURE_OK(
       context, PrepOutputTensor(
                    context, GetOutput(context, node, kOutputTensorPoseScores),
-                   {1, op_data->max_detections}));
+                   {1, op_data->output_max_detections}));
 
   // Output Tensor 3 is an int32 scalar, the number of detected poses.
   // Currently only float output tensors are supported so save this as a float.
@@ -192,6 +269,7 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   auto* op_data = reinterpret_cast<OpData*>(node->user_data);
 
   TF_LITE_ENSURE(context, op_data->stride > 0);
+  if (op_data->deferred) return kTfLiteOk;
   const TfLiteTensor* heatmaps = GetInput(context, node, kInputTensorHeatmaps);
   const TfLiteTensor* shorts =
       GetInput(context, node, kInputTensorShortOffsets);
@@ -223,22 +301,105 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   float* pose_scores_data = GetTensorData<float>(pose_scores);
   float* pose_count_data = GetTensorData<float>(pose_count);
 
-  const float nms_radius = op_data->nms_radius / op_data->stride;
-  pose_count_data[0] = DecodeAllPoses(
-      heatmaps_data, shorts_data, mids_data,
-      /*height = */ heatmaps_float->dims->data[1],
-      /*width = */ heatmaps_float->dims->data[2], op_data->max_detections,
-      op_data->score_threshold,
-      /*mid_short_offset_refinement_steps = */ 5, nms_radius, op_data->stride,
-      reinterpret_cast<PoseKeypoints*>(pose_keypoints_data),
-      reinterpret_cast<PoseKeypointScores*>(pose_keypoint_scores_data),
-      pose_scores_data);
+  Decode(op_data, heatmaps_data, shorts_data, mids_data,
+         /*height = */ heatmaps_float->dims->data[1],
+         /*width = */ heatmaps_float->dims->data[2], pose_keypoints_data,
+         pose_keypoint_scores_data, pose_scores_data, pose_count_data);
 
   return kTfLiteOk;
 }
 
 }  // namespace posenet_decoder_op
 
+const PosenetDecoderParams* GetPosenetDecoderParams(
+    const TfLiteRegistration& registration, const TfLiteNode& node) {
+  if (registration.custom_name == nullptr ||
+      std::strcmp(registration.custom_name, kPosenetDecoderOp) != 0) {
+    return nullptr;
+  }
+  return static_cast<const posenet_decoder_op::OpData*>(node.user_data);
+}
+
+const PoseSkeleton* GetPosenetDecoderSkeleton(
+    const TfLiteRegistration& registration, const TfLiteNode& node) {
+  if (GetPosenetDecoderParams(registration, node) == nullptr) return nullptr;
+  const auto* op_data =
+      static_cast<const posenet_decoder_op::OpData*>(node.user_data);
+  if (op_data->skeleton.NumKeypoints() == 0) return nullptr;
+  return &op_data->skeleton.Skeleton();
+}
+
+bool SetPosenetDecoderPool(const TfLiteRegistration& registration,
+                           const TfLiteNode& node, edge::WorkerPool* pool) {
+  if (GetPosenetDecoderParams(registration, node) == nullptr) return false;
+  static_cast<posenet_decoder_op::OpData*>(node.user_data)->pool = pool;
+  return true;
+}
+
+bool SetPosenetDecoderParams(const TfLiteRegistration& registration,
+                             const TfLiteNode& node,
+                             const PosenetDecoderParams& params) {
+  if (GetPosenetDecoderParams(registration, node) == nullptr) return false;
+  auto* op_data = static_cast<posenet_decoder_op::OpData*>(node.user_data);
+  // The stride is fixed by the network; any other value would silently scale
+  // every keypoint.
+  if (params.stride != op_data->stride) return false;
+  if (params.max_detections < 1 || params.score_threshold <= 0.0f ||
+      params.score_threshold >= 1.0f || params.nms_radius < 0.0f ||
+      params.mid_short_offset_refinement_steps < 0 ||
+      params.local_maximum_radius < 0) {
+    return false;
+  }
+  op_data->max_detections =
+      std::min(params.max_detections, op_data->output_max_detections);
+  op_data->score_threshold = params.score_threshold;
+  op_data->nms_radius = params.nms_radius;
+  op_data->mid_short_offset_refinement_steps =
+      params.mid_short_offset_refinement_steps;
+  op_data->local_maximum_radius = params.local_maximum_radius;
+  return true;
+}
+
+bool SetPosenetDecoderDeferred(const TfLiteRegistration& registration,
+                               const TfLiteNode& node, const bool deferred) {
+  if (GetPosenetDecoderParams(registration, node) == nullptr) return false;
+  static_cast<posenet_decoder_op::OpData*>(node.user_data)->deferred = deferred;
+  return true;
+}
+
+bool DecodePosenetInputs(const TfLiteRegistration& registration,
+                         const TfLiteNode& node,
+                         const TfLiteTensor* const* input_tensors,
+                         const void* const* inputs, float* const* outputs) {
+  if (GetPosenetDecoderParams(registration, node) == nullptr) return false;
+  auto* op_data = static_cast<posenet_decoder_op::OpData*>(node.user_data);
+  if (op_data->stride <= 0) return false;
+  using posenet_decoder_op::kInputTensorHeatmaps;
+  using posenet_decoder_op::kInputTensorMidOffsets;
+  using posenet_decoder_op::kInputTensorShortOffsets;
+  // Same dequantization as Eval.
+  posenet_decoder_op::DequantizeInput(input_tensors[kInputTensorHeatmaps],
+                                      inputs[kInputTensorHeatmaps], 1.0,
+                                      &op_data->heatmaps_float);
+  posenet_decoder_op::DequantizeInput(
+      input_tensors[kInputTensorShortOffsets], inputs[kInputTensorShortOffsets],
+      1.0 / op_data->stride, &op_data->shorts_float);
+  posenet_decoder_op::DequantizeInput(input_tensors[kInputTensorMidOffsets],
+                                      inputs[kInputTensorMidOffsets],
+                                      1.0 / op_data->stride,
+                                      &op_data->mids_float);
+  const TfLiteIntArray* dims = input_tensors[kInputTensorHeatmaps]->dims;
+  posenet_decoder_op::Decode(
+      op_data, op_data->heatmaps_float.data(), op_data->shorts_float.data(),
+      op_data->mids_float.data(), /*height = */ dims->data[1],
+      /*width = */ dims->data[2],
+      outputs[posenet_decoder_op::kOutputTensorPoseKeypoints],
+      outputs[posenet_decoder_op::kOutputTensorPoseKeypointScores],
+      outputs[posenet_decoder_op::kOutputTensorPoseScores],
+      outputs[posenet_decoder_op::kOutputTensorPoseCount]);
+  return true;
+}
+
 TfLiteRegistration* RegisterPosenetDecoderOp() {
   static TfLiteRegistration r = {
       posenet_decoder_op::Init, posenet_decoder_op::Free,
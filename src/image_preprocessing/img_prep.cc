@@ -2,10 +2,101 @@
 // Created by eashwara on 14.05.20.
 //
 #include "img_prep.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <memory>
+
+#include "resampler.h"
 
 namespace edge
 {
+	namespace
+	{
+		// Camera and model geometry rarely change, so every thread keeps the taps of the
+		// last geometry it resized for.
+		Resampler& CachedResampler(const cv::Size& src, const cv::Size& dst)
+		{
+			thread_local std::unique_ptr<Resampler> resampler;
+			if (!resampler || !resampler->Matches(src.width, src.height, dst.width, dst.height, 3,
+			                                      Interpolation::kBilinear, true)) {
+				resampler.reset(new Resampler(src.width, src.height, dst.width, dst.height, 3,
+				                              Interpolation::kBilinear, true));
+			}
+			return *resampler;
+		}
+	}
+
+	InputPlacement PlaceInput(const ResizeMode mode, const int frame_width, const int frame_height,
+	                          const int width, const int height, const int align)
+	{
+		InputPlacement placement;
+		placement.src = cv::Rect(0, 0, frame_width, frame_height);
+		placement.dst = cv::Rect(0, 0, width, height);
+		const double scale_x = static_cast<double>(width) / frame_width;
+		const double scale_y = static_cast<double>(height) / frame_height;
+		if (mode == ResizeMode::kLetterbox) {
+			const double scale = std::min(scale_x, scale_y);
+			placement.dst.width = std::max(1, std::min(width, static_cast<int>(std::lround(frame_width * scale))));
+			placement.dst.height = std::max(1, std::min(height, static_cast<int>(std::lround(frame_height * scale))));
+			placement.dst.x = (width - placement.dst.width) / 2;
+			placement.dst.y = (height - placement.dst.height) / 2;
+		} else if (mode == ResizeMode::kCenterCrop) {
+			const double scale = std::max(scale_x, scale_y);
+			placement.src.width = std::max(1, std::min(frame_width, static_cast<int>(std::lround(width / scale))));
+			placement.src.height = std::max(1, std::min(frame_height, static_cast<int>(std::lround(height / scale))));
+			placement.src.x = (frame_width - placement.src.width) / 2 / align * align;
+			placement.src.y = (frame_height - placement.src.height) / 2 / align * align;
+		}
+		return placement;
+	}
+
+	AffineTransform PlacementTransform(const InputPlacement& placement, const int frame_width, const int frame_height,
+	                                   const int width, const int height)
+	{
+		// input pixel p lies at src.x + (p - dst.x) * src.width / dst.width in the frame.
+		AffineTransform transform;
+		transform.scale_x = static_cast<float>(width) * placement.src.width / placement.dst.width / frame_width;
+		transform.scale_y = static_cast<float>(height) * placement.src.height / placement.dst.height / frame_height;
+		transform.offset_x = (placement.src.x - static_cast<float>(placement.dst.x) * placement.src.width /
+		                                        placement.dst.width) / frame_width;
+		transform.offset_y = (placement.src.y - static_cast<float>(placement.dst.y) * placement.src.height /
+		                                        placement.dst.height) / frame_height;
+		return transform;
+	}
+
+	void ClearPadding(const InputPlacement& placement, const int width, const int height, uint8_t* input)
+	{
+		if (placement.dst.width == width && placement.dst.height == height) return;
+		std::memset(input, 0, static_cast<size_t>(width) * height * 3);
+	}
+
+	YuvImage CropYuv(const YuvImage& image, const cv::Rect& roi)
+	{
+		YuvImage crop = image;
+		crop.width = roi.width;
+		crop.height = roi.height;
+		const int x = roi.x;
+		const int y = roi.y;
+		switch (crop.format) {
+			case PixelFormat::kYUYV:
+				crop.planes[0] += y * crop.strides[0] + 2 * x;
+				break;
+			case PixelFormat::kNV12:
+			case PixelFormat::kNV21:
+				crop.planes[0] += y * crop.strides[0] + x;
+				crop.planes[1] += y / 2 * crop.strides[1] + x;
+				break;
+			case PixelFormat::kI420:
+				crop.planes[0] += y * crop.strides[0] + x;
+				crop.planes[1] += y / 2 * crop.strides[1] + x / 2;
+				crop.planes[2] += y / 2 * crop.strides[2] + x / 2;
+				break;
+		}
+		return crop;
+	}
+
 	std::vector<uint8_t> GetInputFromImage(cv::Mat input_frame, const int& width, const int& height, const int& channels)
 	{
 		cv::resize(input_frame, input_frame, cv::Size(width,height));
@@ -14,4 +105,84 @@ namespace edge
 		std::vector<uint8_t> in_vec= input_frame.isContinuous()? flat : flat.clone();
 		return in_vec;
 	}
+
+	std::vector<uint8_t> GetInputFromImage(const YuvImage& input_frame, const int& width, const int& height)
+	{
+		std::vector<uint8_t> in_vec(static_cast<size_t>(width) * height * 3);
+		ConvertYuvToRgb(input_frame, width, height, in_vec.data(), 3 * width);
+		return in_vec;
+	}
+
+	AffineTransform ResizeInto(const cv::Mat& input_frame, const ResizeMode mode, cv::Mat& dst)
+	{
+		if (input_frame.type() != dst.type()) {
+			// cv::resize would reallocate the view of `dst` instead of writing into it.
+			std::cout << "ResizeInto needs a frame of the destination type " << dst.type() << ", got "
+			          << input_frame.type() << std::endl;
+			dst.setTo(cv::Scalar::all(0));
+			return AffineTransform();
+		}
+		const InputPlacement placement = PlaceInput(mode, input_frame.cols, input_frame.rows, dst.cols, dst.rows, 1);
+		if (placement.dst.size() != dst.size()) dst.setTo(cv::Scalar::all(0));
+		cv::Mat target = dst(placement.dst);
+		cv::resize(input_frame(placement.src), target, placement.dst.size());
+		return PlacementTransform(placement, input_frame.cols, input_frame.rows, dst.cols, dst.rows);
+	}
+
+	AffineTransform GetInputFromImage(const cv::Mat& input_frame, const ResizeMode mode, const int& width,
+	                                  const int& height, uint8_t* input)
+	{
+		if (input_frame.type() != CV_8UC3) {
+			// Gray and BGRA frames are expanded to BGR first; resizing them straight into a
+			// three channel view of the tensor would make OpenCV reallocate the view and leave
+			// the tensor untouched.
+			int code = -1;
+			if (input_frame.type() == CV_8UC1) code = cv::COLOR_GRAY2BGR;
+			else if (input_frame.type() == CV_8UC4) code = cv::COLOR_BGRA2BGR;
+			if (code < 0) {
+				std::cout << "Unsupported frame type " << input_frame.type() << ", expected 8 bit gray, BGR or BGRA"
+				          << std::endl;
+				std::memset(input, 0, static_cast<size_t>(width) * height * 3);
+				return AffineTransform();
+			}
+			thread_local cv::Mat bgr;
+			cv::cvtColor(input_frame, bgr, code);
+			return GetInputFromImage(bgr, mode, width, height, input);
+		}
+		// Resizes and swaps to RGB in one pass.
+		const InputPlacement placement = PlaceInput(mode, input_frame.cols, input_frame.rows, width, height, 1);
+		ClearPadding(placement, width, height, input);
+		const int stride = 3 * width;
+		CachedResampler(placement.src.size(), placement.dst.size())
+						.Resize(input_frame.ptr<uint8_t>(placement.src.y) + 3 * placement.src.x,
+						        static_cast<int>(input_frame.step), input + placement.dst.y * stride + 3 * placement.dst.x,
+						        stride);
+		return PlacementTransform(placement, input_frame.cols, input_frame.rows, width, height);
+	}
+
+	AffineTransform GetInputFromImage(const YuvImage& input_frame, const ResizeMode mode, const int& width,
+	                                  const int& height, uint8_t* input)
+	{
+		const InputPlacement placement = PlaceInput(mode, input_frame.width, input_frame.height, width, height, 2);
+		ClearPadding(placement, width, height, input);
+		const YuvImage src = CropYuv(input_frame, placement.src);
+		const int stride = 3 * width;
+		ConvertYuvToRgb(src, placement.dst.width, placement.dst.height,
+		                input + placement.dst.y * stride + 3 * placement.dst.x, stride);
+		return PlacementTransform(placement, input_frame.width, input_frame.height, width, height);
+	}
+
+	bool ParseResizeMode(const std::string& name, ResizeMode* mode)
+	{
+		if (name == "stretch") {
+			*mode = ResizeMode::kStretch;
+		} else if (name == "letterbox") {
+			*mode = ResizeMode::kLetterbox;
+		} else if (name == "crop") {
+			*mode = ResizeMode::kCenterCrop;
+		} else {
+			return false;
+		}
+		return true;
+	}
 }
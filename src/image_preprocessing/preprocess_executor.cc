@@ -0,0 +1,69 @@
+//
+// Row band parallel preprocessing on a persistent WorkerPool.
+//
+
+#include "preprocess_executor.h"
+
+#include <algorithm>
+
+namespace edge {
+	namespace {
+		// More bands than threads evens out cores that get preempted; each band only
+		// re-blends the few source rows it shares with its neighbour.
+		constexpr int kBandsPerThread = 2;
+	}
+
+	PreprocessExecutor::PreprocessExecutor(int num_threads)
+					: m_num_threads(std::max(1, num_threads)), m_scratch(m_num_threads) {
+		if (m_num_threads > 1) m_pool.reset(new WorkerPool(m_num_threads));
+	}
+
+	void PreprocessExecutor::ForEachBand(const int rows, const std::function<void(int, int, int)>& fn) {
+		if (!m_pool || rows < 2 * m_num_threads) {
+			fn(0, rows, 0);
+			return;
+		}
+		const int num_bands = std::min(rows, m_num_threads * kBandsPerThread);
+		const int band_rows = (rows + num_bands - 1) / num_bands;
+		m_pool->ParallelFor((rows + band_rows - 1) / band_rows, [&](int band, int worker) {
+			fn(band * band_rows, std::min(rows, (band + 1) * band_rows), worker);
+		});
+	}
+
+	AffineTransform PreprocessExecutor::Run(const cv::Mat& frame, const ResizeMode mode, const int width,
+	                                        const int height, uint8_t* input) {
+		if (frame.type() != CV_8UC3) return GetInputFromImage(frame, mode, width, height, input);
+		const InputPlacement placement = PlaceInput(mode, frame.cols, frame.rows, width, height, 1);
+		const cv::Rect& src = placement.src;
+		const cv::Rect& dst = placement.dst;
+		if (!m_resampler || !m_resampler->Matches(src.width, src.height, dst.width, dst.height, 3,
+		                                          Interpolation::kBilinear, true)) {
+			m_resampler.reset(new Resampler(src.width, src.height, dst.width, dst.height, 3,
+			                                Interpolation::kBilinear, true));
+		}
+		ClearPadding(placement, width, height, input);
+		const Resampler& resampler = *m_resampler;
+		const uint8_t* src_data = frame.ptr<uint8_t>(src.y) + 3 * src.x;
+		const int src_stride = static_cast<int>(frame.step);
+		const int stride = 3 * width;
+		uint8_t* dst_data = input + dst.y * stride + 3 * dst.x;
+		ForEachBand(dst.height, [&](int row_begin, int row_end, int worker) {
+			resampler.Resize(src_data, src_stride, dst_data, stride, row_begin, row_end, &m_scratch[worker]);
+		});
+		return PlacementTransform(placement, frame.cols, frame.rows, width, height);
+	}
+
+	AffineTransform PreprocessExecutor::Run(const YuvImage& frame, const ResizeMode mode, const int width,
+	                                        const int height, uint8_t* input) {
+		const InputPlacement placement = PlaceInput(mode, frame.width, frame.height, width, height, 2);
+		ClearPadding(placement, width, height, input);
+		const YuvImage src = CropYuv(frame, placement.src);
+		const cv::Rect& dst = placement.dst;
+		const int stride = 3 * width;
+		uint8_t* dst_data = input + dst.y * stride + 3 * dst.x;
+		ForEachBand(dst.height, [&](int row_begin, int row_end, int) {
+			ConvertYuvToRgb(src, dst.width, dst.height, dst_data, stride, false, row_begin, row_end);
+		});
+		return PlacementTransform(placement, frame.width, frame.height, width, height);
+	}
+}
@@ -0,0 +1,289 @@
+//
+// Separable fixed point resampling with precomputed taps. Every source row that an
+// output row needs is blended horizontally once into 16 bit samples and kept in a small
+// ring, the vertical blend then runs eight samples at a time with SSE2 or NEON. The
+// horizontal blend of three channel bilinear rows, the common camera to model case, runs
+// two pixels at a time. The scalar fallback does the same integer arithmetic, so every
+// path produces identical bytes.
+//
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define EDGE_RESAMPLER_NEON 1
+#endif
+
+namespace edge
+{
+	namespace
+	{
+		// Weights in 7 bit fixed point: a horizontally blended sample fits in 16 bits and
+		// the vertical blend of any number of rows in 32 bits.
+		constexpr int kWeightBits = 7;
+		constexpr int kWeightOne = 1 << kWeightBits;
+		constexpr int kBlendShift = 2 * kWeightBits;
+		constexpr int kBlock = 8;
+
+		inline uint8_t Clamp8(int v) {
+			return static_cast<uint8_t>(v < 0 ? 0 : v > 255 ? 255 : v);
+		}
+
+		// Horizontal pass with the channel and tap counts known at compile time, 0 means
+		// given at runtime. `offset` holds byte offsets of the taps into the row.
+		template <int kChannels, int kTaps>
+		void BlendRow(const uint8_t* __restrict row, const int* __restrict offset, const int16_t* __restrict weight,
+		              const int* channel_map, int channels, int taps, int width, int16_t* __restrict out) {
+			if (kChannels) channels = kChannels;
+			if (kTaps) taps = kTaps;
+			for (int x = 0; x < width; ++x, offset += taps, weight += taps, out += channels) {
+				for (int c = 0; c < channels; ++c) {
+					const uint8_t* samples = row + channel_map[c];
+					int sum = 0;
+					for (int k = 0; k < taps; ++k) sum += samples[offset[k]] * weight[k];
+					out[c] = static_cast<int16_t>(sum);
+				}
+			}
+		}
+
+#if defined(__SSE2__) || defined(EDGE_RESAMPLER_NEON)
+		inline uint32_t Load32(const void* p) {
+			uint32_t v;
+			std::memcpy(&v, p, sizeof(v));
+			return v;
+		}
+
+		// Three channel, two tap horizontal pass over `pixels` output pixels, two at a time.
+		// Each tap loads the four bytes at its offset, so the caller keeps the byte after the
+		// last tap inside the row. Each pixel is stored as four samples, the fourth is
+		// overwritten by the next pixel, so the caller also leaves at least one pixel after
+		// `pixels` to the scalar loop.
+		void BlendRow3x2(const uint8_t* __restrict row, const int* __restrict offset, const int16_t* __restrict weight,
+		                 const bool swap_rb, const int pixels, int16_t* __restrict out) {
+#if defined(__SSE2__)
+			const __m128i zero = _mm_setzero_si128();
+			for (int x = 0; x + 2 <= pixels; x += 2, offset += 4, weight += 4, out += 6) {
+				const __m128i a = _mm_unpacklo_epi8(
+								_mm_unpacklo_epi32(_mm_cvtsi32_si128(static_cast<int>(Load32(row + offset[0]))),
+								                   _mm_cvtsi32_si128(static_cast<int>(Load32(row + offset[2])))),
+								zero);
+				const __m128i b = _mm_unpacklo_epi8(
+								_mm_unpacklo_epi32(_mm_cvtsi32_si128(static_cast<int>(Load32(row + offset[1]))),
+								                   _mm_cvtsi32_si128(static_cast<int>(Load32(row + offset[3])))),
+								zero);
+				// Both taps of a pixel are adjacent 16 bit weights, one madd blends a channel.
+				const __m128i first = _mm_madd_epi16(_mm_unpacklo_epi16(a, b),
+				                                     _mm_set1_epi32(static_cast<int>(Load32(weight))));
+				const __m128i second = _mm_madd_epi16(_mm_unpackhi_epi16(a, b),
+				                                      _mm_set1_epi32(static_cast<int>(Load32(weight + 2))));
+				__m128i packed = _mm_packs_epi32(first, second);
+				if (swap_rb) {
+					packed = _mm_shufflehi_epi16(_mm_shufflelo_epi16(packed, _MM_SHUFFLE(3, 0, 1, 2)),
+					                             _MM_SHUFFLE(3, 0, 1, 2));
+				}
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out), packed);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + 3), _mm_srli_si128(packed, 8));
+			}
+#else
+			for (int x = 0; x + 2 <= pixels; x += 2, offset += 4, weight += 4, out += 6) {
+				const int16x8_t a = vreinterpretq_s16_u16(vmovl_u8(vcreate_u8(
+								Load32(row + offset[0]) | static_cast<uint64_t>(Load32(row + offset[2])) << 32)));
+				const int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(vcreate_u8(
+								Load32(row + offset[1]) | static_cast<uint64_t>(Load32(row + offset[3])) << 32)));
+				// Weights sum to kWeightOne, so the blend cannot leave 16 bits.
+				const int16x8_t wa = vcombine_s16(vdup_n_s16(weight[0]), vdup_n_s16(weight[2]));
+				const int16x8_t wb = vcombine_s16(vdup_n_s16(weight[1]), vdup_n_s16(weight[3]));
+				int16x8_t sum = vmlaq_s16(vmulq_s16(a, wa), b, wb);
+				if (swap_rb) {
+					// c3 c2 c1 c0 | d3 d2 d1 d0 rotated by one lane is c2 c1 c0 d3 | d2 d1 d0 c3.
+					const int16x8_t reversed = vrev64q_s16(sum);
+					sum = vextq_s16(reversed, reversed, 1);
+				}
+				vst1_s16(out, vget_low_s16(sum));
+				vst1_s16(out + 3, vget_high_s16(sum));
+			}
+#endif
+		}
+#endif
+	}
+
+	Resampler::Taps Resampler::BuildTaps(int src_size, int dst_size, Interpolation interpolation)
+	{
+		const double scale = static_cast<double>(src_size) / dst_size;
+		std::vector<std::vector<std::pair<int, double>>> taps(dst_size);
+		for (int d = 0; d < dst_size; ++d) {
+			auto& tap = taps[d];
+			if (interpolation == Interpolation::kArea && scale > 1.0) {
+				const double begin = d * scale;
+				const double end = std::min<double>(src_size, begin + scale);
+				for (int s = static_cast<int>(begin); s < end; ++s) {
+					const double overlap = std::min<double>(s + 1, end) - std::max<double>(s, begin);
+					if (overlap > 1e-6) tap.push_back(std::make_pair(s, overlap / scale));
+				}
+			} else {
+				const double s = std::max(0.0, (d + 0.5) * scale - 0.5);
+				const int i0 = std::min(static_cast<int>(s), src_size - 1);
+				const int i1 = std::min(i0 + 1, src_size - 1);
+				tap.push_back(std::make_pair(i0, 1.0 - (s - i0)));
+				if (i1 != i0) tap.push_back(std::make_pair(i1, s - i0));
+			}
+		}
+
+		Taps result;
+		result.count = 1;
+		for (const auto& tap : taps) result.count = std::max<int>(result.count, tap.size());
+		result.index.assign(static_cast<size_t>(dst_size) * result.count, 0);
+		result.weight.assign(static_cast<size_t>(dst_size) * result.count, 0);
+		for (int d = 0; d < dst_size; ++d) {
+			const auto& tap = taps[d];
+			int* index = &result.index[d * result.count];
+			int16_t* weight = &result.weight[d * result.count];
+			int sum = 0;
+			size_t largest = 0;
+			for (size_t k = 0; k < tap.size(); ++k) {
+				index[k] = tap[k].first;
+				weight[k] = static_cast<int16_t>(std::lround(tap[k].second * kWeightOne));
+				sum += weight[k];
+				if (weight[k] > weight[largest]) largest = k;
+			}
+			// Rounding must not change the overall brightness.
+			weight[largest] = static_cast<int16_t>(weight[largest] + kWeightOne - sum);
+			// Unused taps repeat the last index with zero weight.
+			for (int k = tap.size(); k < result.count; ++k) index[k] = index[tap.size() - 1];
+		}
+		return result;
+	}
+
+	Resampler::Resampler(int src_width, int src_height, int dst_width, int dst_height, int channels,
+	                     Interpolation interpolation, bool swap_rb)
+					: m_src_width(src_width), m_src_height(src_height), m_dst_width(dst_width), m_dst_height(dst_height),
+					  m_channels(channels), m_interpolation(interpolation), m_swap_rb(swap_rb && channels >= 3),
+					  m_taps_x(BuildTaps(src_width, dst_width, interpolation)),
+					  m_taps_y(BuildTaps(src_height, dst_height, interpolation))
+	{
+		for (int index : m_taps_x.index) m_offsets_x.push_back(index * channels);
+		for (int c = 0; c < channels; ++c) m_channel_map.push_back(c);
+		if (m_swap_rb) std::swap(m_channel_map[0], m_channel_map[2]);
+		// Leading pixels whose four byte tap loads stay inside the row, at most all but the
+		// last pixel, see BlendRow3x2.
+		m_vector_pixels_x = 0;
+		if (channels == 3 && m_taps_x.count == 2) {
+			while (m_vector_pixels_x + 1 < dst_width &&
+			       m_offsets_x[2 * m_vector_pixels_x + 1] + 4 <= src_width * channels) {
+				m_vector_pixels_x++;
+			}
+			m_vector_pixels_x &= ~1;
+		}
+	}
+
+	bool Resampler::Matches(int src_width, int src_height, int dst_width, int dst_height, int channels,
+	                        Interpolation interpolation, bool swap_rb) const
+	{
+		return m_src_width == src_width && m_src_height == src_height && m_dst_width == dst_width &&
+		       m_dst_height == dst_height && m_channels == channels && m_interpolation == interpolation &&
+		       m_swap_rb == (swap_rb && channels >= 3);
+	}
+
+	void Resampler::BlendHorizontal(const uint8_t* row, int16_t* out) const
+	{
+		const int* offset = m_offsets_x.data();
+		const int16_t* weight = m_taps_x.weight.data();
+		const int* map = m_channel_map.data();
+		const int n = m_taps_x.count;
+		if (m_channels == 3 && n == 2) {
+			int x = 0;
+#if defined(__SSE2__) || defined(EDGE_RESAMPLER_NEON)
+			x = m_vector_pixels_x;
+			BlendRow3x2(row, offset, weight, m_swap_rb, x, out);
+#endif
+			BlendRow<3, 2>(row, offset + 2 * x, weight + 2 * x, map, 3, 2, m_dst_width - x, out + 3 * x);
+		} else if (m_channels == 3) {
+			BlendRow<3, 0>(row, offset, weight, map, 3, n, m_dst_width, out);
+		} else if (m_channels == 1 && n == 2) {
+			BlendRow<1, 2>(row, offset, weight, map, 1, 2, m_dst_width, out);
+		} else {
+			BlendRow<0, 0>(row, offset, weight, map, m_channels, n, m_dst_width, out);
+		}
+	}
+
+	void Resampler::BlendVertical(const int16_t* const* rows, const int16_t* weights, uint8_t* out) const
+	{
+		const int n = m_taps_y.count;
+		const int length = m_dst_width * m_channels;
+		int i = 0;
+#if defined(__SSE2__)
+		const __m128i round = _mm_set1_epi32(1 << (kBlendShift - 1));
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + kBlock <= length; i += kBlock) {
+			__m128i lo = round;
+			__m128i hi = round;
+			for (int k = 0; k < n; k += 2) {
+				const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + i));
+				const __m128i b = k + 1 < n ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k + 1] + i)) : zero;
+				const int w1 = k + 1 < n ? weights[k + 1] : 0;
+				const __m128i w = _mm_set1_epi32(static_cast<int>((static_cast<uint32_t>(w1) << 16) |
+				                                                  static_cast<uint16_t>(weights[k])));
+				lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+				hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+			}
+			const __m128i packed = _mm_packs_epi32(_mm_srai_epi32(lo, kBlendShift), _mm_srai_epi32(hi, kBlendShift));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(packed, packed));
+		}
+#elif defined(EDGE_RESAMPLER_NEON)
+		for (; i + kBlock <= length; i += kBlock) {
+			int32x4_t lo = vdupq_n_s32(0);
+			int32x4_t hi = vdupq_n_s32(0);
+			for (int k = 0; k < n; ++k) {
+				const int16x8_t a = vld1q_s16(rows[k] + i);
+				lo = vmlal_n_s16(lo, vget_low_s16(a), weights[k]);
+				hi = vmlal_n_s16(hi, vget_high_s16(a), weights[k]);
+			}
+			const int16x8_t packed = vcombine_s16(vqmovn_s32(vrshrq_n_s32(lo, kBlendShift)),
+			                                      vqmovn_s32(vrshrq_n_s32(hi, kBlendShift)));
+			vst1_u8(out + i, vqmovun_s16(packed));
+		}
+#endif
+		for (; i < length; ++i) {
+			int sum = 1 << (kBlendShift - 1);
+			for (int k = 0; k < n; ++k) sum += rows[k][i] * weights[k];
+			out[i] = Clamp8(sum >> kBlendShift);
+		}
+	}
+
+	void Resampler::Resize(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride, int row_begin,
+	                       int row_end, Scratch* scratch) const
+	{
+		if (row_end < 0 || row_end > m_dst_height) row_end = m_dst_height;
+		if (row_begin >= row_end) return;
+		// Horizontally blended source rows, slot i holds source row ring_rows[i]. Taps of
+		// one output row are consecutive, so `count` slots never evict a row still needed.
+		const int n = m_taps_y.count;
+		const size_t length = static_cast<size_t>(m_dst_width) * m_channels;
+		std::vector<int16_t>& ring = scratch->ring;
+		std::vector<int>& ring_rows = scratch->ring_rows;
+		std::vector<const int16_t*>& rows = scratch->rows;
+		// Sizes only change with the geometry, so after the first frame these reuse storage.
+		ring.resize(n * length);
+		ring_rows.assign(n, -1);
+		rows.resize(n);
+
+		for (int dy = row_begin; dy < row_end; ++dy) {
+			const int* index = &m_taps_y.index[dy * n];
+			for (int k = 0; k < n; ++k) {
+				const int slot = index[k] % n;
+				int16_t* blended = &ring[slot * length];
+				if (ring_rows[slot] != index[k]) {
+					BlendHorizontal(src + static_cast<size_t>(index[k]) * src_stride, blended);
+					ring_rows[slot] = index[k];
+				}
+				rows[k] = blended;
+			}
+			BlendVertical(rows.data(), &m_taps_y.weight[dy * n], dst + static_cast<size_t>(dy) * dst_stride);
+		}
+	}
+}
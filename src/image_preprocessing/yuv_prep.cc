@@ -0,0 +1,397 @@
+//
+// YUV to RGB conversion fused with bilinear resizing.
+//
+// Every output row is produced in two steps. The horizontal step gathers and blends the
+// source samples of the two contributing source rows at output resolution, for luma
+// and both chroma channels. The vertical step blends those rows and converts them to
+// RGB, eight pixels at a time with SSE2 or NEON. The scalar fallback does the same
+// integer arithmetic, so all paths produce identical bytes.
+//
+#include "yuv_prep.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define EDGE_YUV_NEON 1
+#endif
+
+namespace edge
+{
+	namespace
+	{
+		// Bilinear weights in 7 bit fixed point, so a horizontally blended sample fits in
+		// 16 bits and the vertical blend is a single 16x16->32 bit multiply-add.
+		constexpr int kWeightBits = 7;
+		constexpr int kWeightOne = 1 << kWeightBits;
+		constexpr int kBlendShift = 2 * kWeightBits;
+
+		// BT.601 limited range coefficients in 13 bit fixed point, OpenCV's constants
+		// rounded to fit signed 16 bit lanes.
+		constexpr int kColorShift = 13;
+		constexpr int kCY = 9535;
+		constexpr int kCUB = 16532;
+		constexpr int kCUG = -3203;
+		constexpr int kCVG = -6660;
+		constexpr int kCVR = 13074;
+
+		// Pixels converted per SIMD step, scratch rows are padded to a multiple of it.
+		constexpr int kBlock = 8;
+
+		struct Tap {
+			int i0;
+			int i1;
+			int w;
+		};
+
+		// Sampling positions of `dst_size` output pixels in a plane of `plane_size` samples
+		// that covers the source image `subsampling` times more coarsely than luma.
+		void BuildTaps(int src_size, int dst_size, int plane_size, int subsampling, std::vector<Tap>* taps) {
+			taps->resize(dst_size);
+			const double scale = static_cast<double>(src_size) / dst_size / subsampling;
+			for (int d = 0; d < dst_size; ++d) {
+				const double s = std::max(0.0, (d + 0.5) * scale - 0.5);
+				Tap& tap = (*taps)[d];
+				tap.i0 = std::min(static_cast<int>(s), plane_size - 1);
+				tap.i1 = std::min(tap.i0 + 1, plane_size - 1);
+				tap.w = tap.i0 == tap.i1 ? 0 : static_cast<int>(std::lround((s - tap.i0) * kWeightOne));
+				if (tap.w == kWeightOne) {
+					tap.i0 = tap.i1;
+					tap.w = 0;
+				}
+			}
+		}
+
+		// Per format location of luma and chroma samples. Sample x of a row is at
+		// row[x * step].
+		struct YuyvLayout {
+			static constexpr int kLumaStep = 2;
+			static constexpr int kChromaStep = 4;
+			static constexpr int kChromaRowsPerLuma = 1;
+			static void ChromaRows(const YuvImage& image, int cy, const uint8_t** u, const uint8_t** v) {
+				const uint8_t* row = image.planes[0] + cy * image.strides[0];
+				*u = row + 1;
+				*v = row + 3;
+			}
+		};
+
+		struct Nv12Layout {
+			static constexpr int kLumaStep = 1;
+			static constexpr int kChromaStep = 2;
+			static constexpr int kChromaRowsPerLuma = 2;
+			static void ChromaRows(const YuvImage& image, int cy, const uint8_t** u, const uint8_t** v) {
+				*u = image.planes[1] + cy * image.strides[1];
+				*v = *u + 1;
+			}
+		};
+
+		struct Nv21Layout {
+			static constexpr int kLumaStep = 1;
+			static constexpr int kChromaStep = 2;
+			static constexpr int kChromaRowsPerLuma = 2;
+			static void ChromaRows(const YuvImage& image, int cy, const uint8_t** u, const uint8_t** v) {
+				*v = image.planes[1] + cy * image.strides[1];
+				*u = *v + 1;
+			}
+		};
+
+		struct I420Layout {
+			static constexpr int kLumaStep = 1;
+			static constexpr int kChromaStep = 1;
+			static constexpr int kChromaRowsPerLuma = 2;
+			static void ChromaRows(const YuvImage& image, int cy, const uint8_t** u, const uint8_t** v) {
+				*u = image.planes[1] + cy * image.strides[1];
+				*v = image.planes[2] + cy * image.strides[2];
+			}
+		};
+
+		template <int kStep>
+		void BlendRow(const uint8_t* row, const std::vector<Tap>& taps, int16_t* out) {
+			const int n = static_cast<int>(taps.size());
+			for (int d = 0; d < n; ++d) {
+				const Tap& tap = taps[d];
+				out[d] = static_cast<int16_t>(row[tap.i0 * kStep] * (kWeightOne - tap.w) + row[tap.i1 * kStep] * tap.w);
+			}
+		}
+
+		inline uint8_t Clamp8(int v) {
+			return static_cast<uint8_t>(v < 0 ? 0 : v > 255 ? 255 : v);
+		}
+
+		// Horizontally blended rows of one output row.
+		struct RowScratch {
+			std::vector<int16_t> y0, y1, u0, u1, v0, v1;
+			std::vector<uint8_t> r, g, b;
+
+			explicit RowScratch(int width) {
+				const size_t padded = (width + kBlock - 1) / kBlock * kBlock;
+				for (auto* row : {&y0, &y1, &u0, &u1, &v0, &v1}) row->assign(padded, 0);
+				for (auto* row : {&r, &g, &b}) row->assign(padded, 0);
+			}
+		};
+
+		inline int BlendScalar(int a, int b, int w) {
+			return (a * (kWeightOne - w) + b * w + (1 << (kBlendShift - 1))) >> kBlendShift;
+		}
+
+		void StoreScalar(int y, int u, int v, uint8_t* r, uint8_t* g, uint8_t* b) {
+			const int luma = std::max(0, y - 16) * kCY;
+			u -= 128;
+			v -= 128;
+			const int round = 1 << (kColorShift - 1);
+			*r = Clamp8((luma + kCVR * v + round) >> kColorShift);
+			*g = Clamp8((luma + kCUG * u + kCVG * v + round) >> kColorShift);
+			*b = Clamp8((luma + kCUB * u + round) >> kColorShift);
+		}
+
+#if defined(__SSE2__)
+		// Vertical blend of eight 16 bit samples, giving 8 bit values in 16 bit lanes.
+		inline __m128i BlendSse2(const int16_t* top, const int16_t* bottom, __m128i weights) {
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom));
+			const __m128i round = _mm_set1_epi32(1 << (kBlendShift - 1));
+			const __m128i lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights), round), kBlendShift);
+			const __m128i hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights), round), kBlendShift);
+			return _mm_packs_epi32(lo, hi);
+		}
+
+		inline __m128i PairWeights(int w) {
+			return _mm_set1_epi32(static_cast<int>((static_cast<uint32_t>(w) << 16) | static_cast<uint32_t>(kWeightOne - w)));
+		}
+
+		inline __m128i PairCoefficients(int c0, int c1) {
+			return _mm_set1_epi32(static_cast<int>((static_cast<uint32_t>(c1) << 16) | (static_cast<uint32_t>(c0) & 0xffff)));
+		}
+
+		// (a * c0 + b * c1 [+ extra]) >> kColorShift, saturated to 8 bits in the low half.
+		inline __m128i ColorChannel(__m128i a, __m128i b, __m128i coefficients, __m128i extra_lo, __m128i extra_hi) {
+			const __m128i round = _mm_set1_epi32(1 << (kColorShift - 1));
+			__m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), coefficients), extra_lo);
+			__m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), coefficients), extra_hi);
+			lo = _mm_srai_epi32(_mm_add_epi32(lo, round), kColorShift);
+			hi = _mm_srai_epi32(_mm_add_epi32(hi, round), kColorShift);
+			const __m128i packed = _mm_packs_epi32(lo, hi);
+			return _mm_packus_epi16(packed, packed);
+		}
+#endif
+
+		// Blends the scratch rows vertically and converts pixels [x, width) to planar R, G
+		// and B.
+		void ConvertScratch(RowScratch& s, int x, int width, int luma_w, int chroma_w) {
+			for (; x < width; ++x) {
+				StoreScalar(BlendScalar(s.y0[x], s.y1[x], luma_w), BlendScalar(s.u0[x], s.u1[x], chroma_w),
+				            BlendScalar(s.v0[x], s.v1[x], chroma_w), &s.r[x], &s.g[x], &s.b[x]);
+			}
+		}
+
+#if defined(__SSE2__)
+		// SSE2 version of ConvertScratch for whole blocks, returns the first pixel left.
+		int ConvertScratchSse2(RowScratch& s, int width, int luma_w, int chroma_w) {
+			int x = 0;
+			const __m128i luma_weights = PairWeights(luma_w);
+			const __m128i chroma_weights = PairWeights(chroma_w);
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i c16 = _mm_set1_epi16(16);
+			const __m128i c128 = _mm_set1_epi16(128);
+			const __m128i y_vr = PairCoefficients(kCY, kCVR);
+			const __m128i y_ug = PairCoefficients(kCY, kCUG);
+			const __m128i v_g = PairCoefficients(kCVG, 0);
+			const __m128i y_ub = PairCoefficients(kCY, kCUB);
+			for (; x + kBlock <= width; x += kBlock) {
+				const __m128i y = _mm_max_epi16(_mm_sub_epi16(BlendSse2(&s.y0[x], &s.y1[x], luma_weights), c16), zero);
+				const __m128i u = _mm_sub_epi16(BlendSse2(&s.u0[x], &s.u1[x], chroma_weights), c128);
+				const __m128i v = _mm_sub_epi16(BlendSse2(&s.v0[x], &s.v1[x], chroma_weights), c128);
+				const __m128i g_lo = _mm_madd_epi16(_mm_unpacklo_epi16(v, zero), v_g);
+				const __m128i g_hi = _mm_madd_epi16(_mm_unpackhi_epi16(v, zero), v_g);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(&s.r[x]), ColorChannel(y, v, y_vr, zero, zero));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(&s.g[x]), ColorChannel(y, u, y_ug, g_lo, g_hi));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(&s.b[x]), ColorChannel(y, u, y_ub, zero, zero));
+			}
+			return x;
+		}
+#endif
+
+#if defined(EDGE_YUV_NEON)
+		inline int16x8_t BlendNeon(const int16_t* top, const int16_t* bottom, int w) {
+			const int16x8_t a = vld1q_s16(top);
+			const int16x8_t b = vld1q_s16(bottom);
+			int32x4_t lo = vmull_n_s16(vget_low_s16(a), kWeightOne - w);
+			int32x4_t hi = vmull_n_s16(vget_high_s16(a), kWeightOne - w);
+			lo = vmlal_n_s16(lo, vget_low_s16(b), w);
+			hi = vmlal_n_s16(hi, vget_high_s16(b), w);
+			return vcombine_s16(vqmovn_s32(vrshrq_n_s32(lo, kBlendShift)), vqmovn_s32(vrshrq_n_s32(hi, kBlendShift)));
+		}
+
+		inline uint8x8_t Narrow(int32x4_t lo, int32x4_t hi) {
+			return vqmovun_s16(vcombine_s16(vqmovn_s32(vrshrq_n_s32(lo, kColorShift)),
+			                                vqmovn_s32(vrshrq_n_s32(hi, kColorShift))));
+		}
+
+		// NEON converts and interleaves in one go, straight into the output row.
+		int ConvertScratchNeon(const RowScratch& s, int width, int luma_w, int chroma_w, bool bgr, uint8_t* out) {
+			int x = 0;
+			const int16x8_t c16 = vdupq_n_s16(16);
+			const int16x8_t c128 = vdupq_n_s16(128);
+			for (; x + kBlock <= width; x += kBlock) {
+				const int16x8_t y = vmaxq_s16(vsubq_s16(BlendNeon(&s.y0[x], &s.y1[x], luma_w), c16), vdupq_n_s16(0));
+				const int16x8_t u = vsubq_s16(BlendNeon(&s.u0[x], &s.u1[x], chroma_w), c128);
+				const int16x8_t v = vsubq_s16(BlendNeon(&s.v0[x], &s.v1[x], chroma_w), c128);
+				const int32x4_t y_lo = vmull_n_s16(vget_low_s16(y), kCY);
+				const int32x4_t y_hi = vmull_n_s16(vget_high_s16(y), kCY);
+				const uint8x8_t r = Narrow(vmlal_n_s16(y_lo, vget_low_s16(v), kCVR), vmlal_n_s16(y_hi, vget_high_s16(v), kCVR));
+				const uint8x8_t g = Narrow(
+								vmlal_n_s16(vmlal_n_s16(y_lo, vget_low_s16(u), kCUG), vget_low_s16(v), kCVG),
+								vmlal_n_s16(vmlal_n_s16(y_hi, vget_high_s16(u), kCUG), vget_high_s16(v), kCVG));
+				const uint8x8_t b = Narrow(vmlal_n_s16(y_lo, vget_low_s16(u), kCUB), vmlal_n_s16(y_hi, vget_high_s16(u), kCUB));
+				uint8x8x3_t rgb;
+				rgb.val[0] = bgr ? b : r;
+				rgb.val[1] = g;
+				rgb.val[2] = bgr ? r : b;
+				vst3_u8(out + 3 * x, rgb);
+			}
+			return x;
+		}
+#endif
+
+		// Taps of one conversion geometry. Geometry rarely changes, so every thread keeps
+		// the plan it used last.
+		struct ConversionPlan {
+			int chroma_rows_per_luma;
+			int src_width;
+			int src_height;
+			int dst_width;
+			int dst_height;
+			std::vector<Tap> luma_x, luma_y, chroma_x, chroma_y;
+		};
+
+		template <typename Layout>
+		const ConversionPlan& CachedPlan(const YuvImage& src, int dst_width, int dst_height) {
+			thread_local std::unique_ptr<ConversionPlan> plan;
+			if (plan && plan->chroma_rows_per_luma == Layout::kChromaRowsPerLuma && plan->src_width == src.width &&
+			    plan->src_height == src.height && plan->dst_width == dst_width && plan->dst_height == dst_height) {
+				return *plan;
+			}
+			plan.reset(new ConversionPlan);
+			plan->chroma_rows_per_luma = Layout::kChromaRowsPerLuma;
+			plan->src_width = src.width;
+			plan->src_height = src.height;
+			plan->dst_width = dst_width;
+			plan->dst_height = dst_height;
+			const int chroma_width = (src.width + 1) / 2;
+			const int chroma_height = (src.height + Layout::kChromaRowsPerLuma - 1) / Layout::kChromaRowsPerLuma;
+			BuildTaps(src.width, dst_width, src.width, 1, &plan->luma_x);
+			BuildTaps(src.height, dst_height, src.height, 1, &plan->luma_y);
+			BuildTaps(src.width, dst_width, chroma_width, 2, &plan->chroma_x);
+			BuildTaps(src.height, dst_height, chroma_height, Layout::kChromaRowsPerLuma, &plan->chroma_y);
+			return *plan;
+		}
+
+		template <typename Layout>
+		void ConvertRows(const YuvImage& src, int dst_width, int dst_height, uint8_t* dst, int dst_stride, bool bgr,
+		                 int row_begin, int row_end) {
+			const ConversionPlan& plan = CachedPlan<Layout>(src, dst_width, dst_height);
+			const std::vector<Tap>& luma_x = plan.luma_x;
+			const std::vector<Tap>& luma_y = plan.luma_y;
+			const std::vector<Tap>& chroma_x = plan.chroma_x;
+			const std::vector<Tap>& chroma_y = plan.chroma_y;
+			RowScratch scratch(dst_width);
+
+			for (int dy = row_begin; dy < row_end; ++dy) {
+				const Tap& ly = luma_y[dy];
+				const Tap& cy = chroma_y[dy];
+				BlendRow<Layout::kLumaStep>(src.planes[0] + ly.i0 * src.strides[0], luma_x, scratch.y0.data());
+				BlendRow<Layout::kLumaStep>(src.planes[0] + ly.i1 * src.strides[0], luma_x, scratch.y1.data());
+				const uint8_t* u;
+				const uint8_t* v;
+				Layout::ChromaRows(src, cy.i0, &u, &v);
+				BlendRow<Layout::kChromaStep>(u, chroma_x, scratch.u0.data());
+				BlendRow<Layout::kChromaStep>(v, chroma_x, scratch.v0.data());
+				Layout::ChromaRows(src, cy.i1, &u, &v);
+				BlendRow<Layout::kChromaStep>(u, chroma_x, scratch.u1.data());
+				BlendRow<Layout::kChromaStep>(v, chroma_x, scratch.v1.data());
+
+				uint8_t* out = dst + static_cast<size_t>(dy) * dst_stride;
+				int x = 0;
+#if defined(__SSE2__)
+				ConvertScratch(scratch, ConvertScratchSse2(scratch, dst_width, ly.w, cy.w), dst_width, ly.w, cy.w);
+#elif defined(EDGE_YUV_NEON)
+				x = ConvertScratchNeon(scratch, dst_width, ly.w, cy.w, bgr, out);
+				ConvertScratch(scratch, x, dst_width, ly.w, cy.w);
+#else
+				ConvertScratch(scratch, 0, dst_width, ly.w, cy.w);
+#endif
+				const uint8_t* first = bgr ? scratch.b.data() : scratch.r.data();
+				const uint8_t* last = bgr ? scratch.r.data() : scratch.b.data();
+				for (; x < dst_width; ++x) {
+					out[3 * x] = first[x];
+					out[3 * x + 1] = scratch.g[x];
+					out[3 * x + 2] = last[x];
+				}
+			}
+		}
+	}
+
+	size_t YuvFrameSize(PixelFormat format, int width, int height)
+	{
+		const size_t chroma_plane = static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+		switch (format) {
+			case PixelFormat::kYUYV:
+				return static_cast<size_t>(width) * height * 2;
+			case PixelFormat::kNV12:
+			case PixelFormat::kNV21:
+			case PixelFormat::kI420:
+				return static_cast<size_t>(width) * height + 2 * chroma_plane;
+		}
+		return 0;
+	}
+
+	YuvImage MakeYuvImage(PixelFormat format, int width, int height, const uint8_t* data)
+	{
+		YuvImage image;
+		image.format = format;
+		image.width = width;
+		image.height = height;
+		image.planes[0] = data;
+		image.planes[1] = nullptr;
+		image.planes[2] = nullptr;
+		image.strides[0] = format == PixelFormat::kYUYV ? 2 * width : width;
+		image.strides[1] = 0;
+		image.strides[2] = 0;
+		if (format == PixelFormat::kNV12 || format == PixelFormat::kNV21) {
+			image.planes[1] = data + static_cast<size_t>(width) * height;
+			image.strides[1] = (width + 1) / 2 * 2;
+		} else if (format == PixelFormat::kI420) {
+			image.planes[1] = data + static_cast<size_t>(width) * height;
+			image.strides[1] = (width + 1) / 2;
+			image.planes[2] = image.planes[1] + static_cast<size_t>(image.strides[1]) * ((height + 1) / 2);
+			image.strides[2] = image.strides[1];
+		}
+		return image;
+	}
+
+	void ConvertYuvToRgb(const YuvImage& src, int dst_width, int dst_height, uint8_t* dst, int dst_stride, bool bgr,
+	                     int row_begin, int row_end)
+	{
+		if (dst_stride <= 0) dst_stride = 3 * dst_width;
+		if (row_end < 0 || row_end > dst_height) row_end = dst_height;
+		switch (src.format) {
+			case PixelFormat::kYUYV:
+				ConvertRows<YuyvLayout>(src, dst_width, dst_height, dst, dst_stride, bgr, row_begin, row_end);
+				break;
+			case PixelFormat::kNV12:
+				ConvertRows<Nv12Layout>(src, dst_width, dst_height, dst, dst_stride, bgr, row_begin, row_end);
+				break;
+			case PixelFormat::kNV21:
+				ConvertRows<Nv21Layout>(src, dst_width, dst_height, dst, dst_stride, bgr, row_begin, row_end);
+				break;
+			case PixelFormat::kI420:
+				ConvertRows<I420Layout>(src, dst_width, dst_height, dst, dst_stride, bgr, row_begin, row_end);
+				break;
+		}
+	}
+}
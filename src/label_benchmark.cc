@@ -0,0 +1,99 @@
+//
+// Measures label file startup cost and lookup speed of LabelTable against the previous
+// std::regex + std::map based loader, on a synthetic label file of configurable size.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cxxopts.hpp"
+#include "label_utils.h"
+
+cxxopts::ParseResult parse_args(int argc, char** argv) {
+	cxxopts::Options options("label_benchmark", "Benchmarks label file loading and lookup");
+
+	options.add_options()
+					("label_path", "Label file to load, a synthetic one is generated if omitted.", cxxopts::value<std::string>())
+					("num_labels", "Number of classes of the synthetic label file.", cxxopts::value<int>()->default_value("20000"))
+					("lookups", "Number of lookups to time.", cxxopts::value<int>()->default_value("10000000"))
+					("help", "Print Usage");
+
+	const auto& args = options.parse(argc, argv);
+	if (args.count("help")) {
+		std::cerr << options.help() << "\n";
+		exit(0);
+	}
+	return args;
+}
+
+// The loader used before LabelTable, kept here as the baseline.
+std::map<int, std::string> ParseLabelWithRegex(const std::string& label_path) {
+	std::map<int, std::string> ret;
+	std::ifstream label_file(label_path);
+	if (!label_file.good()) return ret;
+	for (std::string line; std::getline(label_file, line);) {
+		std::istringstream ss(line);
+		int id;
+		ss >> id;
+		line = std::regex_replace(line, std::regex("^ +[0-9]+ +"), "");
+		ret.emplace(id, line);
+	}
+	return ret;
+}
+
+template <typename Fn>
+double TimeMs(Fn fn) {
+	const auto start = std::chrono::steady_clock::now();
+	fn();
+	const auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char** argv) {
+	const auto& args = parse_args(argc, argv);
+	const int num_labels = args["num_labels"].as<int>();
+	const int lookups = args["lookups"].as<int>();
+	std::string label_path;
+	if (args.count("label_path")) {
+		label_path = args["label_path"].as<std::string>();
+	} else {
+		label_path = "/tmp/label_benchmark_labels.txt";
+		std::ofstream out(label_path);
+		for (int i = 0; i < num_labels; ++i) {
+			out << "   " << i << "  synthetic class number " << i << ", with a longer description" << "\n";
+		}
+	}
+
+	std::map<int, std::string> map_labels;
+	edge::LabelTable table;
+	const double regex_ms = TimeMs([&] { map_labels = ParseLabelWithRegex(label_path); });
+	const double table_ms = TimeMs([&] { table.Load(label_path); });
+	std::cout << "Label file : " << label_path << " (" << table.size() << " labels)" << std::endl;
+	std::cout << "Load regex + std::map : " << regex_ms << " ms" << std::endl;
+	std::cout << "Load LabelTable       : " << table_ms << " ms" << std::endl;
+
+	// Only look up ids present in both, label files may skip ids (e.g. COCO).
+	std::vector<int> ids;
+	for (const auto& label : map_labels) {
+		if (table.contains(label.first)) ids.push_back(label.first);
+	}
+	if (ids.empty()) return 0;
+	const size_t num_ids = ids.size();
+	size_t checksum = 0;
+	const double map_lookup_ms = TimeMs([&] {
+		for (int i = 0; i < lookups; ++i) checksum += map_labels.at(ids[i % num_ids]).size();
+	});
+	const double table_lookup_ms = TimeMs([&] {
+		for (int i = 0; i < lookups; ++i) checksum += table.at(ids[i % num_ids]).size;
+	});
+	std::cout << "Lookup std::map::at   : " << map_lookup_ms * 1e6 / lookups << " ns" << std::endl;
+	std::cout << "Lookup LabelTable::at : " << table_lookup_ms * 1e6 / lookups << " ns" << std::endl;
+	std::cout << "(checksum " << checksum << ")" << std::endl;
+}
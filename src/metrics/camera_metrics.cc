@@ -0,0 +1,58 @@
+//
+// Registration of the camera app series. Durations are recorded in microseconds and
+// exported in seconds, as Prometheus expects.
+//
+
+#include "camera_metrics.h"
+
+#include <chrono>
+
+namespace edge {
+	namespace {
+		constexpr double kMicrosToSeconds = 1e-6;
+	}
+
+	int64_t SteadyNowMicros() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+						std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	CameraMetrics::CameraMetrics(MetricsRegistry& registry, const std::string& device) : m_registry(registry) {
+		frames_skipped = registry.AddCounter("edge_frames_dropped_total", "Captured frames that were never inferred.",
+		                                     {{"reason", "stale"}});
+		frames_late = registry.AddCounter("edge_frames_dropped_total", "Captured frames that were never inferred.",
+		                                  {{"reason", "late"}});
+		frames_inferred = registry.AddCounter("edge_frames_inferred_total", "Frames whose results were published.");
+		const char* const stage_help = "Time spent on one frame in each stage.";
+		preprocess_us = registry.AddHistogram("edge_stage_latency_seconds", stage_help, {{"stage", "preprocess"}},
+		                                      kMicrosToSeconds);
+		inference_us = registry.AddHistogram("edge_stage_latency_seconds", stage_help, {{"stage", "inference"}},
+		                                     kMicrosToSeconds);
+		postprocess_us = registry.AddHistogram("edge_stage_latency_seconds", stage_help, {{"stage", "postprocess"}},
+		                                       kMicrosToSeconds);
+		publish_us = registry.AddHistogram("edge_stage_latency_seconds", stage_help, {{"stage", "publish"}},
+		                                   kMicrosToSeconds);
+		frame_latency_us = registry.AddHistogram("edge_frame_latency_seconds",
+		                                         "Time from the capture of a frame to its published result.", {},
+		                                         kMicrosToSeconds);
+		device_busy_us = registry.AddCounter("edge_device_busy_seconds_total", "Time the device spent inferring.",
+		                                     {{"device", device}}, kMicrosToSeconds);
+		registry.AddRateGauge("edge_device_utilization", "Fraction of time the device was inferring since the last scrape.",
+		                      {{"device", device}}, device_busy_us, kMicrosToSeconds);
+		frames_in_flight = registry.AddGauge("edge_queue_depth", "Frames waiting in each queue.",
+		                                     {{"queue", "in_flight"}});
+	}
+
+	void CameraMetrics::WatchCapture(const FrameGrabber& grabber, const FramePool& pool,
+	                                 const SpscQueue<FrameHandle>& queue) {
+		m_registry.AddCounterFunction("edge_frames_captured_total", "Frames read from the camera.", {},
+		                              [&grabber]() { return static_cast<double>(grabber.Captured()); });
+		m_registry.AddCounterFunction("edge_frames_dropped_total", "Captured frames that were never inferred.",
+		                              {{"reason", "pool_exhausted"}},
+		                              [&grabber]() { return static_cast<double>(grabber.Dropped()); });
+		m_registry.AddGaugeFunction("edge_queue_depth", "Frames waiting in each queue.", {{"queue", "captured"}},
+		                            [&queue]() { return static_cast<double>(queue.Size()); });
+		m_registry.AddGaugeFunction("edge_frame_pool_in_use", "Frame pool buffers checked out.", {},
+		                            [&pool]() { return static_cast<double>(pool.Capacity() - pool.Available()); });
+	}
+}
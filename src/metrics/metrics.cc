@@ -0,0 +1,216 @@
+//
+// Storage and text rendering of MetricsRegistry series.
+//
+
+#include "metrics.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace edge {
+	namespace {
+		// Histograms export the last bucket of every power of two up to 2^26 units, about a
+		// minute in microseconds, plus +Inf.
+		constexpr int kExportedOctaves = 24;
+
+		uint64_t DoubleBits(double value) {
+			uint64_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			return bits;
+		}
+
+		double BitsDouble(uint64_t bits) {
+			double value;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		std::string FormatValue(double value) {
+			char buffer[32];
+			snprintf(buffer, sizeof(buffer), "%.10g", value);
+			return buffer;
+		}
+
+		std::string FormatLabels(const MetricLabels& labels) {
+			std::string text;
+			for (const auto& label : labels) {
+				if (!text.empty()) text += ',';
+				text += label.first;
+				text += "=\"";
+				for (char c : label.second) {
+					if (c == '\\' || c == '"') text += '\\';
+					if (c == '\n') {
+						text += "\\n";
+						continue;
+					}
+					text += c;
+				}
+				text += '"';
+			}
+			return text;
+		}
+
+		// `labels` with one more label appended, braces included, empty for no labels.
+		std::string LabelBlock(const std::string& labels, const std::string& extra = std::string()) {
+			if (labels.empty() && extra.empty()) return std::string();
+			if (labels.empty()) return "{" + extra + "}";
+			if (extra.empty()) return "{" + labels + "}";
+			return "{" + labels + "," + extra + "}";
+		}
+	}
+
+	void Gauge::Set(double value) {
+		m_bits.store(DoubleBits(value), std::memory_order_relaxed);
+	}
+
+	void Gauge::Add(double delta) {
+		uint64_t expected = m_bits.load(std::memory_order_relaxed);
+		while (!m_bits.compare_exchange_weak(expected, DoubleBits(BitsDouble(expected) + delta),
+		                                     std::memory_order_relaxed)) {
+		}
+	}
+
+	double Gauge::Value() const {
+		return BitsDouble(m_bits.load(std::memory_order_relaxed));
+	}
+
+	struct MetricsRegistry::Series {
+		std::string labels;
+		double scale = 1.0;
+		std::unique_ptr<Counter> counter;
+		std::unique_ptr<Gauge> gauge;
+		std::unique_ptr<Histogram> histogram;
+		std::function<double()> read;
+	};
+
+	struct MetricsRegistry::Family {
+		std::string name;
+		std::string help;
+		Type type;
+		std::vector<std::unique_ptr<Series>> series;
+	};
+
+	MetricsRegistry::MetricsRegistry() = default;
+	MetricsRegistry::~MetricsRegistry() = default;
+
+	MetricsRegistry::Series& MetricsRegistry::AddSeries(const std::string& name, const std::string& help,
+	                                                    const Type type, const MetricLabels& labels) {
+		Family* family = nullptr;
+		for (const auto& existing : m_families) {
+			if (existing->name == name) family = existing.get();
+		}
+		if (family == nullptr) {
+			m_families.emplace_back(new Family);
+			family = m_families.back().get();
+			family->name = name;
+			family->help = help;
+			family->type = type;
+		} else if (family->type != type) {
+			std::cerr << "Metric " << name << " registered again with another type" << std::endl;
+			std::abort();
+		}
+		family->series.emplace_back(new Series);
+		family->series.back()->labels = FormatLabels(labels);
+		return *family->series.back();
+	}
+
+	Counter* MetricsRegistry::AddCounter(const std::string& name, const std::string& help,
+	                                     const MetricLabels& labels, const double scale) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Series& series = AddSeries(name, help, kCounter, labels);
+		series.scale = scale;
+		series.counter.reset(new Counter);
+		return series.counter.get();
+	}
+
+	Gauge* MetricsRegistry::AddGauge(const std::string& name, const std::string& help, const MetricLabels& labels) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Series& series = AddSeries(name, help, kGauge, labels);
+		series.gauge.reset(new Gauge);
+		return series.gauge.get();
+	}
+
+	Histogram* MetricsRegistry::AddHistogram(const std::string& name, const std::string& help,
+	                                         const MetricLabels& labels, const double scale) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Series& series = AddSeries(name, help, kHistogram, labels);
+		series.scale = scale;
+		series.histogram.reset(new Histogram);
+		return series.histogram.get();
+	}
+
+	void MetricsRegistry::AddCounterFunction(const std::string& name, const std::string& help,
+	                                         const MetricLabels& labels, std::function<double()> read) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		AddSeries(name, help, kCounter, labels).read = std::move(read);
+	}
+
+	void MetricsRegistry::AddGaugeFunction(const std::string& name, const std::string& help,
+	                                       const MetricLabels& labels, std::function<double()> read) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		AddSeries(name, help, kGauge, labels).read = std::move(read);
+	}
+
+	void MetricsRegistry::AddRateGauge(const std::string& name, const std::string& help,
+	                                   const MetricLabels& labels, const Counter* counter, const double scale) {
+		typedef std::chrono::steady_clock Clock;
+		struct RateState {
+			uint64_t value;
+			Clock::time_point time;
+		};
+		// Renders run one at a time under the registry lock, so the state needs none.
+		std::shared_ptr<RateState> state(new RateState{counter->Value(), Clock::now()});
+		AddGaugeFunction(name, help, labels, [counter, scale, state]() {
+			const uint64_t value = counter->Value();
+			const Clock::time_point now = Clock::now();
+			const double seconds = std::chrono::duration<double>(now - state->time).count();
+			const double rate = seconds > 0 ? (value - state->value) / seconds * scale : 0.0;
+			state->value = value;
+			state->time = now;
+			return rate;
+		});
+	}
+
+	std::string MetricsRegistry::Render() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::string text;
+		for (const auto& family : m_families) {
+			static const char* const kTypeNames[] = {"counter", "gauge", "histogram"};
+			text += "# HELP " + family->name + " " + family->help + "\n";
+			text += "# TYPE " + family->name + " " + kTypeNames[family->type] + "\n";
+			for (const auto& series : family->series) {
+				if (series->histogram) {
+					const Histogram& histogram = *series->histogram;
+					uint64_t cumulative = 0;
+					int bucket = 0;
+					for (int octave = 0; octave < kExportedOctaves; ++octave) {
+						const int last = ((octave + 1) << LatencyHistogram::kSubBucketBits) - 1;
+						for (; bucket <= last; ++bucket) cumulative += histogram.BucketCount(bucket);
+						const double bound = LatencyHistogram::BucketUpperBound(last) * series->scale;
+						text += family->name + "_bucket" +
+						        LabelBlock(series->labels, "le=\"" + FormatValue(bound) + "\"") + " " +
+						        std::to_string(cumulative) + "\n";
+					}
+					// Other threads keep recording while the buckets are read, so the count is
+					// summed from the same reads to stay consistent with them.
+					for (; bucket < LatencyHistogram::kNumBuckets; ++bucket) cumulative += histogram.BucketCount(bucket);
+					const std::string count = std::to_string(cumulative);
+					text += family->name + "_bucket" + LabelBlock(series->labels, "le=\"+Inf\"") + " " + count + "\n";
+					const double sum = histogram.Sum() * series->scale;
+					text += family->name + "_sum" + LabelBlock(series->labels) + " " + FormatValue(sum) + "\n";
+					text += family->name + "_count" + LabelBlock(series->labels) + " " + count + "\n";
+					continue;
+				}
+				double value;
+				if (series->read) value = series->read();
+				else if (series->gauge) value = series->gauge->Value();
+				else value = series->counter->Value() * series->scale;
+				text += family->name + LabelBlock(series->labels) + " " + FormatValue(value) + "\n";
+			}
+		}
+		return text;
+	}
+}
@@ -0,0 +1,144 @@
+//
+// File and HTTP publishing of the metrics text. The endpoint is a minimal HTTP/1.0
+// responder on 127.0.0.1 answering GET /metrics, one connection at a time, which is all
+// a local scraper needs.
+//
+
+#include "metrics_exporter.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace edge {
+	namespace {
+		constexpr int kPollIntervalMs = 100;
+		constexpr size_t kMaxRequestBytes = 8192;
+
+		bool SendAll(int fd, const std::string& data) {
+			size_t sent = 0;
+			while (sent < data.size()) {
+				const ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+				if (n <= 0) return false;
+				sent += static_cast<size_t>(n);
+			}
+			return true;
+		}
+
+		std::string HttpResponse(const char* status, const char* content_type, const std::string& body) {
+			return std::string("HTTP/1.0 ") + status + "\r\nContent-Type: " + content_type +
+			       "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+		}
+	}
+
+	MetricsExporter::MetricsExporter(const MetricsRegistry& registry, const std::string& file_path, const int port,
+	                                 const int file_interval_ms)
+					: m_registry(registry), m_file_path(file_path), m_port(port), m_file_interval_ms(file_interval_ms),
+					  m_listen_fd(-1), m_running(false) {}
+
+	MetricsExporter::~MetricsExporter() {
+		Stop();
+	}
+
+	bool MetricsExporter::Start() {
+		if (m_running.load()) return true;
+		if (m_port > 0) {
+			m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+			const int reuse = 1;
+			setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+			sockaddr_in address;
+			std::memset(&address, 0, sizeof(address));
+			address.sin_family = AF_INET;
+			address.sin_port = htons(static_cast<uint16_t>(m_port));
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			if (m_listen_fd < 0 || bind(m_listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+			    listen(m_listen_fd, 4) != 0) {
+				std::cout << "Failed to serve metrics on 127.0.0.1:" << m_port << ": " << std::strerror(errno)
+				          << std::endl;
+				if (m_listen_fd >= 0) close(m_listen_fd);
+				m_listen_fd = -1;
+				return false;
+			}
+			std::cout << "Serving metrics on http://127.0.0.1:" << m_port << "/metrics" << std::endl;
+		}
+		m_running.store(true);
+		m_thread = std::thread(&MetricsExporter::ExportLoop, this);
+		return true;
+	}
+
+	void MetricsExporter::Stop() {
+		if (!m_running.exchange(false)) return;
+		m_thread.join();
+		if (m_listen_fd >= 0) close(m_listen_fd);
+		m_listen_fd = -1;
+		if (!m_file_path.empty()) WriteFile();
+	}
+
+	void MetricsExporter::ExportLoop() {
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point next_write = Clock::now();
+		while (m_running.load(std::memory_order_acquire)) {
+			if (!m_file_path.empty() && Clock::now() >= next_write) {
+				if (!WriteFile()) std::cout << "Failed to write metrics to " << m_file_path << std::endl;
+				next_write = Clock::now() + std::chrono::milliseconds(m_file_interval_ms);
+			}
+			if (m_listen_fd < 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(kPollIntervalMs));
+				continue;
+			}
+			pollfd listen_poll = {m_listen_fd, POLLIN, 0};
+			if (poll(&listen_poll, 1, kPollIntervalMs) > 0 && (listen_poll.revents & POLLIN)) {
+				const int client = accept(m_listen_fd, nullptr, nullptr);
+				if (client >= 0) {
+					ServeConnection(client);
+					close(client);
+				}
+			}
+		}
+	}
+
+	bool MetricsExporter::WriteFile() const {
+		// Written aside and renamed over the file, so readers never see half of it.
+		const std::string temp_path = m_file_path + ".tmp";
+		FILE* file = fopen(temp_path.c_str(), "w");
+		if (file == nullptr) return false;
+		const std::string text = m_registry.Render();
+		const bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+		if (fclose(file) != 0 || !written) return false;
+		return rename(temp_path.c_str(), m_file_path.c_str()) == 0;
+	}
+
+	void MetricsExporter::ServeConnection(const int client) const {
+		// A stalled client must not hold up the next scrape for long.
+		timeval timeout = {1, 0};
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		std::string request;
+		char buffer[1024];
+		while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequestBytes) {
+			const ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+			if (n <= 0) break;
+			request.append(buffer, static_cast<size_t>(n));
+		}
+		if (request.compare(0, 4, "GET ") != 0) {
+			SendAll(client, HttpResponse("405 Method Not Allowed", "text/plain", "Only GET is supported\n"));
+			return;
+		}
+		std::string path = request.substr(4, request.find(' ', 4) - 4);
+		path = path.substr(0, path.find('?'));
+		if (path != "/metrics" && path != "/") {
+			SendAll(client, HttpResponse("404 Not Found", "text/plain", "Metrics are at /metrics\n"));
+			return;
+		}
+		SendAll(client, HttpResponse("200 OK", "text/plain; version=0.0.4", m_registry.Render()));
+	}
+}
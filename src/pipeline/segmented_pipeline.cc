@@ -0,0 +1,260 @@
+//
+// One thread per model segment, plus one for the PoseNet decoder if it is split off,
+// connected by bounded queues of recycled tensor buffers.
+//
+
+#include "segmented_pipeline.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace edge {
+	namespace {
+		std::unique_ptr<SegmentTensors> AllocateTensors(tflite::Interpreter* interpreter,
+		                                                const std::vector<int>& tensor_indices) {
+			std::unique_ptr<SegmentTensors> buffers(new SegmentTensors);
+			for (int index : tensor_indices) {
+				buffers->tensors.emplace_back(interpreter->tensor(index)->bytes);
+			}
+			return buffers;
+		}
+	}
+
+	SegmentedPipeline::SegmentedPipeline(const std::vector<std::string>& segment_paths,
+	                                     const std::vector<std::shared_ptr<edgetpu::EdgeTpuContext>>& edgetpu_contexts,
+	                                     const bool edgetpu, const size_t queue_depth, const bool decode_stage) {
+		if (segment_paths.empty()) {
+			std::cout << "Segmented pipeline needs at least one segment\n";
+			std::abort();
+		}
+		for (size_t i = 0; i < segment_paths.size(); ++i) {
+			const bool on_edgetpu = edgetpu && i < edgetpu_contexts.size() && edgetpu_contexts[i];
+			m_segments.emplace_back(new Engine(segment_paths[i],
+			                                   on_edgetpu ? edgetpu_contexts[i] : nullptr, on_edgetpu));
+			std::cout << "Segment " << i << " : " << segment_paths[i] << (on_edgetpu ? " (EdgeTPU)" : " (CPU)")
+			          << std::endl;
+		}
+
+		// Wire every segment input to the previous segment output with the same tensor
+		// name. The compiler keeps names across segments; fall back to position otherwise.
+		m_input_map.resize(m_segments.size());
+		for (size_t i = 1; i < m_segments.size(); ++i) {
+			auto* producer = m_segments[i - 1]->GetInterpreter();
+			auto* consumer = m_segments[i]->GetInterpreter();
+			const auto& outputs = producer->outputs();
+			const auto& inputs = consumer->inputs();
+			for (size_t j = 0; j < inputs.size(); ++j) {
+				const TfLiteTensor* input = consumer->tensor(inputs[j]);
+				int source = -1;
+				for (size_t k = 0; k < outputs.size(); ++k) {
+					const TfLiteTensor* output = producer->tensor(outputs[k]);
+					if (input->name && output->name && std::strcmp(input->name, output->name) == 0) {
+						source = static_cast<int>(k);
+						break;
+					}
+				}
+				if (source < 0 && j < outputs.size()) source = static_cast<int>(j);
+				if (source < 0 || producer->tensor(outputs[source])->bytes != input->bytes) {
+					std::cout << "Segment " << i << " input " << j << " does not match any output of segment "
+					          << i - 1 << "\n";
+					std::abort();
+				}
+				m_input_map[i].push_back(source);
+			}
+		}
+
+		m_decode_stage = decode_stage && SplitDecoder();
+
+		tflite::Interpreter* first = m_segments.front()->GetInterpreter();
+		TfLiteTensor* input_tensor = first->tensor(first->inputs()[0]);
+		m_input_adapter.Init(input_tensor);
+		if (m_input_adapter.GetKernel() == InputAdapter::Kernel::kUnsupported) {
+			std::cerr << "Tensor " << input_tensor->name << " has unsupported input type: " << input_tensor->type
+			          << std::endl;
+		}
+		m_input_pixels = 1;
+		for (int d = 0; d < input_tensor->dims->size; ++d) m_input_pixels *= input_tensor->dims->data[d];
+
+		// Queue i carries the inputs of stage i, the decode stage takes the decoder inputs;
+		// the extra last queue carries results.
+		for (size_t i = 0; i <= NumStages(); ++i) {
+			tflite::Interpreter* interpreter = i < m_segments.size() ? m_segments[i]->GetInterpreter()
+			                                                         : m_segments.back()->GetInterpreter();
+			const std::vector<int>& tensor_indices = i < m_segments.size() ? interpreter->inputs()
+			                                         : i < NumStages()     ? m_decoder_inputs
+			                                                               : interpreter->outputs();
+			m_queues.emplace_back(new TensorQueue(queue_depth));
+			m_free_buffers.emplace_back(new TensorQueue(queue_depth + 1));
+			for (size_t k = 0; k < queue_depth + 1; ++k) {
+				m_storage.push_back(AllocateTensors(interpreter, tensor_indices));
+				// The first input carries pixels, m_input_adapter converts them in segment 0.
+				if (i == 0) m_storage.back()->tensors[0].resize(m_input_pixels);
+				m_free_buffers.back()->Push(m_storage.back().get());
+			}
+		}
+
+		tflite::Interpreter* last = m_segments.back()->GetInterpreter();
+		for (int index : last->outputs()) {
+			const TfLiteTensor* tensor = last->tensor(index);
+			ResultReader reader;
+			size_t element_size;
+			reader.read = SelectOutputReader(tensor->type, &element_size);
+			reader.count = reader.read ? tensor->bytes / element_size : 0;
+			reader.scale = tensor->params.scale;
+			reader.zero_point = tensor->params.zero_point;
+			if (!reader.read) {
+				std::cerr << "Tensor " << tensor->name
+				          << " has unsupported output type: " << tensor->type << std::endl;
+			}
+			m_result_readers.push_back(reader);
+			m_result_size += reader.count;
+		}
+
+		for (size_t i = 0; i < m_segments.size(); ++i) {
+			m_threads.emplace_back(&SegmentedPipeline::SegmentLoop, this, i);
+		}
+		if (m_decode_stage) m_threads.emplace_back(&SegmentedPipeline::DecodeLoop, this);
+	}
+
+	bool SegmentedPipeline::SplitDecoder() {
+		Engine& last = *m_segments.back();
+		std::vector<int> decoder_outputs;
+		if (!last.GetPosenetDecoderTensors(&m_decoder_inputs, &decoder_outputs)) {
+			std::cout << "The last segment has no PosenetDecoderOp, poses are decoded in the segment\n";
+			return false;
+		}
+		// Results are the model outputs, so the decode stage has to produce all of them.
+		const std::vector<int>& outputs = last.GetInterpreter()->outputs();
+		m_decoder_output_positions.clear();
+		for (int tensor : decoder_outputs) {
+			const auto position = std::find(outputs.begin(), outputs.end(), tensor);
+			if (position == outputs.end() || decoder_outputs.size() != outputs.size()) {
+				std::cout << "The model has outputs besides the PosenetDecoderOp, poses are decoded in the segment\n";
+				return false;
+			}
+			m_decoder_output_positions.push_back(static_cast<int>(position - outputs.begin()));
+		}
+		return last.SetPosenetDecoderDeferred(true);
+	}
+
+	SegmentedPipeline::~SegmentedPipeline() {
+		Stop();
+	}
+
+	std::vector<int> SegmentedPipeline::GetInputShape() {
+		return m_segments.front()->GetInputShape();
+	}
+
+	const std::vector<size_t>& SegmentedPipeline::GetOutputShape() const {
+		return m_segments.back()->m_output_shape;
+	}
+
+	bool SegmentedPipeline::Push(const std::vector<uint8_t>& input_data) {
+		if (input_data.size() != m_input_pixels || m_input_adapter.GetKernel() == InputAdapter::Kernel::kUnsupported) {
+			return false;
+		}
+		SegmentTensors* buffers;
+		if (!m_free_buffers.front()->Pop(&buffers)) return false;
+		std::memcpy(buffers->tensors[0].data(), input_data.data(), input_data.size());
+		return m_queues.front()->Push(buffers);
+	}
+
+	bool SegmentedPipeline::Pop(std::vector<float>* output_data) {
+		SegmentTensors* buffers;
+		if (!m_queues.back()->Pop(&buffers)) return false;
+		output_data->resize(m_result_size);
+		float* out = output_data->data();
+		for (size_t i = 0; i < m_result_readers.size(); ++i) {
+			const ResultReader& reader = m_result_readers[i];
+			if (reader.read) reader.read(buffers->tensors[i].data(), reader.count, reader.scale, reader.zero_point, out);
+			out += reader.count;
+		}
+		m_free_buffers.back()->Push(buffers);
+		return true;
+	}
+
+	void SegmentedPipeline::Stop() {
+		for (auto& queue : m_queues) queue->Close();
+		for (auto& queue : m_free_buffers) queue->Close();
+		for (auto& thread : m_threads) {
+			if (thread.joinable()) thread.join();
+		}
+	}
+
+	void SegmentedPipeline::SegmentLoop(size_t segment) {
+		tflite::Interpreter* interpreter = m_segments[segment]->GetInterpreter();
+		TensorQueue& input_queue = *m_queues[segment];
+		TensorQueue& input_free = *m_free_buffers[segment];
+		TensorQueue& output_queue = *m_queues[segment + 1];
+		TensorQueue& output_free = *m_free_buffers[segment + 1];
+		const auto& input_indices = interpreter->inputs();
+		const auto& output_indices = interpreter->outputs();
+		// The next segment maps its inputs onto our outputs; the results queue takes them in
+		// order and the decode stage takes the decoder inputs.
+		const bool last = segment + 1 == m_segments.size();
+
+		SegmentTensors* input;
+		while (input_queue.Pop(&input)) {
+			for (size_t j = 0; j < input_indices.size(); ++j) {
+				if (segment == 0 && j == 0) {
+					std::memcpy(m_input_adapter.Buffer(), input->tensors[0].data(), m_input_pixels);
+					m_input_adapter.Apply();
+					continue;
+				}
+				TfLiteTensor* tensor = interpreter->tensor(input_indices[j]);
+				std::memcpy(tensor->data.raw, input->tensors[j].data(), tensor->bytes);
+			}
+			input_free.Push(input);
+			if (interpreter->Invoke() != kTfLiteOk) {
+				std::cerr << "Segment " << segment << " failed to invoke" << std::endl;
+			}
+
+			SegmentTensors* output;
+			if (!output_free.Pop(&output)) break;
+			if (last && m_decode_stage) {
+				for (size_t j = 0; j < m_decoder_inputs.size(); ++j) {
+					const TfLiteTensor* tensor = interpreter->tensor(m_decoder_inputs[j]);
+					std::memcpy(output->tensors[j].data(), tensor->data.raw, tensor->bytes);
+				}
+			} else if (last) {
+				for (size_t k = 0; k < output_indices.size(); ++k) {
+					const TfLiteTensor* tensor = interpreter->tensor(output_indices[k]);
+					std::memcpy(output->tensors[k].data(), tensor->data.raw, tensor->bytes);
+				}
+			} else {
+				const auto& input_map = m_input_map[segment + 1];
+				for (size_t j = 0; j < input_map.size(); ++j) {
+					const TfLiteTensor* tensor = interpreter->tensor(output_indices[input_map[j]]);
+					std::memcpy(output->tensors[j].data(), tensor->data.raw, tensor->bytes);
+				}
+			}
+			if (!output_queue.Push(output)) break;
+		}
+	}
+
+	void SegmentedPipeline::DecodeLoop() {
+		Engine& engine = *m_segments.back();
+		TensorQueue& input_queue = *m_queues[m_segments.size()];
+		TensorQueue& input_free = *m_free_buffers[m_segments.size()];
+		TensorQueue& output_queue = *m_queues.back();
+		TensorQueue& output_free = *m_free_buffers.back();
+		std::vector<const void*> inputs(m_decoder_inputs.size());
+		std::vector<float*> outputs(m_decoder_output_positions.size());
+
+		SegmentTensors* input;
+		while (input_queue.Pop(&input)) {
+			SegmentTensors* output;
+			if (!output_free.Pop(&output)) break;
+			for (size_t j = 0; j < inputs.size(); ++j) inputs[j] = input->tensors[j].data();
+			for (size_t k = 0; k < outputs.size(); ++k) {
+				outputs[k] = reinterpret_cast<float*>(output->tensors[m_decoder_output_positions[k]].data());
+			}
+			if (!engine.DecodePosenetInputs(inputs.data(), outputs.data())) {
+				std::cerr << "Failed to decode poses" << std::endl;
+			}
+			input_free.Push(input);
+			if (!output_queue.Push(output)) break;
+		}
+	}
+}
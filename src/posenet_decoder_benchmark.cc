@@ -0,0 +1,279 @@
+//
+// Shows what each runtime knob of the PoseNet decoder trades: sweeps one parameter at a
+// time over the frames of a tensor recording (humanpose_camera --record_tensors) and
+// reports decoding time next to how well the poses match those decoded with the
+// parameters of the model.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cxxopts.hpp"
+#include "posenet_decoder.h"
+#include "tensor_record.h"
+#include "tensorflow/lite/context.h"
+
+using coral::posenet_decoder_op::Point;
+using coral::posenet_decoder_op::SkeletonGraph;
+
+cxxopts::ParseResult parse_args(int argc, char** argv) {
+	cxxopts::Options options("posenet_decoder_benchmark", "Benchmarks the PoseNet decoder parameters");
+
+	options.add_options()
+					("input", "Tensor recording of a PoseNet model written with --record_tensors.", cxxopts::value<std::string>())
+					("iterations", "Number of timed passes over the recording per setting.", cxxopts::value<int>()->default_value("5"))
+					("match_radius", "Mean keypoint distance in pixels up to which a pose matches a reference pose.",
+					 cxxopts::value<float>()->default_value("10"))
+					("help", "Print Usage");
+
+	const auto& args = options.parse(argc, argv);
+	if (args.count("help") || !args.count("input")) {
+		std::cerr << options.help() << "\n";
+		exit(0);
+	}
+	return args;
+}
+
+// Decoder inputs of one frame, dequantized like the PosenetDecoderOp does.
+struct Frame {
+	int height;
+	int width;
+	std::vector<float> heatmaps;
+	std::vector<float> shorts;
+	std::vector<float> mids;
+};
+
+struct Settings {
+	int max_detections;
+	float score_threshold;
+	float nms_radius;
+	int refinement_steps;
+	int local_maximum_radius;
+	coral::posenet_decoder_op::SamplingMode sampling;
+};
+
+// Keypoints of pose i are keypoints[i * num_keypoints, (i + 1) * num_keypoints).
+struct Poses {
+	std::vector<Point> keypoints;
+	std::vector<float> scores;
+};
+
+void Dequantize(const edge::TensorView& tensor, float extra_scale, std::vector<float>* out) {
+	const size_t num_elements = tensor.NumElements();
+	out->resize(num_elements);
+	if (tensor.header->type == kTfLiteUInt8) {
+		coral::posenet_decoder_op::DequantizeUint8(tensor.data, num_elements, tensor.header->zero_point,
+		                                           tensor.header->scale, extra_scale, out->data());
+	} else {
+		coral::posenet_decoder_op::ScaleFloat(reinterpret_cast<const float*>(tensor.data), num_elements, extra_scale,
+		                                      out->data());
+	}
+}
+
+class Decoder {
+public:
+	Decoder(const SkeletonGraph& graph, int stride) : m_graph(graph), m_stride(stride) {}
+
+	// Decodes every frame, returns the time per frame in microseconds. The first pass
+	// warms up the workspace and is not timed.
+	double Run(const std::vector<Frame>& frames, const Settings& settings, int iterations, std::vector<Poses>* poses) {
+		const int num_keypoints = m_graph.NumKeypoints();
+		m_keypoints.resize(settings.max_detections * num_keypoints);
+		m_keypoint_scores.resize(settings.max_detections * num_keypoints);
+		m_scores.resize(settings.max_detections);
+		poses->resize(frames.size());
+		coral::posenet_decoder_op::SetSamplingMode(settings.sampling);
+		std::chrono::steady_clock::duration decoding(0);
+		for (int iteration = 0; iteration <= iterations; ++iteration) {
+			for (size_t i = 0; i < frames.size(); ++i) {
+				const Frame& frame = frames[i];
+				const auto start = std::chrono::steady_clock::now();
+				const int count = coral::posenet_decoder_op::DecodeAllPoses(
+								m_graph, frame.heatmaps.data(), frame.shorts.data(), frame.mids.data(), frame.height, frame.width,
+								settings.max_detections, settings.score_threshold, settings.refinement_steps,
+								settings.local_maximum_radius, settings.nms_radius / m_stride, m_stride, m_keypoints.data(),
+								m_keypoint_scores.data(), m_scores.data(), nullptr, &m_workspace);
+				if (iteration > 0) decoding += std::chrono::steady_clock::now() - start;
+				(*poses)[i].keypoints.assign(m_keypoints.begin(), m_keypoints.begin() + count * num_keypoints);
+				(*poses)[i].scores.assign(m_scores.begin(), m_scores.begin() + count);
+			}
+		}
+		return std::chrono::duration<double, std::micro>(decoding).count() / (frames.size() * iterations);
+	}
+
+private:
+	const SkeletonGraph& m_graph;
+	const int m_stride;
+	coral::posenet_decoder_op::DecoderWorkspace m_workspace;
+	std::vector<Point> m_keypoints;
+	std::vector<float> m_keypoint_scores;
+	std::vector<float> m_scores;
+};
+
+float MeanKeypointDistance(const Point* a, const Point* b, int num_keypoints) {
+	float total = 0.0f;
+	for (int k = 0; k < num_keypoints; ++k) {
+		total += std::hypot(a[k].y - b[k].y, a[k].x - b[k].x);
+	}
+	return total / num_keypoints;
+}
+
+struct Accuracy {
+	size_t reference_poses = 0;
+	size_t poses = 0;
+	size_t matched = 0;
+	double distance = 0.0;
+};
+
+// Matches poses greedily to the closest unmatched reference pose, in decreasing score order.
+void Compare(const Poses& reference, const Poses& poses, int num_keypoints, float match_radius, Accuracy* accuracy) {
+	std::vector<bool> taken(reference.scores.size(), false);
+	accuracy->reference_poses += reference.scores.size();
+	accuracy->poses += poses.scores.size();
+	for (size_t p = 0; p < poses.scores.size(); ++p) {
+		int best = -1;
+		float best_distance = match_radius;
+		for (size_t r = 0; r < reference.scores.size(); ++r) {
+			if (taken[r]) continue;
+			const float distance = MeanKeypointDistance(&poses.keypoints[p * num_keypoints],
+			                                            &reference.keypoints[r * num_keypoints], num_keypoints);
+			if (distance <= best_distance) {
+				best = static_cast<int>(r);
+				best_distance = distance;
+			}
+		}
+		if (best < 0) continue;
+		taken[best] = true;
+		accuracy->matched++;
+		accuracy->distance += best_distance;
+	}
+}
+
+int main(int argc, char** argv) {
+	const auto& args = parse_args(argc, argv);
+	edge::TensorRecordReader reader;
+	if (!reader.Open(args["input"].as<std::string>())) return 1;
+	if (reader.Stream() != edge::TensorStream::kPosenetDecoderInputs) {
+		std::cerr << "The recording does not contain PosenetDecoderOp inputs" << std::endl;
+		return 1;
+	}
+	const int iterations = std::max(1, args["iterations"].as<int>());
+	const float match_radius = args["match_radius"].as<float>();
+	const int stride = std::stoi(reader.GetMetadata("stride", "16"));
+	Settings model;
+	model.max_detections = std::stoi(reader.GetMetadata("max_detections", "10"));
+	model.score_threshold = std::stof(reader.GetMetadata("score_threshold", "0.5"));
+	model.nms_radius = std::stof(reader.GetMetadata("nms_radius", "20"));
+	model.refinement_steps = std::stoi(reader.GetMetadata(
+					"refinement_steps", std::to_string(coral::posenet_decoder_op::kMidShortOffsetRefinementSteps)));
+	model.local_maximum_radius = std::stoi(reader.GetMetadata(
+					"local_maximum_radius", std::to_string(coral::posenet_decoder_op::kLocalMaximumRadius)));
+	model.sampling = coral::posenet_decoder_op::SamplingMode::kBatched;
+
+	std::vector<Frame> frames;
+	uint64_t frame_index;
+	std::vector<edge::TensorView> tensors;
+	int num_keypoints = 0;
+	int num_edges = 0;
+	while (reader.Next(&frame_index, &tensors)) {
+		if (tensors.size() != 3) continue;
+		num_keypoints = tensors[0].header->dims[3];
+		num_edges = tensors[2].header->dims[3] / 4;
+		Frame frame;
+		frame.height = tensors[0].header->dims[1];
+		frame.width = tensors[0].header->dims[2];
+		Dequantize(tensors[0], 1.0f, &frame.heatmaps);
+		Dequantize(tensors[1], 1.0f / stride, &frame.shorts);
+		Dequantize(tensors[2], 1.0f / stride, &frame.mids);
+		frames.push_back(std::move(frame));
+	}
+	if (frames.empty()) {
+		std::cerr << "The recording has no frames" << std::endl;
+		return 1;
+	}
+	std::vector<std::pair<int, int>> edges;
+	coral::PoseSkeleton skeleton;
+	SkeletonGraph graph;
+	if (!coral::SkeletonEdgesFromString(reader.GetMetadata("skeleton_edges", ""), &edges) ||
+	    !coral::ResolveSkeleton(reader.GetMetadata("skeleton", ""), edges, num_keypoints, num_edges, &skeleton) ||
+	    !graph.Init(skeleton)) {
+		std::cerr << "No pose skeleton with " << num_keypoints << " keypoints and " << num_edges << " edges" << std::endl;
+		return 1;
+	}
+	std::cout << frames.size() << " frames of " << frames[0].height << "x" << frames[0].width << " blocks, stride "
+	          << stride << ", " << skeleton.name << " skeleton" << std::endl;
+
+	Decoder decoder(graph, stride);
+	std::vector<Poses> reference;
+	const double reference_us = decoder.Run(frames, model, iterations, &reference);
+	std::printf("model parameters: max_detections %d score_threshold %.2f nms_radius %.1f refinement_steps %d "
+	            "local_maximum_radius %d, %.1f us per frame with %s sampling\n\n",
+	            model.max_detections, model.score_threshold, model.nms_radius, model.refinement_steps,
+	            model.local_maximum_radius, reference_us, coral::posenet_decoder_op::SamplingIsa());
+
+	struct Knob {
+		const char* name;
+		std::vector<float> values;
+		void (*apply)(float value, Settings* settings);
+		// Names of the values of enumerations, nullptr for numbers.
+		const char* const* labels;
+	};
+	// In SamplingMode order.
+	static const char* const kSamplingModes[] = {"per_edge", "batched_scalar", "batched"};
+	// Poses the model would not return make max_detections above the model's value moot.
+	std::vector<float> max_detections;
+	for (int value : {1, 2, 5, 10, 20}) {
+		if (value <= model.max_detections) max_detections.push_back(static_cast<float>(value));
+	}
+	const Knob knobs[] = {
+					{"max_detections", max_detections,
+					 [](float value, Settings* settings) { settings->max_detections = static_cast<int>(value); }, nullptr},
+					{"score_threshold", {0.1f, 0.2f, 0.3f, 0.5f, 0.7f},
+					 [](float value, Settings* settings) { settings->score_threshold = value; }, nullptr},
+					{"nms_radius", {5.0f, 10.0f, 20.0f, 30.0f, 40.0f},
+					 [](float value, Settings* settings) { settings->nms_radius = value; }, nullptr},
+					{"refinement_steps", {0.0f, 1.0f, 2.0f, 3.0f, 5.0f, 8.0f},
+					 [](float value, Settings* settings) { settings->refinement_steps = static_cast<int>(value); }, nullptr},
+					{"local_maximum_radius", {0.0f, 1.0f, 2.0f, 3.0f},
+					 [](float value, Settings* settings) { settings->local_maximum_radius = static_cast<int>(value); },
+					 nullptr},
+					// Only changes speed, every mode decodes the same poses.
+					{"sampling", {0.0f, 1.0f, 2.0f},
+					 [](float value, Settings* settings) {
+						 settings->sampling = static_cast<coral::posenet_decoder_op::SamplingMode>(static_cast<int>(value));
+					 },
+					 kSamplingModes},
+	};
+
+	std::printf("%-22s %14s %10s %8s %11s %8s %9s %12s\n", "parameter", "value", "us/frame", "speedup", "poses/frame",
+	            "recall", "precision", "error (px)");
+	std::vector<Poses> poses;
+	for (const auto& knob : knobs) {
+		for (float value : knob.values) {
+			Settings settings = model;
+			knob.apply(value, &settings);
+			const double us = decoder.Run(frames, settings, iterations, &poses);
+			Accuracy accuracy;
+			for (size_t i = 0; i < frames.size(); ++i) Compare(reference[i], poses[i], graph.NumKeypoints(), match_radius, &accuracy);
+			char label[32];
+			if (knob.labels) {
+				std::snprintf(label, sizeof(label), "%s", knob.labels[static_cast<int>(value)]);
+			} else {
+				std::snprintf(label, sizeof(label), "%g", value);
+			}
+			std::printf("%-22s %14s %10.1f %7.2fx %11.2f %7.1f%% %8.1f%% %12.2f\n", knob.name, label, us, reference_us / us,
+			            static_cast<double>(accuracy.poses) / frames.size(),
+			            accuracy.reference_poses ? 100.0 * accuracy.matched / accuracy.reference_poses : 100.0,
+			            accuracy.poses ? 100.0 * accuracy.matched / accuracy.poses : 100.0,
+			            accuracy.matched ? accuracy.distance / accuracy.matched : 0.0);
+		}
+		std::printf("\n");
+	}
+	return 0;
+}
@@ -0,0 +1,147 @@
+//
+// Measures preprocessing of a camera frame into a model input: cv::resize + cvtColor as
+// GetInputFromImage used to do it against the Resampler with precomputed taps, and the
+// OpenCV YUV path against the fused ConvertYuvToRgb kernel. Then how both scale across
+// threads of a PreprocessExecutor.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cxxopts.hpp"
+#include "opencv2/opencv.hpp"
+#include "preprocess_executor.h"
+#include "resampler.h"
+#include "yuv_prep.h"
+
+cxxopts::ParseResult parse_args(int argc, char** argv) {
+	cxxopts::Options options("preprocess_benchmark", "Benchmarks resizing camera frames to model inputs");
+
+	options.add_options()
+					("camera_width", "Width of the synthetic camera frame.", cxxopts::value<int>()->default_value("1280"))
+					("camera_height", "Height of the synthetic camera frame.", cxxopts::value<int>()->default_value("720"))
+					("sizes", "Comma separated model input sizes as WxH.", cxxopts::value<std::vector<std::string>>()->default_value("300x300,481x353,641x481,1281x721"))
+					("iterations", "Number of timed frames per measurement.", cxxopts::value<int>()->default_value("100"))
+					("threads", "Comma separated thread counts for the scaling curve.", cxxopts::value<std::vector<int>>()->default_value("1,2,3,4,5,6,7,8"))
+					("help", "Print Usage");
+
+	const auto& args = options.parse(argc, argv);
+	if (args.count("help")) {
+		std::cerr << options.help() << "\n";
+		exit(0);
+	}
+	return args;
+}
+
+template <typename Fn>
+double TimeMsPerFrame(const int iterations, Fn fn) {
+	fn();
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i) fn();
+	const auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+void Report(const std::string& name, const double baseline_ms, const double ms) {
+	std::printf("  %-34s %8.3f ms  %5.2fx\n", name.c_str(), ms, baseline_ms / ms);
+}
+
+int main(int argc, char** argv) {
+	const auto& args = parse_args(argc, argv);
+	const int camera_width = args["camera_width"].as<int>();
+	const int camera_height = args["camera_height"].as<int>();
+	const int iterations = args["iterations"].as<int>();
+	const int cores = static_cast<int>(std::thread::hardware_concurrency());
+
+	cv::Mat bgr(camera_height, camera_width, CV_8UC3);
+	cv::randu(bgr, cv::Scalar::all(0), cv::Scalar::all(255));
+	cv::Mat nv12_mat;
+	cv::cvtColor(bgr, nv12_mat, cv::COLOR_BGR2YUV_I420);
+	// I420 to NV12 by interleaving the chroma planes.
+	std::vector<uint8_t> nv12(edge::YuvFrameSize(edge::PixelFormat::kNV12, camera_width, camera_height));
+	const size_t luma = static_cast<size_t>(camera_width) * camera_height;
+	const size_t chroma = luma / 4;
+	std::memcpy(nv12.data(), nv12_mat.data, luma);
+	for (size_t i = 0; i < chroma; ++i) {
+		nv12[luma + 2 * i] = nv12_mat.data[luma + i];
+		nv12[luma + 2 * i + 1] = nv12_mat.data[luma + chroma + i];
+	}
+	const edge::YuvImage yuv = edge::MakeYuvImage(edge::PixelFormat::kNV12, camera_width, camera_height, nv12.data());
+	const cv::Mat nv12_view(camera_height * 3 / 2, camera_width, CV_8UC1, nv12.data());
+
+	std::cout << "Camera frame " << camera_width << "x" << camera_height << ", " << iterations << " frames per measurement, "
+	          << cores << " cores" << std::endl;
+	for (const auto& size : args["sizes"].as<std::vector<std::string>>()) {
+		int width = 0, height = 0;
+		if (std::sscanf(size.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+			std::cerr << "Invalid size " << size << std::endl;
+			return 1;
+		}
+		std::cout << "Model input " << width << "x" << height << std::endl;
+		cv::Mat resized, input(height, width, CV_8UC3), full_bgr;
+
+		const double opencv_ms = TimeMsPerFrame(iterations, [&] {
+			cv::resize(bgr, resized, cv::Size(width, height));
+			cv::cvtColor(resized, input, cv::COLOR_BGR2RGB);
+		});
+		Report("cv::resize linear + cvtColor", opencv_ms, opencv_ms);
+		const double setup_ms = TimeMsPerFrame(iterations, [&] {
+			edge::Resampler resampler(camera_width, camera_height, width, height, 3, edge::Interpolation::kBilinear, true);
+		});
+		Report("Resampler setup (once)", opencv_ms, setup_ms);
+		edge::Resampler bilinear(camera_width, camera_height, width, height, 3, edge::Interpolation::kBilinear, true);
+		Report("Resampler bilinear + swap", opencv_ms, TimeMsPerFrame(iterations, [&] {
+			bilinear.Resize(bgr.data, static_cast<int>(bgr.step), input.data, static_cast<int>(input.step));
+		}));
+
+		const double opencv_area_ms = TimeMsPerFrame(iterations, [&] {
+			cv::resize(bgr, resized, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+			cv::cvtColor(resized, input, cv::COLOR_BGR2RGB);
+		});
+		Report("cv::resize area + cvtColor", opencv_ms, opencv_area_ms);
+		edge::Resampler area(camera_width, camera_height, width, height, 3, edge::Interpolation::kArea, true);
+		Report("Resampler area + swap", opencv_area_ms, TimeMsPerFrame(iterations, [&] {
+			area.Resize(bgr.data, static_cast<int>(bgr.step), input.data, static_cast<int>(input.step));
+		}));
+
+		const double opencv_yuv_ms = TimeMsPerFrame(iterations, [&] {
+			cv::cvtColor(nv12_view, full_bgr, cv::COLOR_YUV2BGR_NV12);
+			cv::resize(full_bgr, resized, cv::Size(width, height));
+			cv::cvtColor(resized, input, cv::COLOR_BGR2RGB);
+		});
+		Report("NV12: cvtColor + resize + cvtColor", opencv_yuv_ms, opencv_yuv_ms);
+		Report("NV12: ConvertYuvToRgb", opencv_yuv_ms, TimeMsPerFrame(iterations, [&] {
+			edge::ConvertYuvToRgb(yuv, width, height, input.data, static_cast<int>(input.step));
+		}));
+
+		// Speedups relative to one thread of the executor.
+		double bgr_single_ms = 0.0, yuv_single_ms = 0.0;
+		for (const int threads : args["threads"].as<std::vector<int>>()) {
+			edge::PreprocessExecutor executor(threads);
+			const double bgr_ms = TimeMsPerFrame(iterations, [&] {
+				executor.Run(bgr, edge::ResizeMode::kStretch, width, height, input.data);
+			});
+			const double yuv_ms = TimeMsPerFrame(iterations, [&] {
+				executor.Run(yuv, edge::ResizeMode::kStretch, width, height, input.data);
+			});
+			if (bgr_single_ms == 0.0) {
+				bgr_single_ms = bgr_ms;
+				yuv_single_ms = yuv_ms;
+			}
+			// More threads than cores only time-slices the bands, so those rows measure pool overhead.
+			const std::string suffix = std::to_string(threads) + (cores > 0 && threads > cores ? " threads*" : " threads");
+			Report("BGR executor, " + suffix, bgr_single_ms, bgr_ms);
+			Report("NV12 executor, " + suffix, yuv_single_ms, yuv_ms);
+		}
+	}
+	const auto& thread_counts = args["threads"].as<std::vector<int>>();
+	if (cores > 0 && std::any_of(thread_counts.begin(), thread_counts.end(), [&](const int t) { return t > cores; })) {
+		std::cout << "* more threads than the " << cores << " cores of this host" << std::endl;
+	}
+}
@@ -0,0 +1,204 @@
+//
+// Converts a binary result recording (see result_record.h) to CSV or to the JSON lines
+// written by --json_out of the camera apps.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "cxxopts.hpp"
+#include "json_utils.h"
+#include "result_record.h"
+
+cxxopts::ParseResult parse_args(int argc, char** argv) {
+	cxxopts::Options options("result_convert", "Converts binary result recordings to CSV or JSON lines");
+
+	options.add_options()
+					("input", "Recording written with --record_out.", cxxopts::value<std::string>())
+					("output", "Output file, - for stdout.", cxxopts::value<std::string>()->default_value("-"))
+					("format", "Output format, csv or json.", cxxopts::value<std::string>()->default_value("csv"))
+					("help", "Print Usage");
+
+	const auto& args = options.parse(argc, argv);
+	const bool known_format = args["format"].as<std::string>() == "csv" || args["format"].as<std::string>() == "json";
+	if (args.count("help") || !args.count("input") || !known_format) {
+		std::cerr << options.help() << "\n";
+		exit(0);
+	}
+	return args;
+}
+
+// Labels pointing outside the string bytes of a damaged record read as empty.
+std::string GetLabel(const edge::RecordView& record, uint32_t offset, uint32_t size) {
+	const uint32_t string_bytes = record.header().string_bytes;
+	if (offset > string_bytes || size > string_bytes - offset) return std::string();
+	return record.Label(offset, size);
+}
+
+bool ValidRange(uint32_t first, uint32_t count, uint32_t total) {
+	return first <= total && count <= total - first;
+}
+
+std::string CsvField(const std::string& text) {
+	if (text.find_first_of(",\"\n") == std::string::npos) return text;
+	std::string quoted = "\"";
+	for (char c : text) {
+		if (c == '"') quoted.push_back('"');
+		quoted.push_back(c);
+	}
+	quoted.push_back('"');
+	return quoted;
+}
+
+void WriteCsv(FILE* out, const edge::RecordView& record) {
+	const auto& header = record.header();
+	const unsigned long long frame_id = header.frame_id;
+	const long long timestamp_us = header.timestamp_us;
+	for (uint32_t i = 0; i < header.num_detections; ++i) {
+		const auto& detection = record.detections()[i];
+		fprintf(out, "%llu,%lld,detection,%u,-1,%s,%g,%g,%g,%g,%g\n", frame_id, timestamp_us, i,
+		        CsvField(GetLabel(record, detection.label_offset, detection.label_size)).c_str(), detection.score,
+		        detection.x1 * header.width, detection.y1 * header.height, detection.x2 * header.width,
+		        detection.y2 * header.height);
+	}
+	for (uint32_t i = 0; i < header.num_faces; ++i) {
+		const auto& face = record.faces()[i];
+		fprintf(out, "%llu,%lld,face,%u,-1,,%g,%d,%d,%d,%d\n", frame_id, timestamp_us, i, face.score, face.x, face.y,
+		        face.x + face.width, face.y + face.height);
+		if (!ValidRange(face.first_class, face.num_classes, header.num_face_classes)) continue;
+		for (uint32_t c = 0; c < face.num_classes; ++c) {
+			const auto& candidate = record.face_classes()[face.first_class + c];
+			fprintf(out, "%llu,%lld,face_class,%u,%u,%s,%g,,,,\n", frame_id, timestamp_us, c, i,
+			        CsvField(GetLabel(record, candidate.label_offset, candidate.label_size)).c_str(), candidate.score);
+		}
+	}
+	for (uint32_t i = 0; i < header.num_poses; ++i) {
+		const auto& pose = record.poses()[i];
+		if (!ValidRange(pose.first_keypoint, pose.num_keypoints, header.num_keypoints)) continue;
+		for (uint32_t k = 0; k < pose.num_keypoints; ++k) {
+			const auto& keypoint = record.keypoints()[pose.first_keypoint + k];
+			fprintf(out, "%llu,%lld,keypoint,%u,%u,,%g,%g,%g,,\n", frame_id, timestamp_us, k, i, keypoint.score,
+			        keypoint.x, keypoint.y);
+		}
+	}
+	for (uint32_t i = 0; i < header.num_classes; ++i) {
+		const auto& candidate = record.classes()[i];
+		fprintf(out, "%llu,%lld,class,%u,-1,%s,%g,,,,\n", frame_id, timestamp_us, i,
+		        CsvField(GetLabel(record, candidate.label_offset, candidate.label_size)).c_str(), candidate.score);
+	}
+}
+
+void AppendClasses(std::string* line, const edge::RecordView& record, const edge::ClassRecord* classes,
+                   uint32_t count) {
+	char buffer[32];
+	line->push_back('[');
+	for (uint32_t i = 0; i < count; ++i) {
+		if (i) line->push_back(',');
+		snprintf(buffer, sizeof(buffer), "%g", classes[i].score);
+		line->append("{\"label\":");
+		edge::AppendJsonString(line, GetLabel(record, classes[i].label_offset, classes[i].label_size));
+		line->append(",\"score\":" + std::string(buffer) + "}");
+	}
+	line->push_back(']');
+}
+
+// Same schema as the JSON lines sink of the camera apps.
+void WriteJson(FILE* out, const edge::RecordView& record, std::string* line) {
+	const auto& header = record.header();
+	char buffer[160];
+	line->clear();
+	snprintf(buffer, sizeof(buffer), "{\"frame_id\":%llu,\"timestamp_us\":%lld,\"width\":%d,\"height\":%d",
+	         static_cast<unsigned long long>(header.frame_id), static_cast<long long>(header.timestamp_us),
+	         header.width, header.height);
+	line->append(buffer);
+	if (header.num_detections) {
+		line->append(",\"detections\":[");
+		for (uint32_t i = 0; i < header.num_detections; ++i) {
+			const auto& detection = record.detections()[i];
+			if (i) line->push_back(',');
+			line->append("{\"label\":");
+			edge::AppendJsonString(line, GetLabel(record, detection.label_offset, detection.label_size));
+			snprintf(buffer, sizeof(buffer), ",\"score\":%g,\"box\":[%g,%g,%g,%g]}", detection.score,
+			         detection.x1 * header.width, detection.y1 * header.height, detection.x2 * header.width,
+			         detection.y2 * header.height);
+			line->append(buffer);
+		}
+		line->push_back(']');
+	}
+	if (header.num_faces) {
+		line->append(",\"faces\":[");
+		for (uint32_t i = 0; i < header.num_faces; ++i) {
+			const auto& face = record.faces()[i];
+			if (i) line->push_back(',');
+			snprintf(buffer, sizeof(buffer), "{\"score\":%g,\"box\":[%d,%d,%d,%d]", face.score, face.x, face.y,
+			         face.x + face.width, face.y + face.height);
+			line->append(buffer);
+			if (face.num_classes && ValidRange(face.first_class, face.num_classes, header.num_face_classes)) {
+				line->append(",\"classes\":");
+				AppendClasses(line, record, record.face_classes() + face.first_class, face.num_classes);
+			}
+			line->push_back('}');
+		}
+		line->push_back(']');
+	}
+	if (header.num_poses) {
+		line->append(",\"poses\":[");
+		for (uint32_t i = 0; i < header.num_poses; ++i) {
+			const auto& pose = record.poses()[i];
+			if (i) line->push_back(',');
+			line->append("{\"keypoints\":[");
+			if (ValidRange(pose.first_keypoint, pose.num_keypoints, header.num_keypoints)) {
+				for (uint32_t k = 0; k < pose.num_keypoints; ++k) {
+					const auto& keypoint = record.keypoints()[pose.first_keypoint + k];
+					if (k) line->push_back(',');
+					snprintf(buffer, sizeof(buffer), "[%g,%g,%g]", keypoint.x, keypoint.y, keypoint.score);
+					line->append(buffer);
+				}
+			}
+			line->append("]}");
+		}
+		line->push_back(']');
+	}
+	if (header.num_classes) {
+		line->append(",\"classes\":");
+		AppendClasses(line, record, record.classes(), header.num_classes);
+	}
+	line->append("}\n");
+	fwrite(line->data(), 1, line->size(), out);
+}
+
+int main(int argc, char** argv) {
+	const auto& args = parse_args(argc, argv);
+	const auto& input_path = args["input"].as<std::string>();
+	const auto& output_path = args["output"].as<std::string>();
+	const bool csv = args["format"].as<std::string>() == "csv";
+
+	edge::RecordReader reader;
+	if (!reader.Open(input_path)) return 1;
+	FILE* out = output_path == "-" ? stdout : fopen(output_path.c_str(), "w");
+	if (out == nullptr) {
+		std::cerr << "Failed to open " << output_path << " for writing" << std::endl;
+		return 1;
+	}
+
+	if (csv) fputs("frame_id,timestamp_us,kind,index,parent,label,score,x1,y1,x2,y2\n", out);
+	edge::RecordView record;
+	std::string line;
+	size_t frames = 0;
+	while (reader.Next(&record)) {
+		if (csv) {
+			WriteCsv(out, record);
+		} else {
+			WriteJson(out, record, &line);
+		}
+		++frames;
+	}
+	if (out != stdout) fclose(out);
+
+	std::cerr << "Converted " << frames << " frames of format version " << reader.Version() << std::endl;
+	if (reader.Truncated()) {
+		std::cerr << "Stopped at a truncated or damaged record, the rest of the file was skipped" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,330 @@
+//
+// Writer and memory-mapped reader of the binary result format.
+//
+
+#include "result_record.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace edge {
+	namespace {
+		template <typename T>
+		void AddSection(struct iovec* iov, int* count, const std::vector<T>& section) {
+			if (section.empty()) return;
+			iov[*count].iov_base = const_cast<T*>(section.data());
+			iov[*count].iov_len = section.size() * sizeof(T);
+			++*count;
+		}
+
+		bool WriteFully(int fd, struct iovec* iov, int count) {
+			while (count > 0) {
+				const ssize_t written = writev(fd, iov, count);
+				if (written < 0) {
+					if (errno == EINTR) continue;
+					return false;
+				}
+				// Short write, skip what went out and retry the rest.
+				size_t remaining = static_cast<size_t>(written);
+				while (count > 0 && remaining >= iov->iov_len) {
+					remaining -= iov->iov_len;
+					++iov;
+					--count;
+				}
+				if (count > 0) {
+					iov->iov_base = static_cast<char*>(iov->iov_base) + remaining;
+					iov->iov_len -= remaining;
+				}
+			}
+			return true;
+		}
+
+		//Points `section` at `count` elements at `*offset`, false if they overrun `end`.
+		template <typename T>
+		bool TakeSection(const uint8_t* base, size_t* offset, size_t end, uint32_t count, const T** section) {
+			const uint64_t bytes = static_cast<uint64_t>(count) * sizeof(T);
+			if (bytes > end - *offset) return false;
+			*section = reinterpret_cast<const T*>(base + *offset);
+			*offset += static_cast<size_t>(bytes);
+			return true;
+		}
+
+		//False if `first + count` runs past `size`, in 64 bits so a corrupt pair can not wrap.
+		bool InRange(uint32_t first, uint32_t count, uint32_t size) {
+			return static_cast<uint64_t>(first) + count <= size;
+		}
+
+		//False if a label of the `count` records lies outside the `string_bytes` of the record.
+		template <typename T>
+		bool LabelsInRange(const T* records, uint32_t count, uint32_t string_bytes) {
+			for (uint32_t i = 0; i < count; ++i) {
+				if (!InRange(records[i].label_offset, records[i].label_size, string_bytes)) return false;
+			}
+			return true;
+		}
+	}
+
+	RecordWriter::~RecordWriter() {
+		Close();
+	}
+
+	bool RecordWriter::Open(const std::string& path) {
+		Close();
+		m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (m_fd < 0) {
+			std::cout << "Failed to open " << path << " for writing" << std::endl;
+			return false;
+		}
+		RecordFileHeader header;
+		std::memset(&header, 0, sizeof(header));
+		header.magic = kRecordMagic;
+		header.version = kRecordVersion;
+		header.file_header_size = sizeof(RecordFileHeader);
+		header.record_header_size = sizeof(RecordHeader);
+		struct iovec iov;
+		iov.iov_base = &header;
+		iov.iov_len = sizeof(header);
+		if (!WriteFully(m_fd, &iov, 1)) {
+			std::cout << "Failed to write the header of " << path << std::endl;
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void RecordWriter::Close() {
+		if (m_fd >= 0) close(m_fd);
+		m_fd = -1;
+	}
+
+	void RecordWriter::BeginFrame(uint64_t frame_id, int64_t timestamp_us, int width, int height) {
+		std::memset(&m_header, 0, sizeof(m_header));
+		m_header.frame_id = frame_id;
+		m_header.timestamp_us = timestamp_us;
+		m_header.width = width;
+		m_header.height = height;
+		m_detections.clear();
+		m_faces.clear();
+		m_poses.clear();
+		m_keypoints.clear();
+		m_classes.clear();
+		m_face_classes.clear();
+		m_strings.clear();
+	}
+
+	uint32_t RecordWriter::AddString(const std::string& text) {
+		const uint32_t offset = static_cast<uint32_t>(m_strings.size());
+		m_strings.insert(m_strings.end(), text.begin(), text.end());
+		return offset;
+	}
+
+	void RecordWriter::AddDetection(const std::string& label, float score, float x1, float y1, float x2, float y2) {
+		DetectionRecord record;
+		record.score = score;
+		record.x1 = x1;
+		record.y1 = y1;
+		record.x2 = x2;
+		record.y2 = y2;
+		record.label_offset = AddString(label);
+		record.label_size = static_cast<uint32_t>(label.size());
+		m_detections.push_back(record);
+	}
+
+	void RecordWriter::AddFace(float score, int x, int y, int width, int height) {
+		FaceRecord record;
+		record.score = score;
+		record.x = x;
+		record.y = y;
+		record.width = width;
+		record.height = height;
+		record.first_class = static_cast<uint32_t>(m_face_classes.size());
+		record.num_classes = 0;
+		m_faces.push_back(record);
+	}
+
+	void RecordWriter::AddFaceClass(const std::string& label, float score) {
+		if (m_faces.empty()) return;
+		ClassRecord record;
+		record.score = score;
+		record.label_offset = AddString(label);
+		record.label_size = static_cast<uint32_t>(label.size());
+		m_face_classes.push_back(record);
+		++m_faces.back().num_classes;
+	}
+
+	void RecordWriter::AddPose() {
+		PoseRecord record;
+		record.first_keypoint = static_cast<uint32_t>(m_keypoints.size());
+		record.num_keypoints = 0;
+		m_poses.push_back(record);
+	}
+
+	void RecordWriter::AddKeypoint(float x, float y, float score) {
+		if (m_poses.empty()) return;
+		KeypointRecord record;
+		record.x = x;
+		record.y = y;
+		record.score = score;
+		m_keypoints.push_back(record);
+		++m_poses.back().num_keypoints;
+	}
+
+	void RecordWriter::AddClass(const std::string& label, float score) {
+		ClassRecord record;
+		record.score = score;
+		record.label_offset = AddString(label);
+		record.label_size = static_cast<uint32_t>(label.size());
+		m_classes.push_back(record);
+	}
+
+	bool RecordWriter::EndFrame() {
+		if (m_fd < 0) return false;
+		m_header.num_detections = static_cast<uint32_t>(m_detections.size());
+		m_header.num_faces = static_cast<uint32_t>(m_faces.size());
+		m_header.num_poses = static_cast<uint32_t>(m_poses.size());
+		m_header.num_keypoints = static_cast<uint32_t>(m_keypoints.size());
+		m_header.num_classes = static_cast<uint32_t>(m_classes.size());
+		m_header.num_face_classes = static_cast<uint32_t>(m_face_classes.size());
+		m_header.string_bytes = static_cast<uint32_t>(m_strings.size());
+
+		static const char kPadding[kRecordAlignment] = {};
+		struct iovec iov[9];
+		int count = 0;
+		iov[count].iov_base = &m_header;
+		iov[count].iov_len = sizeof(m_header);
+		++count;
+		AddSection(iov, &count, m_detections);
+		AddSection(iov, &count, m_faces);
+		AddSection(iov, &count, m_poses);
+		AddSection(iov, &count, m_keypoints);
+		AddSection(iov, &count, m_classes);
+		AddSection(iov, &count, m_face_classes);
+		AddSection(iov, &count, m_strings);
+		size_t size = 0;
+		for (int i = 0; i < count; ++i) size += iov[i].iov_len;
+		const size_t padding = (kRecordAlignment - size % kRecordAlignment) % kRecordAlignment;
+		if (padding) {
+			iov[count].iov_base = const_cast<char*>(kPadding);
+			iov[count].iov_len = padding;
+			++count;
+		}
+		m_header.size = static_cast<uint32_t>(size + padding);
+		return WriteFully(m_fd, iov, count);
+	}
+
+	RecordReader::~RecordReader() {
+		Close();
+	}
+
+	bool RecordReader::Open(const std::string& path) {
+		Close();
+		const int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			std::cout << "Failed to open " << path << std::endl;
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(RecordFileHeader)) {
+			std::cout << path << " is not a record file" << std::endl;
+			close(fd);
+			return false;
+		}
+		const size_t size = static_cast<size_t>(st.st_size);
+		void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (mapped == MAP_FAILED) {
+			std::cout << "Failed to map " << path << std::endl;
+			return false;
+		}
+		madvise(mapped, size, MADV_SEQUENTIAL);
+		m_data = static_cast<const uint8_t*>(mapped);
+		m_size = size;
+
+		RecordFileHeader header;
+		std::memcpy(&header, m_data, sizeof(header));
+		if (header.magic != kRecordMagic) {
+			std::cout << path << " is not a record file" << std::endl;
+			Close();
+			return false;
+		}
+		if (header.version > kRecordVersion) {
+			std::cout << path << " has record version " << header.version << ", only up to " << kRecordVersion
+			          << " is supported" << std::endl;
+			Close();
+			return false;
+		}
+		if (header.file_header_size < sizeof(RecordFileHeader) || header.file_header_size > m_size ||
+		    header.file_header_size % kRecordAlignment || header.record_header_size < sizeof(RecordHeader)) {
+			std::cout << path << " has a malformed header" << std::endl;
+			Close();
+			return false;
+		}
+		m_version = header.version;
+		m_first_record = header.file_header_size;
+		m_record_header_size = header.record_header_size;
+		m_offset = m_first_record;
+		return true;
+	}
+
+	void RecordReader::Close() {
+		if (m_data) munmap(const_cast<uint8_t*>(m_data), m_size);
+		m_data = nullptr;
+		m_size = 0;
+		m_first_record = 0;
+		m_offset = 0;
+		m_truncated = false;
+	}
+
+	bool RecordReader::Next(RecordView* view) {
+		if (m_data == nullptr || m_offset >= m_size) return false;
+		const size_t remaining = m_size - m_offset;
+		if (remaining < m_record_header_size) {
+			m_truncated = true;
+			return false;
+		}
+		const RecordHeader* header = reinterpret_cast<const RecordHeader*>(m_data + m_offset);
+		if (header->size < m_record_header_size || header->size > remaining || header->size % kRecordAlignment) {
+			m_truncated = true;
+			return false;
+		}
+		const size_t end = m_offset + header->size;
+		size_t offset = m_offset + m_record_header_size;
+		const char* strings = nullptr;
+		if (!TakeSection(m_data, &offset, end, header->num_detections, &view->m_detections) ||
+		    !TakeSection(m_data, &offset, end, header->num_faces, &view->m_faces) ||
+		    !TakeSection(m_data, &offset, end, header->num_poses, &view->m_poses) ||
+		    !TakeSection(m_data, &offset, end, header->num_keypoints, &view->m_keypoints) ||
+		    !TakeSection(m_data, &offset, end, header->num_classes, &view->m_classes) ||
+		    !TakeSection(m_data, &offset, end, header->num_face_classes, &view->m_face_classes) ||
+		    !TakeSection(m_data, &offset, end, header->string_bytes, &strings)) {
+			m_truncated = true;
+			return false;
+		}
+		// Indices into the other sections must stay inside them too, else a view would read
+		// past the record.
+		bool consistent = LabelsInRange(view->m_detections, header->num_detections, header->string_bytes) &&
+		                  LabelsInRange(view->m_classes, header->num_classes, header->string_bytes) &&
+		                  LabelsInRange(view->m_face_classes, header->num_face_classes, header->string_bytes);
+		for (uint32_t i = 0; consistent && i < header->num_poses; ++i) {
+			consistent = InRange(view->m_poses[i].first_keypoint, view->m_poses[i].num_keypoints, header->num_keypoints);
+		}
+		for (uint32_t i = 0; consistent && i < header->num_faces; ++i) {
+			consistent = InRange(view->m_faces[i].first_class, view->m_faces[i].num_classes, header->num_face_classes);
+		}
+		if (!consistent) {
+			m_truncated = true;
+			return false;
+		}
+		view->m_header = header;
+		view->m_strings = strings;
+		m_offset = end;
+		return true;
+	}
+}
@@ -0,0 +1,264 @@
+//
+// JSON lines, binary record, video and display sinks and the threads driving them.
+//
+
+#include "result_sink.h"
+
+#include <iostream>
+
+#include "json_utils.h"
+
+namespace edge {
+	namespace {
+		void AppendNumber(std::string* out, double value) {
+			char buffer[32];
+			snprintf(buffer, sizeof(buffer), "%.6g", value);
+			out->append(buffer);
+		}
+
+		void AppendClasses(std::string* out, const std::vector<ClassificationCandidate>& classes) {
+			out->push_back('[');
+			for (size_t i = 0; i < classes.size(); ++i) {
+				if (i) out->push_back(',');
+				out->append("{\"label\":");
+				AppendJsonString(out, classes[i].classname);
+				out->append(",\"score\":");
+				AppendNumber(out, classes[i].score);
+				out->push_back('}');
+			}
+			out->push_back(']');
+		}
+	}
+
+	JsonLinesSink::JsonLinesSink(const std::string& path)
+					: m_file(path == "-" ? stdout : fopen(path.c_str(), "w")), m_owns_file(path != "-") {
+		if (m_file == nullptr) {
+			std::cout << "Failed to open " << path << " for writing" << std::endl;
+		}
+	}
+
+	JsonLinesSink::~JsonLinesSink() {
+		if (m_file && m_owns_file) fclose(m_file);
+	}
+
+	void JsonLinesSink::Consume(const FrameResult& result) {
+		if (m_file == nullptr) return;
+		std::string& out = m_line;
+		out.clear();
+		out.append("{\"frame_id\":" + std::to_string(result.frame_id));
+		out.append(",\"timestamp_us\":" + std::to_string(result.timestamp_us));
+		out.append(",\"width\":" + std::to_string(result.width));
+		out.append(",\"height\":" + std::to_string(result.height));
+		if (!result.detections.empty()) {
+			out.append(",\"detections\":[");
+			for (size_t i = 0; i < result.detections.size(); ++i) {
+				const auto& detection = result.detections[i];
+				if (i) out.push_back(',');
+				out.append("{\"label\":");
+				AppendJsonString(&out, detection.candidate);
+				out.append(",\"score\":");
+				AppendNumber(&out, detection.score);
+				out.append(",\"box\":[");
+				AppendNumber(&out, detection.x1 * result.width);
+				out.push_back(',');
+				AppendNumber(&out, detection.y1 * result.height);
+				out.push_back(',');
+				AppendNumber(&out, detection.x2 * result.width);
+				out.push_back(',');
+				AppendNumber(&out, detection.y2 * result.height);
+				out.append("]}");
+			}
+			out.push_back(']');
+		}
+		if (!result.faces.empty()) {
+			out.append(",\"faces\":[");
+			for (size_t i = 0; i < result.faces.size(); ++i) {
+				const auto& face = result.faces[i];
+				if (i) out.push_back(',');
+				out.append("{\"score\":");
+				AppendNumber(&out, face.score);
+				out.append(",\"box\":[" + std::to_string(face.box.x) + "," + std::to_string(face.box.y) + "," +
+				           std::to_string(face.box.x + face.box.width) + "," +
+				           std::to_string(face.box.y + face.box.height) + "]");
+				if (!face.classes.empty()) {
+					out.append(",\"classes\":");
+					AppendClasses(&out, face.classes);
+				}
+				out.push_back('}');
+			}
+			out.push_back(']');
+		}
+		if (!result.poses.empty()) {
+			out.append(",\"poses\":[");
+			for (size_t i = 0; i < result.poses.size(); ++i) {
+				const auto& pose = result.poses[i];
+				if (i) out.push_back(',');
+				out.append("{\"keypoints\":[");
+				for (size_t k = 0; k < pose.keypoint_scores.size(); ++k) {
+					if (k) out.push_back(',');
+					out.push_back('[');
+					AppendNumber(&out, pose.keypoint_coordinates[2 * k + 1]);
+					out.push_back(',');
+					AppendNumber(&out, pose.keypoint_coordinates[2 * k]);
+					out.push_back(',');
+					AppendNumber(&out, pose.keypoint_scores[k]);
+					out.push_back(']');
+				}
+				out.append("]}");
+			}
+			out.push_back(']');
+		}
+		if (!result.classes.empty()) {
+			out.append(",\"classes\":");
+			AppendClasses(&out, result.classes);
+		}
+		out.append("}\n");
+		fwrite(out.data(), 1, out.size(), m_file);
+		fflush(m_file);
+	}
+
+	BinaryRecordSink::BinaryRecordSink(const std::string& path) {
+		m_writer.Open(path);
+	}
+
+	void BinaryRecordSink::Consume(const FrameResult& result) {
+		if (!m_writer.IsOpen()) return;
+		m_writer.BeginFrame(result.frame_id, result.timestamp_us, result.width, result.height);
+		for (const auto& detection : result.detections) {
+			m_writer.AddDetection(detection.candidate, detection.score, detection.x1, detection.y1, detection.x2,
+			                      detection.y2);
+		}
+		for (const auto& face : result.faces) {
+			m_writer.AddFace(face.score, face.box.x, face.box.y, face.box.width, face.box.height);
+			for (const auto& candidate : face.classes) m_writer.AddFaceClass(candidate.classname, candidate.score);
+		}
+		for (const auto& pose : result.poses) {
+			m_writer.AddPose();
+			for (size_t k = 0; k < pose.keypoint_scores.size(); ++k) {
+				m_writer.AddKeypoint(pose.keypoint_coordinates[2 * k + 1], pose.keypoint_coordinates[2 * k],
+				                     pose.keypoint_scores[k]);
+			}
+		}
+		for (const auto& candidate : result.classes) m_writer.AddClass(candidate.classname, candidate.score);
+		if (!m_writer.EndFrame()) {
+			std::cout << "Failed to write the record of frame " << result.frame_id << std::endl;
+		}
+	}
+
+	void DrawFrameResult(cv::Mat& frame, const FrameResult& result) {
+		if (!result.detections.empty()) {
+			DetectionEngine::draw_overlay(frame, result.detections, frame.cols, frame.rows);
+		}
+		if (!result.faces.empty()) {
+			CascadeEngine::img_overlay(frame, result.faces);
+		}
+		if (!result.poses.empty()) {
+			// Keypoints are already in frame pixels.
+			HumanPoseEngine::draw_overlay(frame, result.poses, result.keypoint_threshold, frame.cols, frame.rows, frame.cols, frame.rows);
+		}
+		if (!result.classes.empty()) {
+			ClassificationEngine::draw_overlay(frame, result.classes);
+		}
+	}
+
+	VideoWriterSink::VideoWriterSink(const std::string& path, double fps) : m_path(path), m_fps(fps) {}
+
+	void VideoWriterSink::Consume(const FrameResult& result) {
+		if (result.frame.empty()) return;
+		if (!m_writer.isOpened()) {
+			// The frame size is only known once the first frame arrives.
+			m_writer.open(m_path, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), m_fps, result.frame.size());
+			if (!m_writer.isOpened()) {
+				std::cout << "Failed to open video writer for " << m_path << std::endl;
+				return;
+			}
+		}
+		// The frame is shared with the other sinks, so overlays go onto a private copy.
+		result.frame.copyTo(m_canvas);
+		DrawFrameResult(m_canvas, result);
+		m_writer.write(m_canvas);
+	}
+
+	DisplaySink::DisplaySink(const std::string& window_name) : m_window_name(window_name), m_quit(false) {}
+
+	void DisplaySink::Consume(const FrameResult& result) {
+		if (result.frame.empty()) return;
+		result.frame.copyTo(m_canvas);
+		DrawFrameResult(m_canvas, result);
+		cv::imshow(m_window_name, m_canvas);
+		if ((char)cv::waitKey(1) == 27) m_quit.store(true);
+	}
+
+	ResultDispatcher::~ResultDispatcher() {
+		Stop();
+	}
+
+	void ResultDispatcher::Add(std::unique_ptr<ResultSink> sink, bool drop_when_full, size_t queue_depth) {
+		std::unique_ptr<Worker> worker(new Worker);
+		worker->sink = std::move(sink);
+		worker->queue.reset(new BlockingQueue<std::shared_ptr<const FrameResult>>(queue_depth));
+		worker->drop_when_full = drop_when_full;
+		Worker* raw = worker.get();
+		worker->thread = std::thread([raw] {
+			std::shared_ptr<const FrameResult> result;
+			while (raw->queue->Pop(&result)) {
+				raw->sink->Consume(*result);
+				result.reset();
+			}
+		});
+		m_workers.push_back(std::move(worker));
+	}
+
+	void ResultDispatcher::Publish(FrameResult& result, const cv::Mat& frame) {
+		if (m_workers.empty()) return;
+		if (result.frame.empty() && WantsFrame()) frame.copyTo(result.frame);
+		std::shared_ptr<const FrameResult> shared = std::make_shared<FrameResult>(std::move(result));
+		for (const auto& worker : m_workers) {
+			if (worker->drop_when_full) {
+				worker->queue->TryPush(shared);
+			} else {
+				worker->queue->Push(shared);
+			}
+		}
+	}
+
+	bool ResultDispatcher::WantsFrame() const {
+		for (const auto& worker : m_workers) {
+			if (worker->sink->WantsFrame()) return true;
+		}
+		return false;
+	}
+
+	bool ResultDispatcher::QuitRequested() const {
+		for (const auto& worker : m_workers) {
+			if (worker->sink->QuitRequested()) return true;
+		}
+		return false;
+	}
+
+	void ResultDispatcher::Stop() {
+		for (const auto& worker : m_workers) worker->queue->Close();
+		for (const auto& worker : m_workers) {
+			if (worker->thread.joinable()) worker->thread.join();
+		}
+	}
+
+	std::unique_ptr<ResultDispatcher> MakeResultDispatcher(const bool headless, const std::string& window_name,
+	                                                       const std::string& json_path, const std::string& record_path,
+	                                                       const std::string& video_path, const double fps) {
+		std::unique_ptr<ResultDispatcher> dispatcher(new ResultDispatcher);
+		if (!json_path.empty()) {
+			dispatcher->Add(std::unique_ptr<ResultSink>(new JsonLinesSink(json_path)), false, 64);
+		}
+		if (!record_path.empty()) {
+			dispatcher->Add(std::unique_ptr<ResultSink>(new BinaryRecordSink(record_path)), false, 64);
+		}
+		if (!video_path.empty()) {
+			dispatcher->Add(std::unique_ptr<ResultSink>(new VideoWriterSink(video_path, fps)), false);
+		}
+		if (!headless) {
+			dispatcher->Add(std::unique_ptr<ResultSink>(new DisplaySink(window_name)), true, 2);
+		}
+		return dispatcher;
+	}
+}
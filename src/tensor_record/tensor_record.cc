@@ -0,0 +1,263 @@
+//
+// Writer and memory-mapped reader of tensor recordings.
+//
+
+#include "tensor_record.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include "output_reader.h"
+#include "tensorflow/lite/context.h"
+
+namespace edge {
+	namespace {
+		const char kPadding[kTensorRecordAlignment] = {};
+
+		size_t Padding(size_t size) {
+			return (kTensorRecordAlignment - size % kTensorRecordAlignment) % kTensorRecordAlignment;
+		}
+
+		void AddIovec(std::vector<struct iovec>* iov, const void* data, size_t size) {
+			if (size == 0) return;
+			struct iovec entry;
+			entry.iov_base = const_cast<void*>(data);
+			entry.iov_len = size;
+			iov->push_back(entry);
+		}
+
+		bool WriteFully(int fd, struct iovec* iov, int count) {
+			while (count > 0) {
+				const ssize_t written = writev(fd, iov, std::min(count, IOV_MAX));
+				if (written < 0) {
+					if (errno == EINTR) continue;
+					return false;
+				}
+				size_t remaining = static_cast<size_t>(written);
+				while (count > 0 && remaining >= iov->iov_len) {
+					remaining -= iov->iov_len;
+					++iov;
+					--count;
+				}
+				if (count > 0) {
+					iov->iov_base = static_cast<char*>(iov->iov_base) + remaining;
+					iov->iov_len -= remaining;
+				}
+			}
+			return true;
+		}
+	}
+
+	size_t TensorView::NumElements() const {
+		size_t elements = 1;
+		for (uint32_t i = 0; i < header->num_dims; ++i) elements *= static_cast<size_t>(header->dims[i]);
+		return elements;
+	}
+
+	void DequantizeTensorView(const TensorView& tensor, std::vector<float>* out) {
+		size_t element_size;
+		const OutputReadFn read = SelectOutputReader(static_cast<TfLiteType>(tensor.header->type), &element_size);
+		if (read) {
+			out->resize(tensor.header->byte_size / element_size);
+			read(tensor.data, out->size(), tensor.header->scale, tensor.header->zero_point, out->data());
+		} else {
+			std::cerr << "Tensor " << tensor.Name() << " has unsupported type: " << tensor.header->type << std::endl;
+			out->clear();
+		}
+	}
+
+	TensorRecordWriter::~TensorRecordWriter() {
+		Close();
+	}
+
+	bool TensorRecordWriter::Open(const std::string& path, TensorStream stream,
+	                              const std::map<std::string, std::string>& metadata) {
+		Close();
+		m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (m_fd < 0) {
+			std::cout << "Failed to open " << path << " for writing" << std::endl;
+			return false;
+		}
+		std::string text;
+		for (const auto& entry : metadata) text += entry.first + "=" + entry.second + "\n";
+		text.append(Padding(text.size()), '\0');
+
+		TensorFileHeader header;
+		std::memset(&header, 0, sizeof(header));
+		header.magic = kTensorRecordMagic;
+		header.version = kTensorRecordVersion;
+		header.stream = static_cast<uint16_t>(stream);
+		header.metadata_size = static_cast<uint32_t>(text.size());
+		std::vector<struct iovec> iov;
+		AddIovec(&iov, &header, sizeof(header));
+		AddIovec(&iov, text.data(), text.size());
+		if (!WriteFully(m_fd, iov.data(), static_cast<int>(iov.size()))) {
+			std::cout << "Failed to write the header of " << path << std::endl;
+			Close();
+			return false;
+		}
+		m_frame_index = 0;
+		return true;
+	}
+
+	void TensorRecordWriter::Close() {
+		if (m_fd >= 0) close(m_fd);
+		m_fd = -1;
+	}
+
+	void TensorRecordWriter::BeginFrame() {
+		m_num_tensors = 0;
+	}
+
+	void TensorRecordWriter::AddTensor(const std::string& name, int type, const int* dims, int num_dims, float scale,
+	                                   int zero_point, const void* data, size_t byte_size) {
+		if (m_num_tensors == m_tensors.size()) {
+			m_tensors.emplace_back();
+			m_names.emplace_back();
+		}
+		PendingTensor& tensor = m_tensors[m_num_tensors];
+		m_names[m_num_tensors] = name;
+		++m_num_tensors;
+
+		std::memset(&tensor.header, 0, sizeof(tensor.header));
+		tensor.header.type = type;
+		tensor.header.zero_point = zero_point;
+		tensor.header.scale = scale;
+		tensor.header.num_dims = static_cast<uint32_t>(std::min(num_dims, kTensorRecordMaxDims));
+		for (uint32_t i = 0; i < tensor.header.num_dims; ++i) tensor.header.dims[i] = dims[i];
+		tensor.header.name_size = static_cast<uint32_t>(name.size());
+		tensor.header.byte_size = static_cast<uint32_t>(byte_size);
+		tensor.data = data;
+	}
+
+	bool TensorRecordWriter::EndFrame() {
+		if (m_fd < 0) return false;
+		std::vector<struct iovec> iov;
+		iov.reserve(1 + 5 * m_num_tensors);
+		AddIovec(&iov, &m_frame_header, sizeof(m_frame_header));
+		size_t size = sizeof(m_frame_header);
+		for (size_t i = 0; i < m_num_tensors; ++i) {
+			const PendingTensor& tensor = m_tensors[i];
+			AddIovec(&iov, &tensor.header, sizeof(TensorHeader));
+			AddIovec(&iov, m_names[i].data(), m_names[i].size());
+			AddIovec(&iov, kPadding, Padding(tensor.header.name_size));
+			AddIovec(&iov, tensor.data, tensor.header.byte_size);
+			AddIovec(&iov, kPadding, Padding(tensor.header.byte_size));
+			size += sizeof(TensorHeader) + tensor.header.name_size + Padding(tensor.header.name_size) +
+			        tensor.header.byte_size + Padding(tensor.header.byte_size);
+		}
+		m_frame_header.size = static_cast<uint32_t>(size);
+		m_frame_header.num_tensors = static_cast<uint32_t>(m_num_tensors);
+		m_frame_header.frame_index = m_frame_index++;
+		return WriteFully(m_fd, iov.data(), static_cast<int>(iov.size()));
+	}
+
+	TensorRecordReader::~TensorRecordReader() {
+		Close();
+	}
+
+	bool TensorRecordReader::Open(const std::string& path) {
+		Close();
+		const int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			std::cout << "Failed to open " << path << std::endl;
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(TensorFileHeader)) {
+			std::cout << path << " is not a tensor recording" << std::endl;
+			close(fd);
+			return false;
+		}
+		const size_t size = static_cast<size_t>(st.st_size);
+		void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (mapped == MAP_FAILED) {
+			std::cout << "Failed to map " << path << std::endl;
+			return false;
+		}
+		m_data = static_cast<const uint8_t*>(mapped);
+		m_size = size;
+
+		TensorFileHeader header;
+		std::memcpy(&header, m_data, sizeof(header));
+		if (header.magic != kTensorRecordMagic || header.version > kTensorRecordVersion ||
+		    header.metadata_size > m_size - sizeof(header) || header.metadata_size % kTensorRecordAlignment) {
+			std::cout << path << " is not a supported tensor recording" << std::endl;
+			Close();
+			return false;
+		}
+		m_stream = static_cast<TensorStream>(header.stream);
+		const char* metadata = reinterpret_cast<const char*>(m_data + sizeof(header));
+		const char* metadata_end = metadata + header.metadata_size;
+		for (const char* line = metadata; line < metadata_end && *line;) {
+			const char* line_end = std::find(line, metadata_end, '\n');
+			const char* equals = std::find(line, line_end, '=');
+			if (equals != line_end) m_metadata[std::string(line, equals)] = std::string(equals + 1, line_end);
+			line = line_end + 1;
+		}
+		m_first_frame = sizeof(header) + header.metadata_size;
+		m_offset = m_first_frame;
+		return true;
+	}
+
+	void TensorRecordReader::Close() {
+		if (m_data) munmap(const_cast<uint8_t*>(m_data), m_size);
+		m_data = nullptr;
+		m_size = 0;
+		m_first_frame = 0;
+		m_offset = 0;
+		m_metadata.clear();
+		m_truncated = false;
+	}
+
+	std::string TensorRecordReader::GetMetadata(const std::string& key, const std::string& fallback) const {
+		const auto it = m_metadata.find(key);
+		return it == m_metadata.end() ? fallback : it->second;
+	}
+
+	bool TensorRecordReader::Next(uint64_t* frame_index, std::vector<TensorView>* tensors) {
+		tensors->clear();
+		if (m_data == nullptr || m_offset >= m_size) return false;
+		const size_t remaining = m_size - m_offset;
+		const TensorFrameHeader* frame = reinterpret_cast<const TensorFrameHeader*>(m_data + m_offset);
+		if (remaining < sizeof(TensorFrameHeader) || frame->size < sizeof(TensorFrameHeader) ||
+		    frame->size > remaining || frame->size % kTensorRecordAlignment) {
+			m_truncated = true;
+			return false;
+		}
+		const size_t end = m_offset + frame->size;
+		size_t offset = m_offset + sizeof(TensorFrameHeader);
+		for (uint32_t i = 0; i < frame->num_tensors; ++i) {
+			if (end - offset < sizeof(TensorHeader)) {
+				m_truncated = true;
+				return false;
+			}
+			TensorView view;
+			view.header = reinterpret_cast<const TensorHeader*>(m_data + offset);
+			const uint64_t name_size = view.header->name_size + Padding(view.header->name_size);
+			const uint64_t data_size = view.header->byte_size + Padding(view.header->byte_size);
+			if (sizeof(TensorHeader) + name_size + data_size > end - offset ||
+			    view.header->num_dims > kTensorRecordMaxDims) {
+				m_truncated = true;
+				return false;
+			}
+			view.name = reinterpret_cast<const char*>(m_data + offset + sizeof(TensorHeader));
+			view.data = m_data + offset + sizeof(TensorHeader) + name_size;
+			offset += sizeof(TensorHeader) + name_size + data_size;
+			tensors->push_back(view);
+		}
+		*frame_index = frame->frame_index;
+		m_offset = end;
+		return true;
+	}
+}
@@ -3,16 +3,20 @@
 //
 
 #include <algorithm>
-#include <chrono>
 #include <iostream>
 #include <memory>
 #include <ostream>
 #include <string>
 
+#include "camera_metrics.h"
+#include "cascade_engine.h"
 #include "cxxopts.hpp"
 #include "edgetpu.h"
+#include "frame_pool.h"
 #include "img_prep.h"
+#include "metrics_exporter.h"
 #include "opencv2/opencv.hpp"
+#include "result_sink.h"
 #include "ultraface_engine.h"
 
 cxxopts::ParseResult parse_args(int argc, char** argv) {
@@ -31,32 +35,51 @@ cxxopts::ParseResult parse_args(int argc, char** argv) {
       "height", "Camera image height.",
       cxxopts::value<int>()->default_value("480"))(
       "width", "Camera image width.",
-      cxxopts::value<int>()->default_value("640"))("help", "Print Usage");
+      cxxopts::value<int>()->default_value("640"))(
+      "secondary_model_path",
+      "Optional per-face classification model fed with the face crops.",
+      cxxopts::value<std::string>())(
+      "secondary_label_path", "Label file of the secondary model.",
+      cxxopts::value<std::string>())(
+      "secondary_threshold", "Minimum secondary classification confidence.",
+      cxxopts::value<float>()->default_value("0.1"))(
+      "secondary_workers",
+      "Number of CPU workers for the secondary model without EdgeTPU.",
+      cxxopts::value<int>()->default_value("2"))(
+      "max_faces", "Maximum number of faces classified per frame.",
+      cxxopts::value<int>()->default_value("8"))(
+      "headless", "Run without display, e.g. on a server or in a container.",
+      cxxopts::value<bool>()->default_value("false"))(
+      "json_out",
+      "Write per-frame results as JSON lines to this file, - for stdout.",
+      cxxopts::value<std::string>()->default_value(""))(
+      "record_out", "Write per-frame results as binary records to this file.",
+      cxxopts::value<std::string>()->default_value(""))(
+      "video_out", "Write the annotated frames to this video file.",
+      cxxopts::value<std::string>()->default_value(""))(
+      "record_tensors",
+      "Record the raw output tensors of every frame to this file for "
+      "decoder_replay.",
+      cxxopts::value<std::string>())(
+      "resize_mode",
+      "Fit frames to the model input by stretch, letterbox or crop.",
+      cxxopts::value<std::string>()->default_value("stretch"))(
+      "metrics_file", "Rewrite Prometheus metrics to this file every second.",
+      cxxopts::value<std::string>()->default_value(""))(
+      "metrics_port",
+      "Serve Prometheus metrics on this localhost port, 0 to disable.",
+      cxxopts::value<int>()->default_value("0"))("help", "Print Usage");
 
   const auto& args = options.parse(argc, argv);
-  if (args.count("help") || !args.count("model_path")) {
+  if (args.count("help") || !args.count("model_path") ||
+      (args.count("secondary_model_path") &&
+       !args.count("secondary_label_path"))) {
     std::cerr << options.help() << "\n";
     exit(0);
   }
   return args;
 }
 
-std::vector<float> GetInputFromImage(const cv::Mat& input_frame,
-                                     const cv::Size& input_size,
-                                     const double scale = 1 / 128,
-                                     float mean_value = 127.5,
-                                     bool sw_ch = true) {
-  cv::Mat tmp;
-  cv::resize(input_frame, tmp, input_size);
-  if (sw_ch) cv::cvtColor(tmp, tmp, cv::COLOR_BGR2RGB);
-  tmp.convertTo(tmp, CV_32F);
-  tmp -= mean_value;
-  tmp *= scale;
-  cv::Mat flat = tmp.reshape(1, tmp.total() * tmp.channels());
-  std::vector<float> in_vec = tmp.isContinuous() ? flat : flat.clone();
-  return in_vec;
-}
-
 int main(int argc, char** argv) {
   const auto& args = parse_args(argc, argv);
   // Building Interpreter.
@@ -66,6 +89,13 @@ int main(int argc, char** argv) {
   auto image_height = args["height"].as<int>();
   auto image_width = args["width"].as<int>();
   const auto source = args["video_source"].as<int>();
+  edge::ResizeMode resize_mode;
+  if (!edge::ParseResizeMode(args["resize_mode"].as<std::string>(),
+                             &resize_mode)) {
+    std::cout << "Unknown resize mode "
+              << args["resize_mode"].as<std::string>() << std::endl;
+    return 1;
+  }
 
   std::cout << std::endl << "Model Path : " << model_path << std::endl;
   std::cout << "Detection threshold : " << threshold << std::endl;
@@ -79,6 +109,35 @@ int main(int argc, char** argv) {
       edgetpu::EdgeTpuManager::GetSingleton()->OpenDevice();
 
   edge::UltraFaceEngine engine(model_path, edgetpu_context, with_edgetpu);
+  if (args.count("record_tensors") &&
+      !engine.StartTensorRecording(args["record_tensors"].as<std::string>())) {
+    return 1;
+  }
+
+  // The secondary model gets every other Edge TPU, or shares the only one.
+  std::unique_ptr<edge::CascadeEngine> cascade;
+  if (args.count("secondary_model_path")) {
+    std::vector<std::shared_ptr<edgetpu::EdgeTpuContext>> secondary_contexts;
+    if (with_edgetpu) {
+      auto* manager = edgetpu::EdgeTpuManager::GetSingleton();
+      for (const auto& record : manager->EnumerateEdgeTpu()) {
+        if (edgetpu_context &&
+            record == edgetpu_context->GetDeviceEnumRecord()) {
+          continue;
+        }
+        auto context = manager->OpenDevice(record.type, record.path);
+        if (context) secondary_contexts.push_back(context);
+      }
+      if (secondary_contexts.empty() && edgetpu_context) {
+        secondary_contexts.push_back(edgetpu_context);
+      }
+    }
+    cascade.reset(new edge::CascadeEngine(
+        args["secondary_model_path"].as<std::string>(),
+        args["secondary_label_path"].as<std::string>(), secondary_contexts,
+        with_edgetpu, args["secondary_workers"].as<int>(),
+        args["max_faces"].as<int>(), args["secondary_threshold"].as<float>()));
+  }
   const auto& required_input_tensor_shape = engine.GetInputShape();
 
   cv::VideoCapture cam_frame;
@@ -118,34 +177,70 @@ int main(int argc, char** argv) {
   }
   std::vector<std::vector<float>> outputs;
   engine.InitAll(0.35);
-  while (true) {
-    cam_frame >> frame;
-
-    const auto& input =
-        GetInputFromImage(frame, {320, 240}, 1.0 / 128.0, 127.5, true);
-    std::cout << "required_input_tensor_shape[2] "
-              << required_input_tensor_shape[2] << std::endl;
-    std::cout << "required_input_tensor_shape[1] "
-              << required_input_tensor_shape[1] << std::endl;
-    std::cout << "required_input_tensor_shape[3] "
-              << required_input_tensor_shape[3] << std::endl;
-
-    auto start = std::chrono::steady_clock::now();
-    engine.RunInference(input, outputs);
-    auto end = std::chrono::steady_clock::now();
-
-    std::cout << "Inference time : "
-              << std::chrono::duration_cast<std::chrono::milliseconds>(end -
-                                                                       start)
-                     .count()
-              << " ms" << std::endl;
-
-    auto faces_bbox = engine.Decode(outputs, frame.size());
-    for (auto bbox : faces_bbox) {
-      cv::rectangle(frame, bbox.first, {255, 1, 127}, 4);
+  const auto dispatcher = edge::MakeResultDispatcher(
+      args["headless"].as<bool>(), "DETECTIONS",
+      args["json_out"].as<std::string>(), args["record_out"].as<std::string>(),
+      args["video_out"].as<std::string>(), 30.0);
+  edge::FramePool frame_pool(edge::kDefaultFramePoolSize, camera_height,
+                             camera_width, frame.type());
+  edge::SpscQueue<edge::FrameHandle> captured_frames(
+      edge::kDefaultFramePoolSize);
+  edge::FrameGrabber grabber(cam_frame, frame_pool, captured_frames);
+  edge::MetricsRegistry metrics_registry;
+  edge::CameraMetrics metrics(metrics_registry,
+                              with_edgetpu ? "edgetpu" : "cpu");
+  metrics.WatchCapture(grabber, frame_pool, captured_frames);
+  const auto& metrics_file = args["metrics_file"].as<std::string>();
+  const int metrics_port = args["metrics_port"].as<int>();
+  edge::MetricsExporter metrics_exporter(metrics_registry, metrics_file,
+                                         metrics_port);
+  if ((!metrics_file.empty() || metrics_port > 0) &&
+      !metrics_exporter.Start()) {
+    return 1;
+  }
+  grabber.Start();
+  edge::FrameHandle handle;
+  uint64_t skipped_frames;
+  while (edge::PopLatestFrame(captured_frames, frame_pool, grabber, &handle,
+                              &skipped_frames)) {
+    metrics.frames_skipped->Increment(skipped_frames);
+    edge::StageTimer stage_timer;
+    cv::Mat& frame = frame_pool.Frame(handle);
+
+    // Pixels go straight into the input adapter, which normalizes them into the
+    // float tensor in one pass.
+    const auto transform = edge::GetInputFromImage(
+        frame, resize_mode, required_input_tensor_shape[2],
+        required_input_tensor_shape[1], engine.GetInputBuffer());
+    metrics.preprocess_us->Record(stage_timer.Lap());
+
+    engine.RunInference(outputs);
+    metrics.RecordInference(stage_timer.Lap());
+
+    auto faces_bbox = engine.Decode(outputs, frame.size(), transform);
+    edge::FrameResult frame_result;
+    frame_result.frame_id = handle.frame_id;
+    frame_result.timestamp_us = handle.capture_time_us;
+    frame_result.width = camera_width;
+    frame_result.height = camera_height;
+    if (cascade) {
+      frame_result.faces = cascade->Run(frame, faces_bbox);
+    } else {
+      for (const auto& bbox : faces_bbox) {
+        edge::CascadeCandidate face;
+        face.box = bbox.first;
+        face.score = bbox.second;
+        frame_result.faces.push_back(face);
+      }
     }
-    cv::imshow("DETECTIONS", frame);
-    char c = (char)cv::waitKey(1);
-    if (c == 27) break;
+    metrics.postprocess_us->Record(stage_timer.Lap());
+    dispatcher->Publish(frame_result, frame);
+    frame_pool.Release(handle);
+    metrics.publish_us->Record(stage_timer.Lap());
+    metrics.RecordResult(frame_result.timestamp_us);
+    if (dispatcher->QuitRequested()) break;
   }
+  grabber.Stop();
+  dispatcher->Stop();
+  metrics_exporter.Stop();
 }
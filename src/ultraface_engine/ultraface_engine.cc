@@ -26,11 +26,23 @@ namespace edge {
 
 
 void UltraFaceEngine::InitAll(const float det_score, const float nms_iou)
+{
+    decoder_.Init(det_score, nms_iou);
+}
+
+std::vector<std::pair<cv::Rect, float>> UltraFaceEngine::Decode(const std::vector<std::vector<float>> &outputs, const cv::Size &img_size,
+                                                                const AffineTransform &transform)
+{
+    return decoder_.Decode(outputs, img_size, transform);
+}
+
+void UltraFaceDecoder::Init(const float det_score, const float nms_iou)
 {
     iw_  = 320;
     ih_  = 240;
     th_  = det_score;
     nms_th_  = nms_iou;
+    priors.clear();
 
     std::vector<std::vector<float>> featuremap_size;
     std::vector<std::vector<float>> shrinkage_size;
@@ -63,7 +75,8 @@ void UltraFaceEngine::InitAll(const float det_score, const float nms_iou)
     }
 }
 
-std::vector<std::pair<cv::Rect, float>> UltraFaceEngine::Decode(const std::vector<std::vector<float>> &outputs, const cv::Size &img_size)
+std::vector<std::pair<cv::Rect, float>> UltraFaceDecoder::Decode(const std::vector<std::vector<float>> &outputs, const cv::Size &img_size,
+                                                                 const AffineTransform &transform) const
 {
     std::vector<std::pair<cv::Rect, float>> bboxes_scores, result;
     const float *bboxes_ptr = outputs[0].data();
@@ -80,10 +93,10 @@ std::vector<std::pair<cv::Rect, float>> UltraFaceEngine::Decode(const std::vecto
             float w = exp(bboxes_ptr[i * 4 + 2] * kSizeVariance) * priors[i][2];
             float h = exp(bboxes_ptr[i * 4 + 3] * kSizeVariance) * priors[i][3];
 
-            box.x = static_cast<int>( clip(x_center - 0.5*w)*frame_width );
-            box.y = static_cast<int>( clip(y_center - 0.5*h)*frame_height );
-            box.width = static_cast<int>( clip(w)*frame_width );
-            box.height = static_cast<int>( clip(h)*frame_height );
+            box.x = static_cast<int>( clip(transform.X(x_center - 0.5*w))*frame_width );
+            box.y = static_cast<int>( clip(transform.Y(y_center - 0.5*h))*frame_height );
+            box.width = static_cast<int>( clip(w*transform.scale_x)*frame_width );
+            box.height = static_cast<int>( clip(h*transform.scale_y)*frame_height );
 
             bboxes_scores.push_back({box, scores_ptr[i * 2 + 1]});
         }
@@ -92,7 +105,7 @@ std::vector<std::pair<cv::Rect, float>> UltraFaceEngine::Decode(const std::vecto
     return result;
 }
 
-void UltraFaceEngine::NMS(std::vector<std::pair<cv::Rect, float>> &input, std::vector<std::pair<cv::Rect, float>> &output) {
+void UltraFaceDecoder::NMS(std::vector<std::pair<cv::Rect, float>> &input, std::vector<std::pair<cv::Rect, float>> &output) const {
     std::sort(input.begin(), input.end(), [](const std::pair<cv::Rect, float> &a, const std::pair<cv::Rect, float> &b) { return a.second > b.second; });
     int box_num = input.size();
     std::vector<int> merged(box_num, 0);
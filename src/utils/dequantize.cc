@@ -0,0 +1,240 @@
+//
+// Dequantization kernels. The x86 variants are compiled with target attributes so one
+// binary runs everywhere and uses AVX2 where the CPU has it; NEON is a build time choice
+// since every ARM target this project supports has it.
+//
+
+#include "dequantize.h"
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EDGE_DEQUANTIZE_X86 1
+#define EDGE_TARGET(isa) __attribute__((target(isa)))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define EDGE_DEQUANTIZE_NEON 1
+#endif
+
+namespace edge {
+	namespace {
+		typedef void (*Uint8Fn)(const uint8_t*, size_t, int32_t, float, float*);
+		typedef void (*Int8Fn)(const int8_t*, size_t, int32_t, float, float*);
+		typedef void (*Int16Fn)(const int16_t*, size_t, int32_t, float, float*);
+		typedef void (*FloatFn)(const float*, size_t, float, float*);
+
+		struct Kernels {
+			Uint8Fn uint8;
+			Int8Fn int8;
+			Int16Fn int16;
+			FloatFn scale;
+			const char* isa;
+		};
+
+		template <typename T>
+		void DequantizeScalar(const T* src, size_t count, int32_t zero_point, float scale, float* dst) {
+			for (size_t i = 0; i < count; ++i) dst[i] = static_cast<float>(src[i] - zero_point) * scale;
+		}
+
+		void ScaleScalar(const float* src, size_t count, float scale, float* dst) {
+			for (size_t i = 0; i < count; ++i) dst[i] = src[i] * scale;
+		}
+
+		const Kernels kScalar = {&DequantizeScalar<uint8_t>, &DequantizeScalar<int8_t>, &DequantizeScalar<int16_t>,
+		                         &ScaleScalar, "scalar"};
+
+#if defined(EDGE_DEQUANTIZE_X86)
+		// Sign or zero extension of 16 elements into four vectors of int32.
+		EDGE_TARGET("sse4.1") inline void Widen16(const uint8_t* src, __m128i* out) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			out[0] = _mm_cvtepu8_epi32(v);
+			out[1] = _mm_cvtepu8_epi32(_mm_srli_si128(v, 4));
+			out[2] = _mm_cvtepu8_epi32(_mm_srli_si128(v, 8));
+			out[3] = _mm_cvtepu8_epi32(_mm_srli_si128(v, 12));
+		}
+
+		EDGE_TARGET("sse4.1") inline void Widen16(const int8_t* src, __m128i* out) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			out[0] = _mm_cvtepi8_epi32(v);
+			out[1] = _mm_cvtepi8_epi32(_mm_srli_si128(v, 4));
+			out[2] = _mm_cvtepi8_epi32(_mm_srli_si128(v, 8));
+			out[3] = _mm_cvtepi8_epi32(_mm_srli_si128(v, 12));
+		}
+
+		EDGE_TARGET("sse4.1") inline void Widen16(const int16_t* src, __m128i* out) {
+			const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 8));
+			out[0] = _mm_cvtepi16_epi32(lo);
+			out[1] = _mm_cvtepi16_epi32(_mm_srli_si128(lo, 8));
+			out[2] = _mm_cvtepi16_epi32(hi);
+			out[3] = _mm_cvtepi16_epi32(_mm_srli_si128(hi, 8));
+		}
+
+		template <typename T>
+		EDGE_TARGET("sse4.1") void DequantizeSse41(const T* src, size_t count, int32_t zero_point, float scale,
+		                                           float* dst) {
+			const __m128i zero = _mm_set1_epi32(zero_point);
+			const __m128 factor = _mm_set1_ps(scale);
+			size_t i = 0;
+			for (; i + 16 <= count; i += 16) {
+				__m128i q[4];
+				Widen16(src + i, q);
+				for (int k = 0; k < 4; ++k) {
+					const __m128 value = _mm_cvtepi32_ps(_mm_sub_epi32(q[k], zero));
+					_mm_storeu_ps(dst + i + 4 * k, _mm_mul_ps(value, factor));
+				}
+			}
+			DequantizeScalar(src + i, count - i, zero_point, scale, dst + i);
+		}
+
+		EDGE_TARGET("sse4.1") void ScaleSse41(const float* src, size_t count, float scale, float* dst) {
+			const __m128 factor = _mm_set1_ps(scale);
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4) _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), factor));
+			ScaleScalar(src + i, count - i, scale, dst + i);
+		}
+
+		// 32 elements into four vectors of eight int32.
+		EDGE_TARGET("avx2") inline void Widen32(const uint8_t* src, __m256i* out) {
+			for (int k = 0; k < 4; ++k) {
+				out[k] = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + 8 * k)));
+			}
+		}
+
+		EDGE_TARGET("avx2") inline void Widen32(const int8_t* src, __m256i* out) {
+			for (int k = 0; k < 4; ++k) {
+				out[k] = _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + 8 * k)));
+			}
+		}
+
+		EDGE_TARGET("avx2") inline void Widen32(const int16_t* src, __m256i* out) {
+			for (int k = 0; k < 4; ++k) {
+				out[k] = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 8 * k)));
+			}
+		}
+
+		template <typename T>
+		EDGE_TARGET("avx2") void DequantizeAvx2(const T* src, size_t count, int32_t zero_point, float scale,
+		                                        float* dst) {
+			const __m256i zero = _mm256_set1_epi32(zero_point);
+			const __m256 factor = _mm256_set1_ps(scale);
+			size_t i = 0;
+			for (; i + 32 <= count; i += 32) {
+				__m256i q[4];
+				Widen32(src + i, q);
+				for (int k = 0; k < 4; ++k) {
+					const __m256 value = _mm256_cvtepi32_ps(_mm256_sub_epi32(q[k], zero));
+					_mm256_storeu_ps(dst + i + 8 * k, _mm256_mul_ps(value, factor));
+				}
+			}
+			DequantizeScalar(src + i, count - i, zero_point, scale, dst + i);
+		}
+
+		EDGE_TARGET("avx2") void ScaleAvx2(const float* src, size_t count, float scale, float* dst) {
+			const __m256 factor = _mm256_set1_ps(scale);
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8) _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), factor));
+			ScaleScalar(src + i, count - i, scale, dst + i);
+		}
+
+		const Kernels kSse41 = {&DequantizeSse41<uint8_t>, &DequantizeSse41<int8_t>, &DequantizeSse41<int16_t>,
+		                        &ScaleSse41, "sse4.1"};
+		const Kernels kAvx2 = {&DequantizeAvx2<uint8_t>, &DequantizeAvx2<int8_t>, &DequantizeAvx2<int16_t>,
+		                       &ScaleAvx2, "avx2"};
+#elif defined(EDGE_DEQUANTIZE_NEON)
+		// 16 elements into four vectors of int32.
+		inline void Widen16(const uint8_t* src, int32x4_t* out) {
+			const uint8x16_t v = vld1q_u8(src);
+			const uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+			const uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+			out[0] = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(lo)));
+			out[1] = vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(lo)));
+			out[2] = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(hi)));
+			out[3] = vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(hi)));
+		}
+
+		inline void Widen16(const int8_t* src, int32x4_t* out) {
+			const int8x16_t v = vld1q_s8(src);
+			const int16x8_t lo = vmovl_s8(vget_low_s8(v));
+			const int16x8_t hi = vmovl_s8(vget_high_s8(v));
+			out[0] = vmovl_s16(vget_low_s16(lo));
+			out[1] = vmovl_s16(vget_high_s16(lo));
+			out[2] = vmovl_s16(vget_low_s16(hi));
+			out[3] = vmovl_s16(vget_high_s16(hi));
+		}
+
+		inline void Widen16(const int16_t* src, int32x4_t* out) {
+			const int16x8_t lo = vld1q_s16(src);
+			const int16x8_t hi = vld1q_s16(src + 8);
+			out[0] = vmovl_s16(vget_low_s16(lo));
+			out[1] = vmovl_s16(vget_high_s16(lo));
+			out[2] = vmovl_s16(vget_low_s16(hi));
+			out[3] = vmovl_s16(vget_high_s16(hi));
+		}
+
+		template <typename T>
+		void DequantizeNeon(const T* src, size_t count, int32_t zero_point, float scale, float* dst) {
+			const int32x4_t zero = vdupq_n_s32(zero_point);
+			size_t i = 0;
+			for (; i + 16 <= count; i += 16) {
+				int32x4_t q[4];
+				Widen16(src + i, q);
+				for (int k = 0; k < 4; ++k) {
+					vst1q_f32(dst + i + 4 * k, vmulq_n_f32(vcvtq_f32_s32(vsubq_s32(q[k], zero)), scale));
+				}
+			}
+			DequantizeScalar(src + i, count - i, zero_point, scale, dst + i);
+		}
+
+		void ScaleNeon(const float* src, size_t count, float scale, float* dst) {
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4) vst1q_f32(dst + i, vmulq_n_f32(vld1q_f32(src + i), scale));
+			ScaleScalar(src + i, count - i, scale, dst + i);
+		}
+
+		const Kernels kNeon = {&DequantizeNeon<uint8_t>, &DequantizeNeon<int8_t>, &DequantizeNeon<int16_t>,
+		                       &ScaleNeon, "neon"};
+#endif
+
+		const Kernels* Detect() {
+#if defined(EDGE_DEQUANTIZE_X86)
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2")) return &kAvx2;
+			if (__builtin_cpu_supports("sse4.1")) return &kSse41;
+#elif defined(EDGE_DEQUANTIZE_NEON)
+			return &kNeon;
+#endif
+			return &kScalar;
+		}
+
+		std::atomic<const Kernels*>& Active() {
+			static std::atomic<const Kernels*> kernels(Detect());
+			return kernels;
+		}
+	}
+
+	void DequantizeUint8(const uint8_t* src, size_t count, int32_t zero_point, float scale, float* dst) {
+		Active().load(std::memory_order_relaxed)->uint8(src, count, zero_point, scale, dst);
+	}
+
+	void DequantizeInt8(const int8_t* src, size_t count, int32_t zero_point, float scale, float* dst) {
+		Active().load(std::memory_order_relaxed)->int8(src, count, zero_point, scale, dst);
+	}
+
+	void DequantizeInt16(const int16_t* src, size_t count, int32_t zero_point, float scale, float* dst) {
+		Active().load(std::memory_order_relaxed)->int16(src, count, zero_point, scale, dst);
+	}
+
+	void ScaleFloat(const float* src, size_t count, float scale, float* dst) {
+		Active().load(std::memory_order_relaxed)->scale(src, count, scale, dst);
+	}
+
+	const char* DequantizeIsa() {
+		return Active().load(std::memory_order_relaxed)->isa;
+	}
+
+	void SetDequantizeScalar(bool scalar) {
+		Active().store(scalar ? &kScalar : Detect(), std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,30 @@
+//
+// JSON string escaping.
+//
+
+#include "json_utils.h"
+
+#include <cstdio>
+
+namespace edge {
+	void AppendJsonString(std::string* out, const std::string& text) {
+		out->push_back('"');
+		for (char c : text) {
+			switch (c) {
+				case '"': out->append("\\\""); break;
+				case '\\': out->append("\\\\"); break;
+				case '\n': out->append("\\n"); break;
+				case '\t': out->append("\\t"); break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20) {
+						char buffer[8];
+						snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+						out->append(buffer);
+					} else {
+						out->push_back(c);
+					}
+			}
+		}
+		out->push_back('"');
+	}
+}
@@ -1,31 +1,143 @@
 #include "label_utils.h"
 
-#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <fstream>
+#include <iostream>
+#include <iterator>
 #include <map>
-#include <regex>
+#include <stdexcept>
 #include <string>
 
-using std::getline;
-using std::ifstream;
-using std::istringstream;
 using std::map;
-using std::regex;
-using std::regex_replace;
 using std::string;
 
 namespace edge {
 
+namespace {
+
+inline bool IsBlank(char c) { return c == ' ' || c == '\t'; }
+inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Label ids index a dense table, so a stray huge id would allocate for every id below
+// it. Real label maps stay far below this.
+constexpr int kMaxLabelId = 65535;
+
+}  // namespace
+
+constexpr uint32_t LabelTable::kMissing;
+
+bool LabelTable::Load(const string& label_path) {
+  m_text.clear();
+  m_offsets.clear();
+  m_lengths.clear();
+  m_count = 0;
+
+  const int fd = open(label_path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  const size_t length = static_cast<size_t>(st.st_size);
+  if (length == 0) {
+    close(fd);
+    return true;
+  }
+  void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    // Not mappable (e.g. a pipe), fall back to reading it.
+    std::ifstream label_file(label_path, std::ios::binary);
+    if (!label_file.good()) return false;
+    const string contents((std::istreambuf_iterator<char>(label_file)),
+                          std::istreambuf_iterator<char>());
+    Parse(contents.data(), contents.data() + contents.size());
+    return true;
+  }
+  madvise(mapped, length, MADV_SEQUENTIAL);
+  const char* begin = static_cast<const char*>(mapped);
+  Parse(begin, begin + length);
+  munmap(mapped, length);
+  return true;
+}
+
+void LabelTable::Parse(const char* begin, const char* end) {
+  m_text.reserve(end - begin);
+  int line_number = 0;
+  for (const char* line = begin; line < end; ++line_number) {
+    const char* line_end = line;
+    while (line_end < end && *line_end != '\n') ++line_end;
+    const char* next_line = line_end + 1;
+    // Tolerate CRLF files.
+    if (line_end > line && line_end[-1] == '\r') --line_end;
+
+    const char* p = line;
+    while (p < line_end && IsBlank(*p)) ++p;
+    int id = line_number;
+    if (p < line_end && IsDigit(*p)) {
+      id = 0;
+      while (p < line_end && IsDigit(*p) && id <= kMaxLabelId) {
+        id = id * 10 + (*p++ - '0');
+      }
+      if (id > kMaxLabelId) {
+        std::cout << "Skipping label line " << line_number + 1
+                  << ": id exceeds " << kMaxLabelId << std::endl;
+        line = next_line;
+        continue;
+      }
+      while (p < line_end && IsBlank(*p)) ++p;
+    } else if (p == line_end) {
+      line = next_line;
+      continue;
+    } else if (id > kMaxLabelId) {
+      std::cout << "Skipping labels from line " << line_number + 1
+                << ": more than " << kMaxLabelId + 1 << " lines" << std::endl;
+      return;
+    }
+
+    if (static_cast<size_t>(id) >= m_offsets.size()) {
+      m_offsets.resize(id + 1, kMissing);
+      m_lengths.resize(id + 1, 0);
+    }
+    if (m_offsets[id] == kMissing) m_count++;
+    m_offsets[id] = static_cast<uint32_t>(m_text.size());
+    m_lengths[id] = static_cast<uint32_t>(line_end - p);
+    m_text.append(p, line_end);
+    line = next_line;
+  }
+}
+
+bool LabelTable::contains(int id) const {
+  return id >= 0 && static_cast<size_t>(id) < m_offsets.size() &&
+         m_offsets[id] != kMissing;
+}
+
+LabelView LabelTable::Get(int id) const {
+  if (!contains(id)) return LabelView{"", 0};
+  return LabelView{m_text.data() + m_offsets[id], m_lengths[id]};
+}
+
+LabelView LabelTable::at(int id) const {
+  if (!contains(id)) throw std::out_of_range("label id out of range");
+  return LabelView{m_text.data() + m_offsets[id], m_lengths[id]};
+}
+
+LabelTable ParseLabelTable(const string& label_path) {
+  LabelTable ret;
+  ret.Load(label_path);
+  return ret;
+}
+
 map<int, std::string> ParseLabel(const string& label_path) {
   map<int, string> ret;
-  std::ifstream label_file(label_path);
-  if (!label_file.good()) return ret;
-  for (std::string line; std::getline(label_file, line);) {
-    std::istringstream ss(line);
-    int id;
-    ss >> id;
-    line = std::regex_replace(line, std::regex("^ +[0-9]+ +"), "");
-    ret.emplace(id,line);
+  const LabelTable table = ParseLabelTable(label_path);
+  for (size_t id = 0; id < table.capacity(); ++id) {
+    if (table.contains(id)) ret.emplace(id, table.Get(id).str());
   }
   return ret;
 }
@@ -0,0 +1,70 @@
+//
+// Bucketing of LatencyHistogram: values below kSubBuckets map to themselves, above that
+// the top kSubBucketBits + 1 bits select the bucket and the lower bits are dropped.
+//
+
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace edge {
+	namespace {
+		int HighestBit(uint64_t value) {
+			int bit = 0;
+			while (value >>= 1) ++bit;
+			return bit;
+		}
+	}
+
+	int LatencyHistogram::BucketIndex(uint64_t value) {
+		if (value < kSubBuckets) return static_cast<int>(value);
+		const int shift = HighestBit(value) - kSubBucketBits;
+		return ((shift + 1) << kSubBucketBits) + static_cast<int>((value >> shift) - kSubBuckets);
+	}
+
+	uint64_t LatencyHistogram::BucketLowerBound(int index) {
+		if (index < kSubBuckets) return static_cast<uint64_t>(index);
+		const int shift = (index >> kSubBucketBits) - 1;
+		return static_cast<uint64_t>(kSubBuckets + (index & (kSubBuckets - 1))) << shift;
+	}
+
+	uint64_t LatencyHistogram::BucketUpperBound(int index) {
+		if (index < kSubBuckets) return static_cast<uint64_t>(index);
+		const int shift = (index >> kSubBucketBits) - 1;
+		return BucketLowerBound(index) + ((uint64_t{1} << shift) - 1);
+	}
+
+	void LatencyHistogram::Record(uint64_t value) {
+		++m_buckets[BucketIndex(value)];
+		++m_count;
+		m_sum += value;
+		m_min = std::min(m_min, value);
+		m_max = std::max(m_max, value);
+	}
+
+	void LatencyHistogram::Merge(const LatencyHistogram& other) {
+		for (int i = 0; i < kNumBuckets; ++i) m_buckets[i] += other.m_buckets[i];
+		m_count += other.m_count;
+		m_sum += other.m_sum;
+		m_min = std::min(m_min, other.m_min);
+		m_max = std::max(m_max, other.m_max);
+	}
+
+	void LatencyHistogram::Reset() {
+		*this = LatencyHistogram();
+	}
+
+	uint64_t LatencyHistogram::Percentile(double p) const {
+		if (m_count == 0) return 0;
+		// The rank of the percentile value, 1-based, as nearest-rank percentiles define it.
+		const double clamped = std::min(100.0, std::max(0.0, p));
+		const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped / 100.0 * m_count)));
+		uint64_t seen = 0;
+		for (int i = 0; i < kNumBuckets; ++i) {
+			seen += m_buckets[i];
+			if (seen >= rank) return std::min(BucketUpperBound(i), m_max);
+		}
+		return m_max;
+	}
+}
@@ -0,0 +1,62 @@
+//
+// Persistent worker threads handing out task indices through an atomic counter.
+//
+
+#include "worker_pool.h"
+
+namespace edge {
+	WorkerPool::WorkerPool(int num_threads)
+					: m_fn(nullptr), m_num_tasks(0), m_next_task(0), m_active_workers(0),
+					  m_generation(0), m_stop(false) {
+		if (num_threads < 1) num_threads = 1;
+		for (int i = 0; i < num_threads; ++i) {
+			m_threads.emplace_back(&WorkerPool::WorkerLoop, this, i);
+		}
+	}
+
+	WorkerPool::~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_work_cv.notify_all();
+		for (auto& thread : m_threads) thread.join();
+	}
+
+	void WorkerPool::ParallelFor(int num_tasks, const std::function<void(int, int)>& fn) {
+		if (num_tasks <= 0) return;
+		std::lock_guard<std::mutex> call_lock(m_call_mutex);
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_fn = &fn;
+		m_num_tasks = num_tasks;
+		m_next_task.store(0, std::memory_order_relaxed);
+		m_active_workers = NumThreads();
+		m_generation++;
+		m_work_cv.notify_all();
+		m_done_cv.wait(lock, [this] { return m_active_workers == 0; });
+		m_fn = nullptr;
+	}
+
+	void WorkerPool::WorkerLoop(int worker) {
+		unsigned seen_generation = 0;
+		while (true) {
+			const std::function<void(int, int)>* fn;
+			int num_tasks;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_work_cv.wait(lock, [&] { return m_stop || m_generation != seen_generation; });
+				if (m_stop) return;
+				seen_generation = m_generation;
+				fn = m_fn;
+				num_tasks = m_num_tasks;
+			}
+			for (int task = m_next_task.fetch_add(1); task < num_tasks; task = m_next_task.fetch_add(1)) {
+				(*fn)(task, worker);
+			}
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (--m_active_workers == 0) m_done_cv.notify_one();
+			}
+		}
+	}
+}
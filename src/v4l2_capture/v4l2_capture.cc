@@ -0,0 +1,320 @@
+//
+// V4L2 streaming capture with mmap'ed buffers and the file-backed stand-in.
+//
+
+#include "v4l2_capture.h"
+
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace edge {
+	namespace {
+		constexpr int kDequeueTimeoutMs = 2000;
+
+		int Ioctl(int fd, unsigned long request, void* arg) {
+			int ret;
+			do {
+				ret = ioctl(fd, request, arg);
+			} while (ret < 0 && errno == EINTR);
+			return ret;
+		}
+
+		uint32_t FourCC(PixelFormat format) {
+			switch (format) {
+				case PixelFormat::kYUYV:
+					return V4L2_PIX_FMT_YUYV;
+				case PixelFormat::kNV12:
+					return V4L2_PIX_FMT_NV12;
+				case PixelFormat::kNV21:
+					return V4L2_PIX_FMT_NV21;
+				case PixelFormat::kI420:
+					return V4L2_PIX_FMT_YUV420;
+			}
+			return 0;
+		}
+
+		int64_t NowMicros() {
+			return std::chrono::duration_cast<std::chrono::microseconds>(
+							std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+	}
+
+	bool ParsePixelFormat(const std::string& name, PixelFormat* format) {
+		if (name == "yuyv") {
+			*format = PixelFormat::kYUYV;
+		} else if (name == "nv12") {
+			*format = PixelFormat::kNV12;
+		} else if (name == "nv21") {
+			*format = PixelFormat::kNV21;
+		} else if (name == "i420") {
+			*format = PixelFormat::kI420;
+		} else {
+			return false;
+		}
+		return true;
+	}
+
+	V4l2Capture::V4l2Capture(const std::string& device, int width, int height, PixelFormat format, int num_buffers,
+	                         bool export_dmabuf)
+					: m_device(device), m_width(width), m_height(height), m_format(format), m_num_buffers(num_buffers),
+					  m_export_dmabuf(export_dmabuf), m_fd(-1), m_bytes_per_line(0), m_streaming(false) {}
+
+	V4l2Capture::~V4l2Capture() {
+		Stop();
+	}
+
+	bool V4l2Capture::Configure() {
+		struct v4l2_capability capability;
+		std::memset(&capability, 0, sizeof(capability));
+		if (Ioctl(m_fd, VIDIOC_QUERYCAP, &capability) < 0) {
+			std::cout << m_device << " is not a V4L2 device" << std::endl;
+			return false;
+		}
+		const uint32_t caps = capability.capabilities & V4L2_CAP_DEVICE_CAPS ? capability.device_caps
+		                                                                     : capability.capabilities;
+		if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING)) {
+			std::cout << m_device << " does not support single-planar streaming capture" << std::endl;
+			return false;
+		}
+
+		struct v4l2_format format;
+		std::memset(&format, 0, sizeof(format));
+		format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		format.fmt.pix.width = m_width;
+		format.fmt.pix.height = m_height;
+		format.fmt.pix.pixelformat = FourCC(m_format);
+		format.fmt.pix.field = V4L2_FIELD_NONE;
+		if (Ioctl(m_fd, VIDIOC_S_FMT, &format) < 0) {
+			std::cout << "Failed to set the capture format of " << m_device << std::endl;
+			return false;
+		}
+		if (format.fmt.pix.pixelformat != FourCC(m_format)) {
+			std::cout << m_device << " does not deliver the requested pixel format" << std::endl;
+			return false;
+		}
+		m_width = format.fmt.pix.width;
+		m_height = format.fmt.pix.height;
+		m_bytes_per_line = format.fmt.pix.bytesperline;
+		if (m_bytes_per_line == 0) m_bytes_per_line = m_format == PixelFormat::kYUYV ? 2 * m_width : m_width;
+		return true;
+	}
+
+	bool V4l2Capture::MapBuffers() {
+		struct v4l2_requestbuffers request;
+		std::memset(&request, 0, sizeof(request));
+		request.count = m_num_buffers;
+		request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		request.memory = V4L2_MEMORY_MMAP;
+		if (Ioctl(m_fd, VIDIOC_REQBUFS, &request) < 0 || request.count == 0) {
+			std::cout << "Failed to allocate capture buffers on " << m_device << std::endl;
+			return false;
+		}
+		for (uint32_t i = 0; i < request.count; ++i) {
+			struct v4l2_buffer buffer;
+			std::memset(&buffer, 0, sizeof(buffer));
+			buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			buffer.memory = V4L2_MEMORY_MMAP;
+			buffer.index = i;
+			if (Ioctl(m_fd, VIDIOC_QUERYBUF, &buffer) < 0) {
+				std::cout << "Failed to query capture buffer " << i << std::endl;
+				return false;
+			}
+			MappedBuffer mapped;
+			mapped.length = buffer.length;
+			mapped.data = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, buffer.m.offset);
+			mapped.dmabuf_fd = -1;
+			if (mapped.data == MAP_FAILED) {
+				std::cout << "Failed to map capture buffer " << i << std::endl;
+				return false;
+			}
+			if (m_export_dmabuf) {
+				struct v4l2_exportbuffer exported;
+				std::memset(&exported, 0, sizeof(exported));
+				exported.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+				exported.index = i;
+				exported.flags = O_RDONLY | O_CLOEXEC;
+				if (Ioctl(m_fd, VIDIOC_EXPBUF, &exported) == 0) {
+					mapped.dmabuf_fd = exported.fd;
+				} else {
+					std::cout << m_device << " can not export DMABUF, continuing with mmap only" << std::endl;
+					m_export_dmabuf = false;
+				}
+			}
+			m_buffers.push_back(mapped);
+			if (Ioctl(m_fd, VIDIOC_QBUF, &buffer) < 0) {
+				std::cout << "Failed to queue capture buffer " << i << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool V4l2Capture::Start() {
+		m_fd = open(m_device.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		if (m_fd < 0) {
+			std::cout << "Failed to open " << m_device << ": " << std::strerror(errno) << std::endl;
+			return false;
+		}
+		if (!Configure() || !MapBuffers()) {
+			Stop();
+			return false;
+		}
+		int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if (Ioctl(m_fd, VIDIOC_STREAMON, &type) < 0) {
+			std::cout << "Failed to start streaming on " << m_device << std::endl;
+			Stop();
+			return false;
+		}
+		m_streaming = true;
+		return true;
+	}
+
+	void V4l2Capture::Stop() {
+		if (m_fd < 0) return;
+		if (m_streaming) {
+			int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			Ioctl(m_fd, VIDIOC_STREAMOFF, &type);
+			m_streaming = false;
+		}
+		for (const auto& mapped : m_buffers) {
+			if (mapped.dmabuf_fd >= 0) close(mapped.dmabuf_fd);
+			munmap(mapped.data, mapped.length);
+		}
+		m_buffers.clear();
+		struct v4l2_requestbuffers request;
+		std::memset(&request, 0, sizeof(request));
+		request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		request.memory = V4L2_MEMORY_MMAP;
+		Ioctl(m_fd, VIDIOC_REQBUFS, &request);
+		close(m_fd);
+		m_fd = -1;
+	}
+
+	bool V4l2Capture::Dequeue(CapturedBuffer* buffer) {
+		if (!m_streaming) return false;
+		struct pollfd descriptor;
+		descriptor.fd = m_fd;
+		descriptor.events = POLLIN;
+		descriptor.revents = 0;
+		int ready;
+		do {
+			ready = poll(&descriptor, 1, kDequeueTimeoutMs);
+		} while (ready < 0 && errno == EINTR);
+		if (ready <= 0) {
+			std::cout << "Timed out waiting for a frame from " << m_device << std::endl;
+			return false;
+		}
+
+		struct v4l2_buffer dequeued;
+		std::memset(&dequeued, 0, sizeof(dequeued));
+		dequeued.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		dequeued.memory = V4L2_MEMORY_MMAP;
+		if (Ioctl(m_fd, VIDIOC_DQBUF, &dequeued) < 0) {
+			std::cout << "Failed to dequeue a frame from " << m_device << std::endl;
+			return false;
+		}
+		const MappedBuffer& mapped = m_buffers[dequeued.index];
+		const uint8_t* data = static_cast<const uint8_t*>(mapped.data);
+		buffer->index = dequeued.index;
+		buffer->image = MakeYuvImage(m_format, m_width, m_height, data);
+		buffer->image.strides[0] = m_bytes_per_line;
+		if (m_format == PixelFormat::kNV12 || m_format == PixelFormat::kNV21) {
+			buffer->image.planes[1] = data + static_cast<size_t>(m_bytes_per_line) * m_height;
+			buffer->image.strides[1] = m_bytes_per_line;
+		} else if (m_format == PixelFormat::kI420) {
+			// Single-planar YUV420 keeps the chroma planes at half the luma pitch.
+			buffer->image.planes[1] = data + static_cast<size_t>(m_bytes_per_line) * m_height;
+			buffer->image.strides[1] = m_bytes_per_line / 2;
+			buffer->image.planes[2] = buffer->image.planes[1] + static_cast<size_t>(m_bytes_per_line / 2) * ((m_height + 1) / 2);
+			buffer->image.strides[2] = m_bytes_per_line / 2;
+		}
+		buffer->dmabuf_fd = mapped.dmabuf_fd;
+		buffer->sequence = dequeued.sequence;
+		buffer->timestamp_us = static_cast<int64_t>(dequeued.timestamp.tv_sec) * 1000000 + dequeued.timestamp.tv_usec;
+		return true;
+	}
+
+	void V4l2Capture::Requeue(const CapturedBuffer& buffer) {
+		if (!m_streaming || buffer.index < 0) return;
+		struct v4l2_buffer queued;
+		std::memset(&queued, 0, sizeof(queued));
+		queued.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		queued.memory = V4L2_MEMORY_MMAP;
+		queued.index = buffer.index;
+		if (Ioctl(m_fd, VIDIOC_QBUF, &queued) < 0) {
+			std::cout << "Failed to requeue capture buffer " << buffer.index << std::endl;
+		}
+	}
+
+	FileCaptureSource::FileCaptureSource(const std::string& path, int width, int height, PixelFormat format,
+	                                     double fps, bool loop)
+					: m_path(path), m_width(width), m_height(height), m_format(format), m_fps(fps), m_loop(loop),
+					  m_data(nullptr), m_size(0), m_frame_size(YuvFrameSize(format, width, height)), m_num_frames(0),
+					  m_sequence(0), m_start_us(0) {}
+
+	FileCaptureSource::~FileCaptureSource() {
+		Stop();
+	}
+
+	bool FileCaptureSource::Start() {
+		const int fd = open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			std::cout << "Failed to open " << m_path << std::endl;
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < m_frame_size || m_frame_size == 0) {
+			std::cout << m_path << " does not hold a single " << m_width << "x" << m_height << " frame" << std::endl;
+			close(fd);
+			return false;
+		}
+		m_size = static_cast<size_t>(st.st_size);
+		void* mapped = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (mapped == MAP_FAILED) {
+			std::cout << "Failed to map " << m_path << std::endl;
+			return false;
+		}
+		madvise(mapped, m_size, MADV_SEQUENTIAL);
+		m_data = static_cast<const uint8_t*>(mapped);
+		m_num_frames = m_size / m_frame_size;
+		m_sequence = 0;
+		m_start_us = NowMicros();
+		return true;
+	}
+
+	void FileCaptureSource::Stop() {
+		if (m_data) munmap(const_cast<uint8_t*>(m_data), m_size);
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+	bool FileCaptureSource::Dequeue(CapturedBuffer* buffer) {
+		if (m_data == nullptr) return false;
+		if (m_sequence >= m_num_frames && !m_loop) return false;
+		if (m_fps > 0) {
+			// Pace delivery like a camera running at m_fps.
+			const int64_t due_us = m_start_us + static_cast<int64_t>(m_sequence * 1e6 / m_fps);
+			const int64_t wait_us = due_us - NowMicros();
+			if (wait_us > 0) std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+		}
+		const size_t frame = m_sequence % m_num_frames;
+		buffer->index = static_cast<int>(frame);
+		buffer->image = MakeYuvImage(m_format, m_width, m_height, m_data + frame * m_frame_size);
+		buffer->dmabuf_fd = -1;
+		buffer->sequence = m_sequence++;
+		buffer->timestamp_us = NowMicros();
+		return true;
+	}
+}